@@ -15,7 +15,8 @@ ChParallelDataManager::ChParallelDataManager()
       num_constraints(0),
       num_shafts(0),
       num_dof(0),
-      nnz_bilaterals(0) {
+      nnz_bilaterals(0),
+      contact_matrix_free(false) {
 }
 
 ChParallelDataManager::~ChParallelDataManager() {
@@ -88,7 +89,16 @@ int ChParallelDataManager::ExportCurrentSystem(std::string output_dir) {
   filename = output_dir + "dump_fric.dat";
   OutputBlazeVector(fric, filename);
 
-  // output D_T
+  // output M_inv
+  filename = output_dir + "dump_Minv.dat";
+  OutputBlazeMatrix(host_data.M_inv, filename);
+
+  // output D_T, the contact rows are not assembled in matrix-free mode
+  if (contact_matrix_free) {
+    LOG(WARNING) << "ExportCurrentSystem: the contact Jacobian is not assembled with use_matrix_free, "
+                 << "dump_D.dat is not written";
+    return 0;
+  }
 
   int nnz_normal = 6 * 2 * num_rigid_contacts;
   int nnz_tangential = 6 * 4 * num_rigid_contacts;
@@ -142,9 +152,5 @@ int ChParallelDataManager::ExportCurrentSystem(std::string output_dir) {
   filename = output_dir + "dump_D.dat";
   OutputBlazeMatrix(D_T, filename);
 
-  // output M_inv
-  filename = output_dir + "dump_Minv.dat";
-  OutputBlazeMatrix(host_data.M_inv, filename);
-
   return 0;
 }
@@ -68,13 +68,34 @@ struct host_container {
   host_vector<real3> ObB_rigid;       // Size of shape (dims or convex data)
   host_vector<real3> ObC_rigid;       // Rounded size
   host_vector<real4> ObR_rigid;       // Shape rotation
+  host_vector<real3> ObA_global;      // Position of shape in the global frame (AABB pass)
+  host_vector<real3> ObB_global;      // Size of shape, triangle vertices in the global frame
+  host_vector<real3> ObC_global;      // Rounded size, triangle vertices in the global frame
+  host_vector<real4> ObR_global;      // Shape rotation in the global frame
   host_vector<short2> fam_rigid;      // Family information
   host_vector<int> typ_rigid;         // Shape type
   host_vector<real> margin_rigid;     // Inner collision margins
   host_vector<uint> id_rigid;         // Body identifier for each shape
+  host_vector<bool> static_rigid;     // True if the shape belongs to a fixed body (static BVH)
   host_vector<real3> aabb_min_rigid;  // List of bounding boxes minimum point
   host_vector<real3> aabb_max_rigid;  // List of bounding boxes maximum point
   host_vector<real3> convex_data;     // list of convex points
+  host_vector<int2> convex_adjacency;  // start and number of hull neighbors of every convex point
+  host_vector<int> convex_neighbors;   // hull neighbors, indexed within their convex shape
+
+  // Triangle meshes (TRIANGLEMESH_BVH shapes), ObB holds the number of
+  // triangles and the root node of the mesh. Vertices and node bounds are
+  // expressed in the body frame, triangles are ordered by leaf.
+  host_vector<real3> mesh_vertices;    // Mesh vertices
+  host_vector<int3> mesh_triangles;    // Vertex indices of every triangle
+  host_vector<real3> mesh_node_min;    // BVH node bounds minimum point
+  host_vector<real3> mesh_node_max;    // BVH node bounds maximum point
+  host_vector<uint> mesh_node_start;   // First triangle (leaf) or first child
+  host_vector<uint> mesh_node_count;   // Number of triangles, zero for interior nodes
+
+  // Heights of the HEIGHTFIELD shapes, ObB holds the grid size and the offset
+  // of the first height, ObC the grid spacing and the half range of heights
+  host_vector<real> heightfield_data;
 
   // Contact data
   host_vector<real3> norm_rigid_rigid;
@@ -123,6 +144,7 @@ struct host_container {
   host_vector<real4> rot_rigid;
   host_vector<bool> active_rigid;
   host_vector<bool> collide_rigid;
+  host_vector<bool> fixed_rigid;
   host_vector<real> mass_rigid;
 
   host_vector<real3> pos_fluid;
@@ -176,12 +198,30 @@ struct host_container {
   // entire operation happens inline without a temp variable.
   CompressedMatrix<real> M_invD_n, M_invD_t, M_invD_s, M_invD_b;
 
+  // Jacobian blocks of the contacts used by the matrix-free Schur product (see
+  // Contact_D_Product). The normal and sliding rows of a contact share the
+  // linear part given by its frame (U, V, W), the angular parts of the two
+  // bodies and the spinning rows are stored three per contact.
+  host_vector<real3> jac_frame, jac_angA, jac_angB, jac_rollA, jac_rollB;
+  // The contacts of every body sorted by body, an entry is (contact << 1 | side)
+  // where side is one for the second body of the contact
+  host_vector<uint> body_contact_start, body_contact_list;
+  // Inverse mass and inverse inertia of every rigid body, zero if inactive
+  host_vector<real> inv_mass_rigid;
+  host_vector<M33> inv_inertia_rigid;
+
   DynamicVector<real> R_full;  // The right hand side of the system
   DynamicVector<real> R;       // The rhs of the system, changes during solve
   DynamicVector<real> b;       // Correction terms
   DynamicVector<real> s;
   DynamicVector<real> M_invk;  // result of M_inv multiplied by vector of forces
   DynamicVector<real> gamma;   // THe unknowns we are solving for
+  // Contacts of the previous step sorted by shape pair, their contact point
+  // and their impulses (normal, two sliding, three spinning) used to warm
+  // start the DVI solver
+  host_vector<long long> warm_pair;
+  host_vector<real3> warm_point;
+  host_vector<real> warm_gamma;
   DynamicVector<real> v;       // This vector holds the velocities for all objects
   DynamicVector<real> hf;      // This vector holds h*forces, h is time step
   DynamicVector<real> rhs_bilateral;
@@ -228,6 +268,9 @@ class CH_PARALLEL_API ChParallelDataManager {
 
   // Flag indicating whether or not the contact forces are current (DVI only).
   bool Fc_current;
+  // Flag indicating that the contact Jacobian was not assembled for this step
+  // and the contact products use the per contact Jacobian blocks (DVI only).
+  bool contact_matrix_free;
   // This object hold all of the timers for the system
   ChTimerParallel system_timer;
   // Structure that contains all settings for the system, collision detection
@@ -240,7 +283,8 @@ class CH_PARALLEL_API ChParallelDataManager {
   // Output a sparse blaze matrix to a file
   int OutputBlazeMatrix(CompressedMatrix<real> src, std::string filename);
   // Convenience function that outputs all of the data associated for a system
-  // This is useful when debugging
+  // This is useful when debugging. The Jacobian (dump_D.dat) is not written
+  // when the contact products are matrix-free (contact_matrix_free)
   int ExportCurrentSystem(std::string output_dir);
 };
 }
@@ -32,11 +32,34 @@ struct collision_measures {
     max_bounding_point = 0;
     global_origin = 0;
     bin_size_vec = 0;
+    bins_per_axis = I3(0, 0, 0);
+    bin_scale = 1;
+    num_bins_active = 0;
+    number_of_bin_intersections = 0;
+    max_bin_occupancy = 0;
+    num_single_bins = 0;
+    for (int i = 0; i < num_occupancy_buckets; i++) {
+      occupancy_histogram[i] = 0;
+    }
   }
   real3 min_bounding_point;  // The minimal global bounding point
   real3 max_bounding_point;  // The maximum global bounding point
   real3 global_origin;       // The global zero point
   real3 bin_size_vec;        // Vector holding bin sizes for each dimension
+  int3 bins_per_axis;        // The number of bins used by the grid broadphase
+  // Factor applied to the number of bins per axis by the bin tuner
+  // (perform_bin_tuning), the collision settings are never changed by it
+  real bin_scale;
+
+  // Occupancy of the broadphase bins, used to tune the number of bins
+  uint num_bins_active;              // The number of bins that contain at least one shape
+  uint number_of_bin_intersections;  // The number of (shape, bin) entries
+  uint max_bin_occupancy;            // The largest number of shapes in a bin
+  uint num_single_bins;              // The number of bins that contain a single shape
+  // Entry i holds the number of (shape, bin) entries in bins with 2^i to
+  // 2^(i+1)-1 shapes, the last entry holds all larger bins
+  static const int num_occupancy_buckets = 16;
+  uint occupancy_histogram[num_occupancy_buckets];
 };
 // solver_measures, like the name implies is the structure that contains all
 // measures associated with the parallel solver.
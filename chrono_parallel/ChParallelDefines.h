@@ -134,6 +134,13 @@ enum SOLVERMODE { NORMAL, SLIDING, SPINNING, BILATERAL };
 
 enum COLLISIONSYSTEMTYPE { COLLSYS_PARALLEL, COLLSYS_BULLET_PARALLEL };
 
+// Broadphase algorithm used by the parallel collision system.
+// BROADPHASE_GRID uses a single uniform grid, BROADPHASE_HIERARCHICAL places each
+// shape in the level of a multi-level grid whose cell size matches its AABB.
+// BROADPHASE_SAP sorts the AABBs along the axis with the largest variance and
+// sweeps the sorted list (sweep and prune).
+enum BROADPHASETYPE { BROADPHASE_GRID, BROADPHASE_HIERARCHICAL, BROADPHASE_SAP };
+
 enum NARROWPHASETYPE {
   NARROWPHASE_MPR,
   NARROWPHASE_GJK,
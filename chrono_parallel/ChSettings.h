@@ -45,8 +45,19 @@ struct collision_settings {
     // many cores you are using.
     bins_per_axis = I3(20, 20, 20);
     narrowphase_algorithm = NARROWPHASE_HYBRID_MPR;
+    broadphase_type = BROADPHASE_GRID;
+    max_grid_levels = 8;
     grid_density = 5;
     fixed_bins = true;
+    use_incremental_broadphase = false;
+    collision_skin = 0;
+    use_static_bvh = false;
+    use_radix_sort = false;
+    use_morton_bins = false;
+    use_thread_buffers = false;
+    use_axis_cache = false;
+    use_contact_reduction = false;
+    contact_reduction_angle = 0.2;
   }
 
   real3 min_bounding_point, max_bounding_point;
@@ -72,9 +83,62 @@ struct collision_settings {
   // detection code. The narrowphase_algorithm parameter can be used to change
   // the type of narrowphase used at runtime.
   NARROWPHASETYPE narrowphase_algorithm;
+  // The broadphase algorithm. The hierarchical grid should be used when the
+  // sizes of the shapes differ greatly (e.g. large container walls with small
+  // particles). Its finest level uses bins_per_axis and every coarser level
+  // doubles the bin size, up to max_grid_levels levels. Sweep and prune does
+  // not depend on the number of bins and works well for elongated domains.
+  BROADPHASETYPE broadphase_type;
+  int max_grid_levels;
   real grid_density;
   //use fixed number of bins instead of tuning them
   bool fixed_bins;
+  // When enabled the broadphase keeps the grid, the bin assignments and the
+  // sorted pair list from the previous step. Only shapes whose AABB crossed a
+  // bin boundary are re-inserted and the pair list is patched for them. The
+  // grid is rebuilt when a shape leaves it or shapes are added.
+  bool use_incremental_broadphase;
+  // Verlet style skin distance, AABBs are inflated by this amount on top of the
+  // collision envelope. The AABBs and the broadphase are skipped and the pairs
+  // from the last broadphase are reused until a body moves by more than half
+  // of the skin. The narrowphase is always performed. A value of zero disables
+  // the skin.
+  real collision_skin;
+  // When enabled the shapes of fixed bodies are kept in a bounding volume
+  // hierarchy that is only rebuilt when a fixed body is added or moved. These
+  // shapes are not binned by the broadphase, dynamic shapes are tested against
+  // the hierarchy instead and static-static pairs are never generated.
+  bool use_static_bvh;
+  // Sort the bin keys of the broadphase with a parallel radix sort instead of
+  // a comparison sort. The number of passes depends on the number of bits
+  // needed by the largest key, which follows from bins_per_axis.
+  bool use_radix_sort;
+  // Hash the bins of the uniform grid in Morton (Z) order instead of row
+  // order so that neighboring bins are close in memory. Only used when there
+  // are at most 1024 bins along every axis.
+  bool use_morton_bins;
+  // When enabled every thread of the narrowphase appends the contacts it finds
+  // to its own buffer. The buffers are then scattered directly to the final,
+  // compacted contact arrays using a prefix sum over the number of contacts of
+  // every pair. This avoids sizing the contact arrays for the worst case and
+  // compacting them afterwards, which pays off when only a small fraction of
+  // the potential pairs end up in contact (e.g. with a large envelope).
+  bool use_thread_buffers;
+  // Keep the separating axis (or contact normal) found by MPR and GJK for
+  // every pair of shapes from one step to the next. A pair that is still
+  // separated along its cached axis is rejected with a single support point
+  // evaluation and GJK starts its search from the cached axis. This pays off
+  // when MPR or GJK dominate the narrowphase (e.g. convex hulls) and the
+  // relative poses change little between steps.
+  bool use_axis_cache;
+  // After the narrowphase the contacts between two bodies are grouped by their
+  // normal, all the normals of a group are within contact_reduction_angle
+  // (radians) of the normal of its deepest contact. Every group keeps at most
+  // four contacts: the deepest one and the ones that span the largest area.
+  // This shrinks the solver problem when a body rests on a triangle mesh or a
+  // compound body touches a surface with many nearly coplanar contacts.
+  bool use_contact_reduction;
+  real contact_reduction_angle;
 };
 // solver_settings, like the name implies is the structure that contains all
 // settings associated with the parallel solver.
@@ -113,6 +177,10 @@ struct solver_settings {
     use_material_properties = true;
     characteristic_vel = 1;
     min_slip_vel = 1e-4;
+    use_warm_start = false;
+    warm_start_factor = 1;
+    use_matrix_free = false;
+    relaxation_factor = 1;
   }
 
   // The solver type variable defines name of the solver that will be used to
@@ -174,6 +242,24 @@ struct solver_settings {
   real characteristic_vel;
   // Threshold tangential velocity
   real min_slip_vel;
+  // Start the DVI solver from the impulses of the previous step instead of
+  // zero. A contact gets the normal, sliding and spinning impulses of the
+  // closest contact of the same pair of shapes in the previous step, scaled by
+  // warm_start_factor. New contacts and bilaterals start from zero. This
+  // greatly reduces the number of iterations for slowly changing problems
+  // such as piles at rest.
+  bool use_warm_start;
+  real warm_start_factor;
+  // Compute the products with the contact Jacobian from the per contact
+  // Jacobian blocks and the per body inverse mass instead of the sparse D and
+  // M_inv*D matrices, which are then not assembled for the contacts. The PDIP
+  // solver still needs the assembled matrices.
+  bool use_matrix_free;
+  // Relaxation factor of the projected Gauss-Seidel and block Jacobi solvers.
+  // For PGS one is plain Gauss-Seidel and values between one and two give
+  // successive over-relaxation (PSOR). Block Jacobi updates every contact at
+  // once and usually needs a value below one when bodies have many contacts.
+  real relaxation_factor;
 
   // Along with setting the solver mode, the total number of iterations for each
   // type of constraints can be performed.
@@ -215,6 +301,12 @@ struct settings_container {
     // I don't really check to see if max_threads is > than min_threads
     // not sure if that is a huge issue
     perform_thread_tuning = ((min_threads == max_threads) ? false : true);
+    // Bin tuning is off by default, the number of bins is the one set in the
+    // collision settings
+    perform_bin_tuning = false;
+    bin_tuning_frequency = 50;
+    // Bodies are kept in the order in which they were added
+    spatial_reorder_frequency = 0;
     system_type = SYSTEM_DVI;
     step_size = .01;
   }
@@ -229,6 +321,22 @@ struct settings_container {
   // it changes the number of threads, if not, it decreases the number of threads
   // back to the original value.
   bool perform_thread_tuning;
+  // If set to true chrono parallel periodically tries a finer or coarser grid
+  // for the broadphase and measures the time spent in collision detection.
+  // The direction is picked from the occupancy of the bins and the new number
+  // of bins is kept if it is faster. A trial starts every bin_tuning_frequency
+  // steps and lasts 10 steps. The tuner scales bins_per_axis, or the number of
+  // bins computed from grid_density when fixed_bins is false, by a factor kept
+  // in the collision measures (bin_scale); the settings are not changed.
+  bool perform_bin_tuning;
+  uint bin_tuning_frequency;
+  // If larger than zero the bodies and their collision shapes are sorted along
+  // a space filling (Morton) curve every spatial_reorder_frequency steps so
+  // that bodies that are close in space are also close in memory. The ChBody
+  // pointers stay the same but their index in the body list and GetId()
+  // change, use the identifier of a body to track it. Only supported with the
+  // parallel collision system.
+  uint spatial_reorder_frequency;
   // The minimum number of threads that will ever be used by this simulation.
   // If you know a good number of threads for your simulation set the minimum so
   // that the simulation is running optimally from the start
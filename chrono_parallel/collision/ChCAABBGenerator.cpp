@@ -1,6 +1,7 @@
 #include <algorithm>
 
 #include "chrono_parallel/collision/ChCAABBGenerator.h"
+#include "chrono_parallel/collision/ChCNarrowphaseUtils.h"
 using namespace chrono;
 using namespace chrono::collision;
 
@@ -19,22 +20,14 @@ static void ComputeAABBTriangle(const real3& A, const real3& B, const real3& C,
   maxp.z = std::max(A.z, std::max(B.z, C.z));
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-static void ComputeAABBBox(const real3& dim,
-                           const real3& lpositon,
-                           const real3& positon,
-                           const real4& lrotation,
-                           const real4& rotation,
-                           real3& minp,
-                           real3& maxp) {
-  real4 q1 = mult(rotation, lrotation);
-  M33 rotmat = AMat(q1);
+static void ComputeAABBBox(const real3& dim, const real3& position, const real4& rotation, real3& minp, real3& maxp) {
+  M33 rotmat = AMat(rotation);
   rotmat = AbsMat(rotmat);
 
   real3 temp = MatMult(rotmat, dim);
 
-  real3 pos = quatRotate(lpositon, rotation) + positon;
-  minp = pos - temp;
-  maxp = pos + temp;
+  minp = position - temp;
+  maxp = position + temp;
 
   // cout<<minp.x<<" "<<minp.y<<" "<<minp.z<<"  |  "<<maxp.x<<" "<<maxp.y<<" "<<maxp.z<<endl;
   //    real3 pos = quatRotate(lpositon, rotation) + positon; //new position
@@ -101,38 +94,29 @@ static void ComputeAABBCone(const real3& dim,
   maxp = pos + temp;
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+// The extreme points along the world axes are found with six support queries
+// on the hull adjacency, every query starts from the result of the previous one
 static void ComputeAABBConvex(const real3* convex_points,
+                              const int2* adjacency,
+                              const int* neighbors,
                               const real3& B,
-                              const real3& lpos,
                               const real3& pos,
                               const real4& rot,
                               real3& minp,
                               real3& maxp) {
   int start = B.y;
-  int size = B.x;
-  real3 point_0 = quatRotate(convex_points[start] + lpos, rot) + pos;
-
-  minp = maxp = point_0;
-  for (int i = start; i < start + size; i++) {
-    real3 p = quatRotate(convex_points[i] + lpos, rot) + pos;
-    if (minp.x > p.x) {
-      minp.x = p.x;
-    }
-    if (minp.y > p.y) {
-      minp.y = p.y;
-    }
-    if (minp.z > p.z) {
-      minp.z = p.z;
-    }
-    if (maxp.x < p.x) {
-      maxp.x = p.x;
-    }
-    if (maxp.y < p.y) {
-      maxp.y = p.y;
-    }
-    if (maxp.z < p.z) {
-      maxp.z = p.z;
-    }
+  const real3* points = convex_points + start;
+  const int2* adj = adjacency + start;
+
+  int hint = 0;
+  for (int i = 0; i < 3; i++) {
+    real3 axis(0);
+    axis[i] = 1;
+    real3 dir = quatRotateT(axis, rot);
+    hint = GetSupportIndex_Convex(points, adj, neighbors, hint, dir);
+    maxp[i] = (quatRotate(points[hint], rot) + pos)[i];
+    hint = GetSupportIndex_Convex(points, adj, neighbors, hint, -dir);
+    minp[i] = (quatRotate(points[hint], rot) + pos)[i];
   }
 
   minp = minp - R3(B.z);
@@ -142,64 +126,156 @@ static void ComputeAABBConvex(const real3* convex_points,
 ChCAABBGenerator::ChCAABBGenerator() {
 }
 
-void ChCAABBGenerator::GenerateAABB() {
+void ChCAABBGenerator::Reset() {
+  transformed.clear();
+}
+
+void ChCAABBGenerator::TransformFlagged() {
   const host_vector<shape_type>& obj_data_T = data_manager->host_data.typ_rigid;
   const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
   const host_vector<real3>& obj_data_A = data_manager->host_data.ObA_rigid;
   const host_vector<real3>& obj_data_B = data_manager->host_data.ObB_rigid;
   const host_vector<real3>& obj_data_C = data_manager->host_data.ObC_rigid;
   const host_vector<real4>& obj_data_R = data_manager->host_data.ObR_rigid;
+  const host_vector<real3>& body_pos = data_manager->host_data.pos_rigid;
+  const host_vector<real4>& body_rot = data_manager->host_data.rot_rigid;
+  const host_vector<bool>& fixed_rigid = data_manager->host_data.fixed_rigid;
+  host_vector<real3>& obj_data_A_global = data_manager->host_data.ObA_global;
+  host_vector<real3>& obj_data_B_global = data_manager->host_data.ObB_global;
+  host_vector<real3>& obj_data_C_global = data_manager->host_data.ObC_global;
+  host_vector<real4>& obj_data_R_global = data_manager->host_data.ObR_global;
+  uint num_rigid_shapes = data_manager->num_rigid_shapes;
+
+  if (transformed.size() != num_rigid_shapes) {
+    transformed.assign(num_rigid_shapes, 0);
+    last_pos.resize(num_rigid_shapes);
+    last_rot.resize(num_rigid_shapes);
+  }
+  obj_data_A_global.resize(num_rigid_shapes);
+  obj_data_B_global.resize(num_rigid_shapes);
+  obj_data_C_global.resize(num_rigid_shapes);
+  obj_data_R_global.resize(num_rigid_shapes);
+
+#pragma omp parallel for
+  for (int index = 0; index < num_rigid_shapes; index++) {
+    if (!shape_flag[index]) {
+      continue;
+    }
+    uint id = obj_data_ID[index];
+    real3 pos = body_pos[id];
+    real4 rot = body_rot[id];
+
+    // The global data of a fixed body is still valid if the body was not moved
+    if (transformed[index] && fixed_rigid[id] && last_pos[index] == pos && last_rot[index] == rot) {
+      continue;
+    }
+
+    obj_data_A_global[index] = TransformLocalToParent(pos, rot, obj_data_A[index]);
+    if (obj_data_T[index] == TRIANGLEMESH) {
+      obj_data_B_global[index] = TransformLocalToParent(pos, rot, obj_data_B[index]);
+      obj_data_C_global[index] = TransformLocalToParent(pos, rot, obj_data_C[index]);
+    } else {
+      obj_data_B_global[index] = obj_data_B[index];
+      obj_data_C_global[index] = obj_data_C[index];
+    }
+    obj_data_R_global[index] = mult(rot, obj_data_R[index]);
+
+    last_pos[index] = pos;
+    last_rot[index] = rot;
+    transformed[index] = 1;
+  }
+}
+
+void ChCAABBGenerator::TransformShapes(const custom_vector<long long>& pairs) {
+  uint num_rigid_shapes = data_manager->num_rigid_shapes;
+  int num_pairs = pairs.size();
+
+  shape_flag.assign(num_rigid_shapes, 0);
+#pragma omp parallel for
+  for (int i = 0; i < num_pairs; i++) {
+    long long p = pairs[i];
+    shape_flag[int(p >> 32)] = 1;
+    shape_flag[int(p & 0xffffffff)] = 1;
+  }
+
+  TransformFlagged();
+}
+
+void ChCAABBGenerator::GenerateAABB() {
+  const host_vector<shape_type>& obj_data_T = data_manager->host_data.typ_rigid;
+  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  const host_vector<real3>& obj_data_A = data_manager->host_data.ObA_global;
+  const host_vector<real3>& obj_data_B = data_manager->host_data.ObB_global;
+  const host_vector<real3>& obj_data_C = data_manager->host_data.ObC_global;
+  const host_vector<real4>& obj_data_R = data_manager->host_data.ObR_global;
   const host_vector<real3>& convex_data = data_manager->host_data.convex_data;
+  const host_vector<int2>& convex_adjacency = data_manager->host_data.convex_adjacency;
+  const host_vector<int>& convex_neighbors = data_manager->host_data.convex_neighbors;
+  const host_vector<real3>& mesh_node_min = data_manager->host_data.mesh_node_min;
+  const host_vector<real3>& mesh_node_max = data_manager->host_data.mesh_node_max;
   const host_vector<real3>& body_pos = data_manager->host_data.pos_rigid;
   const host_vector<real4>& body_rot = data_manager->host_data.rot_rigid;
   uint num_rigid_shapes = data_manager->num_rigid_shapes;
 
   real collision_envelope = data_manager->settings.collision.collision_envelope;
+  real collision_skin = data_manager->settings.collision.collision_skin;
   host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
   host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
 
   LOG(TRACE) << "AABB START";
 
+  // Every shape needs a box, the global shape data written here is reused by
+  // the narrowphase
+  shape_flag.assign(num_rigid_shapes, 1);
+  TransformFlagged();
+
   aabb_min_rigid.resize(num_rigid_shapes);
   aabb_max_rigid.resize(num_rigid_shapes);
 
 #pragma omp parallel for
   for (int index = 0; index < num_rigid_shapes; index++) {
     shape_type type = obj_data_T[index];
-    uint id = obj_data_ID[index];
     real3 A = obj_data_A[index];
     real3 B = obj_data_B[index];
     real3 C = obj_data_C[index];
-    real3 position = body_pos[id];
-    real4 rotation = (mult(body_rot[id], obj_data_R[index]));
+    real4 R = obj_data_R[index];
     real3 temp_min;
     real3 temp_max;
 
     if (type == SPHERE) {
-      A = quatRotate(A, body_rot[id]);
-      ComputeAABBSphere(B.x + collision_envelope, A + position, temp_min, temp_max);
+      ComputeAABBSphere(B.x + collision_envelope, A, temp_min, temp_max);
     } else if (type == TRIANGLEMESH) {
-      A = quatRotate(A, body_rot[id]) + position;
-      B = quatRotate(B, body_rot[id]) + position;
-      C = quatRotate(C, body_rot[id]) + position;
       ComputeAABBTriangle(A, B, C, temp_min, temp_max);
     } else if (type == ELLIPSOID || type == BOX || type == CYLINDER || type == CONE) {
-      ComputeAABBBox(B + collision_envelope, A, position, obj_data_R[index], body_rot[id], temp_min, temp_max);
+      ComputeAABBBox(B + collision_envelope, A, R, temp_min, temp_max);
     } else if (type == ROUNDEDBOX || type == ROUNDEDCYL || type == ROUNDEDCONE) {
-      ComputeAABBBox(B + C.x + collision_envelope, A, position, obj_data_R[index], body_rot[id], temp_min, temp_max);
+      ComputeAABBBox(B + C.x + collision_envelope, A, R, temp_min, temp_max);
     } else if (type == CAPSULE) {
       real3 B_ = R3(B.x, B.x + B.y, B.z) + collision_envelope;
-      ComputeAABBBox(B_, A, position, obj_data_R[index], body_rot[id], temp_min, temp_max);
+      ComputeAABBBox(B_, A, R, temp_min, temp_max);
     } else if (type == CONVEX) {
-      ComputeAABBConvex(convex_data.data(), B, A, position, rotation, temp_min, temp_max);
+      ComputeAABBConvex(convex_data.data(), convex_adjacency.data(), convex_neighbors.data(), B, A, R, temp_min,
+                        temp_max);
       temp_min -= collision_envelope;
       temp_max += collision_envelope;
+    } else if (type == TRIANGLEMESH_BVH) {
+      // Box around the root of the hierarchy, expressed in the body frame
+      uint id = obj_data_ID[index];
+      uint root = B.y;
+      real3 hdims = (mesh_node_max[root] - mesh_node_min[root]) * real(0.5);
+      real3 center = (mesh_node_max[root] + mesh_node_min[root]) * real(0.5);
+      center = TransformLocalToParent(body_pos[id], body_rot[id], center);
+      ComputeAABBBox(hdims + collision_envelope, center, R, temp_min, temp_max);
+    } else if (type == HEIGHTFIELD) {
+      // Box around the grid and the range of heights
+      real3 hdims = R3((B.x - 1) * C.x, (B.y - 1) * C.y, 2 * C.z) * real(0.5);
+      ComputeAABBBox(hdims + collision_envelope, A, R, temp_min, temp_max);
     } else {
       continue;
     }
 
-    aabb_min_rigid[index] = temp_min;
-    aabb_max_rigid[index] = temp_max;
+    aabb_min_rigid[index] = temp_min - collision_skin;
+    aabb_max_rigid[index] = temp_max + collision_skin;
   }
 
   LOG(TRACE) << "AABB END";
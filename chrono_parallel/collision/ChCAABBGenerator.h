@@ -22,6 +22,7 @@
 #include "chrono_parallel/math/ChParallelMath.h"
 #include "chrono_parallel/ChParallelDefines.h"
 #include "chrono_parallel/ChDataManager.h"
+#include "chrono_parallel/collision/ChCDataStructures.h"
 
 namespace chrono {
 namespace collision {
@@ -31,9 +32,29 @@ class CH_PARALLEL_API ChCAABBGenerator {
   // functions
   ChCAABBGenerator();
 
+  // Transform the shapes to the global frame and compute their AABBs
   void GenerateAABB();
+  // Transform only the shapes that appear in the given pairs, used when the
+  // AABBs and the pairs of a previous step are kept
+  void TransformShapes(const custom_vector<long long>& pairs);
+  // Forget which shapes are already in the global frame, must be called when
+  // the shapes are reordered
+  void Reset();
 
   ChParallelDataManager* data_manager;
+
+ private:
+  // Transform the shapes whose flag is set, the shapes of fixed bodies that did
+  // not move since their last transform are skipped
+  void TransformFlagged();
+
+  // Shapes to transform in this pass
+  custom_vector<char> shape_flag;
+  // Body position and rotation used for the last transform of every shape and
+  // whether the shape was transformed at all
+  custom_vector<real3> last_pos;
+  custom_vector<real4> last_rot;
+  custom_vector<char> transformed;
 };
 }
 }
@@ -1,10 +1,16 @@
 #include <algorithm>
+#include <vector>
 
 #include <chrono_parallel/collision/ChCBroadphase.h>
 #include "chrono_parallel/collision/ChCBroadphaseUtils.h"
 
 #include <thrust/transform.h>
+#include <thrust/count.h>
+#include <thrust/extrema.h>
+#include <thrust/merge.h>
 #include <thrust/iterator/constant_iterator.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/zip_iterator.h>
 
 
 using thrust::transform;
@@ -13,6 +19,65 @@ using thrust::transform_reduce;
 namespace chrono {
 namespace collision {
 
+// Number of bits of a radix sort digit
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// Function to sort keys and values with a parallel LSD radix sort===========================================
+// Only the lower key_bits bits of the keys are sorted. The data is split into blocks, every pass counts the
+// digits of each block, computes the output offset of each digit for each block and scatters the blocks in
+// parallel. The sort is stable. The input and temporary vectors are swapped after every pass.
+static void function_Radix_Sort_By_Key(host_vector<uint>& keys,
+                                       host_vector<uint>& values,
+                                       host_vector<uint>& keys_tmp,
+                                       host_vector<uint>& values_tmp,
+                                       const uint key_bits) {
+  const int num_items = keys.size();
+  const int num_blocks = std::max(1, std::min(omp_get_max_threads(), num_items / RADIX_BUCKETS));
+  const int block_size = (num_items + num_blocks - 1) / num_blocks;
+  keys_tmp.resize(num_items);
+  values_tmp.resize(num_items);
+  std::vector<uint> offsets(num_blocks * RADIX_BUCKETS);
+
+  for (uint shift = 0; shift < key_bits; shift += RADIX_BITS) {
+    const uint* key_in = keys.data();
+    const uint* value_in = values.data();
+    uint* key_out = keys_tmp.data();
+    uint* value_out = values_tmp.data();
+
+#pragma omp parallel for
+    for (int b = 0; b < num_blocks; b++) {
+      uint* count = offsets.data() + b * RADIX_BUCKETS;
+      std::fill(count, count + RADIX_BUCKETS, 0);
+      int end = std::min(num_items, (b + 1) * block_size);
+      for (int i = b * block_size; i < end; i++) {
+        count[(key_in[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+      }
+    }
+    // Digits in order, blocks in order within a digit
+    uint sum = 0;
+    for (int d = 0; d < RADIX_BUCKETS; d++) {
+      for (int b = 0; b < num_blocks; b++) {
+        uint count = offsets[b * RADIX_BUCKETS + d];
+        offsets[b * RADIX_BUCKETS + d] = sum;
+        sum += count;
+      }
+    }
+#pragma omp parallel for
+    for (int b = 0; b < num_blocks; b++) {
+      uint* offset = offsets.data() + b * RADIX_BUCKETS;
+      int end = std::min(num_items, (b + 1) * block_size);
+      for (int i = b * block_size; i < end; i++) {
+        uint pos = offset[(key_in[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        key_out[pos] = key_in[i];
+        value_out[pos] = value_in[i];
+      }
+    }
+    keys.swap(keys_tmp);
+    values.swap(values_tmp);
+  }
+}
+
 // Function to Count AABB Bin intersections=================================================================
 inline void function_Count_AABB_BIN_Intersection(const uint index,
                                                  const real3& inv_bin_size_vec,
@@ -27,6 +92,7 @@ inline void function_Count_AABB_BIN_Intersection(const uint index,
 // Function to Store AABB Bin Intersections=================================================================
 inline void function_Store_AABB_BIN_Intersection(const uint index,
                                                  const int3& bins_per_axis,
+                                                 const bool morton,
                                                  const real3& inv_bin_size_vec,
                                                  const host_vector<real3>& aabb_min_data,
                                                  const host_vector<real3>& aabb_max_data,
@@ -40,7 +106,7 @@ inline void function_Store_AABB_BIN_Intersection(const uint index,
   for (i = gmin.x; i <= gmax.x; i++) {
     for (j = gmin.y; j <= gmax.y; j++) {
       for (k = gmin.z; k <= gmax.z; k++) {
-        bin_number[mInd + count] = Hash_Index(I3(i, j, k), bins_per_axis);
+        bin_number[mInd + count] = Hash_Bin(I3(i, j, k), bins_per_axis, morton);
         aabb_number[mInd + count] = index;
         count++;
       }
@@ -48,135 +114,350 @@ inline void function_Store_AABB_BIN_Intersection(const uint index,
   }
 }
 
-// Function to count AABB AABB intersection=================================================================
-inline void function_Count_AABB_AABB_Intersection(const uint index,
-                                                  const host_vector<real3>& aabb_min_data,
-                                                  const host_vector<real3>& aabb_max_data,
-                                                  const host_vector<uint>& bin_number,
-                                                  const host_vector<uint>& aabb_number,
-                                                  const host_vector<uint>& bin_start_index,
-                                                  const host_vector<short2>& fam_data,
-                                                  const host_vector<bool>& body_active,
-                                                  const host_vector<uint>& body_id,
-                                                  host_vector<uint>& num_contact) {
-  uint start = bin_start_index[index];
-  uint end = bin_start_index[index + 1];
+// Function to count or store the pairs of a shape in the grid===============================================
+// A shape is only paired with the shapes that have a larger index, in the bin that owns the pair (see
+// Hash_Owner). Every pair is found exactly once and the pairs of a shape are generated in one segment.
+// Pairs are stored if potential_contacts is not null.
+inline uint function_Grid_Shape_Pairs(const uint shapeA,
+                                      const int3& bins_per_axis,
+                                      const bool morton,
+                                      const host_vector<real3>& aabb_min_data,
+                                      const host_vector<real3>& aabb_max_data,
+                                      const host_vector<int3>& shape_bin_min,
+                                      const host_vector<int3>& shape_bin_max,
+                                      const uint num_bins_active,
+                                      const host_vector<uint>& bin_active,
+                                      const host_vector<uint>& bin_start_index,
+                                      const host_vector<uint>& aabb_number,
+                                      const host_vector<short2>& fam_data,
+                                      const host_vector<bool>& body_active,
+                                      const host_vector<uint>& body_id,
+                                      const bool candidates_only,
+                                      long long* potential_contacts) {
   uint count = 0;
-  // Terminate early if there is only one object in the bin
-  if (end - start == 1) {
-    num_contact[index] = 0;
-    return;
-  }
-  for (uint i = start; i < end; i++) {
-    uint shapeA = aabb_number[i];
-    real3 Amin = aabb_min_data[shapeA];
-    real3 Amax = aabb_max_data[shapeA];
-    short2 famA = fam_data[shapeA];
-    uint bodyA = body_id[shapeA];
-
-    for (uint k = i + 1; k < end; k++) {
-      uint shapeB = aabb_number[k];
-      uint bodyB = body_id[shapeB];
+  real3 Amin = aabb_min_data[shapeA];
+  real3 Amax = aabb_max_data[shapeA];
+  short2 famA = fam_data[shapeA];
+  uint bodyA = body_id[shapeA];
+  int3 gmin = shape_bin_min[shapeA];
+  int3 gmax = shape_bin_max[shapeA];
 
-      if (shapeA == shapeB)
-        continue;
-      if (bodyA == bodyB)
-        continue;
-      if (!body_active[bodyA] && !body_active[bodyB])
-        continue;
-      if (!collide(famA, fam_data[shapeB]))
-        continue;
-      if (!overlap(Amin, Amax, aabb_min_data[shapeB], aabb_max_data[shapeB]))
-        continue;
-      count++;
+  // With row order hashing the bins are visited in increasing hash order so
+  // the search for the next active bin can start after the previous one
+  const uint* search_begin = bin_active.data();
+  const uint* active_end = bin_active.data() + num_bins_active;
+  for (int k = gmin.z; k <= gmax.z; k++) {
+    for (int j = gmin.y; j <= gmax.y; j++) {
+      for (int i = gmin.x; i <= gmax.x; i++) {
+        uint bin = Hash_Bin(I3(i, j, k), bins_per_axis, morton);
+        const uint* found = std::lower_bound(search_begin, active_end, bin);
+        if (!morton) {
+          search_begin = found;
+        }
+        if (found == active_end || *found != bin)
+          continue;
+        uint index = found - bin_active.data();
+        for (uint e = bin_start_index[index]; e < bin_start_index[index + 1]; e++) {
+          uint shapeB = aabb_number[e];
+          if (shapeB <= shapeA)
+            continue;
+          if (Hash_Bin(Hash_Owner(gmin, shape_bin_min[shapeB]), bins_per_axis, morton) != bin)
+            continue;
+          uint bodyB = body_id[shapeB];
+          if (bodyA == bodyB)
+            continue;
+          if (!collide(famA, fam_data[shapeB]))
+            continue;
+          // Candidate pairs are kept between steps so they only depend on the bins,
+          // the active and overlap tests are done when the pair list is filtered
+          if (!candidates_only) {
+            if (!body_active[bodyA] && !body_active[bodyB])
+              continue;
+            if (!overlap(Amin, Amax, aabb_min_data[shapeB], aabb_max_data[shapeB]))
+              continue;
+          }
+          if (potential_contacts) {
+            // the two indices of the shapes that make up the contact
+            potential_contacts[count] = ((long long)shapeA << 32 | (long long)shapeB);
+          }
+          count++;
+        }
+      }
     }
   }
+  return count;
+}
 
-  num_contact[index] = count;
+// Function to compute the bins spanned by an AABB on a fixed grid=========================================
+// Returns false if part of the AABB lies outside of the grid
+inline bool function_Compute_AABB_BIN_Range(const uint index,
+                                            const real3& origin,
+                                            const int3& bins_per_axis,
+                                            const real3& inv_bin_size_vec,
+                                            const host_vector<real3>& aabb_min_data,
+                                            const host_vector<real3>& aabb_max_data,
+                                            int3& gmin,
+                                            int3& gmax) {
+  gmin = HashMin(aabb_min_data[index] - origin, inv_bin_size_vec);
+  gmax = HashMax(aabb_max_data[index] - origin, inv_bin_size_vec);
+  return (gmin.x >= 0 && gmin.y >= 0 && gmin.z >= 0 && gmax.x < bins_per_axis.x && gmax.y < bins_per_axis.y &&
+          gmax.z < bins_per_axis.z);
 }
 
-// Function to store AABB-AABB intersections================================================================
-inline void function_Store_AABB_AABB_Intersection(const uint index,
-                                                  const host_vector<real3>& aabb_min_data,
-                                                  const host_vector<real3>& aabb_max_data,
-                                                  const host_vector<uint>& bin_number,
-                                                  const host_vector<uint>& aabb_number,
-                                                  const host_vector<uint>& bin_start_index,
-                                                  const host_vector<uint>& num_contact,
-                                                  const host_vector<short2>& fam_data,
-                                                  const host_vector<bool>& body_active,
-                                                  const host_vector<uint>& body_id,
-                                                  host_vector<long long>& potential_contacts) {
-  uint start = bin_start_index[index];
-  uint end = bin_start_index[index + 1];
-  // Terminate early if there is only one object in the bin
-  if (end - start == 1) {
-    return;
-  }
-  uint offset = num_contact[index];
+// Function to count the candidate pairs of a shape that changed bins========================================
+// Pairs with other shapes that changed bins are only counted by the shape with the lower index, pairs are
+// only counted in the bin that owns them (see Hash_Owner)
+inline uint function_Count_Moved_Shape_Pairs(const uint shapeA,
+                                             const int3& bins_per_axis,
+                                             const bool morton,
+                                             const int3& gmin,
+                                             const int3& gmax,
+                                             const host_vector<int3>& shape_bin_min,
+                                             const uint num_bins_active,
+                                             const host_vector<uint>& bin_active,
+                                             const host_vector<uint>& bin_start_index,
+                                             const host_vector<uint>& aabb_number,
+                                             const host_vector<uint>& shape_moved,
+                                             const host_vector<short2>& fam_data,
+                                             const host_vector<uint>& body_id,
+                                             long long* potential_contacts) {
   uint count = 0;
+  short2 famA = fam_data[shapeA];
+  uint bodyA = body_id[shapeA];
+  for (int i = gmin.x; i <= gmax.x; i++) {
+    for (int j = gmin.y; j <= gmax.y; j++) {
+      for (int k = gmin.z; k <= gmax.z; k++) {
+        uint bin = Hash_Bin(I3(i, j, k), bins_per_axis, morton);
+        const uint* active_end = bin_active.data() + num_bins_active;
+        const uint* found = std::lower_bound(bin_active.data(), active_end, bin);
+        if (found == active_end || *found != bin)
+          continue;
+        uint index = found - bin_active.data();
+        for (uint e = bin_start_index[index]; e < bin_start_index[index + 1]; e++) {
+          uint shapeB = aabb_number[e];
+          if (shapeB == shapeA)
+            continue;
+          if (shape_moved[shapeB] && shapeB < shapeA)
+            continue;
+          if (Hash_Bin(Hash_Owner(gmin, shape_bin_min[shapeB]), bins_per_axis, morton) != bin)
+            continue;
+          if (body_id[shapeB] == bodyA)
+            continue;
+          if (!collide(famA, fam_data[shapeB]))
+            continue;
+          if (potential_contacts) {
+            potential_contacts[count] = (shapeA < shapeB) ? ((long long)shapeA << 32 | (long long)shapeB)
+                                                          : ((long long)shapeB << 32 | (long long)shapeA);
+          }
+          count++;
+        }
+      }
+    }
+  }
+  return count;
+}
 
-  for (uint i = start; i < end; i++) {
-    uint shapeA = aabb_number[i];
-    real3 Amin = aabb_min_data[shapeA];
-    real3 Amax = aabb_max_data[shapeA];
-    short2 famA = fam_data[shapeA];
-    uint bodyA = body_id[shapeA];
+// Function to compute the level of an AABB in the hierarchical grid===========================================
+// The level is the finest one whose bins are at least as large as the AABB, so that the AABB overlaps at
+// most two bins along each axis
+inline int function_Compute_AABB_Level(const uint index,
+                                       const real3& bin_size_vec,
+                                       const int num_levels,
+                                       const host_vector<real3>& aabb_min_data,
+                                       const host_vector<real3>& aabb_max_data) {
+  real3 extent = aabb_max_data[index] - aabb_min_data[index];
+  real3 size = bin_size_vec;
+  int level = 0;
+  while (level < num_levels - 1 && (extent.x > size.x || extent.y > size.y || extent.z > size.z)) {
+    size = size * real(2);
+    level++;
+  }
+  return level;
+}
 
-    for (int k = i + 1; k < end; k++) {
-      uint shapeB = aabb_number[k];
-      uint bodyB = body_id[shapeB];
+// Compute the range of bins spanned by an AABB on a level of the hierarchical grid
+inline void function_Level_BIN_Range(const real3& Amin,
+                                     const real3& Amax,
+                                     const int level,
+                                     const real3& inv_bin_size_vec,
+                                     const int3& bins,
+                                     int3& gmin,
+                                     int3& gmax) {
+  real3 inv_level_size = inv_bin_size_vec / real(1 << level);
+  gmin = clamp(HashMin(Amin, inv_level_size), I3(0, 0, 0), bins - I3(1, 1, 1));
+  gmax = clamp(HashMax(Amax, inv_level_size), I3(0, 0, 0), bins - I3(1, 1, 1));
+}
 
-      if (shapeA == shapeB)
-        continue;
-      if (bodyA == bodyB)
-        continue;
-      if (!body_active[bodyA] && !body_active[bodyB])
-        continue;
-      if (!collide(famA, fam_data[shapeB]))
-        continue;
-      if (!overlap(Amin, Amax, aabb_min_data[shapeB], aabb_max_data[shapeB]))
-        continue;
+// Function to count or store the pairs of a shape in the hierarchical grid====================================
+// A shape is tested against the shapes on its own level and on every coarser level. On its own level only
+// shapes with a larger index are considered. A pair is only reported in the bin that owns it (see
+// Hash_Owner) so it is found once. Pairs are stored if potential_contacts is not null.
+inline uint function_Hierarchical_Shape_Pairs(const uint shapeA,
+                                              const int num_levels,
+                                              const real3& inv_bin_size_vec,
+                                              const host_vector<int>& shape_level,
+                                              const host_vector<int3>& shape_bin_min,
+                                              const host_vector<int3>& level_bins,
+                                              const host_vector<uint>& level_offset,
+                                              const host_vector<real3>& aabb_min_data,
+                                              const host_vector<real3>& aabb_max_data,
+                                              const uint num_bins_active,
+                                              const host_vector<uint>& bin_active,
+                                              const host_vector<uint>& bin_start_index,
+                                              const host_vector<uint>& aabb_number,
+                                              const host_vector<short2>& fam_data,
+                                              const host_vector<bool>& body_active,
+                                              const host_vector<uint>& body_id,
+                                              long long* potential_contacts) {
+  uint count = 0;
+  real3 Amin = aabb_min_data[shapeA];
+  real3 Amax = aabb_max_data[shapeA];
+  short2 famA = fam_data[shapeA];
+  uint bodyA = body_id[shapeA];
+  int levelA = shape_level[shapeA];
+  const uint* active_end = bin_active.data() + num_bins_active;
 
-      if (shapeB < shapeA) {
-        uint t = shapeA;
-        shapeA = shapeB;
-        shapeB = t;
+  for (int level = levelA; level < num_levels; level++) {
+    int3 gmin, gmax;
+    function_Level_BIN_Range(Amin, Amax, level, inv_bin_size_vec, level_bins[level], gmin, gmax);
+    for (int i = gmin.x; i <= gmax.x; i++) {
+      for (int j = gmin.y; j <= gmax.y; j++) {
+        for (int k = gmin.z; k <= gmax.z; k++) {
+          uint bin = level_offset[level] + Hash_Index(I3(i, j, k), level_bins[level]);
+          const uint* found = std::lower_bound(bin_active.data(), active_end, bin);
+          if (found == active_end || *found != bin)
+            continue;
+          uint index = found - bin_active.data();
+          for (uint e = bin_start_index[index]; e < bin_start_index[index + 1]; e++) {
+            uint shapeB = aabb_number[e];
+            if (level == levelA && shapeB <= shapeA)
+              continue;
+            if (level_offset[level] + Hash_Index(Hash_Owner(gmin, shape_bin_min[shapeB]), level_bins[level]) != bin)
+              continue;
+            uint bodyB = body_id[shapeB];
+            if (bodyA == bodyB)
+              continue;
+            if (!body_active[bodyA] && !body_active[bodyB])
+              continue;
+            if (!collide(famA, fam_data[shapeB]))
+              continue;
+            if (!overlap(Amin, Amax, aabb_min_data[shapeB], aabb_max_data[shapeB]))
+              continue;
+            if (potential_contacts) {
+              potential_contacts[count] = (shapeA < shapeB) ? ((long long)shapeA << 32 | (long long)shapeB)
+                                                            : ((long long)shapeB << 32 | (long long)shapeA);
+            }
+            count++;
+          }
+        }
       }
-      // the two indices of the shapes that make up the contact
-      potential_contacts[offset + count] = ((long long)shapeA << 32 | (long long)shapeB);
-      count++;
     }
   }
+  return count;
+}
+
+// Function to count or store the pairs of a shape during the sweep============================================
+// The shape at position index in the sorted order is tested against the following shapes until their
+// minimum along the sweep axis is past its maximum. Pairs are stored if potential_contacts is not null.
+inline uint function_SAP_Shape_Pairs(const uint index,
+                                     const uint num_shapes,
+                                     const host_vector<uint>& sap_order,
+                                     const host_vector<real>& sap_min,
+                                     const host_vector<real>& sap_max,
+                                     const host_vector<real3>& aabb_min_data,
+                                     const host_vector<real3>& aabb_max_data,
+                                     const host_vector<short2>& fam_data,
+                                     const host_vector<bool>& body_active,
+                                     const host_vector<uint>& body_id,
+                                     const bool use_static_bvh,
+                                     const host_vector<bool>& static_rigid,
+                                     long long* potential_contacts) {
+  uint count = 0;
+  uint shapeA = sap_order[index];
+  if (use_static_bvh && static_rigid[shapeA]) {
+    return 0;
+  }
+  real3 Amin = aabb_min_data[shapeA];
+  real3 Amax = aabb_max_data[shapeA];
+  short2 famA = fam_data[shapeA];
+  uint bodyA = body_id[shapeA];
+  real Aend = sap_max[index];
+
+  for (uint k = index + 1; k < num_shapes && sap_min[k] <= Aend; k++) {
+    uint shapeB = sap_order[k];
+    if (use_static_bvh && static_rigid[shapeB])
+      continue;
+    uint bodyB = body_id[shapeB];
+    if (bodyA == bodyB)
+      continue;
+    if (!body_active[bodyA] && !body_active[bodyB])
+      continue;
+    if (!collide(famA, fam_data[shapeB]))
+      continue;
+    if (!overlap(Amin, Amax, aabb_min_data[shapeB], aabb_max_data[shapeB]))
+      continue;
+    if (potential_contacts) {
+      potential_contacts[count] = (shapeA < shapeB) ? ((long long)shapeA << 32 | (long long)shapeB)
+                                                    : ((long long)shapeB << 32 | (long long)shapeA);
+    }
+    count++;
+  }
+  return count;
 }
+
 // =========================================================================================================
 ChCBroadphase::ChCBroadphase() {
   number_of_contacts_possible = 0;
   num_bins_active = 0;
   number_of_bin_intersections = 0;
   data_manager = 0;
+  grid_valid = false;
+  last_num_shapes = 0;
+  grid_bins_per_axis = I3(0, 0, 0);
+  sap_axis = -1;
+  morton_bins = false;
+  grid_ready = false;
+  static_excluded = false;
 }
 // =========================================================================================================
 // use spatial subdivision to detect the list of POSSIBLE collisions
 // let user define their own narrow-phase collision detection
 void ChCBroadphase::DetectPossibleCollisions() {
+  LOG(TRACE) << "Number of AABBs: " << data_manager->num_rigid_shapes;
+  data_manager->host_data.pair_rigid_rigid.clear();
+  static_excluded = data_manager->settings.collision.use_static_bvh;
+
+  switch (data_manager->settings.collision.broadphase_type) {
+    case BROADPHASE_HIERARCHICAL:
+      grid_valid = false;
+      grid_ready = false;
+      DetectPossibleCollisionsHierarchical();
+      break;
+    case BROADPHASE_SAP:
+      grid_valid = false;
+      grid_ready = false;
+      DetectPossibleCollisionsSAP();
+      break;
+    case BROADPHASE_GRID:
+    default:
+      DetectPossibleCollisionsGrid();
+      grid_ready = true;
+      break;
+  }
+}
+// =========================================================================================================
+void ChCBroadphase::ComputeGrid() {
   host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
   host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
-
-  host_vector<long long>& contact_pairs = data_manager->host_data.pair_rigid_rigid;
   real3& min_bounding_point = data_manager->measures.collision.min_bounding_point;
   real3& max_bounding_point = data_manager->measures.collision.max_bounding_point;
   real3& bin_size_vec = data_manager->measures.collision.bin_size_vec;
   real3& global_origin = data_manager->measures.collision.global_origin;
-  int3& bins_per_axis = data_manager->settings.collision.bins_per_axis;
+  int3& bins_per_axis = data_manager->measures.collision.bins_per_axis;
+  int3& base_bins_per_axis = data_manager->settings.collision.bins_per_axis;
   const real density = data_manager->settings.collision.grid_density;
-  const host_vector<short2>& fam_data = data_manager->host_data.fam_rigid;
-  const host_vector<bool>& obj_active = data_manager->host_data.active_rigid;
-  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
   uint num_shapes = data_manager->num_rigid_shapes;
 
-  LOG(TRACE) << "Number of AABBs: " << num_shapes;
-  contact_pairs.clear();
   // STEP 2: determine the bounds on the total space and subdivide based on the bins per axis
   // create a zero volume bounding box using the first aabb
   bbox res = bbox(aabb_min_rigid[0], aabb_min_rigid[0]);
@@ -191,10 +472,10 @@ void ChCBroadphase::DetectPossibleCollisions() {
   real3 diagonal = max_bounding_point - min_bounding_point;
 
   if (data_manager->settings.collision.fixed_bins == false) {
-    bins_per_axis = function_Compute_Grid_Resolution(num_shapes, diagonal, density);
+    base_bins_per_axis = function_Compute_Grid_Resolution(num_shapes, diagonal, density);
   }
+  bins_per_axis = function_Scale_Grid_Resolution(base_bins_per_axis, data_manager->measures.collision.bin_scale);
   bin_size_vec = diagonal / R3(bins_per_axis.x, bins_per_axis.y, bins_per_axis.z);
-  real3 inv_bin_size_vec = 1.0 / bin_size_vec;
 
   thrust::constant_iterator<real3> offset(global_origin);
   transform(aabb_min_rigid.begin(), aabb_min_rigid.end(), offset, aabb_min_rigid.begin(), thrust::minus<real3>());
@@ -203,12 +484,58 @@ void ChCBroadphase::DetectPossibleCollisions() {
   LOG(TRACE) << "Minimum bounding point: (" << res.first.x << ", " << res.first.y << ", " << res.first.z << ")";
   LOG(TRACE) << "Maximum bounding point: (" << res.second.x << ", " << res.second.y << ", " << res.second.z << ")";
   LOG(TRACE) << "Bin size vector: (" << bin_size_vec.x << ", " << bin_size_vec.y << ", " << bin_size_vec.z << ")";
+}
+// =========================================================================================================
+void ChCBroadphase::DetectPossibleCollisionsGrid() {
+  host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+
+  host_vector<long long>& contact_pairs = data_manager->host_data.pair_rigid_rigid;
+  const real3& bin_size_vec = data_manager->measures.collision.bin_size_vec;
+  const int3& bins_per_axis = data_manager->measures.collision.bins_per_axis;
+  const host_vector<short2>& fam_data = data_manager->host_data.fam_rigid;
+  const host_vector<bool>& obj_active = data_manager->host_data.active_rigid;
+  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  const bool incremental = data_manager->settings.collision.use_incremental_broadphase;
+  // Shapes of fixed bodies are handled by the static BVH
+  const bool use_static_bvh = data_manager->settings.collision.use_static_bvh;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  uint num_shapes = data_manager->num_rigid_shapes;
+
+  // Reuse the grid, bins and pairs from the previous step if possible. The grid is rebuilt if the number of
+  // bins was changed in the settings or by the bin tuner
+  const int3 requested_bins = function_Scale_Grid_Resolution(data_manager->settings.collision.bins_per_axis,
+                                                             data_manager->measures.collision.bin_scale);
+  if (incremental && grid_valid && num_shapes == last_num_shapes && requested_bins.x == grid_bins_per_axis.x &&
+      requested_bins.y == grid_bins_per_axis.y && requested_bins.z == grid_bins_per_axis.z) {
+    if (UpdateIncremental()) {
+      return;
+    }
+    LOG(TRACE) << "Incremental broadphase: grid is invalid, rebuilding";
+  }
+  grid_valid = false;
+
+  ComputeGrid();
+  real3 inv_bin_size_vec = 1.0 / bin_size_vec;
+  grid_bins_per_axis = bins_per_axis;
+
+  // Morton codes are limited to 10 bits per axis
+  morton_bins = data_manager->settings.collision.use_morton_bins && bins_per_axis.x <= 1024 &&
+                bins_per_axis.y <= 1024 && bins_per_axis.z <= 1024;
 
   bins_intersected.resize(num_shapes + 1);
   bins_intersected[num_shapes] = 0;
+  shape_bin_min.resize(num_shapes);
+  shape_bin_max.resize(num_shapes);
 
 #pragma omp parallel for
   for (int i = 0; i < num_shapes; i++) {
+    shape_bin_min[i] = HashMin(aabb_min_rigid[i], inv_bin_size_vec);
+    shape_bin_max[i] = HashMax(aabb_max_rigid[i], inv_bin_size_vec);
+    if (use_static_bvh && static_rigid[i]) {
+      bins_intersected[i] = 0;
+      continue;
+    }
     function_Count_AABB_BIN_Intersection(i, inv_bin_size_vec, aabb_min_rigid, aabb_max_rigid, bins_intersected);
   }
 
@@ -220,17 +547,22 @@ void ChCBroadphase::DetectPossibleCollisions() {
   bin_number.resize(number_of_bin_intersections);
   aabb_number.resize(number_of_bin_intersections);
   bin_start_index.resize(number_of_bin_intersections);
+  bin_active.resize(number_of_bin_intersections);
 
 #pragma omp parallel for
   for (int i = 0; i < num_shapes; i++) {
-    function_Store_AABB_BIN_Intersection(i, bins_per_axis, inv_bin_size_vec, aabb_min_rigid, aabb_max_rigid,
-                                         bins_intersected, bin_number, aabb_number);
+    if (use_static_bvh && static_rigid[i]) {
+      continue;
+    }
+    function_Store_AABB_BIN_Intersection(i, bins_per_axis, morton_bins, inv_bin_size_vec, aabb_min_rigid,
+                                         aabb_max_rigid, bins_intersected, bin_number, aabb_number);
   }
 
   LOG(TRACE) << "Completed (device_Store_AABB_BIN_Intersection)";
 
-  Thrust_Sort_By_Key(bin_number, aabb_number);
-  num_bins_active = Thrust_Reduce_By_Key(bin_number, bin_number, bin_start_index);
+  SortBinKeys(bin_number, aabb_number, Hash_Max(bins_per_axis, morton_bins));
+  num_bins_active = Thrust_Reduce_By_Key(bin_number, bin_active, bin_start_index);
+  StoreBinOccupancy();
 
   if (num_bins_active <= 0) {
     number_of_contacts_possible = 0;
@@ -244,36 +576,748 @@ void ChCBroadphase::DetectPossibleCollisions() {
   LOG(TRACE) << "Last active bin: " << num_bins_active;
 
   Thrust_Exclusive_Scan(bin_start_index);
-  num_contact.resize(num_bins_active + 1);
-  num_contact[num_bins_active] = 0;
+  num_contact.resize(num_shapes + 1);
+  num_contact[num_shapes] = 0;
 
 #pragma omp parallel for
-  for (int i = 0; i < num_bins_active; i++) {
-    function_Count_AABB_AABB_Intersection(i, aabb_min_rigid, aabb_max_rigid, bin_number, aabb_number, bin_start_index,
-                                          fam_data, obj_active, obj_data_ID, num_contact);
+  for (int i = 0; i < num_shapes; i++) {
+    if (use_static_bvh && static_rigid[i]) {
+      num_contact[i] = 0;
+      continue;
+    }
+    num_contact[i] = function_Grid_Shape_Pairs(i, bins_per_axis, morton_bins, aabb_min_rigid, aabb_max_rigid,
+                                               shape_bin_min, shape_bin_max, num_bins_active, bin_active,
+                                               bin_start_index, aabb_number, fam_data, obj_active, obj_data_ID,
+                                               incremental, 0);
   }
 
-  thrust::exclusive_scan(num_contact.begin(), num_contact.end(), num_contact.begin());
+  Thrust_Exclusive_Scan(num_contact);
   number_of_contacts_possible = num_contact.back();
   contact_pairs.resize(number_of_contacts_possible);
   LOG(TRACE) << "Number of possible collisions: " << number_of_contacts_possible;
 
 #pragma omp parallel for
-  for (int index = 0; index < num_bins_active; index++) {
-    function_Store_AABB_AABB_Intersection(index, aabb_min_rigid, aabb_max_rigid, bin_number, aabb_number,
-                                          bin_start_index, num_contact, fam_data, obj_active, obj_data_ID,
-                                          contact_pairs);
+  for (int i = 0; i < num_shapes; i++) {
+    if (use_static_bvh && static_rigid[i]) {
+      continue;
+    }
+    long long* pairs = contact_pairs.data() + num_contact[i];
+    uint count = function_Grid_Shape_Pairs(i, bins_per_axis, morton_bins, aabb_min_rigid, aabb_max_rigid,
+                                           shape_bin_min, shape_bin_max, num_bins_active, bin_active,
+                                           bin_start_index, aabb_number, fam_data, obj_active, obj_data_ID,
+                                           incremental, pairs);
+    // The pairs of a shape all start with its index, sorting each segment
+    // is enough for the whole list to be sorted
+    std::sort(pairs, pairs + count);
+  }
+
+  if (incremental) {
+    // Store the state needed to update the bins and pairs during the next step
+    candidate_pairs.swap(contact_pairs);
+    last_num_shapes = num_shapes;
+    grid_valid = true;
+    FilterCandidatePairs();
+  }
+
+  LOG(TRACE) << "Number of possible collisions: " << number_of_contacts_possible;
+
+  return;
+}
+// =========================================================================================================
+void ChCBroadphase::DetectPossibleCollisionsHierarchical() {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+
+  host_vector<long long>& contact_pairs = data_manager->host_data.pair_rigid_rigid;
+  const real3& bin_size_vec = data_manager->measures.collision.bin_size_vec;
+  const int3& bins_per_axis = data_manager->measures.collision.bins_per_axis;
+  const int max_grid_levels = std::max(data_manager->settings.collision.max_grid_levels, 1);
+  const host_vector<short2>& fam_data = data_manager->host_data.fam_rigid;
+  const host_vector<bool>& obj_active = data_manager->host_data.active_rigid;
+  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  // Shapes of fixed bodies are handled by the static BVH
+  const bool use_static_bvh = data_manager->settings.collision.use_static_bvh;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  uint num_shapes = data_manager->num_rigid_shapes;
+
+  ComputeGrid();
+  real3 inv_bin_size_vec = 1.0 / bin_size_vec;
+
+  // Every level halves the number of bins along each axis, stop once a level
+  // has a single bin
+  level_bins.clear();
+  level_offset.clear();
+  uint total_bins = 0;
+  for (int level = 0; level < max_grid_levels; level++) {
+    int3 bins = I3((bins_per_axis.x + (1 << level) - 1) >> level, (bins_per_axis.y + (1 << level) - 1) >> level,
+                   (bins_per_axis.z + (1 << level) - 1) >> level);
+    level_bins.push_back(bins);
+    level_offset.push_back(total_bins);
+    total_bins += bins.x * bins.y * bins.z;
+    if (bins.x == 1 && bins.y == 1 && bins.z == 1) {
+      break;
+    }
   }
+  int num_levels = level_bins.size();
 
-  thrust::stable_sort(thrust_parallel, contact_pairs.begin(), contact_pairs.end());
+  LOG(TRACE) << "Number of grid levels: " << num_levels;
 
-  number_of_contacts_possible = Thrust_Unique(contact_pairs);
+  shape_level.resize(num_shapes);
+  shape_bin_min.resize(num_shapes);
+  bins_intersected.resize(num_shapes + 1);
+  bins_intersected[num_shapes] = 0;
+
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    int level = function_Compute_AABB_Level(i, bin_size_vec, num_levels, aabb_min_rigid, aabb_max_rigid);
+    shape_level[i] = level;
+    if (use_static_bvh && static_rigid[i]) {
+      bins_intersected[i] = 0;
+      continue;
+    }
+    int3 gmin, gmax;
+    function_Level_BIN_Range(aabb_min_rigid[i], aabb_max_rigid[i], level, inv_bin_size_vec, level_bins[level], gmin,
+                             gmax);
+    shape_bin_min[i] = gmin;
+    bins_intersected[i] = (gmax.x - gmin.x + 1) * (gmax.y - gmin.y + 1) * (gmax.z - gmin.z + 1);
+  }
+
+  Thrust_Exclusive_Scan(bins_intersected);
+  number_of_bin_intersections = bins_intersected.back();
 
+  LOG(TRACE) << "Number of bin intersections: " << number_of_bin_intersections;
+
+  bin_number.resize(number_of_bin_intersections);
+  aabb_number.resize(number_of_bin_intersections);
+  bin_start_index.resize(number_of_bin_intersections);
+  bin_active.resize(number_of_bin_intersections);
+
+#pragma omp parallel for
+  for (int index = 0; index < num_shapes; index++) {
+    if (use_static_bvh && static_rigid[index]) {
+      continue;
+    }
+    int level = shape_level[index];
+    int3 bins = level_bins[level];
+    int3 gmin, gmax;
+    function_Level_BIN_Range(aabb_min_rigid[index], aabb_max_rigid[index], level, inv_bin_size_vec, bins, gmin, gmax);
+    uint count = bins_intersected[index];
+    for (int i = gmin.x; i <= gmax.x; i++) {
+      for (int j = gmin.y; j <= gmax.y; j++) {
+        for (int k = gmin.z; k <= gmax.z; k++) {
+          bin_number[count] = level_offset[level] + Hash_Index(I3(i, j, k), bins);
+          aabb_number[count] = index;
+          count++;
+        }
+      }
+    }
+  }
+
+  SortBinKeys(bin_number, aabb_number, total_bins - 1);
+  num_bins_active = Thrust_Reduce_By_Key(bin_number, bin_active, bin_start_index);
+  StoreBinOccupancy();
+
+  if (num_bins_active <= 0) {
+    number_of_contacts_possible = 0;
+    return;
+  }
+
+  bin_start_index.resize(num_bins_active + 1);
+  bin_start_index[num_bins_active] = 0;
+  Thrust_Exclusive_Scan(bin_start_index);
+
+  LOG(TRACE) << "Last active bin: " << num_bins_active;
+
+  num_contact.resize(num_shapes + 1);
+  num_contact[num_shapes] = 0;
+
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    if (use_static_bvh && static_rigid[i]) {
+      num_contact[i] = 0;
+      continue;
+    }
+    num_contact[i] = function_Hierarchical_Shape_Pairs(i, num_levels, inv_bin_size_vec, shape_level, shape_bin_min,
+                                                       level_bins, level_offset, aabb_min_rigid, aabb_max_rigid,
+                                                       num_bins_active, bin_active, bin_start_index, aabb_number,
+                                                       fam_data, obj_active, obj_data_ID, 0);
+  }
+
+  Thrust_Exclusive_Scan(num_contact);
+  number_of_contacts_possible = num_contact.back();
   contact_pairs.resize(number_of_contacts_possible);
 
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    if (use_static_bvh && static_rigid[i]) {
+      continue;
+    }
+    function_Hierarchical_Shape_Pairs(i, num_levels, inv_bin_size_vec, shape_level, shape_bin_min, level_bins,
+                                      level_offset, aabb_min_rigid, aabb_max_rigid, num_bins_active, bin_active,
+                                      bin_start_index, aabb_number, fam_data, obj_active, obj_data_ID,
+                                      contact_pairs.data() + num_contact[i]);
+  }
+
+  // Every pair is found once, but pairs with a shape on a coarser level are
+  // generated by the shape on the finer level which can have the larger index
+  thrust::sort(thrust_parallel, contact_pairs.begin(), contact_pairs.end());
+
   LOG(TRACE) << "Number of possible collisions: " << number_of_contacts_possible;
+}
+// =========================================================================================================
+void ChCBroadphase::DetectPossibleCollisionsSAP() {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
 
-  return;
+  host_vector<long long>& contact_pairs = data_manager->host_data.pair_rigid_rigid;
+  const host_vector<short2>& fam_data = data_manager->host_data.fam_rigid;
+  const host_vector<bool>& obj_active = data_manager->host_data.active_rigid;
+  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  // Shapes of fixed bodies are handled by the static BVH
+  const bool use_static_bvh = data_manager->settings.collision.use_static_bvh;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  uint num_shapes = data_manager->num_rigid_shapes;
+
+  // The grid is not used but this keeps the bounding box and the shifted AABBs
+  // consistent with the other algorithms
+  ComputeGrid();
+
+  // Sweep along the axis with the largest variance of the AABB centers
+  real3 sum = R3(0), sum_sq = R3(0);
+  for (int i = 0; i < num_shapes; i++) {
+    real3 center = (aabb_min_rigid[i] + aabb_max_rigid[i]) * real(0.5);
+    sum = sum + center;
+    sum_sq = sum_sq + center * center;
+  }
+  real3 variance = sum_sq / real(num_shapes) - (sum / real(num_shapes)) * (sum / real(num_shapes));
+  int axis = 0;
+  if (variance.y > variance.x && variance.y >= variance.z) {
+    axis = 1;
+  } else if (variance.z > variance.x && variance.z > variance.y) {
+    axis = 2;
+  }
+
+  sap_min.resize(num_shapes);
+  sap_max.resize(num_shapes);
+
+  bool sorted = false;
+  if (axis == sap_axis && sap_order.size() == num_shapes) {
+    // The order from the previous step is nearly sorted, use an insertion sort
+    // and give up if the shapes moved too much
+    const long long max_shifts = 8 * (long long)num_shapes;
+    long long num_shifts = 0;
+    for (int i = 0; i < num_shapes; i++) {
+      sap_min[i] = aabb_min_rigid[sap_order[i]].array[axis];
+    }
+    sorted = true;
+    for (int i = 1; i < num_shapes && sorted; i++) {
+      uint shape = sap_order[i];
+      real key = sap_min[i];
+      int j = i;
+      while (j > 0 && sap_min[j - 1] > key) {
+        sap_min[j] = sap_min[j - 1];
+        sap_order[j] = sap_order[j - 1];
+        j--;
+        num_shifts++;
+      }
+      sap_min[j] = key;
+      sap_order[j] = shape;
+      if (num_shifts > max_shifts) {
+        sorted = false;
+      }
+    }
+    LOG(TRACE) << "Sweep and prune: insertion sort shifts: " << num_shifts;
+  }
+
+  if (!sorted) {
+    sap_axis = axis;
+    sap_order.resize(num_shapes);
+    Thrust_Sequence(sap_order);
+#pragma omp parallel for
+    for (int i = 0; i < num_shapes; i++) {
+      sap_min[i] = aabb_min_rigid[i].array[axis];
+    }
+    thrust::sort_by_key(thrust_parallel, sap_min.begin(), sap_min.end(), sap_order.begin());
+  }
+
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    sap_max[i] = aabb_max_rigid[sap_order[i]].array[axis];
+  }
+
+  num_contact.resize(num_shapes + 1);
+  num_contact[num_shapes] = 0;
+
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    num_contact[i] =
+        function_SAP_Shape_Pairs(i, num_shapes, sap_order, sap_min, sap_max, aabb_min_rigid, aabb_max_rigid, fam_data,
+                                 obj_active, obj_data_ID, use_static_bvh, static_rigid, 0);
+  }
+
+  Thrust_Exclusive_Scan(num_contact);
+  number_of_contacts_possible = num_contact.back();
+  contact_pairs.resize(number_of_contacts_possible);
+
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    function_SAP_Shape_Pairs(i, num_shapes, sap_order, sap_min, sap_max, aabb_min_rigid, aabb_max_rigid, fam_data,
+                             obj_active, obj_data_ID, use_static_bvh, static_rigid,
+                             contact_pairs.data() + num_contact[i]);
+  }
+
+  // Every pair is found once, sort to match the output of the other algorithms
+  thrust::sort(thrust_parallel, contact_pairs.begin(), contact_pairs.end());
+
+  LOG(TRACE) << "Number of possible collisions: " << number_of_contacts_possible;
+}
+// =========================================================================================================
+bool ChCBroadphase::UpdateIncremental() {
+  host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const real3& bin_size_vec = data_manager->measures.collision.bin_size_vec;
+  const real3& global_origin = data_manager->measures.collision.global_origin;
+  const int3& bins_per_axis = data_manager->measures.collision.bins_per_axis;
+  const host_vector<short2>& fam_data = data_manager->host_data.fam_rigid;
+  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  const bool use_static_bvh = data_manager->settings.collision.use_static_bvh;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  const uint num_shapes = data_manager->num_rigid_shapes;
+  const real3 inv_bin_size_vec = 1.0 / bin_size_vec;
+
+  // The grid is only reused if every AABB is still inside of it
+  int num_outside = 0;
+#pragma omp parallel for reduction(+ : num_outside)
+  for (int i = 0; i < num_shapes; i++) {
+    int3 gmin, gmax;
+    if (!function_Compute_AABB_BIN_Range(i, global_origin, bins_per_axis, inv_bin_size_vec, aabb_min_rigid,
+                                         aabb_max_rigid, gmin, gmax)) {
+      num_outside++;
+    }
+  }
+  if (num_outside > 0) {
+    return false;
+  }
+
+  thrust::constant_iterator<real3> offset(global_origin);
+  transform(aabb_min_rigid.begin(), aabb_min_rigid.end(), offset, aabb_min_rigid.begin(), thrust::minus<real3>());
+  transform(aabb_max_rigid.begin(), aabb_max_rigid.end(), offset, aabb_max_rigid.begin(), thrust::minus<real3>());
+
+  // Flag the shapes whose range of bins changed since the last step
+  shape_moved.resize(num_shapes);
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    int3 gmin = HashMin(aabb_min_rigid[i], inv_bin_size_vec);
+    int3 gmax = HashMax(aabb_max_rigid[i], inv_bin_size_vec);
+    int3 omin = shape_bin_min[i];
+    int3 omax = shape_bin_max[i];
+    // Shapes handled by the static BVH are never inserted into the bins
+    shape_moved[i] = !(use_static_bvh && static_rigid[i]) &&
+                     (gmin.x != omin.x || gmin.y != omin.y || gmin.z != omin.z || gmax.x != omax.x ||
+                      gmax.y != omax.y || gmax.z != omax.z);
+    shape_bin_min[i] = gmin;
+    shape_bin_max[i] = gmax;
+  }
+
+  moved_shapes.resize(num_shapes);
+  uint num_moved = thrust::copy_if(thrust::counting_iterator<uint>(0), thrust::counting_iterator<uint>(num_shapes),
+                                   shape_moved.begin(), moved_shapes.begin(), thrust::identity<uint>()) -
+                   moved_shapes.begin();
+  moved_shapes.resize(num_moved);
+
+  LOG(TRACE) << "Incremental broadphase: shapes that changed bins: " << num_moved;
+
+  if (num_moved == 0) {
+    FilterCandidatePairs();
+    return true;
+  }
+
+  // Remove the bin entries of the shapes that changed bins, this keeps the remaining entries sorted
+  custom_vector<uint> entry_moved(number_of_bin_intersections);
+#pragma omp parallel for
+  for (int i = 0; i < number_of_bin_intersections; i++) {
+    entry_moved[i] = shape_moved[aabb_number[i]];
+  }
+  uint num_kept =
+      thrust::remove_if(thrust::make_zip_iterator(thrust::make_tuple(bin_number.begin(), aabb_number.begin())),
+                        thrust::make_zip_iterator(thrust::make_tuple(bin_number.end(), aabb_number.end())),
+                        entry_moved.begin(), thrust::identity<uint>()) -
+      thrust::make_zip_iterator(thrust::make_tuple(bin_number.begin(), aabb_number.begin()));
+
+  // Re-insert the shapes that changed bins
+  custom_vector<uint> moved_count(num_moved + 1);
+  moved_count[num_moved] = 0;
+#pragma omp parallel for
+  for (int i = 0; i < num_moved; i++) {
+    int3 gmin = shape_bin_min[moved_shapes[i]];
+    int3 gmax = shape_bin_max[moved_shapes[i]];
+    moved_count[i] = (gmax.x - gmin.x + 1) * (gmax.y - gmin.y + 1) * (gmax.z - gmin.z + 1);
+  }
+  Thrust_Exclusive_Scan(moved_count);
+  uint num_new = moved_count.back();
+
+  custom_vector<uint> new_bin_number(num_new), new_aabb_number(num_new);
+#pragma omp parallel for
+  for (int i = 0; i < num_moved; i++) {
+    uint shape = moved_shapes[i];
+    int3 gmin = shape_bin_min[shape];
+    int3 gmax = shape_bin_max[shape];
+    uint count = moved_count[i];
+    for (int x = gmin.x; x <= gmax.x; x++) {
+      for (int y = gmin.y; y <= gmax.y; y++) {
+        for (int z = gmin.z; z <= gmax.z; z++) {
+          new_bin_number[count] = Hash_Bin(I3(x, y, z), bins_per_axis, morton_bins);
+          new_aabb_number[count] = shape;
+          count++;
+        }
+      }
+    }
+  }
+  SortBinKeys(new_bin_number, new_aabb_number, Hash_Max(bins_per_axis, morton_bins));
+
+  number_of_bin_intersections = num_kept + num_new;
+  custom_vector<uint> merged_bin_number(number_of_bin_intersections);
+  custom_vector<uint> merged_aabb_number(number_of_bin_intersections);
+  thrust::merge_by_key(bin_number.begin(), bin_number.begin() + num_kept, new_bin_number.begin(),
+                       new_bin_number.end(), aabb_number.begin(), new_aabb_number.begin(), merged_bin_number.begin(),
+                       merged_aabb_number.begin());
+  bin_number.swap(merged_bin_number);
+  aabb_number.swap(merged_aabb_number);
+
+  bin_active.resize(number_of_bin_intersections);
+  bin_start_index.resize(number_of_bin_intersections);
+  num_bins_active = Thrust_Reduce_By_Key(bin_number, bin_active, bin_start_index);
+  StoreBinOccupancy();
+  bin_start_index.resize(num_bins_active + 1);
+  bin_start_index[num_bins_active] = 0;
+  Thrust_Exclusive_Scan(bin_start_index);
+
+  // Drop the candidate pairs that involve a shape that changed bins
+  custom_vector<uint> pair_moved(candidate_pairs.size());
+#pragma omp parallel for
+  for (int i = 0; i < candidate_pairs.size(); i++) {
+    long long pair = candidate_pairs[i];
+    pair_moved[i] = shape_moved[int(pair >> 32)] || shape_moved[int(pair & 0xffffffff)];
+  }
+  uint num_kept_pairs =
+      thrust::remove_if(candidate_pairs.begin(), candidate_pairs.end(), pair_moved.begin(), thrust::identity<uint>()) -
+      candidate_pairs.begin();
+
+  // Generate the candidate pairs for the shapes that changed bins
+  num_contact.resize(num_moved + 1);
+  num_contact[num_moved] = 0;
+#pragma omp parallel for
+  for (int i = 0; i < num_moved; i++) {
+    uint shape = moved_shapes[i];
+    num_contact[i] = function_Count_Moved_Shape_Pairs(shape, bins_per_axis, morton_bins, shape_bin_min[shape],
+                                                      shape_bin_max[shape], shape_bin_min, num_bins_active,
+                                                      bin_active, bin_start_index, aabb_number, shape_moved,
+                                                      fam_data, obj_data_ID, 0);
+  }
+  Thrust_Exclusive_Scan(num_contact);
+  custom_vector<long long> new_pairs(num_contact.back());
+#pragma omp parallel for
+  for (int i = 0; i < num_moved; i++) {
+    uint shape = moved_shapes[i];
+    function_Count_Moved_Shape_Pairs(shape, bins_per_axis, morton_bins, shape_bin_min[shape], shape_bin_max[shape],
+                                     shape_bin_min, num_bins_active, bin_active, bin_start_index, aabb_number,
+                                     shape_moved, fam_data, obj_data_ID, new_pairs.data() + num_contact[i]);
+  }
+  // Every new pair is found once but the shape with the lower index is not always the one that moved
+  Thrust_Sort(new_pairs);
+  uint num_new_pairs = new_pairs.size();
+
+  custom_vector<long long> merged_pairs(num_kept_pairs + num_new_pairs);
+  thrust::merge(candidate_pairs.begin(), candidate_pairs.begin() + num_kept_pairs, new_pairs.begin(),
+                new_pairs.begin() + num_new_pairs, merged_pairs.begin());
+  candidate_pairs.swap(merged_pairs);
+
+  FilterCandidatePairs();
+  return true;
+}
+// =========================================================================================================
+void ChCBroadphase::FilterCandidatePairs() {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const host_vector<bool>& obj_active = data_manager->host_data.active_rigid;
+  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  host_vector<long long>& contact_pairs = data_manager->host_data.pair_rigid_rigid;
+
+  uint num_candidates = candidate_pairs.size();
+  custom_vector<uint> pair_valid(num_candidates);
+#pragma omp parallel for
+  for (int i = 0; i < num_candidates; i++) {
+    uint shapeA = int(candidate_pairs[i] >> 32);
+    uint shapeB = int(candidate_pairs[i] & 0xffffffff);
+    pair_valid[i] = (obj_active[obj_data_ID[shapeA]] || obj_active[obj_data_ID[shapeB]]) &&
+                    overlap(aabb_min_rigid[shapeA], aabb_max_rigid[shapeA], aabb_min_rigid[shapeB],
+                            aabb_max_rigid[shapeB]);
+  }
+  // copy_if is stable so the pair list stays sorted
+  contact_pairs.resize(num_candidates);
+  number_of_contacts_possible = thrust::copy_if(candidate_pairs.begin(), candidate_pairs.end(), pair_valid.begin(),
+                                                contact_pairs.begin(), thrust::identity<uint>()) -
+                                contact_pairs.begin();
+  contact_pairs.resize(number_of_contacts_possible);
+
+  LOG(TRACE) << "Number of candidate pairs: " << num_candidates;
+  LOG(TRACE) << "Number of possible collisions: " << number_of_contacts_possible;
+}
+// =========================================================================================================
+void ChCBroadphase::SortBinKeys(custom_vector<uint>& keys, custom_vector<uint>& values, uint max_key) {
+  if (!data_manager->settings.collision.use_radix_sort) {
+    Thrust_Sort_By_Key(keys, values);
+    return;
+  }
+  uint key_bits = 0;
+  while (key_bits < 32 && (max_key >> key_bits) != 0) {
+    key_bits++;
+  }
+  LOG(TRACE) << "Radix sort: key bits: " << key_bits;
+  function_Radix_Sort_By_Key(keys, values, radix_keys, radix_values, key_bits);
+}
+// =========================================================================================================
+void ChCBroadphase::StoreBinOccupancy() {
+  collision_measures& measures = data_manager->measures.collision;
+  measures.num_bins_active = num_bins_active;
+  measures.number_of_bin_intersections = number_of_bin_intersections;
+  const int num_buckets = collision_measures::num_occupancy_buckets;
+  uint* histogram = measures.occupancy_histogram;
+  std::fill(histogram, histogram + num_buckets, 0);
+  if (num_bins_active == 0) {
+    measures.max_bin_occupancy = 0;
+    measures.num_single_bins = 0;
+    return;
+  }
+  measures.max_bin_occupancy =
+      *thrust::max_element(bin_start_index.begin(), bin_start_index.begin() + num_bins_active);
+  measures.num_single_bins = thrust::count(bin_start_index.begin(), bin_start_index.begin() + num_bins_active, 1);
+
+  // Histogram of the (shape, bin) entries over the occupancy of their bin, bucket i holds the bins with 2^i to
+  // 2^(i+1)-1 shapes. Every thread fills its own histogram, they are summed at the end
+#pragma omp parallel
+  {
+    uint local_histogram[collision_measures::num_occupancy_buckets] = {0};
+#pragma omp for
+    for (int i = 0; i < (signed)num_bins_active; i++) {
+      uint occupancy = bin_start_index[i];
+      int bucket = 0;
+      while ((occupancy >>= 1) && bucket < num_buckets - 1) {
+        bucket++;
+      }
+      local_histogram[bucket] += bin_start_index[i];
+    }
+#pragma omp critical
+    for (int b = 0; b < num_buckets; b++) {
+      histogram[b] += local_histogram[b];
+    }
+  }
+}
+// =========================================================================================================
+bool ChCBroadphase::QueryBinRange(const real3& Amin, const real3& Amax, int3& gmin, int3& gmax) const {
+  const real3 inv_bin_size_vec = 1.0 / data_manager->measures.collision.bin_size_vec;
+  const int3& bins_per_axis = grid_bins_per_axis;
+  gmin = HashMin(Amin, inv_bin_size_vec);
+  gmax = HashMax(Amax, inv_bin_size_vec);
+  // A point or a flat box still covers the bin it lies in
+  gmax = I3(std::max(gmin.x, gmax.x), std::max(gmin.y, gmax.y), std::max(gmin.z, gmax.z));
+  if (gmax.x < 0 || gmax.y < 0 || gmax.z < 0 || gmin.x >= bins_per_axis.x || gmin.y >= bins_per_axis.y ||
+      gmin.z >= bins_per_axis.z) {
+    return false;
+  }
+  gmin = clamp(gmin, I3(0), bins_per_axis - I3(1));
+  gmax = clamp(gmax, I3(0), bins_per_axis - I3(1));
+  return true;
+}
+// =========================================================================================================
+template <typename Test>
+uint ChCBroadphase::QueryBins(int3 gmin, int3 gmax, Test test, uint* shapes) const {
+  const uint* active_begin = bin_active.data();
+  const uint* active_end = bin_active.data() + num_bins_active;
+  uint count = 0;
+  for (int k = gmin.z; k <= gmax.z; k++) {
+    for (int j = gmin.y; j <= gmax.y; j++) {
+      for (int i = gmin.x; i <= gmax.x; i++) {
+        uint bin = Hash_Bin(I3(i, j, k), grid_bins_per_axis, morton_bins);
+        const uint* found = std::lower_bound(active_begin, active_end, bin);
+        if (found == active_end || *found != bin)
+          continue;
+        uint index = found - active_begin;
+        for (uint e = bin_start_index[index]; e < bin_start_index[index + 1]; e++) {
+          uint shape = aabb_number[e];
+          // Same rule as for the pairs, the query box acts as the first shape
+          if (Hash_Bin(Hash_Owner(gmin, shape_bin_min[shape]), grid_bins_per_axis, morton_bins) != bin)
+            continue;
+          if (!test(shape))
+            continue;
+          if (shapes) {
+            shapes[count] = shape;
+          }
+          count++;
+        }
+      }
+    }
+  }
+  return count;
+}
+// =========================================================================================================
+uint ChCBroadphase::QueryAABB(const real3& Amin, const real3& Amax, uint* shapes) const {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+
+  if (!grid_ready) {
+    uint count = 0;
+    for (uint i = 0; i < aabb_min_rigid.size(); i++) {
+      if (static_excluded && static_rigid[i])
+        continue;
+      if (!overlap(Amin, Amax, aabb_min_rigid[i], aabb_max_rigid[i]))
+        continue;
+      if (shapes) {
+        shapes[count] = i;
+      }
+      count++;
+    }
+    return count;
+  }
+
+  int3 gmin, gmax;
+  if (!QueryBinRange(Amin, Amax, gmin, gmax)) {
+    return 0;
+  }
+  return QueryBins(gmin, gmax, [&](uint shape) {
+    return overlap(Amin, Amax, aabb_min_rigid[shape], aabb_max_rigid[shape]);
+  }, shapes);
+}
+// =========================================================================================================
+uint ChCBroadphase::QuerySphere(const real3& center, const real radius, uint* shapes) const {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+
+  if (!grid_ready) {
+    uint count = 0;
+    for (uint i = 0; i < aabb_min_rigid.size(); i++) {
+      if (static_excluded && static_rigid[i])
+        continue;
+      if (!overlap_sphere(center, radius, aabb_min_rigid[i], aabb_max_rigid[i]))
+        continue;
+      if (shapes) {
+        shapes[count] = i;
+      }
+      count++;
+    }
+    return count;
+  }
+
+  int3 gmin, gmax;
+  if (!QueryBinRange(center - R3(radius), center + R3(radius), gmin, gmax)) {
+    return 0;
+  }
+  return QueryBins(gmin, gmax, [&](uint shape) {
+    return overlap_sphere(center, radius, aabb_min_rigid[shape], aabb_max_rigid[shape]);
+  }, shapes);
+}
+// =========================================================================================================
+// Function to compute how a ray steps through the bins along one axis======================================
+inline void function_Ray_Step(const real origin,
+                              const real dir,
+                              const int cell,
+                              const real bin_size,
+                              int& step,
+                              real& t_next,
+                              real& t_delta) {
+  if (dir > 0) {
+    step = 1;
+    t_next = ((cell + 1) * bin_size - origin) / dir;
+    t_delta = bin_size / dir;
+  } else if (dir < 0) {
+    step = -1;
+    t_next = (cell * bin_size - origin) / dir;
+    t_delta = -bin_size / dir;
+  } else {
+    step = 0;
+    t_next = LARGE_REAL;
+    t_delta = LARGE_REAL;
+  }
+}
+// =========================================================================================================
+// The bins crossed by the segment are visited in order with a 3D DDA, only the part of the segment inside
+// of the grid is traversed
+void ChCBroadphase::QueryRay(const real3& from,
+                             const real3& to,
+                             std::vector<std::pair<real, uint> >& hits) const {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  const real3& bin_size_vec = data_manager->measures.collision.bin_size_vec;
+  const int3& bins_per_axis = grid_bins_per_axis;
+  const real3 dir = to - from;
+  real tmin, tmax;
+
+  if (!grid_ready) {
+    for (uint i = 0; i < aabb_min_rigid.size(); i++) {
+      if (static_excluded && static_rigid[i])
+        continue;
+      if (overlap_ray(from, dir, aabb_min_rigid[i], aabb_max_rigid[i], tmin, tmax)) {
+        hits.push_back(std::make_pair(tmin, i));
+      }
+    }
+    return;
+  }
+
+  const real3 grid_max = bin_size_vec * R3(bins_per_axis.x, bins_per_axis.y, bins_per_axis.z);
+  real t_start, t_end;
+  if (!overlap_ray(from, dir, R3(0), grid_max, t_start, t_end)) {
+    return;
+  }
+  int3 cell = HashMin(from + dir * t_start, 1.0 / bin_size_vec);
+  cell = clamp(cell, I3(0), bins_per_axis - I3(1));
+
+  int3 step;
+  real3 t_next, t_delta;
+  function_Ray_Step(from.x, dir.x, cell.x, bin_size_vec.x, step.x, t_next.x, t_delta.x);
+  function_Ray_Step(from.y, dir.y, cell.y, bin_size_vec.y, step.y, t_next.y, t_delta.y);
+  function_Ray_Step(from.z, dir.z, cell.z, bin_size_vec.z, step.z, t_next.z, t_delta.z);
+
+  const uint* active_begin = bin_active.data();
+  const uint* active_end = bin_active.data() + num_bins_active;
+  // A segment crosses at most one bin per step along each axis
+  const int max_steps = bins_per_axis.x + bins_per_axis.y + bins_per_axis.z;
+  for (int s = 0; s <= max_steps; s++) {
+    uint bin = Hash_Bin(cell, bins_per_axis, morton_bins);
+    const uint* found = std::lower_bound(active_begin, active_end, bin);
+    if (found != active_end && *found == bin) {
+      uint index = found - active_begin;
+      for (uint e = bin_start_index[index]; e < bin_start_index[index + 1]; e++) {
+        uint shape = aabb_number[e];
+        if (overlap_ray(from, dir, aabb_min_rigid[shape], aabb_max_rigid[shape], tmin, tmax)) {
+          hits.push_back(std::make_pair(tmin, shape));
+        }
+      }
+    }
+    // Move to the next bin along the axis whose boundary is crossed first
+    if (t_next.x <= t_next.y && t_next.x <= t_next.z) {
+      if (t_next.x > t_end)
+        break;
+      cell.x += step.x;
+      t_next.x += t_delta.x;
+    } else if (t_next.y <= t_next.z) {
+      if (t_next.y > t_end)
+        break;
+      cell.y += step.y;
+      t_next.y += t_delta.y;
+    } else {
+      if (t_next.z > t_end)
+        break;
+      cell.z += step.z;
+      t_next.z += t_delta.z;
+    }
+    if (cell.x < 0 || cell.y < 0 || cell.z < 0 || cell.x >= bins_per_axis.x || cell.y >= bins_per_axis.y ||
+        cell.z >= bins_per_axis.z) {
+      break;
+    }
+  }
 }
 }
 }
@@ -18,6 +18,9 @@
 #ifndef CHC_BROADPHASE_H
 #define CHC_BROADPHASE_H
 
+#include <vector>
+#include <utility>
+
 #include "chrono_parallel/ChParallelDefines.h"
 #include "chrono_parallel/math/ChParallelMath.h"
 #include "chrono_parallel/ChDataManager.h"
@@ -31,8 +34,63 @@ class CH_PARALLEL_API ChCBroadphase {
   // functions
   ChCBroadphase();
   void DetectPossibleCollisions();
+  // Discard the state kept by the incremental broadphase, the next step does a
+  // full rebuild
+  void ResetIncremental() { grid_valid = false; }
+  // Discard the bins used by the spatial queries as well, must be called when
+  // the shapes are reordered
+  void Reset() {
+    grid_valid = false;
+    grid_ready = false;
+    static_excluded = false;
+  }
+
+  // Spatial queries against the AABBs of the last call to
+  // DetectPossibleCollisions. Positions are given in the shifted coordinates
+  // of the broadphase (see global_origin). The bins of the uniform grid are
+  // used when available, otherwise every shape is tested. Shapes handled by the
+  // static BVH are not reported. Shapes are stored if shapes is not null, the
+  // number of shapes found is returned.
+  uint QueryAABB(const real3& Amin, const real3& Amax, uint* shapes) const;
+  uint QuerySphere(const real3& center, const real radius, uint* shapes) const;
+  // Append the shapes whose AABB is hit by the segment from-to along with the
+  // fraction of the segment where it enters the AABB. A shape spanning several
+  // bins can be appended more than once.
+  void QueryRay(const real3& from, const real3& to, std::vector<std::pair<real, uint> >& hits) const;
+
   ChParallelDataManager* data_manager;
  private:
+  // Compute the bounding box of all AABBs and the grid resolution, the AABBs
+  // are shifted so that the origin of the grid is at zero
+  void ComputeGrid();
+  // Uniform grid broadphase
+  void DetectPossibleCollisionsGrid();
+  // Multi-level grid broadphase, every shape is placed into the level whose
+  // bin size matches its AABB, pairs are tested within and across levels
+  void DetectPossibleCollisionsHierarchical();
+  // Sweep and prune broadphase, the order of the AABBs from the previous step
+  // is updated with an insertion sort
+  void DetectPossibleCollisionsSAP();
+  // Try to update the bins and the pair list from the previous step, only
+  // shapes that changed bins are re-inserted. Returns false if the grid from
+  // the previous step can no longer be used and a full rebuild is needed.
+  bool UpdateIncremental();
+  // Fill the list of pairs sent to the narrowphase using the persistent list of
+  // candidate pairs, inactive pairs and pairs that do not overlap are removed.
+  void FilterCandidatePairs();
+  // Sort the bin keys along with the shape indices, max_key is the largest
+  // key that can be present and bounds the number of radix sort passes
+  void SortBinKeys(custom_vector<uint>& keys, custom_vector<uint>& values, uint max_key);
+  // Store the occupancy of the bins in the collision measures, must be called
+  // while bin_start_index holds the number of shapes in every active bin
+  void StoreBinOccupancy();
+  // Call test(shape) for every shape stored in the bins from gmin to gmax, the
+  // shapes are returned in the bin that owns them so every shape is found once
+  template <typename Test>
+  uint QueryBins(int3 gmin, int3 gmax, Test test, uint* shapes) const;
+  // Range of bins covered by a query box, returns false if it misses the grid
+  bool QueryBinRange(const real3& Amin, const real3& Amax, int3& gmin, int3& gmax) const;
+
   uint num_bins_active;
   uint number_of_bin_intersections;
   uint number_of_contacts_possible;
@@ -42,7 +100,45 @@ class CH_PARALLEL_API ChCBroadphase {
   custom_vector<uint> aabb_number;
   custom_vector<uint> bin_start_index;
   custom_vector<uint> num_contact;
+  // Unique bin keys for each active bin, bin_start_index has the offsets
+  custom_vector<uint> bin_active;
+
+  // Level of every shape, bins and hash offsets for every level of the
+  // hierarchical grid
+  custom_vector<int> shape_level;
+  custom_vector<int3> level_bins;
+  custom_vector<uint> level_offset;
+
+  // Sorted order of the shapes and their extents along the sweep axis
+  int sap_axis;
+  custom_vector<uint> sap_order;
+  custom_vector<real> sap_min;
+  custom_vector<real> sap_max;
+
+  // Temporary storage for the radix sort
+  custom_vector<uint> radix_keys;
+  custom_vector<uint> radix_values;
+
+  // True if the bins of the uniform grid are hashed in Morton order
+  bool morton_bins;
+
+  // Range of bins spanned by every shape, used to find the bin that owns a pair
+  custom_vector<int3> shape_bin_min;
+  custom_vector<int3> shape_bin_max;
+
+  // True if the bins of the uniform grid match the current AABBs and can be
+  // used by the spatial queries
+  bool grid_ready;
+  // True if the shapes of fixed bodies were left to the static BVH
+  bool static_excluded;
 
+  // Persistent state used by the incremental broadphase
+  bool grid_valid;
+  uint last_num_shapes;
+  int3 grid_bins_per_axis;
+  custom_vector<uint> shape_moved;
+  custom_vector<uint> moved_shapes;
+  custom_vector<long long> candidate_pairs;
 };
 }
 }
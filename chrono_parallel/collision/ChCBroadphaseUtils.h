@@ -17,6 +17,8 @@
 #ifndef CHC_BROADPHASEUTILS_H
 #define CHC_BROADPHASEUTILS_H
 
+#include <algorithm>
+
 #include "chrono_parallel/ChParallelDefines.h"
 #include "chrono_parallel/math/ChParallelMath.h"
 #include "chrono_parallel/ChDataManager.h"
@@ -67,6 +69,28 @@ inline int3 HashMax(const T& A, const real3& inv_bin_size_vec) {
 inline uint Hash_Index(const int3& A, int3 bins_per_axis) {
   return ((A.z * bins_per_axis.y) * bins_per_axis.x) + (A.y * bins_per_axis.x) + A.x;
 }
+// Spread the lower 10 bits of a value so that there are two zero bits between each of them
+inline uint Morton_Spread(uint x) {
+  x &= 0x000003ff;
+  x = (x | (x << 16)) & 0x030000ff;
+  x = (x | (x << 8)) & 0x0300f00f;
+  x = (x | (x << 4)) & 0x030c30c3;
+  x = (x | (x << 2)) & 0x09249249;
+  return x;
+}
+// Convert a bin index into a hash value by interleaving the bits of its coordinates (Morton order), at most
+// 1024 bins are supported along each axis
+inline uint Hash_Morton(const int3& A) {
+  return Morton_Spread(A.x) | (Morton_Spread(A.y) << 1) | (Morton_Spread(A.z) << 2);
+}
+// Convert a bin index into a hash value using either ordering
+inline uint Hash_Bin(const int3& A, const int3& bins_per_axis, const bool morton) {
+  return morton ? Hash_Morton(A) : Hash_Index(A, bins_per_axis);
+}
+// Largest hash value of a grid
+inline uint Hash_Max(const int3& bins_per_axis, const bool morton) {
+  return Hash_Bin(bins_per_axis - I3(1, 1, 1), bins_per_axis, morton);
+}
 // Decodes a hash into it's associated bin position
 inline int3 Hash_Decode(uint hash, int3 bins_per_axis) {
   int3 decoded_hash;
@@ -76,6 +100,12 @@ inline int3 Hash_Decode(uint hash, int3 bins_per_axis) {
   return decoded_hash;
 }
 
+// Bin that owns the pair made of two AABBs given the first bin of each. This is the minimum corner of the
+// intersection of their bin ranges, a pair is only reported in this bin so that it is found once.
+inline int3 Hash_Owner(const int3& gmin_A, const int3& gmin_B) {
+  return I3(std::max(gmin_A.x, gmin_B.x), std::max(gmin_A.y, gmin_B.y), std::max(gmin_A.z, gmin_B.z));
+}
+
 // AABB COLLISION FUNCTIONS ================================================================================
 
 // Check if two bodies interact using their collision family data.
@@ -92,6 +122,38 @@ inline bool overlap(real3 Amin, real3 Amax, real3 Bmin, real3 Bmax) {
          (Amin.z <= Bmax.z && Bmin.z <= Amax.z);
 }
 
+// Check if a sphere overlaps an AABB, the closest point of the AABB to the center is compared with the radius.
+inline bool overlap_sphere(real3 center, real radius, real3 Bmin, real3 Bmax) {
+  real3 closest = R3(clamp(center.x, Bmin.x, Bmax.x), clamp(center.y, Bmin.y, Bmax.y),
+                     clamp(center.z, Bmin.z, Bmax.z));
+  real3 d = closest - center;
+  return dot(d, d) <= radius * radius;
+}
+
+// Intersect the segment from + t * dir, t in [0, 1] with an AABB using the slab test. Returns false if the
+// segment misses the AABB, otherwise tmin and tmax hold the range of t inside of the AABB.
+inline bool overlap_ray(real3 from, real3 dir, real3 Bmin, real3 Bmax, real& tmin, real& tmax) {
+  tmin = 0;
+  tmax = 1;
+  for (int i = 0; i < 3; i++) {
+    real o = from.array[i];
+    real d = dir.array[i];
+    if (fabs(d) < ZERO_EPSILON) {
+      // Parallel to the slab, the origin has to be inside of it
+      if (o < Bmin.array[i] || o > Bmax.array[i])
+        return false;
+      continue;
+    }
+    real t1 = (Bmin.array[i] - o) / d;
+    real t2 = (Bmax.array[i] - o) / d;
+    tmin = std::max(tmin, std::min(t1, t2));
+    tmax = std::min(tmax, std::max(t1, t2));
+    if (tmin > tmax)
+      return false;
+  }
+  return true;
+}
+
 // Grid Size FUNCTIONS =====================================================================================
 
 // for a given number of aabbs in a grid, the grids maximum and minimum point along with the density factor
@@ -108,9 +170,19 @@ static int3 function_Compute_Grid_Resolution(uint num_aabb, real3 d, real k = .1
   return grid_size;
 }
 
+// scale the number of bins per axis by the factor chosen by the bin tuner, keeping at least one and at most
+// 1024 bins per axis. A factor of one leaves the grid unchanged
+static int3 function_Scale_Grid_Resolution(int3 grid_size, real scale) {
+  if (scale == 1) {
+    return grid_size;
+  }
+  int3 scaled = I3(int(grid_size.x * scale + 0.5), int(grid_size.y * scale + 0.5), int(grid_size.z * scale + 0.5));
+  return clamp(scaled, I3(1), I3(1024));
+}
+
 // =========================================================================================================
 
-bool function_Check_Sphere(real3 pos_a, real3 pos_b, real radius) {
+inline bool function_Check_Sphere(real3 pos_a, real3 pos_b, real radius) {
   real3 delta = pos_b - pos_a;
   real dist2 = dot(delta, delta);
   real radSum = radius + radius;
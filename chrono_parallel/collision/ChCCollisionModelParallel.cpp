@@ -14,6 +14,9 @@
 //
 // Description: class for a parallel collision model
 // =============================================================================
+#include <algorithm>
+#include <set>
+
 #include "chrono_parallel/collision/ChCCollisionModelParallel.h"
 #include "physics/ChBody.h"
 #include "physics/ChBodyAuxRef.h"
@@ -36,6 +39,16 @@ int ChCollisionModelParallel::ClearModel() {
   }
 
   mData.clear();
+  local_convex_data.clear();
+  local_convex_adjacency.clear();
+  local_convex_neighbors.clear();
+  local_mesh_vertices.clear();
+  local_mesh_triangles.clear();
+  local_mesh_node_min.clear();
+  local_mesh_node_max.clear();
+  local_mesh_node_start.clear();
+  local_mesh_node_count.clear();
+  local_heightfield_data.clear();
   nObjects = 0;
   family_group = 1;
   family_mask = 0x7FFF;
@@ -371,6 +384,151 @@ bool ChCollisionModelParallel::AddCapsule(double radius, double hlen, const ChVe
   return true;
 }
 
+// Face of the incremental convex hull, its vertices are counterclockwise when
+// seen from outside
+struct HullFace {
+  int v[3];
+  ChVector<> n;
+  double d;
+  bool live;
+};
+
+static HullFace MakeHullFace(const std::vector<ChVector<double> >& points, int a, int b, int c) {
+  HullFace face;
+  face.v[0] = a;
+  face.v[1] = b;
+  face.v[2] = c;
+  face.n = Vcross(points[b] - points[a], points[c] - points[a]);
+  face.n.Normalize();
+  face.d = Vdot(face.n, points[a]);
+  face.live = true;
+  return face;
+}
+
+// Compute the edges of the convex hull of a set of points with an incremental
+// hull. The hull vertices are returned first in 'order', followed by the points
+// that are inside the hull or on its faces. Returns false if the points do not
+// span a volume.
+static bool ComputeHullEdges(const std::vector<ChVector<double> >& points,
+                             std::vector<int>& order,
+                             std::vector<std::pair<int, int> >& edges) {
+  int num = points.size();
+  if (num < 4) {
+    return false;
+  }
+
+  ChVector<> lo = points[0];
+  ChVector<> hi = points[0];
+  for (int i = 1; i < num; i++) {
+    lo = ChVector<>(std::min(lo.x, points[i].x), std::min(lo.y, points[i].y), std::min(lo.z, points[i].z));
+    hi = ChVector<>(std::max(hi.x, points[i].x), std::max(hi.y, points[i].y), std::max(hi.z, points[i].z));
+  }
+  double eps = 1e-9 * (hi - lo).Length();
+
+  // Initial tetrahedron: the point farthest from the first one, the point
+  // farthest from their line and the point farthest from their plane
+  int i0 = 0, i1 = 0, i2 = 0, i3 = 0;
+  double best = 0;
+  for (int i = 1; i < num; i++) {
+    double dist = (points[i] - points[i0]).Length();
+    if (dist > best) {
+      best = dist;
+      i1 = i;
+    }
+  }
+  if (best <= eps) {
+    return false;
+  }
+  ChVector<> axis = points[i1] - points[i0];
+  axis.Normalize();
+  best = 0;
+  for (int i = 0; i < num; i++) {
+    double dist = Vcross(points[i] - points[i0], axis).Length();
+    if (dist > best) {
+      best = dist;
+      i2 = i;
+    }
+  }
+  if (best <= eps) {
+    return false;
+  }
+  ChVector<> normal = Vcross(points[i1] - points[i0], points[i2] - points[i0]);
+  normal.Normalize();
+  best = 0;
+  for (int i = 0; i < num; i++) {
+    double dist = std::abs(Vdot(points[i] - points[i0], normal));
+    if (dist > best) {
+      best = dist;
+      i3 = i;
+    }
+  }
+  if (best <= eps) {
+    return false;
+  }
+
+  ChVector<> centroid = (points[i0] + points[i1] + points[i2] + points[i3]) * 0.25;
+  std::vector<HullFace> faces;
+  int tetra[4][3] = {{i0, i1, i2}, {i0, i1, i3}, {i0, i2, i3}, {i1, i2, i3}};
+  for (int f = 0; f < 4; f++) {
+    HullFace face = MakeHullFace(points, tetra[f][0], tetra[f][1], tetra[f][2]);
+    if (Vdot(face.n, centroid) - face.d > 0) {
+      face = MakeHullFace(points, tetra[f][0], tetra[f][2], tetra[f][1]);
+    }
+    faces.push_back(face);
+  }
+
+  // Add the points one by one, the faces they see are replaced by a fan of
+  // faces joining the point to the horizon
+  for (int i = 0; i < num; i++) {
+    if (i == i0 || i == i1 || i == i2 || i == i3) {
+      continue;
+    }
+    std::set<std::pair<int, int> > visible_edges;
+    for (int f = 0; f < faces.size(); f++) {
+      HullFace& face = faces[f];
+      if (face.live && Vdot(face.n, points[i]) - face.d > eps) {
+        face.live = false;
+        for (int k = 0; k < 3; k++) {
+          visible_edges.insert(std::make_pair(face.v[k], face.v[(k + 1) % 3]));
+        }
+      }
+    }
+    for (std::set<std::pair<int, int> >::iterator it = visible_edges.begin(); it != visible_edges.end(); ++it) {
+      if (visible_edges.count(std::make_pair(it->second, it->first)) == 0) {
+        faces.push_back(MakeHullFace(points, it->first, it->second, i));
+      }
+    }
+  }
+
+  std::vector<bool> on_hull(num, false);
+  std::set<std::pair<int, int> > hull_edges;
+  for (int f = 0; f < faces.size(); f++) {
+    if (!faces[f].live) {
+      continue;
+    }
+    for (int k = 0; k < 3; k++) {
+      int a = faces[f].v[k];
+      int b = faces[f].v[(k + 1) % 3];
+      on_hull[a] = true;
+      hull_edges.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+    }
+  }
+
+  order.clear();
+  for (int i = 0; i < num; i++) {
+    if (on_hull[i]) {
+      order.push_back(i);
+    }
+  }
+  for (int i = 0; i < num; i++) {
+    if (!on_hull[i]) {
+      order.push_back(i);
+    }
+  }
+  edges.assign(hull_edges.begin(), hull_edges.end());
+  return true;
+}
+
 bool ChCollisionModelParallel::AddConvexHull(std::vector<ChVector<double> >& pointlist,
                                              const ChVector<>& pos,
                                              const ChMatrix33<>& rot) {
@@ -392,8 +550,81 @@ bool ChCollisionModelParallel::AddConvexHull(std::vector<ChVector<double> >& poi
   mData.push_back(tData);
   total_volume += 0;
 
-  for (int i = 0; i < pointlist.size(); i++) {
-    local_convex_data.push_back(R3(pointlist[i].x, pointlist[i].y, pointlist[i].z));
+  // Hull adjacency used by the support function. If the points are flat every
+  // point is a neighbor of every other one, which amounts to a linear scan.
+  int num_points = pointlist.size();
+  std::vector<int> order;
+  std::vector<std::pair<int, int> > edges;
+  if (!ComputeHullEdges(pointlist, order, edges)) {
+    order.clear();
+    edges.clear();
+    for (int i = 0; i < num_points; i++) {
+      order.push_back(i);
+      for (int j = i + 1; j < num_points; j++) {
+        edges.push_back(std::make_pair(i, j));
+      }
+    }
+  }
+
+  // Position of every point in the stored order
+  std::vector<int> rank(num_points);
+  for (int i = 0; i < num_points; i++) {
+    rank[order[i]] = i;
+  }
+  std::vector<std::vector<int> > adjacency(num_points);
+  for (int e = 0; e < edges.size(); e++) {
+    int a = rank[edges[e].first];
+    int b = rank[edges[e].second];
+    adjacency[a].push_back(b);
+    adjacency[b].push_back(a);
+  }
+
+  for (int i = 0; i < num_points; i++) {
+    const ChVector<double>& p = pointlist[order[i]];
+    local_convex_data.push_back(R3(p.x, p.y, p.z));
+    local_convex_adjacency.push_back(I2(local_convex_neighbors.size(), adjacency[i].size()));
+    local_convex_neighbors.insert(local_convex_neighbors.end(), adjacency[i].begin(), adjacency[i].end());
+  }
+
+  LOG(TRACE) << "AddConvexHull: " << num_points << " points, " << edges.size() << " hull edges";
+
+  return true;
+}
+
+bool ChCollisionModelParallel::AddHeightfield(int num_x,
+                                              int num_y,
+                                              double spacing_x,
+                                              double spacing_y,
+                                              const std::vector<double>& heights,
+                                              const ChVector<>& pos,
+                                              const ChMatrix33<>& rot) {
+  if (num_x < 2 || num_y < 2 || heights.size() != size_t(num_x * num_y)) {
+    return false;
+  }
+
+  ChFrame<> frame;
+  TransformToCOG(GetBody(), pos, rot, frame);
+
+  // The shape frame is moved to the middle of the range of heights so that
+  // the bounding box of the heightfield is symmetric
+  double hmin = *std::min_element(heights.begin(), heights.end());
+  double hmax = *std::max_element(heights.begin(), heights.end());
+  double hmid = (hmin + hmax) / 2;
+  ChVector<> position = frame.TransformPointLocalToParent(ChVector<>(0, 0, hmid));
+  const ChQuaternion<>& rotation = frame.GetRot();
+
+  nObjects++;
+  ConvexShape tData;
+  tData.A = R3(position.x, position.y, position.z);
+  tData.B = R3(num_x, num_y, local_heightfield_data.size());
+  tData.C = R3(spacing_x, spacing_y, (hmax - hmin) / 2);
+  tData.R = R4(rotation.e0, rotation.e1, rotation.e2, rotation.e3);
+  tData.type = HEIGHTFIELD;
+  tData.margin = model_safe_margin;
+  mData.push_back(tData);
+
+  for (int i = 0; i < heights.size(); i++) {
+    local_heightfield_data.push_back(heights[i] - hmid);
   }
 
   return true;
@@ -410,6 +641,107 @@ bool ChCollisionModelParallel::AddBarrel(double Y_low,
   return false;
 }
 
+// Maximum number of triangles stored in a leaf of a mesh hierarchy
+#define MESH_LEAF_SIZE 4
+
+// Build the hierarchy of the triangles first to first + num of a model. Every
+// node is split at the median of the triangle centers along the longest axis
+// of its bounds, as for the static BVH. The triangles are reordered so that
+// every leaf refers to a contiguous range. Returns the index of the root.
+static uint BuildMeshBVH(const std::vector<real3>& vertices,
+                         std::vector<int3>& triangles,
+                         uint first,
+                         uint num,
+                         std::vector<real3>& node_min,
+                         std::vector<real3>& node_max,
+                         std::vector<uint>& node_start,
+                         std::vector<uint>& node_count) {
+  std::vector<real3> tri_min(num), tri_max(num), center(num);
+  std::vector<uint> order(num);
+  for (uint i = 0; i < num; i++) {
+    const int3& t = triangles[first + i];
+    const real3& A = vertices[t.x];
+    const real3& B = vertices[t.y];
+    const real3& C = vertices[t.z];
+    tri_min[i] = R3(std::min(A.x, std::min(B.x, C.x)), std::min(A.y, std::min(B.y, C.y)),
+                    std::min(A.z, std::min(B.z, C.z)));
+    tri_max[i] = R3(std::max(A.x, std::max(B.x, C.x)), std::max(A.y, std::max(B.y, C.y)),
+                    std::max(A.z, std::max(B.z, C.z)));
+    center[i] = (tri_min[i] + tri_max[i]) * real(0.5);
+    order[i] = i;
+  }
+
+  uint root = node_min.size();
+  node_min.push_back(R3(0));
+  node_max.push_back(R3(0));
+  node_start.push_back(0);
+  node_count.push_back(0);
+
+  // Nodes to process along with the range of triangles they contain
+  std::vector<int3> stack;
+  stack.push_back(I3(root, 0, num));
+  while (!stack.empty()) {
+    int3 item = stack.back();
+    stack.pop_back();
+    uint node = item.x;
+    uint start = item.y;
+    uint end = item.z;
+
+    real3 bmin = tri_min[order[start]];
+    real3 bmax = tri_max[order[start]];
+    real3 cmin = center[order[start]];
+    real3 cmax = cmin;
+    for (uint i = start + 1; i < end; i++) {
+      uint t = order[i];
+      bmin = R3(std::min(bmin.x, tri_min[t].x), std::min(bmin.y, tri_min[t].y), std::min(bmin.z, tri_min[t].z));
+      bmax = R3(std::max(bmax.x, tri_max[t].x), std::max(bmax.y, tri_max[t].y), std::max(bmax.z, tri_max[t].z));
+      cmin = R3(std::min(cmin.x, center[t].x), std::min(cmin.y, center[t].y), std::min(cmin.z, center[t].z));
+      cmax = R3(std::max(cmax.x, center[t].x), std::max(cmax.y, center[t].y), std::max(cmax.z, center[t].z));
+    }
+    node_min[node] = bmin;
+    node_max[node] = bmax;
+
+    if (end - start <= MESH_LEAF_SIZE) {
+      node_start[node] = first + start;
+      node_count[node] = end - start;
+      continue;
+    }
+
+    real3 extent = cmax - cmin;
+    int axis = 0;
+    if (extent.y > extent.x && extent.y >= extent.z) {
+      axis = 1;
+    } else if (extent.z > extent.x && extent.z > extent.y) {
+      axis = 2;
+    }
+
+    uint mid = (start + end) / 2;
+    std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                     [&center, axis](uint a, uint b) { return center[a].array[axis] < center[b].array[axis]; });
+
+    uint left = node_min.size();
+    node_start[node] = left;
+    node_count[node] = 0;
+    for (int c = 0; c < 2; c++) {
+      node_min.push_back(R3(0));
+      node_max.push_back(R3(0));
+      node_start.push_back(0);
+      node_count.push_back(0);
+    }
+    stack.push_back(I3(left, start, mid));
+    stack.push_back(I3(left + 1, mid, end));
+  }
+
+  // Store the triangles in leaf order
+  std::vector<int3> sorted(num);
+  for (uint i = 0; i < num; i++) {
+    sorted[i] = triangles[first + order[i]];
+  }
+  std::copy(sorted.begin(), sorted.end(), triangles.begin() + first);
+
+  return root;
+}
+
 /// Add a triangle mesh to this model
 bool ChCollisionModelParallel::AddTriangleMesh(const geometry::ChTriangleMesh& trimesh,
                                                bool is_static,
@@ -418,22 +750,67 @@ bool ChCollisionModelParallel::AddTriangleMesh(const geometry::ChTriangleMesh& t
                                                const ChMatrix33<>& rot) {
   ChFrame<> frame;
   TransformToCOG(GetBody(), pos, rot, frame);
-  const ChVector<>& position = frame.GetPos();
-  const ChQuaternion<>& rotation = frame.GetRot();
 
-  nObjects += trimesh.getNumTriangles();
-  ConvexShape tData;
-  for (int i = 0; i < trimesh.getNumTriangles(); i++) {
+  int num_triangles = trimesh.getNumTriangles();
+  if (num_triangles == 0) {
+    return false;
+  }
+
+  // Express the vertices in the body frame and merge the vertices shared by
+  // several triangles
+  std::vector<real3> corners(3 * num_triangles);
+  for (int i = 0; i < num_triangles; i++) {
     geometry::ChTriangle temptri = trimesh.getTriangle(i);
-    tData.A = R3(temptri.p1.x + position.x, temptri.p1.y + position.y, temptri.p1.z + position.z);
-    tData.B = R3(temptri.p2.x + position.x, temptri.p2.y + position.y, temptri.p2.z + position.z);
-    tData.C = R3(temptri.p3.x + position.x, temptri.p3.y + position.y, temptri.p3.z + position.z);
-    tData.R = R4(rotation.e0, rotation.e1, rotation.e2, rotation.e3);
-    tData.type = TRIANGLEMESH;
-    tData.margin = model_safe_margin;
-    mData.push_back(tData);
+    ChVector<> p1 = frame.TransformPointLocalToParent(temptri.p1);
+    ChVector<> p2 = frame.TransformPointLocalToParent(temptri.p2);
+    ChVector<> p3 = frame.TransformPointLocalToParent(temptri.p3);
+    corners[3 * i + 0] = R3(p1.x, p1.y, p1.z);
+    corners[3 * i + 1] = R3(p2.x, p2.y, p2.z);
+    corners[3 * i + 2] = R3(p3.x, p3.y, p3.z);
+  }
+
+  std::vector<uint> order(corners.size());
+  for (uint i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&corners](uint a, uint b) {
+    const real3& A = corners[a];
+    const real3& B = corners[b];
+    return A.x < B.x || (A.x == B.x && (A.y < B.y || (A.y == B.y && A.z < B.z)));
+  });
+
+  uint first_vertex = local_mesh_vertices.size();
+  std::vector<int> vertex_index(corners.size());
+  for (uint i = 0; i < order.size(); i++) {
+    const real3& v = corners[order[i]];
+    if (i == 0 || !(v == corners[order[i - 1]])) {
+      local_mesh_vertices.push_back(v);
+    }
+    vertex_index[order[i]] = local_mesh_vertices.size() - 1;
+  }
+
+  uint first_triangle = local_mesh_triangles.size();
+  for (int i = 0; i < num_triangles; i++) {
+    local_mesh_triangles.push_back(I3(vertex_index[3 * i + 0], vertex_index[3 * i + 1], vertex_index[3 * i + 2]));
   }
 
+  uint root = BuildMeshBVH(local_mesh_vertices, local_mesh_triangles, first_triangle, num_triangles,
+                           local_mesh_node_min, local_mesh_node_max, local_mesh_node_start, local_mesh_node_count);
+
+  LOG(TRACE) << "AddTriangleMesh: " << num_triangles << " triangles, "
+             << local_mesh_vertices.size() - first_vertex << " vertices, "
+             << local_mesh_node_min.size() - root << " nodes";
+
+  nObjects++;
+  ConvexShape tData;
+  tData.A = R3(0, 0, 0);
+  tData.B = R3(num_triangles, root, 0);
+  tData.C = R3(0, 0, 0);
+  tData.R = R4(1, 0, 0, 0);
+  tData.type = TRIANGLEMESH_BVH;
+  tData.margin = model_safe_margin;
+  mData.push_back(tData);
+
   return true;
 }
 
@@ -126,6 +126,8 @@ class CH_PARALLEL_API ChCollisionModelParallel : public ChCollisionModel {
                           const ChVector<>& pos = ChVector<>(),
                           const ChMatrix33<>& rot = ChMatrix33<>(1));
 
+  /// Add a convex hull to this model. The adjacency of the hull vertices is computed here so that
+  /// support points are found by hill climbing, the points inside the hull are stored after them.
   virtual bool AddConvexHull(std::vector<ChVector<double> >& pointlist,
                              const ChVector<>& pos = ChVector<>(),
                              const ChMatrix33<>& rot = ChMatrix33<>(1));
@@ -135,6 +137,8 @@ class CH_PARALLEL_API ChCollisionModelParallel : public ChCollisionModel {
   /// classes, maybe the triangle is referenced via a striding interface or just copied)
   /// Note: if possible, in sake of high performance, avoid triangle meshes and prefer simplified
   /// representations as compounds of convex shapes of boxes/spheres/etc.. type.
+  /// The mesh is stored as a single shape: its vertices are kept in the body frame and a bounding
+  /// volume hierarchy is built here, the narrowphase only tests the triangles close to the other shape.
   virtual bool AddTriangleMesh(
       const geometry::ChTriangleMesh& trimesh,  ///< the triangle mesh
       bool is_static,  ///< true only if model doesn't move (es.a terrain). May improve performance
@@ -143,6 +147,18 @@ class CH_PARALLEL_API ChCollisionModelParallel : public ChCollisionModel {
       const ChMatrix33<>& rot = ChMatrix33<>(1)  ///< the rotation of the mesh - matrix must be orthogonal
       );
 
+  /// Add a heightfield to this model, for collision purposes. The heights are given on a regular
+  /// grid of num_x by num_y points (x varying fastest) with the given spacings. The grid is centered
+  /// at pos in the XY plane of rot and the heights are along its Z axis. Only sphere, box and
+  /// capsule shapes collide with a heightfield.
+  bool AddHeightfield(int num_x,
+                      int num_y,
+                      double spacing_x,
+                      double spacing_y,
+                      const std::vector<double>& heights,
+                      const ChVector<>& pos = ChVector<>(),
+                      const ChMatrix33<>& rot = ChMatrix33<>(1));
+
   /// Add a barrel-like shape to this model (main axis on Y direction), for collision purposes.
   /// The barrel shape is made by lathing an arc of an ellipse around the vertical Y axis.
   /// The center of the ellipse is on Y=0 level, and it is ofsetted by R_offset from
@@ -208,6 +224,20 @@ class CH_PARALLEL_API ChCollisionModelParallel : public ChCollisionModel {
 
   std::vector<ConvexShape> mData;
   std::vector<real3> local_convex_data;
+  // Start and number of hull neighbors of every convex point, and the
+  // neighbor list (indices within the convex hull)
+  std::vector<int2> local_convex_adjacency;
+  std::vector<int> local_convex_neighbors;
+  // Triangle meshes of this model and their hierarchies. Indices are local to
+  // the model, they are offset when the model is added to the system.
+  std::vector<real3> local_mesh_vertices;
+  std::vector<int3> local_mesh_triangles;
+  std::vector<real3> local_mesh_node_min;
+  std::vector<real3> local_mesh_node_max;
+  std::vector<uint> local_mesh_node_start;
+  std::vector<uint> local_mesh_node_count;
+  // Heights of the heightfields of this model
+  std::vector<real> local_heightfield_data;
 
  protected:
   unsigned int nObjects;
@@ -8,23 +8,32 @@
 // ------------------------------------------------
 ///////////////////////////////////////////////////
 
+#include <algorithm>
+
 #include "chrono_parallel/collision/ChCCollisionSystemParallel.h"
+#include "chrono_parallel/collision/ChCBroadphaseUtils.h"
 
 namespace chrono {
 namespace collision {
 
 ChCollisionSystemParallel::ChCollisionSystemParallel(ChParallelDataManager* dm) : data_manager(dm) {
   broadphase = new ChCBroadphase;
+  static_bvh = new ChCStaticBVH;
   narrowphase = new ChCNarrowphaseDispatch;
   aabb_generator = new ChCAABBGenerator;
   broadphase->data_manager = dm;
+  static_bvh->data_manager = dm;
   narrowphase->data_manager = dm;
   aabb_generator->data_manager = dm;
+  skin_num_shapes = 0;
+  query_ready = false;
+  query_static_bvh = false;
 }
 
 ChCollisionSystemParallel::~ChCollisionSystemParallel() {
   delete narrowphase;
   delete broadphase;
+  delete static_bvh;
   delete aabb_generator;
 }
 
@@ -39,6 +48,44 @@ void ChCollisionSystemParallel::Add(ChCollisionModel* model) {
     // Insert the points into the global convex list
     data_manager->host_data.convex_data.insert(data_manager->host_data.convex_data.end(),
                                                pmodel->local_convex_data.begin(), pmodel->local_convex_data.end());
+    // The hull neighbors are indexed within their shape, only the start of
+    // the neighbors of every point is offset
+    int neighbor_offset = data_manager->host_data.convex_neighbors.size();
+    data_manager->host_data.convex_neighbors.insert(data_manager->host_data.convex_neighbors.end(),
+                                                    pmodel->local_convex_neighbors.begin(),
+                                                    pmodel->local_convex_neighbors.end());
+    for (int i = 0; i < pmodel->local_convex_adjacency.size(); i++) {
+      const int2& adj = pmodel->local_convex_adjacency[i];
+      data_manager->host_data.convex_adjacency.push_back(I2(adj.x + neighbor_offset, adj.y));
+    }
+
+    // Append the triangle meshes, the indices of the model are offset by the
+    // size of the global lists
+    host_container& host_data = data_manager->host_data;
+    uint vertex_offset = host_data.mesh_vertices.size();
+    uint triangle_offset = host_data.mesh_triangles.size();
+    uint node_offset = host_data.mesh_node_min.size();
+    host_data.mesh_vertices.insert(host_data.mesh_vertices.end(), pmodel->local_mesh_vertices.begin(),
+                                   pmodel->local_mesh_vertices.end());
+    for (int i = 0; i < pmodel->local_mesh_triangles.size(); i++) {
+      const int3& t = pmodel->local_mesh_triangles[i];
+      host_data.mesh_triangles.push_back(I3(t.x + vertex_offset, t.y + vertex_offset, t.z + vertex_offset));
+    }
+    host_data.mesh_node_min.insert(host_data.mesh_node_min.end(), pmodel->local_mesh_node_min.begin(),
+                                   pmodel->local_mesh_node_min.end());
+    host_data.mesh_node_max.insert(host_data.mesh_node_max.end(), pmodel->local_mesh_node_max.begin(),
+                                   pmodel->local_mesh_node_max.end());
+    host_data.mesh_node_count.insert(host_data.mesh_node_count.end(), pmodel->local_mesh_node_count.begin(),
+                                     pmodel->local_mesh_node_count.end());
+    for (int i = 0; i < pmodel->local_mesh_node_start.size(); i++) {
+      // Leaves refer to triangles, interior nodes to their first child
+      uint offset = (pmodel->local_mesh_node_count[i] > 0) ? triangle_offset : node_offset;
+      host_data.mesh_node_start.push_back(pmodel->local_mesh_node_start[i] + offset);
+    }
+
+    uint heightfield_offset = host_data.heightfield_data.size();
+    host_data.heightfield_data.insert(host_data.heightfield_data.end(), pmodel->local_heightfield_data.begin(),
+                                      pmodel->local_heightfield_data.end());
 
     for (int j = 0; j < pmodel->GetNObjects(); j++) {
       real3 obB = pmodel->mData[j].B;
@@ -48,6 +95,12 @@ void ChCollisionSystemParallel::Add(ChCollisionModel* model) {
       if (pmodel->mData[j].type == CONVEX) {
         obB.y += convex_data_offset;  // update to get the global offset
       }
+      if (pmodel->mData[j].type == TRIANGLEMESH_BVH) {
+        obB.y += node_offset;  // global index of the root node
+      }
+      if (pmodel->mData[j].type == HEIGHTFIELD) {
+        obB.z += heightfield_offset;  // global index of the first height
+      }
 
       data_manager->host_data.ObA_rigid.push_back(pmodel->mData[j].A);
       data_manager->host_data.ObB_rigid.push_back(obB);
@@ -101,8 +154,29 @@ void ChCollisionSystemParallel::Run() {
   }
 
   data_manager->system_timer.start("collision_broad");
-  aabb_generator->GenerateAABB();
-  broadphase->DetectPossibleCollisions();
+  if (CheckSkin()) {
+    // The narrowphase removes pairs that are not in contact, start from the stored list
+    data_manager->host_data.pair_rigid_rigid = skin_pairs;
+    // Without new AABBs only the shapes of the stored pairs are transformed
+    aabb_generator->TransformShapes(skin_pairs);
+    // The active AABB test regenerated the AABBs without running the broadphase
+    if (data_manager->settings.collision.use_aabb_active) {
+      query_ready = false;
+    }
+  } else {
+    aabb_generator->GenerateAABB();
+    if (data_manager->settings.collision.use_static_bvh && static_bvh->Update()) {
+      // The set of shapes in the bins changed
+      broadphase->ResetIncremental();
+    }
+    broadphase->DetectPossibleCollisions();
+    if (data_manager->settings.collision.use_static_bvh) {
+      static_bvh->DetectPossibleCollisions();
+    }
+    StoreSkin();
+    query_ready = true;
+    query_static_bvh = data_manager->settings.collision.use_static_bvh;
+  }
   data_manager->system_timer.stop("collision_broad");
 
   data_manager->system_timer.start("collision_narrow");
@@ -110,6 +184,80 @@ void ChCollisionSystemParallel::Run() {
   data_manager->system_timer.stop("collision_narrow");
 }
 
+void ChCollisionSystemParallel::ResetPersistentState() {
+  skin_num_shapes = 0;
+  broadphase->Reset();
+  static_bvh->Reset();
+  narrowphase->ResetAxisCache();
+  aabb_generator->Reset();
+  // The shapes of fixed bodies are no longer in the hierarchy
+  query_static_bvh = false;
+}
+
+bool ChCollisionSystemParallel::CheckSkin() {
+  const real collision_skin = data_manager->settings.collision.collision_skin;
+  const host_vector<real3>& pos_rigid = data_manager->host_data.pos_rigid;
+  const host_vector<real4>& rot_rigid = data_manager->host_data.rot_rigid;
+  const host_vector<bool>& active_rigid = data_manager->host_data.active_rigid;
+  const uint num_bodies = data_manager->num_rigid_bodies;
+
+  if (collision_skin <= 0) {
+    return false;
+  }
+  if (skin_num_shapes != data_manager->num_rigid_shapes || skin_pos.size() != num_bodies) {
+    return false;
+  }
+
+  // Any point on a body moves by at most the translation of its center plus
+  // the rotation angle times the distance to the center
+  const real threshold = 0.5 * collision_skin;
+  int num_moved = 0;
+#pragma omp parallel for reduction(+ : num_moved)
+  for (int i = 0; i < num_bodies; i++) {
+    if (active_rigid[i] != skin_active[i]) {
+      num_moved++;
+      continue;
+    }
+    real c = clamp(fabs(dot(rot_rigid[i], skin_rot[i])), real(0), real(1));
+    real rotation_angle = 2 * acos(c);
+    real displacement = length(pos_rigid[i] - skin_pos[i]) + rotation_angle * skin_radius[i];
+    if (displacement > threshold) {
+      num_moved++;
+    }
+  }
+  LOG(TRACE) << "Collision skin: bodies outside of skin: " << num_moved;
+  return num_moved == 0;
+}
+
+void ChCollisionSystemParallel::StoreSkin() {
+  if (data_manager->settings.collision.collision_skin <= 0) {
+    return;
+  }
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const host_vector<uint>& id_rigid = data_manager->host_data.id_rigid;
+  const real3& global_origin = data_manager->measures.collision.global_origin;
+  const uint num_bodies = data_manager->num_rigid_bodies;
+
+  skin_pairs = data_manager->host_data.pair_rigid_rigid;
+  skin_pos = data_manager->host_data.pos_rigid;
+  skin_rot = data_manager->host_data.rot_rigid;
+  skin_active = data_manager->host_data.active_rigid;
+  skin_num_shapes = data_manager->num_rigid_shapes;
+
+  // The radius of a body is the distance from its center to the farthest AABB
+  // corner of its shapes, the AABBs were shifted by the broadphase
+  skin_radius.resize(num_bodies);
+  thrust::fill(skin_radius.begin(), skin_radius.end(), 0);
+  for (int i = 0; i < skin_num_shapes; i++) {
+    uint id = id_rigid[i];
+    real3 dmin = absolute(aabb_min_rigid[i] + global_origin - skin_pos[id]);
+    real3 dmax = absolute(aabb_max_rigid[i] + global_origin - skin_pos[id]);
+    real3 corner = R3(std::max(dmin.x, dmax.x), std::max(dmin.y, dmax.y), std::max(dmin.z, dmax.z));
+    skin_radius[id] = std::max(skin_radius[id], length(corner));
+  }
+}
+
 void ChCollisionSystemParallel::GetOverlappingAABB(custom_vector<bool>& active_id, real3 Amin, real3 Amax) {
   aabb_generator->GenerateAABB();
 #pragma omp parallel for
@@ -125,6 +273,125 @@ void ChCollisionSystemParallel::GetOverlappingAABB(custom_vector<bool>& active_i
   }
 }
 
+bool ChCollisionSystemParallel::QueryReady() {
+  if (!query_ready || data_manager->host_data.aabb_min_rigid.size() != data_manager->num_rigid_shapes) {
+    LOG(TRACE) << "Spatial query: no AABBs available, Run() has to be called first";
+    return false;
+  }
+  return true;
+}
+
+void ChCollisionSystemParallel::QueryAABB(const custom_vector<real3>& query_min,
+                                          const custom_vector<real3>& query_max,
+                                          custom_vector<uint>& offsets,
+                                          custom_vector<uint>& shapes) {
+  // The AABBs in the bins are shifted, the static BVH is in global coordinates
+  const real3 global_origin = data_manager->measures.collision.global_origin;
+  const uint num_queries = query_min.size();
+  offsets.resize(num_queries + 1);
+  thrust::fill(offsets.begin(), offsets.end(), 0);
+  shapes.clear();
+  if (!QueryReady()) {
+    return;
+  }
+
+#pragma omp parallel for
+  for (int i = 0; i < num_queries; i++) {
+    offsets[i] = broadphase->QueryAABB(query_min[i] - global_origin, query_max[i] - global_origin, 0);
+    if (query_static_bvh) {
+      offsets[i] += static_bvh->QueryAABB(query_min[i], query_max[i], 0);
+    }
+  }
+  Thrust_Exclusive_Scan(offsets);
+  shapes.resize(offsets.back());
+
+#pragma omp parallel for
+  for (int i = 0; i < num_queries; i++) {
+    uint* result = shapes.data() + offsets[i];
+    uint count = broadphase->QueryAABB(query_min[i] - global_origin, query_max[i] - global_origin, result);
+    if (query_static_bvh) {
+      count += static_bvh->QueryAABB(query_min[i], query_max[i], result + count);
+    }
+    std::sort(result, result + count);
+  }
+}
+
+void ChCollisionSystemParallel::QuerySphere(const custom_vector<real3>& centers,
+                                            const custom_vector<real>& radii,
+                                            custom_vector<uint>& offsets,
+                                            custom_vector<uint>& shapes) {
+  const real3 global_origin = data_manager->measures.collision.global_origin;
+  const uint num_queries = centers.size();
+  offsets.resize(num_queries + 1);
+  thrust::fill(offsets.begin(), offsets.end(), 0);
+  shapes.clear();
+  if (!QueryReady()) {
+    return;
+  }
+
+#pragma omp parallel for
+  for (int i = 0; i < num_queries; i++) {
+    offsets[i] = broadphase->QuerySphere(centers[i] - global_origin, radii[i], 0);
+    if (query_static_bvh) {
+      offsets[i] += static_bvh->QuerySphere(centers[i], radii[i], 0);
+    }
+  }
+  Thrust_Exclusive_Scan(offsets);
+  shapes.resize(offsets.back());
+
+#pragma omp parallel for
+  for (int i = 0; i < num_queries; i++) {
+    uint* result = shapes.data() + offsets[i];
+    uint count = broadphase->QuerySphere(centers[i] - global_origin, radii[i], result);
+    if (query_static_bvh) {
+      count += static_bvh->QuerySphere(centers[i], radii[i], result + count);
+    }
+    std::sort(result, result + count);
+  }
+}
+
+void ChCollisionSystemParallel::RayCast(const custom_vector<real3>& from,
+                                        const custom_vector<real3>& to,
+                                        custom_vector<uint>& offsets,
+                                        custom_vector<uint>& shapes,
+                                        custom_vector<real>& distances) {
+  const real3 global_origin = data_manager->measures.collision.global_origin;
+  const uint num_queries = from.size();
+  offsets.resize(num_queries + 1);
+  thrust::fill(offsets.begin(), offsets.end(), 0);
+  shapes.clear();
+  distances.clear();
+  if (!QueryReady()) {
+    return;
+  }
+
+  // A ray visits a shape once for every bin it shares with it, the hits are
+  // gathered per ray and the duplicates removed before they are counted
+  std::vector<std::vector<std::pair<real, uint> > > hits(num_queries);
+#pragma omp parallel for
+  for (int i = 0; i < num_queries; i++) {
+    broadphase->QueryRay(from[i] - global_origin, to[i] - global_origin, hits[i]);
+    if (query_static_bvh) {
+      static_bvh->QueryRay(from[i], to[i], hits[i]);
+    }
+    std::sort(hits[i].begin(), hits[i].end());
+    hits[i].erase(std::unique(hits[i].begin(), hits[i].end()), hits[i].end());
+    offsets[i] = hits[i].size();
+  }
+  Thrust_Exclusive_Scan(offsets);
+  shapes.resize(offsets.back());
+  distances.resize(offsets.back());
+
+#pragma omp parallel for
+  for (int i = 0; i < num_queries; i++) {
+    real ray_length = length(to[i] - from[i]);
+    for (uint j = 0; j < hits[i].size(); j++) {
+      shapes[offsets[i] + j] = hits[i][j].second;
+      distances[offsets[i] + j] = hits[i][j].first * ray_length;
+    }
+  }
+}
+
 std::vector<int2> ChCollisionSystemParallel::GetOverlappingPairs() {
   std::vector<int2> pairs;
   pairs.resize(data_manager->host_data.pair_rigid_rigid.size());
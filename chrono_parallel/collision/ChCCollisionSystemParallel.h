@@ -13,6 +13,7 @@
 #include "chrono_parallel/collision/ChCAABBGenerator.h"
 #include "chrono_parallel/collision/ChCNarrowphaseDispatch.h"
 #include "chrono_parallel/collision/ChCBroadphase.h"
+#include "chrono_parallel/collision/ChCStaticBVH.h"
 
 namespace chrono {
 
@@ -72,6 +73,34 @@ class CH_PARALLEL_API ChCollisionSystemParallel : public ChCollisionSystem {
   /// Perform a raycast (ray-hit test with the collision models).
   virtual bool RayHit(const ChVector<>& from, const ChVector<>& to, ChRayhitResult& mresult) { return false; }
 
+  /// Discard the data kept between steps (collision skin, incremental
+  /// broadphase, static hierarchy and narrowphase axis cache). Must be called
+  /// when the bodies or the shapes are reordered.
+  void ResetPersistentState();
+
+  /// Batched spatial queries against the shape AABBs computed during the last
+  /// Run(), the bins of the broadphase are reused. The shapes found by query i
+  /// are stored in shapes[offsets[i]] to shapes[offsets[i + 1] - 1], offsets
+  /// has one entry more than the number of queries. Shapes are indices into the
+  /// shape data, host_data.id_rigid gives their body. Queries are processed in
+  /// parallel and the shapes of every query are sorted.
+  void QueryAABB(const custom_vector<real3>& query_min,
+                 const custom_vector<real3>& query_max,
+                 custom_vector<uint>& offsets,
+                 custom_vector<uint>& shapes);
+  void QuerySphere(const custom_vector<real3>& centers,
+                   const custom_vector<real>& radii,
+                   custom_vector<uint>& offsets,
+                   custom_vector<uint>& shapes);
+  /// Cast the segments from[i]-to[i] against the shape AABBs. The shapes hit by
+  /// every segment are sorted along it, distances holds the distance from the
+  /// start of the segment to where it enters the AABB of the shape.
+  void RayCast(const custom_vector<real3>& from,
+               const custom_vector<real3>& to,
+               custom_vector<uint>& offsets,
+               custom_vector<uint>& shapes,
+               custom_vector<real>& distances);
+
   std::vector<int2> GetOverlappingPairs();
   void GetOverlappingAABB(custom_vector<bool>& active_id, real3 Amin, real3 Amax);
 
@@ -89,13 +118,35 @@ class CH_PARALLEL_API ChCollisionSystemParallel : public ChCollisionSystem {
   }
 
  private:
+  // Returns true if the pairs from the last broadphase are still valid, this is
+  // the case when no body moved by more than half of the collision skin
+  bool CheckSkin();
+  // Store the body state and the broadphase pairs used by CheckSkin
+  void StoreSkin();
+  // Returns true if the AABBs from the last broadphase can be queried
+  bool QueryReady();
+
   ChCBroadphase* broadphase;
+  ChCStaticBVH* static_bvh;
   ChCNarrowphaseDispatch* narrowphase;
 
   ChCAABBGenerator* aabb_generator;
 
   ChParallelDataManager* data_manager;
 
+  // Set when the AABBs match the last broadphase, and whether the shapes of
+  // fixed bodies were stored in the static BVH
+  bool query_ready;
+  bool query_static_bvh;
+
+  // State stored at the last broadphase when a collision skin is used
+  uint skin_num_shapes;
+  custom_vector<long long> skin_pairs;
+  custom_vector<real3> skin_pos;
+  custom_vector<real4> skin_rot;
+  custom_vector<real> skin_radius;
+  custom_vector<bool> skin_active;
+
   friend class chrono::ChSystemParallel;
 };
 
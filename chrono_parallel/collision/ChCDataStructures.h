@@ -6,6 +6,14 @@
 namespace chrono {
 namespace collision {
 
+// Triangle mesh stored as a single shape, its triangles and their bounding
+// volume hierarchy are kept in the body frame (see AddTriangleMesh). Numbered
+// well past the shape types of ChCollisionModel.
+static const shape_type TRIANGLEMESH_BVH = 20;
+// Heightfield on a regular grid, its heights are kept in a separate list (see
+// AddHeightfield).
+static const shape_type HEIGHTFIELD = 21;
+
 struct ConvexShape {
   shape_type type;  // type of shape
   real3 A;  // location
@@ -13,6 +21,10 @@ struct ConvexShape {
   real3 C;  // extra
   quaternion R;  // rotation
   real3* convex;  // pointer to convex data;
+  int2* adjacency;  // pointer to the hull neighbors (start, count) of the convex points
+  int* neighbors;  // pointer to the hull neighbor list
+  mutable int hint;  // convex point where the next support search starts
+  real* heights;  // pointer to heightfield data;
   real margin;
 };
 
@@ -1,4 +1,11 @@
 #include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <vector>
+
+#include <thrust/extrema.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
 
 #include "collision/ChCCollisionModel.h"
 #include "chrono_parallel/math/ChParallelMath.h"
@@ -7,6 +14,16 @@
 #include "chrono_parallel/collision/ChCNarrowphaseMPR.h"
 #include "chrono_parallel/collision/ChCNarrowphaseR.h"
 #include "chrono_parallel/collision/ChCNarrowphaseGJK_EPA.h"
+#include "chrono_parallel/collision/ChCBroadphaseUtils.h"
+
+// Maximum number of contacts kept for a pair with a triangle mesh and depth of
+// the stack used to traverse the bounding volume hierarchy of the mesh
+#define MESH_MAX_CONTACTS 4
+#define MESH_STACK_SIZE 64
+// Maximum number of contacts kept for a group of contacts with similar normals
+// between two bodies when contact reduction is enabled
+#define REDUCED_MAX_CONTACTS 4
+
 namespace chrono {
 namespace collision {
 
@@ -30,6 +47,8 @@ void ChCNarrowphaseDispatch::Process() {
   uint& number_of_contacts = data_manager->num_rigid_contacts;
   narrowphase_algorithm = data_manager->settings.collision.narrowphase_algorithm;
   system_type = data_manager->settings.system_type;
+  use_thread_buffers = data_manager->settings.collision.use_thread_buffers;
+  use_axis_cache = data_manager->settings.collision.use_axis_cache;
   // The number of possible contacts based on the broadphase pair list
   num_potentialCollisions = potentialCollisions.size();
 
@@ -45,15 +64,32 @@ void ChCNarrowphaseDispatch::Process() {
     return;
   }
 
-  // Transform to global coordinate system
-  PreprocessLocalToParent();
-
   // Set maximum possible number of contacts for each potential collision
   // (depending on the narrowphase algorithm and on the types of shapes in
   // potential collision)
   contact_index.resize(num_potentialCollisions);
   PreprocessCount();
 
+  if (use_thread_buffers) {
+    // Every thread appends its contacts to its own buffer, contact_index keeps
+    // the maximum number of contacts of each pair so that room can be made for
+    // them before a pair is processed
+    thread_buffers.resize(omp_get_max_threads());
+    for (int t = 0; t < thread_buffers.size(); t++) {
+      thread_buffers[t].size = 0;
+    }
+    contact_count.resize(num_potentialCollisions);
+    thrust::fill(contact_count.begin(), contact_count.end(), 0);
+
+    Dispatch();
+
+    ScatterThreadBuffers();
+    if (data_manager->settings.collision.use_contact_reduction) {
+      ReduceContacts();
+    }
+    return;
+  }
+
   // Scan to find total number of potential contacts
   int num_potentialContacts = contact_index.back();
   thrust::exclusive_scan(thrust_parallel, contact_index.begin(), contact_index.end(), contact_index.begin());
@@ -96,21 +132,24 @@ void ChCNarrowphaseDispatch::Process() {
   bids_data.resize(number_of_contacts);
   potentialCollisions.resize(number_of_contacts);
 
+  if (data_manager->settings.collision.use_contact_reduction) {
+    ReduceContacts();
+  }
+
   // std::cout << num_potentialContacts << " " << number_of_contacts << std::endl;
 }
 
 void ChCNarrowphaseDispatch::PreprocessCount() {
-  // MPR and GJK always report at most one contact per pair.
-  if (narrowphase_algorithm == NARROWPHASE_MPR /*|| narrowphase_algorithm == NARROWPHASE_GJK*/) {
-    thrust::fill(contact_index.begin(), contact_index.end(), 1);
-    return;
-  }
-
+  // MPR and GJK always report at most one contact per pair, except for the
+  // pairs with a triangle mesh which keep up to MESH_MAX_CONTACTS contacts and
+  // the pairs with a heightfield which always use NarrowphaseR (up to 4
+  // contacts for a box).
   // NarrowphaseR (and hence the hybrid algorithms) may produce different number
   // of contacts per pair, depending on the interacting shapes:
   //   - an interaction involving a sphere can produce at most one contact
   //   - an interaction involving a capsule can produce up to two contacts
-  //   - a box-box interaction can produce up to 8 contacts
+  //   - a box-box interaction can produce up to 4 contacts (the manifold is
+  //     reduced to 4 points)
 
   // shape type (per shape)
   const shape_type* obj_data_T = data_manager->host_data.typ_rigid.data();
@@ -125,60 +164,26 @@ void ChCNarrowphaseDispatch::PreprocessCount() {
     shape_type type2 = obj_data_T[pair.y];
 
     // Set the maximum number of possible contacts for this particular pair
-    if (type1 == SPHERE || type2 == SPHERE) {
+    if (type1 == TRIANGLEMESH_BVH || type2 == TRIANGLEMESH_BVH) {
+      contact_index[index] = MESH_MAX_CONTACTS;
+    } else if (type1 == HEIGHTFIELD || type2 == HEIGHTFIELD) {
+      contact_index[index] = 4;
+    } else if (narrowphase_algorithm == NARROWPHASE_MPR) {
+      contact_index[index] = 1;
+    } else if (type1 == SPHERE || type2 == SPHERE) {
       contact_index[index] = 1;
     } else if (type1 == CAPSULE || type2 == CAPSULE) {
       contact_index[index] = 2;
-      ////} else if (type1 == BOX && type2 == BOX) {
-      ////  contact_index[index] = 8;
+    } else if (type1 == BOX && type2 == BOX) {
+      contact_index[index] = 4;
     } else {
       contact_index[index] = 1;
     }
   }
 }
 
-void ChCNarrowphaseDispatch::PreprocessLocalToParent() {
-  uint num_shapes = data_manager->num_rigid_shapes;
-
-  const custom_vector<int>& obj_data_T = data_manager->host_data.typ_rigid;
-  const custom_vector<real3>& obj_data_A = data_manager->host_data.ObA_rigid;
-  const custom_vector<real3>& obj_data_B = data_manager->host_data.ObB_rigid;
-  const custom_vector<real3>& obj_data_C = data_manager->host_data.ObC_rigid;
-  const custom_vector<real4>& obj_data_R = data_manager->host_data.ObR_rigid;
-  const custom_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
-
-  const custom_vector<real3>& body_pos = data_manager->host_data.pos_rigid;
-  const custom_vector<real4>& body_rot = data_manager->host_data.rot_rigid;
-
-  obj_data_A_global.resize(num_shapes);
-  obj_data_B_global.resize(num_shapes);
-  obj_data_C_global.resize(num_shapes);
-  obj_data_R_global.resize(num_shapes);
-
-#pragma omp parallel for
-  for (int index = 0; index < num_shapes; index++) {
-    shape_type T = obj_data_T[index];
-
-    // Get the identifier for the object associated with this collision shape
-    uint ID = obj_data_ID[index];
-
-    real3 pos = body_pos[ID];  // Get the global object position
-    real4 rot = body_rot[ID];  // Get the global object rotation
-
-    obj_data_A_global[index] = TransformLocalToParent(pos, rot, obj_data_A[index]);
-    if (T == TRIANGLEMESH) {
-      obj_data_B_global[index] = TransformLocalToParent(pos, rot, obj_data_B[index]);
-      obj_data_C_global[index] = TransformLocalToParent(pos, rot, obj_data_C[index]);
-    } else {
-      obj_data_B_global[index] = obj_data_B[index];
-      obj_data_C_global[index] = obj_data_C[index];
-    }
-    obj_data_R_global[index] = mult(rot, obj_data_R[index]);
-  }
-}
-
 void ChCNarrowphaseDispatch::Dispatch_Init(uint index,
-                                           uint& icoll,
+                                           ContactSlot& slot,
                                            uint& ID_A,
                                            uint& ID_B,
                                            ConvexShape& shapeA,
@@ -188,6 +193,13 @@ void ChCNarrowphaseDispatch::Dispatch_Init(uint index,
   const custom_vector<long long>& contact_pair = data_manager->host_data.pair_rigid_rigid;
   const custom_vector<real>& collision_margins = data_manager->host_data.margin_rigid;
   real3* convex_data = data_manager->host_data.convex_data.data();
+  int2* convex_adjacency = data_manager->host_data.convex_adjacency.data();
+  int* convex_neighbors = data_manager->host_data.convex_neighbors.data();
+  real* heightfield_data = data_manager->host_data.heightfield_data.data();
+  const custom_vector<real3>& obj_data_A_global = data_manager->host_data.ObA_global;
+  const custom_vector<real3>& obj_data_B_global = data_manager->host_data.ObB_global;
+  const custom_vector<real3>& obj_data_C_global = data_manager->host_data.ObC_global;
+  const custom_vector<real4>& obj_data_R_global = data_manager->host_data.ObR_global;
 
   long long p = contact_pair[index];
   int2 pair =
@@ -209,14 +221,52 @@ void ChCNarrowphaseDispatch::Dispatch_Init(uint index,
   shapeB.R = obj_data_R_global[pair.y];
   shapeA.convex = convex_data;
   shapeB.convex = convex_data;
+  shapeA.adjacency = convex_adjacency;
+  shapeB.adjacency = convex_adjacency;
+  shapeA.neighbors = convex_neighbors;
+  shapeB.neighbors = convex_neighbors;
+  shapeA.hint = 0;
+  shapeB.hint = 0;
+  shapeA.heights = heightfield_data;
+  shapeB.heights = heightfield_data;
   shapeA.margin = collision_margins[pair.x];
   shapeB.margin = collision_margins[pair.y];
 
   //// TODO: what is the best way to dispatch this?
-  icoll = contact_index[index];
+  slot.index = index;
+  if (use_thread_buffers) {
+    ContactBuffer& buffer = thread_buffers[omp_get_thread_num()];
+    buffer.Reserve(contact_index[index]);
+    slot.icoll = buffer.size;
+    slot.norm = buffer.norm.data() + slot.icoll;
+    slot.ptA = buffer.ptA.data() + slot.icoll;
+    slot.ptB = buffer.ptB.data() + slot.icoll;
+    slot.depth = buffer.depth.data() + slot.icoll;
+    slot.erad = buffer.erad.data() + slot.icoll;
+  } else {
+    slot.icoll = contact_index[index];
+    slot.norm = data_manager->host_data.norm_rigid_rigid.data() + slot.icoll;
+    slot.ptA = data_manager->host_data.cpta_rigid_rigid.data() + slot.icoll;
+    slot.ptB = data_manager->host_data.cptb_rigid_rigid.data() + slot.icoll;
+    slot.depth = data_manager->host_data.dpth_rigid_rigid.data() + slot.icoll;
+    slot.erad = data_manager->host_data.erad_rigid_rigid.data() + slot.icoll;
+  }
 }
 
-void ChCNarrowphaseDispatch::Dispatch_Finalize(uint icoll, uint ID_A, uint ID_B, int nC) {
+void ChCNarrowphaseDispatch::Dispatch_Finalize(uint index, uint icoll, uint ID_A, uint ID_B, int nC) {
+  if (use_thread_buffers) {
+    // Append the contacts to the buffer of the thread, they were written at
+    // its end by the collision function
+    ContactBuffer& buffer = thread_buffers[omp_get_thread_num()];
+    for (int i = 0; i < nC; i++) {
+      buffer.bids[icoll + i] = I2(ID_A, ID_B);
+      buffer.pair[icoll + i] = index;
+    }
+    buffer.size = icoll + nC;
+    contact_count[index] = nC;
+    return;
+  }
+
   custom_vector<int2>& body_ids = data_manager->host_data.bids_rigid_rigid;
 
   // Mark the active contacts and set their body IDs
@@ -226,137 +276,750 @@ void ChCNarrowphaseDispatch::Dispatch_Finalize(uint icoll, uint ID_A, uint ID_B,
   }
 }
 
-void ChCNarrowphaseDispatch::DispatchMPR() {
-  custom_vector<real3>& norm = data_manager->host_data.norm_rigid_rigid;
-  custom_vector<real3>& ptA = data_manager->host_data.cpta_rigid_rigid;
-  custom_vector<real3>& ptB = data_manager->host_data.cptb_rigid_rigid;
-  custom_vector<real>& contactDepth = data_manager->host_data.dpth_rigid_rigid;
-  custom_vector<real>& effective_radius = data_manager->host_data.erad_rigid_rigid;
+void ContactBuffer::Reserve(uint count) {
+  if (size + count <= norm.size()) {
+    return;
+  }
+  uint capacity = std::max(2 * size, std::max(size + count, 256u));
+  norm.resize(capacity);
+  ptA.resize(capacity);
+  ptB.resize(capacity);
+  depth.resize(capacity);
+  erad.resize(capacity);
+  bids.resize(capacity);
+  pair.resize(capacity);
+}
+
+void ChCNarrowphaseDispatch::ScatterThreadBuffers() {
+  custom_vector<real3>& norm_data = data_manager->host_data.norm_rigid_rigid;
+  custom_vector<real3>& cpta_data = data_manager->host_data.cpta_rigid_rigid;
+  custom_vector<real3>& cptb_data = data_manager->host_data.cptb_rigid_rigid;
+  custom_vector<real>& dpth_data = data_manager->host_data.dpth_rigid_rigid;
+  custom_vector<real>& erad_data = data_manager->host_data.erad_rigid_rigid;
+  custom_vector<int2>& bids_data = data_manager->host_data.bids_rigid_rigid;
+  custom_vector<long long>& potentialCollisions = data_manager->host_data.pair_rigid_rigid;
+  uint& number_of_contacts = data_manager->num_rigid_contacts;
+
+  // The contacts of a pair start at the number of contacts of all the pairs
+  // before it, so the final order is the same as with the compaction
+  number_of_contacts = contact_count.back();
+  thrust::exclusive_scan(thrust_parallel, contact_count.begin(), contact_count.end(), contact_count.begin());
+  number_of_contacts += contact_count.back();
+
+  norm_data.resize(number_of_contacts);
+  cpta_data.resize(number_of_contacts);
+  cptb_data.resize(number_of_contacts);
+  dpth_data.resize(number_of_contacts);
+  erad_data.resize(number_of_contacts);
+  bids_data.resize(number_of_contacts);
+  scatter_pair.resize(number_of_contacts);
+
+#pragma omp parallel for
+  for (int t = 0; t < thread_buffers.size(); t++) {
+    const ContactBuffer& buffer = thread_buffers[t];
+    uint k = 0;
+    for (uint j = 0; j < buffer.size; j++) {
+      uint index = buffer.pair[j];
+      // k counts the contacts of the same pair, they are stored next to each other
+      k = (j > 0 && buffer.pair[j - 1] == index) ? k + 1 : 0;
+      uint icoll = contact_count[index] + k;
+      norm_data[icoll] = buffer.norm[j];
+      cpta_data[icoll] = buffer.ptA[j];
+      cptb_data[icoll] = buffer.ptB[j];
+      dpth_data[icoll] = buffer.depth[j];
+      erad_data[icoll] = buffer.erad[j];
+      bids_data[icoll] = buffer.bids[j];
+      scatter_pair[icoll] = potentialCollisions[index];
+    }
+  }
+
+  // Keep the pair of every contact, as done by the compaction
+  potentialCollisions.swap(scatter_pair);
+}
+
+// Keep up to REDUCED_MAX_CONTACTS contacts of a group with similar normals,
+// group[0] is the deepest contact. The second contact is the farthest from the
+// deepest one, the third one gives the triangle with the largest area and the
+// fourth one adds the largest area outside of that triangle.
+static void KeepManifold(const std::vector<uint>& group, const real3* pt, bool* keep) {
+  int count = group.size();
+  if (count <= REDUCED_MAX_CONTACTS) {
+    for (int i = 0; i < count; i++) {
+      keep[group[i]] = true;
+    }
+    return;
+  }
+
+  real3 p0 = pt[group[0]];
+  keep[group[0]] = true;
+
+  int i1 = 0;
+  real best = 0;
+  for (int i = 1; i < count; i++) {
+    real d = (pt[group[i]] - p0).length2();
+    if (d > best) {
+      best = d;
+      i1 = i;
+    }
+  }
+  if (i1 == 0) {
+    return;
+  }
+  real3 p1 = pt[group[i1]];
+  keep[group[i1]] = true;
+
+  int i2 = 0;
+  best = 0;
+  for (int i = 1; i < count; i++) {
+    real a = cross(p1 - p0, pt[group[i]] - p0).length2();
+    if (a > best) {
+      best = a;
+      i2 = i;
+    }
+  }
+  if (i2 == 0) {
+    return;
+  }
+  real3 p2 = pt[group[i2]];
+  keep[group[i2]] = true;
+
+  // The area added by a point outside of an edge is negative along the normal
+  // of the triangle
+  real3 n = cross(p1 - p0, p2 - p0);
+  int i3 = 0;
+  best = 0;
+  for (int i = 1; i < count; i++) {
+    real3 q = pt[group[i]];
+    real a = std::max(-dot(cross(p1 - p0, q - p0), n),
+                      std::max(-dot(cross(p2 - p1, q - p1), n), -dot(cross(p0 - p2, q - p2), n)));
+    if (a > best) {
+      best = a;
+      i3 = i;
+    }
+  }
+  if (i3 != 0) {
+    keep[group[i3]] = true;
+  }
+}
+
+void ChCNarrowphaseDispatch::ReduceContacts() {
+  custom_vector<real3>& norm_data = data_manager->host_data.norm_rigid_rigid;
+  custom_vector<real3>& cpta_data = data_manager->host_data.cpta_rigid_rigid;
+  custom_vector<real3>& cptb_data = data_manager->host_data.cptb_rigid_rigid;
+  custom_vector<real>& dpth_data = data_manager->host_data.dpth_rigid_rigid;
+  custom_vector<real>& erad_data = data_manager->host_data.erad_rigid_rigid;
+  custom_vector<int2>& bids_data = data_manager->host_data.bids_rigid_rigid;
+  custom_vector<long long>& potentialCollisions = data_manager->host_data.pair_rigid_rigid;
+  uint& number_of_contacts = data_manager->num_rigid_contacts;
+  const real cos_angle = cos(data_manager->settings.collision.contact_reduction_angle);
+
+  if (number_of_contacts <= REDUCED_MAX_CONTACTS) {
+    return;
+  }
+
+  // Sort the contacts by body pair, the sort is stable so that the contacts of
+  // a body pair keep the order given by the narrowphase
+  reduce_key.resize(number_of_contacts);
+  reduce_order.resize(number_of_contacts);
+#pragma omp parallel for
+  for (int i = 0; i < number_of_contacts; i++) {
+    reduce_key[i] = (long long)bids_data[i].x << 32 | (long long)(uint)bids_data[i].y;
+  }
+  thrust::sequence(reduce_order.begin(), reduce_order.end());
+  thrust::stable_sort_by_key(reduce_key.begin(), reduce_key.end(), reduce_order.begin());
+
+  reduce_start.clear();
+  for (uint i = 0; i < number_of_contacts; i++) {
+    if (i == 0 || reduce_key[i] != reduce_key[i - 1]) {
+      reduce_start.push_back(i);
+    }
+  }
+  reduce_start.push_back(number_of_contacts);
+  int num_body_pairs = reduce_start.size() - 1;
+
+  // Nothing to remove if no body pair has more contacts than a single group keeps
+  bool reduce = false;
+  for (int p = 0; p < num_body_pairs && !reduce; p++) {
+    reduce = (reduce_start[p + 1] - reduce_start[p] > REDUCED_MAX_CONTACTS);
+  }
+  if (!reduce) {
+    return;
+  }
+
+  contact_active.resize(number_of_contacts);
+  thrust::fill(contact_active.begin(), contact_active.end(), false);
+
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int p = 0; p < num_body_pairs; p++) {
+    uint start = reduce_start[p];
+    uint end = reduce_start[p + 1];
+    if (end - start <= REDUCED_MAX_CONTACTS) {
+      for (uint i = start; i < end; i++) {
+        contact_active[reduce_order[i]] = true;
+      }
+      continue;
+    }
+
+    // The deepest contact that is not in a group yet starts the next group,
+    // the group takes every remaining contact whose normal is within the cone
+    // around the normal of the deepest contact
+    std::vector<bool> grouped(end - start, false);
+    std::vector<uint> group;
+    while (true) {
+      int seed = -1;
+      for (uint i = start; i < end; i++) {
+        if (!grouped[i - start] && (seed < 0 || dpth_data[reduce_order[i]] < dpth_data[reduce_order[seed]])) {
+          seed = i;
+        }
+      }
+      if (seed < 0) {
+        break;
+      }
+      real3 axis = norm_data[reduce_order[seed]];
+      group.clear();
+      group.push_back(reduce_order[seed]);
+      grouped[seed - start] = true;
+      for (uint i = start; i < end; i++) {
+        if (!grouped[i - start] && dot(norm_data[reduce_order[i]], axis) >= cos_angle) {
+          group.push_back(reduce_order[i]);
+          grouped[i - start] = true;
+        }
+      }
+      KeepManifold(group, cptb_data.data(), contact_active.data());
+    }
+  }
+
+  number_of_contacts = thrust::count_if(contact_active.begin(), contact_active.end(), thrust::identity<bool>());
+
+  thrust::remove_if(
+      thrust::make_zip_iterator(thrust::make_tuple(norm_data.begin(), cpta_data.begin(), cptb_data.begin(),
+                                                   dpth_data.begin(), erad_data.begin(), bids_data.begin(),
+                                                   potentialCollisions.begin())),
+      thrust::make_zip_iterator(thrust::make_tuple(norm_data.end(), cpta_data.end(), cptb_data.end(), dpth_data.end(),
+                                                   erad_data.end(), bids_data.end(), potentialCollisions.end())),
+      contact_active.begin(), thrust::logical_not<bool>());
+
+  norm_data.resize(number_of_contacts);
+  cpta_data.resize(number_of_contacts);
+  cptb_data.resize(number_of_contacts);
+  dpth_data.resize(number_of_contacts);
+  erad_data.resize(number_of_contacts);
+  bids_data.resize(number_of_contacts);
+  potentialCollisions.resize(number_of_contacts);
+}
+
+bool ChCNarrowphaseDispatch::CollideMPR(const ConvexShape& shapeA, const ConvexShape& shapeB, ContactSlot& slot) {
+  bool found;
+  if (use_axis_cache) {
+    found = MPRCollisionCached(shapeA, shapeB, collision_envelope, pair_axis[slot.index], *slot.norm, *slot.ptA,
+                               *slot.ptB, *slot.depth);
+  } else {
+    found = MPRCollision(shapeA, shapeB, collision_envelope, *slot.norm, *slot.ptA, *slot.ptB, *slot.depth);
+  }
+  if (found) {
+    *slot.erad = edge_radius;
+  }
+  return found;
+}
+
+bool ChCNarrowphaseDispatch::CollideGJK(const ConvexShape& shapeA, const ConvexShape& shapeB, ContactSlot& slot) {
+  ContactPoint contact_point;
+  real3 separating_axis = use_axis_cache ? pair_axis[slot.index] : real3(0);
+  bool found = GJKCollide(shapeA, shapeB, collision_envelope, contact_point, separating_axis, use_axis_cache);
+  if (use_axis_cache) {
+    pair_axis[slot.index] = separating_axis;
+  }
+  if (found) {
+    *slot.norm = -contact_point.normal;
+    *slot.ptA = contact_point.pointA;
+    *slot.ptB = contact_point.pointB;
+    *slot.depth = contact_point.depth;
+    *slot.erad = edge_radius;
+  }
+  return found;
+}
 
+// Bounding sphere of a shape in the global frame
+static void GetGlobalBoundingSphere(const ConvexShape& shape, real3& center, real& radius) {
+  if (shape.type == TRIANGLEMESH) {
+    center = GetCenter_Triangle(shape.A, shape.B, shape.C);
+    radius = std::max(length(shape.A - center), std::max(length(shape.B - center), length(shape.C - center)));
+  } else if (shape.type == CONVEX) {
+    center = shape.A;
+    radius = 0;
+    for (int i = int(shape.B.y); i < int(shape.B.y + shape.B.x); i++) {
+      radius = std::max(radius, length(shape.convex[i]));
+    }
+    radius += shape.B.z;
+  } else {
+    GetBoundingSphere(shape, center, radius);
+    center = shape.A;
+  }
+}
+
+int ChCNarrowphaseDispatch::CollideMesh(const ConvexShape& shapeA,
+                                        const ConvexShape& shapeB,
+                                        ContactSlot& slot,
+                                        NARROWPHASETYPE algorithm) {
+  const bool mesh_is_A = (shapeA.type == TRIANGLEMESH_BVH);
+  const ConvexShape& mesh = mesh_is_A ? shapeA : shapeB;
+  const ConvexShape& other = mesh_is_A ? shapeB : shapeA;
+  if (other.type == TRIANGLEMESH_BVH || other.type == HEIGHTFIELD) {
+    // Mesh-mesh and mesh-heightfield collisions are not supported
+    static std::once_flag unsupported_warning;
+    std::call_once(unsupported_warning, []() {
+      LOG(WARNING) << "Triangle mesh collisions with meshes and heightfields are not supported, these pairs are "
+                      "skipped";
+    });
+    return 0;
+  }
+
+  const real3* vertices = data_manager->host_data.mesh_vertices.data();
+  const int3* triangles = data_manager->host_data.mesh_triangles.data();
+  const real3* node_min = data_manager->host_data.mesh_node_min.data();
+  const real3* node_max = data_manager->host_data.mesh_node_max.data();
+  const uint* node_start = data_manager->host_data.mesh_node_start.data();
+  const uint* node_count = data_manager->host_data.mesh_node_count.data();
+
+  // The hierarchy is in the frame of the mesh body, the other shape is tested
+  // against it with its bounding sphere
+  real3 center;
+  real radius;
+  GetGlobalBoundingSphere(other, center, radius);
+  radius += 2 * collision_envelope;
+  center = TransformParentToLocal(mesh.A, mesh.R, center);
+  const real3 sphere_min = center - real3(radius);
+  const real3 sphere_max = center + real3(radius);
+
+  RCollisionPair pair_function = 0;
+  if (algorithm == NARROWPHASE_R || algorithm == NARROWPHASE_HYBRID_MPR || algorithm == NARROWPHASE_HYBRID_GJK) {
+    pair_function = mesh_is_A ? RCollisionSelect(TRIANGLEMESH, other.type) : RCollisionSelect(other.type, TRIANGLEMESH);
+  }
+
+  ConvexShape triangle;
+  triangle.type = TRIANGLEMESH;
+  triangle.R = mesh.R;
+  triangle.convex = mesh.convex;
+  triangle.margin = mesh.margin;
+
+  int nC = 0;
+  uint stack[MESH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = uint(mesh.B.y);
+  while (top > 0) {
+    uint node = stack[--top];
+    if (!overlap(sphere_min, sphere_max, node_min[node], node_max[node])) {
+      continue;
+    }
+    if (node_count[node] == 0) {
+      // The median split in BuildMeshBVH halves the triangles of every node,
+      // the stack is at most as deep as the hierarchy (log2 of the number of
+      // triangles) plus one
+      assert(top + 2 <= MESH_STACK_SIZE);
+      stack[top++] = node_start[node];
+      stack[top++] = node_start[node] + 1;
+      continue;
+    }
+
+    for (uint i = node_start[node]; i < node_start[node] + node_count[node]; i++) {
+      const int3& t = triangles[i];
+      triangle.A = TransformLocalToParent(mesh.A, mesh.R, vertices[t.x]);
+      triangle.B = TransformLocalToParent(mesh.A, mesh.R, vertices[t.y]);
+      triangle.C = TransformLocalToParent(mesh.A, mesh.R, vertices[t.z]);
+      const ConvexShape& triA = mesh_is_A ? triangle : shapeA;
+      const ConvexShape& triB = mesh_is_A ? shapeB : triangle;
+
+      real3 norm[MESH_MAX_CONTACTS], ptA[MESH_MAX_CONTACTS], ptB[MESH_MAX_CONTACTS];
+      real depth[MESH_MAX_CONTACTS], erad[MESH_MAX_CONTACTS];
+      int count = 0;
+      if (pair_function) {
+        if (!pair_function(triA, triB, 2 * collision_envelope, norm, ptA, ptB, depth, erad, count)) {
+          count = 0;
+        }
+      } else if (algorithm == NARROWPHASE_MPR || algorithm == NARROWPHASE_HYBRID_MPR) {
+        if (MPRCollision(triA, triB, collision_envelope, norm[0], ptA[0], ptB[0], depth[0])) {
+          erad[0] = edge_radius;
+          count = 1;
+        }
+      } else if (algorithm == NARROWPHASE_GJK || algorithm == NARROWPHASE_HYBRID_GJK) {
+        ContactPoint contact_point;
+        real3 separating_axis(0);
+        if (GJKCollide(triA, triB, collision_envelope, contact_point, separating_axis, false)) {
+          norm[0] = -contact_point.normal;
+          ptA[0] = contact_point.pointA;
+          ptB[0] = contact_point.pointB;
+          depth[0] = contact_point.depth;
+          erad[0] = edge_radius;
+          count = 1;
+        }
+      }
+
+      // Keep the deepest contacts, a full slot replaces its shallowest contact
+      for (int k = 0; k < count; k++) {
+        int j = nC;
+        if (nC == MESH_MAX_CONTACTS) {
+          j = 0;
+          for (int m = 1; m < nC; m++) {
+            if (slot.depth[m] > slot.depth[j]) {
+              j = m;
+            }
+          }
+          if (depth[k] >= slot.depth[j]) {
+            continue;
+          }
+        } else {
+          nC++;
+        }
+        slot.norm[j] = norm[k];
+        slot.ptA[j] = ptA[k];
+        slot.ptB[j] = ptB[k];
+        slot.depth[j] = depth[k];
+        slot.erad[j] = erad[k];
+      }
+    }
+  }
+  return nC;
+}
+
+void ChCNarrowphaseDispatch::CollideHeightfield(const ConvexShape& shapeA,
+                                                const ConvexShape& shapeB,
+                                                ContactSlot& slot,
+                                                uint ID_A,
+                                                uint ID_B) {
+  RCollisionPair pair_function = RCollisionSelect(shapeA.type, shapeB.type);
+  int nC;
+  if (pair_function && pair_function(shapeA, shapeB, 2 * collision_envelope, slot.norm, slot.ptA, slot.ptB,
+                                     slot.depth, slot.erad, nC) && nC > 0) {
+    Dispatch_Finalize(slot.index, slot.icoll, ID_A, ID_B, nC);
+  }
+}
+
+void ChCNarrowphaseDispatch::LoadAxisCache() {
+  const custom_vector<long long>& collision_pair = data_manager->host_data.pair_rigid_rigid;
+
+  // Both pair lists are sorted, pairs that are new get a zero axis
+  pair_axis.resize(num_potentialCollisions);
 #pragma omp parallel for
   for (int index = 0; index < num_potentialCollisions; index++) {
-    uint ID_A, ID_B, icoll;
+    long long p = collision_pair[index];
+    custom_vector<long long>::iterator it = std::lower_bound(cache_pair.begin(), cache_pair.end(), p);
+    if (it != cache_pair.end() && *it == p) {
+      pair_axis[index] = cache_axis[it - cache_pair.begin()];
+    } else {
+      pair_axis[index] = real3(0);
+    }
+  }
+}
+
+void ChCNarrowphaseDispatch::StoreAxisCache() {
+  // Must be done before the pair list is compacted
+  cache_pair = data_manager->host_data.pair_rigid_rigid;
+  cache_axis.swap(pair_axis);
+}
+
+void ChCNarrowphaseDispatch::ResetAxisCache() {
+  cache_pair.clear();
+  cache_axis.clear();
+}
+
+void ChCNarrowphaseDispatch::DispatchMPR() {
+#pragma omp parallel for
+  for (int index = 0; index < num_potentialCollisions; index++) {
+    uint ID_A, ID_B;
+    ContactSlot slot;
     ConvexShape shapeA, shapeB;
 
-    Dispatch_Init(index, icoll, ID_A, ID_B, shapeA, shapeB);
+    Dispatch_Init(index, slot, ID_A, ID_B, shapeA, shapeB);
+
+    if (shapeA.type == TRIANGLEMESH_BVH || shapeB.type == TRIANGLEMESH_BVH) {
+      int nC = CollideMesh(shapeA, shapeB, slot, NARROWPHASE_MPR);
+      if (nC > 0) {
+        Dispatch_Finalize(index, slot.icoll, ID_A, ID_B, nC);
+      }
+      continue;
+    }
+
+    if (shapeA.type == HEIGHTFIELD || shapeB.type == HEIGHTFIELD) {
+      CollideHeightfield(shapeA, shapeB, slot, ID_A, ID_B);
+      continue;
+    }
 
-    if (MPRCollision(shapeA, shapeB, collision_envelope, norm[icoll], ptA[icoll], ptB[icoll], contactDepth[icoll])) {
-      effective_radius[icoll] = edge_radius;
+    if (CollideMPR(shapeA, shapeB, slot)) {
       // The number of contacts reported by MPR is always 1.
-      Dispatch_Finalize(icoll, ID_A, ID_B, 1);
+      Dispatch_Finalize(index, slot.icoll, ID_A, ID_B, 1);
     }
   }
 }
 
 void ChCNarrowphaseDispatch::DispatchGJK() {
-  custom_vector<real3>& norm = data_manager->host_data.norm_rigid_rigid;
-  custom_vector<real3>& ptA = data_manager->host_data.cpta_rigid_rigid;
-  custom_vector<real3>& ptB = data_manager->host_data.cptb_rigid_rigid;
-  custom_vector<real>& contactDepth = data_manager->host_data.dpth_rigid_rigid;
-  custom_vector<real>& effective_radius = data_manager->host_data.erad_rigid_rigid;
-
 #pragma omp parallel for
   for (int index = 0; index < num_potentialCollisions; index++) {
-    uint ID_A, ID_B, icoll;
+    uint ID_A, ID_B;
+    ContactSlot slot;
     ConvexShape shapeA, shapeB;
 
-    Dispatch_Init(index, icoll, ID_A, ID_B, shapeA, shapeB);
+    Dispatch_Init(index, slot, ID_A, ID_B, shapeA, shapeB);
+
+    if (shapeA.type == TRIANGLEMESH_BVH || shapeB.type == TRIANGLEMESH_BVH) {
+      int nC = CollideMesh(shapeA, shapeB, slot, NARROWPHASE_GJK);
+      if (nC > 0) {
+        Dispatch_Finalize(index, slot.icoll, ID_A, ID_B, nC);
+      }
+      continue;
+    }
 
-    ContactPoint contact_point;
-    real3 separating_axis;
-    if (GJKCollide(shapeA, shapeB, collision_envelope, contact_point , separating_axis)) {
-      norm[icoll] = -contact_point.normal;
-      ptA[icoll] = contact_point.pointA;
-      ptB[icoll] = contact_point.pointB;
-      contactDepth[icoll] = contact_point.depth;
+    if (shapeA.type == HEIGHTFIELD || shapeB.type == HEIGHTFIELD) {
+      CollideHeightfield(shapeA, shapeB, slot, ID_A, ID_B);
+      continue;
+    }
 
-      effective_radius[icoll] = edge_radius;
+    if (CollideGJK(shapeA, shapeB, slot)) {
       // The number of contacts reported by MPR is always 1.
-      Dispatch_Finalize(icoll, ID_A, ID_B, 1);
+      Dispatch_Finalize(index, slot.icoll, ID_A, ID_B, 1);
     }
   }
 }
 
-void ChCNarrowphaseDispatch::DispatchR() {
-  real3* norm = data_manager->host_data.norm_rigid_rigid.data();
-  real3* ptA = data_manager->host_data.cpta_rigid_rigid.data();
-  real3* ptB = data_manager->host_data.cptb_rigid_rigid.data();
-  real* contactDepth = data_manager->host_data.dpth_rigid_rigid.data();
-  real* effective_radius = data_manager->host_data.erad_rigid_rigid.data();
+void ChCNarrowphaseDispatch::SortPairsByType() {
+  const custom_vector<shape_type>& obj_data_T = data_manager->host_data.typ_rigid;
+  const custom_vector<long long>& collision_pair = data_manager->host_data.pair_rigid_rigid;
+
+  num_types = *thrust::max_element(obj_data_T.begin(), obj_data_T.end()) + 1;
+  const int num_buckets = num_types * num_types;
 
+  pair_type.resize(num_potentialCollisions);
 #pragma omp parallel for
   for (int index = 0; index < num_potentialCollisions; index++) {
-    uint ID_A, ID_B, icoll;
-    ConvexShape shapeA, shapeB;
-    int nC;
+    long long p = collision_pair[index];
+    pair_type[index] = obj_data_T[int(p >> 32)] * num_types + obj_data_T[int(p & 0xffffffff)];
+  }
+
+  // Every block counts its pair types, the offsets are computed type by type
+  // and block by block so that the sort is stable, then the blocks scatter
+  // their pairs in parallel
+  const int num_blocks = std::max(1, std::min(omp_get_max_threads(), int(num_potentialCollisions / 1024)));
+  const int block_size = (num_potentialCollisions + num_blocks - 1) / num_blocks;
+  std::vector<uint> offsets(num_blocks * num_buckets, 0);
+
+#pragma omp parallel for
+  for (int b = 0; b < num_blocks; b++) {
+    uint* count = offsets.data() + b * num_buckets;
+    int end = std::min(int(num_potentialCollisions), (b + 1) * block_size);
+    for (int i = b * block_size; i < end; i++) {
+      count[pair_type[i]]++;
+    }
+  }
 
-    Dispatch_Init(index, icoll, ID_A, ID_B, shapeA, shapeB);
+  type_start.resize(num_buckets + 1);
+  uint sum = 0;
+  for (int t = 0; t < num_buckets; t++) {
+    type_start[t] = sum;
+    for (int b = 0; b < num_blocks; b++) {
+      uint count = offsets[b * num_buckets + t];
+      offsets[b * num_buckets + t] = sum;
+      sum += count;
+    }
+  }
+  type_start[num_buckets] = sum;
 
-    if (RCollision(shapeA, shapeB, 2 * collision_envelope, &norm[icoll], &ptA[icoll], &ptB[icoll], &contactDepth[icoll],
-                   &effective_radius[icoll], nC)) {
-      Dispatch_Finalize(icoll, ID_A, ID_B, nC);
+  pair_order.resize(num_potentialCollisions);
+#pragma omp parallel for
+  for (int b = 0; b < num_blocks; b++) {
+    uint* offset = offsets.data() + b * num_buckets;
+    int end = std::min(int(num_potentialCollisions), (b + 1) * block_size);
+    for (int i = b * block_size; i < end; i++) {
+      pair_order[offset[pair_type[i]]++] = i;
     }
   }
 }
 
-void ChCNarrowphaseDispatch::DispatchHybridMPR() {
-  real3* norm = data_manager->host_data.norm_rigid_rigid.data();
-  real3* ptA = data_manager->host_data.cpta_rigid_rigid.data();
-  real3* ptB = data_manager->host_data.cptb_rigid_rigid.data();
-  real* contactDepth = data_manager->host_data.dpth_rigid_rigid.data();
-  real* effective_radius = data_manager->host_data.erad_rigid_rigid.data();
+void ChCNarrowphaseDispatch::DispatchRSorted(NARROWPHASETYPE fallback) {
+  SortPairsByType();
 
+  // Every pair type is processed by its own loop, the pairs of a loop all do
+  // the same amount of work
+  for (int t = 0; t < num_types * num_types; t++) {
+    const int start = type_start[t];
+    const int end = type_start[t + 1];
+    if (start == end) {
+      continue;
+    }
+    const shape_type typeA = t / num_types;
+    const shape_type typeB = t % num_types;
+    RCollisionPair pair_function = RCollisionSelect(typeA, typeB);
+
+    if (typeA == TRIANGLEMESH_BVH || typeB == TRIANGLEMESH_BVH) {
 #pragma omp parallel for
-  for (int index = 0; index < num_potentialCollisions; index++) {
-    uint ID_A, ID_B, icoll;
-    ConvexShape shapeA, shapeB;
-    int nC;
+      for (int i = start; i < end; i++) {
+        uint ID_A, ID_B;
+        ContactSlot slot;
+        ConvexShape shapeA, shapeB;
 
-    Dispatch_Init(index, icoll, ID_A, ID_B, shapeA, shapeB);
+        Dispatch_Init(pair_order[i], slot, ID_A, ID_B, shapeA, shapeB);
 
-    if (RCollision(shapeA, shapeB, 2 * collision_envelope, &norm[icoll], &ptA[icoll], &ptB[icoll], &contactDepth[icoll],
-                   &effective_radius[icoll], nC)) {
-      Dispatch_Finalize(icoll, ID_A, ID_B, nC);
-    } else if (MPRCollision(shapeA, shapeB, collision_envelope, norm[icoll], ptA[icoll], ptB[icoll],
-                            contactDepth[icoll])) {
-      effective_radius[icoll] = edge_radius;
-      Dispatch_Finalize(icoll, ID_A, ID_B, 1);
+        int nC = CollideMesh(shapeA, shapeB, slot, fallback);
+        if (nC > 0) {
+          Dispatch_Finalize(slot.index, slot.icoll, ID_A, ID_B, nC);
+        }
+      }
+    } else if ((typeA == SPHERE && typeB == SPHERE) || (typeA == BOX && typeB == SPHERE) ||
+               (typeA == SPHERE && typeB == BOX)) {
+      DispatchRBatch(start, end, typeA, typeB);
+    } else if (pair_function) {
+#pragma omp parallel for
+      for (int i = start; i < end; i++) {
+        uint ID_A, ID_B;
+        ContactSlot slot;
+        ConvexShape shapeA, shapeB;
+        int nC;
+
+        Dispatch_Init(pair_order[i], slot, ID_A, ID_B, shapeA, shapeB);
+
+        if (pair_function(shapeA, shapeB, 2 * collision_envelope, slot.norm, slot.ptA, slot.ptB, slot.depth,
+                          slot.erad, nC)) {
+          Dispatch_Finalize(slot.index, slot.icoll, ID_A, ID_B, nC);
+        }
+      }
+    } else if (typeA == HEIGHTFIELD || typeB == HEIGHTFIELD) {
+      // Heightfields are only handled by NarrowphaseR
+      continue;
+    } else if (fallback == NARROWPHASE_HYBRID_MPR) {
+#pragma omp parallel for
+      for (int i = start; i < end; i++) {
+        uint ID_A, ID_B;
+        ContactSlot slot;
+        ConvexShape shapeA, shapeB;
+
+        Dispatch_Init(pair_order[i], slot, ID_A, ID_B, shapeA, shapeB);
+
+        if (CollideMPR(shapeA, shapeB, slot)) {
+          Dispatch_Finalize(slot.index, slot.icoll, ID_A, ID_B, 1);
+        }
+      }
+    } else if (fallback == NARROWPHASE_HYBRID_GJK) {
+#pragma omp parallel for
+      for (int i = start; i < end; i++) {
+        uint ID_A, ID_B;
+        ContactSlot slot;
+        ConvexShape shapeA, shapeB;
+
+        Dispatch_Init(pair_order[i], slot, ID_A, ID_B, shapeA, shapeB);
+
+        if (CollideGJK(shapeA, shapeB, slot)) {
+          Dispatch_Finalize(slot.index, slot.icoll, ID_A, ID_B, 1);
+        }
+      }
     }
   }
 }
 
-void ChCNarrowphaseDispatch::DispatchHybridGJK() {
-  real3* norm = data_manager->host_data.norm_rigid_rigid.data();
-  real3* ptA = data_manager->host_data.cpta_rigid_rigid.data();
-  real3* ptB = data_manager->host_data.cptb_rigid_rigid.data();
-  real* contactDepth = data_manager->host_data.dpth_rigid_rigid.data();
-  real* effective_radius = data_manager->host_data.erad_rigid_rigid.data();
+void ChCNarrowphaseDispatch::DispatchRBatch(int start, int end, shape_type typeA, shape_type typeB) {
+  const custom_vector<long long>& contact_pair = data_manager->host_data.pair_rigid_rigid;
+  const custom_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  const custom_vector<real3>& obj_data_A_global = data_manager->host_data.ObA_global;
+  const custom_vector<real3>& obj_data_B_global = data_manager->host_data.ObB_global;
+  const custom_vector<real4>& obj_data_R_global = data_manager->host_data.ObR_global;
+  const int num_pairs = end - start;
+  batch_shapeA.resize(num_pairs);
+  batch_shapeB.resize(num_pairs);
+  batch_icoll.resize(num_pairs);
+  batch_contact.resize(num_pairs);
 
 #pragma omp parallel for
-  for (int index = 0; index < num_potentialCollisions; index++) {
-    uint ID_A, ID_B, icoll;
-    ConvexShape shapeA, shapeB;
-    int nC;
-
-    Dispatch_Init(index, icoll, ID_A, ID_B, shapeA, shapeB);
-    ContactPoint contact_point;
-    real3 separating_axis;
-    if (RCollision(shapeA, shapeB, 2 * collision_envelope, &norm[icoll], &ptA[icoll], &ptB[icoll], &contactDepth[icoll],
-                   &effective_radius[icoll], nC)) {
-      Dispatch_Finalize(icoll, ID_A, ID_B, nC);
-    } else if (GJKCollide(shapeA, shapeB, collision_envelope, contact_point,separating_axis )) {
-      norm[icoll] = -contact_point.normal;
-      ptA[icoll] = contact_point.pointA;
-      ptB[icoll] = contact_point.pointB;
-      contactDepth[icoll] = contact_point.depth;
-
-      effective_radius[icoll] = edge_radius;
-      Dispatch_Finalize(icoll, ID_A, ID_B, 1);
+  for (int i = 0; i < num_pairs; i++) {
+    uint index = pair_order[start + i];
+    long long p = contact_pair[index];
+    batch_shapeA[i] = int(p >> 32);
+    batch_shapeB[i] = int(p & 0xffffffff);
+    batch_icoll[i] = contact_index[index];
+  }
+
+  // Every chunk is processed by one thread, its size is a multiple of the
+  // vector width so that only the last chunk has pairs left for the scalar code
+  const int chunk_size = 256;
+  const int num_chunks = (num_pairs + chunk_size - 1) / chunk_size;
+  const real separation = 2 * collision_envelope;
+
+#pragma omp parallel for
+  for (int c = 0; c < num_chunks; c++) {
+    const int first = c * chunk_size;
+    const int count = std::min(chunk_size, num_pairs - first);
+    const uint* shapeA = batch_shapeA.data() + first;
+    const uint* shapeB = batch_shapeB.data() + first;
+    uint* icoll = batch_icoll.data() + first;
+    bool* contact = batch_contact.data() + first;
+
+    real3* norm = data_manager->host_data.norm_rigid_rigid.data();
+    real3* ptA = data_manager->host_data.cpta_rigid_rigid.data();
+    real3* ptB = data_manager->host_data.cptb_rigid_rigid.data();
+    real* contactDepth = data_manager->host_data.dpth_rigid_rigid.data();
+    real* effective_radius = data_manager->host_data.erad_rigid_rigid.data();
+
+    // With thread buffers every pair of the chunk gets a slot at the end of
+    // the buffer, the slots are compacted once the contacts are known
+    ContactBuffer* buffer = 0;
+    if (use_thread_buffers) {
+      buffer = &thread_buffers[omp_get_thread_num()];
+      buffer->Reserve(count);
+      for (int i = 0; i < count; i++) {
+        icoll[i] = buffer->size + i;
+      }
+      norm = buffer->norm.data();
+      ptA = buffer->ptA.data();
+      ptB = buffer->ptB.data();
+      contactDepth = buffer->depth.data();
+      effective_radius = buffer->erad.data();
+    }
+
+    if (typeA == SPHERE && typeB == SPHERE) {
+      sphere_sphere_batch(count, shapeA, shapeB, icoll, obj_data_A_global.data(), obj_data_B_global.data(), separation,
+                          norm, contactDepth, ptA, ptB, effective_radius, contact);
+    } else if (typeA == BOX) {
+      box_sphere_batch(count, shapeA, shapeB, false, icoll, obj_data_A_global.data(), obj_data_R_global.data(),
+                       obj_data_B_global.data(), separation, norm, contactDepth, ptA, ptB, effective_radius, contact);
+    } else {
+      box_sphere_batch(count, shapeB, shapeA, true, icoll, obj_data_A_global.data(), obj_data_R_global.data(),
+                       obj_data_B_global.data(), separation, norm, contactDepth, ptA, ptB, effective_radius, contact);
+    }
+
+    for (int i = 0; i < count; i++) {
+      if (!contact[i]) {
+        continue;
+      }
+      uint index = pair_order[start + first + i];
+      if (buffer) {
+        // Move the contact next to the previous one, Dispatch_Finalize
+        // appends it
+        uint k = buffer->size;
+        norm[k] = norm[icoll[i]];
+        ptA[k] = ptA[icoll[i]];
+        ptB[k] = ptB[icoll[i]];
+        contactDepth[k] = contactDepth[icoll[i]];
+        effective_radius[k] = effective_radius[icoll[i]];
+        Dispatch_Finalize(index, k, obj_data_ID[shapeA[i]], obj_data_ID[shapeB[i]], 1);
+      } else {
+        Dispatch_Finalize(index, icoll[i], obj_data_ID[shapeA[i]], obj_data_ID[shapeB[i]], 1);
+      }
     }
   }
 }
 
+void ChCNarrowphaseDispatch::DispatchR() {
+  DispatchRSorted(NARROWPHASE_R);
+}
+
+void ChCNarrowphaseDispatch::DispatchHybridMPR() {
+  DispatchRSorted(NARROWPHASE_HYBRID_MPR);
+}
+
+void ChCNarrowphaseDispatch::DispatchHybridGJK() {
+  DispatchRSorted(NARROWPHASE_HYBRID_GJK);
+}
+
 void ChCNarrowphaseDispatch::Dispatch() {
+  if (use_axis_cache) {
+    LoadAxisCache();
+  }
   switch (narrowphase_algorithm) {
     case NARROWPHASE_MPR:
       DispatchMPR();
@@ -374,6 +1037,9 @@ void ChCNarrowphaseDispatch::Dispatch() {
       DispatchHybridGJK();
       break;
   }
+  if (use_axis_cache) {
+    StoreAxisCache();
+  }
 }
 
 }  // end namespace collision
@@ -1,11 +1,40 @@
 #ifndef CHC_NARROWPHASEDISPATCH_H
 #define CHC_NARROWPHASEDISPATCH_H
 
+#include <vector>
+
 #include "chrono_parallel/ChParallelDefines.h"
 #include "chrono_parallel/ChDataManager.h"
 #include "chrono_parallel/collision/ChCDataStructures.h"
 namespace chrono {
 namespace collision {
+// Where the contacts of one pair are written, set by Dispatch_Init. The output
+// pointers point either to the slots of the pair in the contact arrays or to
+// the end of the buffer of the calling thread.
+struct ContactSlot {
+  uint index;  // index of the potential collision
+  uint icoll;  // index of the first contact in the output arrays
+  real3* norm;
+  real3* ptA;
+  real3* ptB;
+  real* depth;
+  real* erad;
+};
+
+// Contacts found by one thread when thread buffers are used. The contacts of a
+// pair are stored next to each other and pair holds their potential collision.
+struct ContactBuffer {
+  ContactBuffer() { size = 0; }
+  // Make room for count more contacts, the storage is kept between steps
+  void Reserve(uint count);
+
+  custom_vector<real3> norm, ptA, ptB;
+  custom_vector<real> depth, erad;
+  custom_vector<int2> bids;
+  custom_vector<uint> pair;
+  uint size;
+};
+
 /*
  * Narrowphase dispatch will handle the outer loop for the collision detection code
  * For each contact pair it will decide what algorithm to use
@@ -18,19 +47,19 @@ namespace collision {
 
 class CH_PARALLEL_API ChCNarrowphaseDispatch {
  public:
-  ChCNarrowphaseDispatch() {}
+  ChCNarrowphaseDispatch() {
+    num_types = 0;
+    use_thread_buffers = false;
+    use_axis_cache = false;
+  }
   ~ChCNarrowphaseDispatch() {}
   // Perform collision detection
   void Process();
 
   void PreprocessCount();
 
-  // Transform the shape data to the global reference frame
-  // Perform this as a preprocessing step to improve performance
-  // Performance is improved because the amount of data loaded is still the same
-  // but it does not have to be transformed per contact pair, now it is
-  // transformed once per shape
-  void PreprocessLocalToParent();
+  // The shape data in the global reference frame (ObA_global, ...) is written
+  // once per shape by ChCAABBGenerator, it is not transformed per contact pair
 
   // For each contact pair decide what to do.
   void Dispatch();
@@ -39,15 +68,78 @@ class CH_PARALLEL_API ChCNarrowphaseDispatch {
   void DispatchR();
   void DispatchHybridMPR();
   void DispatchHybridGJK();
-  void Dispatch_Init(uint index, uint& icoll, uint& ID_A, uint& ID_B, ConvexShape& shapeA, ConvexShape& shapeB);
-  void Dispatch_Finalize(uint icoll, uint ID_A, uint ID_B, int nC);
+  // Sort the pairs by the types of their shapes with a counting sort so that
+  // every pair type can be processed by its own loop
+  void SortPairsByType();
+  // Process the sorted pairs with the NarrowphaseR function of every pair type,
+  // the types it does not support are processed by MPR or GJK if requested
+  void DispatchRSorted(NARROWPHASETYPE fallback);
+  // Process the sorted pairs from start to end, all sphere-sphere or all
+  // box-sphere, with the batched (SIMD) NarrowphaseR functions
+  void DispatchRBatch(int start, int end, shape_type typeA, shape_type typeB);
+  void Dispatch_Init(uint index, ContactSlot& slot, uint& ID_A, uint& ID_B, ConvexShape& shapeA, ConvexShape& shapeB);
+  void Dispatch_Finalize(uint index, uint icoll, uint ID_A, uint ID_B, int nC);
+  // Write the contacts of the thread buffers to their final position in the
+  // contact arrays, computed with a prefix sum over the contacts of each pair
+  void ScatterThreadBuffers();
+  // Group the contacts of every body pair by normal and keep at most four
+  // contacts per group, then compact the contact arrays
+  void ReduceContacts();
+  // Run MPR or GJK on one pair and write the contact to its slot, the cached
+  // axis of the pair is used and updated when enabled
+  bool CollideMPR(const ConvexShape& shapeA, const ConvexShape& shapeB, ContactSlot& slot);
+  bool CollideGJK(const ConvexShape& shapeA, const ConvexShape& shapeB, ContactSlot& slot);
+  // Collide a shape with the triangles of a mesh found by traversing its
+  // hierarchy, the triangles are processed by the given algorithm and the
+  // deepest contacts are kept. Returns the number of contacts. Mesh-mesh and
+  // mesh-heightfield pairs are not supported, they give no contact and a
+  // warning is logged the first time one is found.
+  int CollideMesh(const ConvexShape& shapeA, const ConvexShape& shapeB, ContactSlot& slot, NARROWPHASETYPE algorithm);
+  // Collide a shape with a heightfield using NarrowphaseR, the cells under the
+  // shape are found by indexing the grid. Pairs that are not supported by
+  // NarrowphaseR give no contact.
+  void CollideHeightfield(const ConvexShape& shapeA,
+                          const ConvexShape& shapeB,
+                          ContactSlot& slot,
+                          uint ID_A,
+                          uint ID_B);
+  // Find the cached axis of every pair, and keep the axes of this step for the
+  // next one
+  void LoadAxisCache();
+  void StoreAxisCache();
+  // Discard the cached axes, must be called when the shapes are reordered
+  void ResetAxisCache();
   ChParallelDataManager* data_manager;
 
  private:
-  custom_vector<real3> obj_data_A_global, obj_data_B_global, obj_data_C_global;  //
-  custom_vector<real4> obj_data_R_global;
   custom_vector<bool> contact_active;
   custom_vector<uint> contact_index;
+  // Pair type (typeA * num_types + typeB) of every pair, pair indices sorted
+  // by type and the start of every type in the sorted list
+  int num_types;
+  custom_vector<uint> pair_type;
+  custom_vector<uint> pair_order;
+  custom_vector<uint> type_start;
+  // Shapes, contact slots and results of the pairs given to the batched functions
+  custom_vector<uint> batch_shapeA, batch_shapeB, batch_icoll;
+  custom_vector<bool> batch_contact;
+  // Contacts found by every thread and number of contacts of every pair when
+  // thread buffers are used
+  bool use_thread_buffers;
+  std::vector<ContactBuffer> thread_buffers;
+  custom_vector<uint> contact_count;
+  custom_vector<long long> scatter_pair;
+  // Axis used by MPR and GJK for every pair, and the pairs and axes kept from
+  // the previous step sorted by pair
+  bool use_axis_cache;
+  custom_vector<real3> pair_axis;
+  custom_vector<long long> cache_pair;
+  custom_vector<real3> cache_axis;
+  // Body pair of every contact, contact indices sorted by body pair and the
+  // start of every body pair in the sorted list
+  custom_vector<long long> reduce_key;
+  custom_vector<uint> reduce_order;
+  custom_vector<uint> reduce_start;
   unsigned int num_potentialCollisions;
   real collision_envelope;
   NARROWPHASETYPE narrowphase_algorithm;
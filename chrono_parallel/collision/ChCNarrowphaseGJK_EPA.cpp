@@ -812,7 +812,8 @@ bool GJKCollide(const ConvexShape& shape0,
                 const ConvexShape& shape1,
                 const real & envelope,
                 ContactPoint& contact_point,
-                real3& m_cachedSeparatingAxis) {
+                real3& m_cachedSeparatingAxis,
+                bool use_cached_axis) {
   sResults results;
   real m_cachedSeparatingDistance;
   int gNumDeepPenetrationChecks = 0;
@@ -841,7 +842,11 @@ bool GJKCollide(const ConvexShape& shape0,
 
   m_curIter = 0;
   int gGjkMaxIter = 1000;
-  m_cachedSeparatingAxis = real3(0, 1, 0);
+  // Start from the axis of the previous call for this pair if there is one
+  bool warm_started = use_cached_axis && !IsZero(m_cachedSeparatingAxis);
+  if (!warm_started) {
+    m_cachedSeparatingAxis = real3(0, 1, 0);
+  }
 
   bool isValid = false;
   bool checkSimplex = false;
@@ -875,6 +880,14 @@ bool GJKCollide(const ConvexShape& shape0,
       real3 w = pWorld - qWorld;
       delta = m_cachedSeparatingAxis.dot(w);
 
+      // early out, the shapes are still separated along the cached axis by
+      // more than the margins and the envelope
+      if (warm_started && m_curIter == 0 && delta > 0 &&
+          delta * delta > (margin + envelope) * (margin + envelope) * m_cachedSeparatingAxis.length2()) {
+        delete m_simplexSolver;
+        return false;
+      }
+
       // potential exit, they don't overlap
       if ((delta > real(0.0)) && (delta * delta > squaredDistance * LARGE_REAL)) {
         m_degenerateSimplex = 10;
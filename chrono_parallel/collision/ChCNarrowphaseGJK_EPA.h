@@ -49,12 +49,17 @@ bool GJKDistance(const ConvexShape& shape0, const ConvexShape& shape1, const rea
 CH_PARALLEL_API
 bool GJKPenetration(const ConvexShape& shape0, const ConvexShape& shape1, const real3& guess, const real & envelope, sResults& results);
 
+// If use_cached_axis is set and m_cachedSeparatingAxis is not zero, it holds
+// the axis returned for the same pair by a previous call. It seeds the search
+// and the pair is rejected right away if the shapes are still separated along
+// it. On return m_cachedSeparatingAxis holds the axis to use for the next call.
 CH_PARALLEL_API
 bool GJKCollide(const ConvexShape& shape0,
                 const ConvexShape& shape1,
                 const real & envelope,
                 ContactPoint& point,
-                real3& m_cachedSeparatingAxis);
+                real3& m_cachedSeparatingAxis,
+                bool use_cached_axis = false);
 
 CH_PARALLEL_API
 bool GJKFindPenetration(const ConvexShape& shape0, const ConvexShape& shape1, const real & envelope, sResults& results);
@@ -484,8 +484,12 @@ bool FindPortal(const ConvexShape& shapeA, const ConvexShape& shapeB, const real
   return true;
 }
 
-int DiscoverPortal(const ConvexShape& shapeA, const ConvexShape& shapeB, const real& envelope, simplex& portal) {
-  real3 n, va, vb;
+// On failure n holds the direction along which the shapes were found to be separated
+int DiscoverPortal(const ConvexShape& shapeA,
+                   const ConvexShape& shapeB,
+                   const real& envelope,
+                   simplex& portal,
+                   real3& n) {
   // vertex 0 is center of portal
   FindCenter(shapeA, shapeB, portal);
 
@@ -553,8 +557,11 @@ int DiscoverPortal(const ConvexShape& shapeA, const ConvexShape& shapeB, const r
   }
   return 0;
 }
-int RefinePortal(const ConvexShape& shapeA, const ConvexShape& shapeB, const real& envelope, simplex& portal) {
-  real3 n;
+int RefinePortal(const ConvexShape& shapeA,
+                 const ConvexShape& shapeB,
+                 const real& envelope,
+                 simplex& portal,
+                 real3& n) {
   for (int i = 0; i < MAX_ITERATIONS; i++) {
     // Compute normal of the wedge face
     n = PortalDir(portal);
@@ -578,20 +585,22 @@ int RefinePortal(const ConvexShape& shapeA, const ConvexShape& shapeB, const rea
   }
   return -1;
 }
-// Code for Convex-Convex Collision detection, adopted from xeno-collide
-bool chrono::collision::MPRContact(const ConvexShape& shapeA,
-                                   const ConvexShape& shapeB,
-                                   const real& envelope,
-                                   real3& returnNormal,
-                                   real3& point,
-                                   real& depth) {
+// Same as MPRContact, if there is no contact the last search direction is
+// returned in dir
+bool MPRFindContact(const ConvexShape& shapeA,
+                    const ConvexShape& shapeB,
+                    const real& envelope,
+                    real3& returnNormal,
+                    real3& point,
+                    real& depth,
+                    real3& dir) {
   simplex portal;
 
-  int result = DiscoverPortal(shapeA, shapeB, envelope, portal);
+  int result = DiscoverPortal(shapeA, shapeB, envelope, portal, dir);
   // std::cout << result << std::endl;
 
   if (result == 0) {
-    result = RefinePortal(shapeA, shapeB, envelope, portal);
+    result = RefinePortal(shapeA, shapeB, envelope, portal, dir);
     // std::cout << result << std::endl;
 
     if (result < 0) {
@@ -608,6 +617,17 @@ bool chrono::collision::MPRContact(const ConvexShape& shapeA,
   return 1;
 }
 
+// Code for Convex-Convex Collision detection, adopted from xeno-collide
+bool chrono::collision::MPRContact(const ConvexShape& shapeA,
+                                   const ConvexShape& shapeB,
+                                   const real& envelope,
+                                   real3& returnNormal,
+                                   real3& point,
+                                   real& depth) {
+  real3 dir;
+  return MPRFindContact(shapeA, shapeB, envelope, returnNormal, point, depth, dir);
+}
+
 void chrono::collision::MPRGetPoints(const ConvexShape& shapeA,
                                      const ConvexShape& shapeB,
                                      const real& envelope,
@@ -640,3 +660,38 @@ bool chrono::collision::MPRCollision(const ConvexShape& shapeA,
   depth = dot(normal, pointB - pointA);
   return true;
 }
+
+bool chrono::collision::MPRCollisionCached(const ConvexShape& shapeA,
+                                           const ConvexShape& shapeB,
+                                           real envelope,
+                                           real3& axis,
+                                           real3& normal,
+                                           real3& pointA,
+                                           real3& pointB,
+                                           real& depth) {
+  // If the support point of the Minkowski difference along the cached axis is
+  // behind the origin the shapes are still separated along it
+  if (!IsZero(axis)) {
+    support s;
+    MPRSupport(shapeA, shapeB, axis, envelope, s);
+    if (dot(s.v, axis) < 0) {
+      return false;
+    }
+  }
+
+  real3 point, dir;
+  if (!MPRFindContact(shapeA, shapeB, envelope, normal, point, depth, dir)) {
+    axis = dir;
+    return false;
+  }
+
+  MPRGetPoints(shapeA, shapeB, envelope, normal, point, pointA, pointB);
+
+  pointA = pointA - normal * envelope;
+  pointB = pointB + normal * envelope;
+  depth = dot(normal, pointB - pointA);
+  // The contact normal points from A to B, the shapes separate along the
+  // opposite direction in the Minkowski difference
+  axis = -normal;
+  return true;
+}
@@ -21,6 +21,19 @@ bool MPRCollision(const ConvexShape& ShapeA,
                   real3& pointA,
                   real3& pointB,
                   real& depth);
+// Same as MPRCollision with a direction kept for the pair between calls, zero
+// if there is none. The pair is rejected without running MPR if the shapes are
+// still separated along it. On return axis holds the direction that separated
+// the shapes or the opposite of the contact normal.
+CH_PARALLEL_API
+bool MPRCollisionCached(const ConvexShape& ShapeA,
+                        const ConvexShape& ShapeB,
+                        real envelope,
+                        real3& axis,
+                        real3& returnNormal,
+                        real3& pointA,
+                        real3& pointB,
+                        real& depth);
 CH_PARALLEL_API
 void MPRGetPoints(const ConvexShape& ShapeA,
                   const ConvexShape& ShapeB,
@@ -51,311 +51,312 @@ bool RCollision(const ConvexShape& shapeA,  // first candidate shape
                 real* ct_eff_rad,           // [output] effective contact radius (per contact pair)
                 int& nC)                    // [output] number of contacts found
 {
+  nC = 0;
+
   // Special-case the collision detection based on the types of the
   // two potentially colliding shapes.
+  RCollisionPair pair_function = RCollisionSelect(shapeA.type, shapeB.type);
 
-  nC = 0;
-
-  if (shapeA.type == SPHERE && shapeB.type == SPHERE) {
-    if (sphere_sphere(shapeA.A,
-                      shapeA.B.x,
-                      shapeB.A,
-                      shapeB.B.x,
-                      separation,
-                      *ct_norm,
-                      *ct_depth,
-                      *ct_pt1,
-                      *ct_pt2,
-                      *ct_eff_rad)) {
-      nC = 1;
-    }
-    return true;
-  }
+  // Contact could not be checked using this CD algorithm
+  if (pair_function == 0)
+    return false;
 
-  if (shapeA.type == CAPSULE && shapeB.type == SPHERE) {
-    if (capsule_sphere(shapeA.A,
-                       shapeA.R,
-                       shapeA.B.x,
-                       shapeA.B.y,
-                       shapeB.A,
-                       shapeB.B.x,
-                       separation,
-                       *ct_norm,
-                       *ct_depth,
-                       *ct_pt1,
-                       *ct_pt2,
-                       *ct_eff_rad)) {
-      nC = 1;
-    }
-    return true;
-  }
+  return pair_function(shapeA, shapeB, separation, ct_norm, ct_pt1, ct_pt2, ct_depth, ct_eff_rad, nC);
+}
 
-  if (shapeA.type == SPHERE && shapeB.type == CAPSULE) {
-    if (capsule_sphere(shapeB.A,
-                       shapeB.R,
-                       shapeB.B.x,
-                       shapeB.B.y,
-                       shapeA.A,
-                       shapeA.B.x,
-                       separation,
-                       *ct_norm,
-                       *ct_depth,
-                       *ct_pt2,
-                       *ct_pt1,
-                       *ct_eff_rad)) {
-      *ct_norm = -(*ct_norm);
-      nC = 1;
-    }
-    return true;
+// =============================================================================
+//              PAIR FUNCTIONS
+//
+// One function per supported pair of shape types, all with the signature of
+// RCollision. The pairs where the order of the shapes is reversed call the
+// function of the other order with the shapes and the contact points swapped
+// and flip the normals.
+
+static bool RCollision_sphere_sphere(const ConvexShape& shapeA,
+                                     const ConvexShape& shapeB,
+                                     real separation,
+                                     real3* ct_norm,
+                                     real3* ct_pt1,
+                                     real3* ct_pt2,
+                                     real* ct_depth,
+                                     real* ct_eff_rad,
+                                     int& nC) {
+  nC = 0;
+  if (sphere_sphere(shapeA.A, shapeA.B.x, shapeB.A, shapeB.B.x, separation, *ct_norm, *ct_depth, *ct_pt1, *ct_pt2,
+                    *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == CYLINDER && shapeB.type == SPHERE) {
-    if (cylinder_sphere(shapeA.A,
-                        shapeA.R,
-                        shapeA.B.x,
-                        shapeA.B.y,
-                        shapeB.A,
-                        shapeB.B.x,
-                        separation,
-                        *ct_norm,
-                        *ct_depth,
-                        *ct_pt1,
-                        *ct_pt2,
-                        *ct_eff_rad)) {
-      nC = 1;
-    }
-    return true;
+static bool RCollision_capsule_sphere(const ConvexShape& shapeA,
+                                      const ConvexShape& shapeB,
+                                      real separation,
+                                      real3* ct_norm,
+                                      real3* ct_pt1,
+                                      real3* ct_pt2,
+                                      real* ct_depth,
+                                      real* ct_eff_rad,
+                                      int& nC) {
+  nC = 0;
+  if (capsule_sphere(shapeA.A, shapeA.R, shapeA.B.x, shapeA.B.y, shapeB.A, shapeB.B.x, separation, *ct_norm,
+                     *ct_depth, *ct_pt1, *ct_pt2, *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == SPHERE && shapeB.type == CYLINDER) {
-    if (cylinder_sphere(shapeB.A,
-                        shapeB.R,
-                        shapeB.B.x,
-                        shapeB.B.y,
-                        shapeA.A,
-                        shapeA.B.x,
-                        separation,
-                        *ct_norm,
-                        *ct_depth,
-                        *ct_pt2,
-                        *ct_pt1,
-                        *ct_eff_rad)) {
-      *ct_norm = -(*ct_norm);
-      nC = 1;
-    }
-    return true;
+static bool RCollision_cylinder_sphere(const ConvexShape& shapeA,
+                                       const ConvexShape& shapeB,
+                                       real separation,
+                                       real3* ct_norm,
+                                       real3* ct_pt1,
+                                       real3* ct_pt2,
+                                       real* ct_depth,
+                                       real* ct_eff_rad,
+                                       int& nC) {
+  nC = 0;
+  if (cylinder_sphere(shapeA.A, shapeA.R, shapeA.B.x, shapeA.B.y, shapeB.A, shapeB.B.x, separation, *ct_norm,
+                      *ct_depth, *ct_pt1, *ct_pt2, *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == ROUNDEDCYL && shapeB.type == SPHERE) {
-    if (roundedcyl_sphere(shapeA.A,
-                          shapeA.R,
-                          shapeA.B.x,
-                          shapeA.B.y,
-                          shapeA.C.x,
-                          shapeB.A,
-                          shapeB.B.x,
-                          separation,
-                          *ct_norm,
-                          *ct_depth,
-                          *ct_pt1,
-                          *ct_pt2,
-                          *ct_eff_rad)) {
-      nC = 1;
-    }
-    return true;
+static bool RCollision_roundedcyl_sphere(const ConvexShape& shapeA,
+                                         const ConvexShape& shapeB,
+                                         real separation,
+                                         real3* ct_norm,
+                                         real3* ct_pt1,
+                                         real3* ct_pt2,
+                                         real* ct_depth,
+                                         real* ct_eff_rad,
+                                         int& nC) {
+  nC = 0;
+  if (roundedcyl_sphere(shapeA.A, shapeA.R, shapeA.B.x, shapeA.B.y, shapeA.C.x, shapeB.A, shapeB.B.x, separation,
+                        *ct_norm, *ct_depth, *ct_pt1, *ct_pt2, *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == SPHERE && shapeB.type == ROUNDEDCYL) {
-    if (roundedcyl_sphere(shapeB.A,
-                          shapeB.R,
-                          shapeB.B.x,
-                          shapeB.B.y,
-                          shapeB.C.x,
-                          shapeA.A,
-                          shapeA.B.x,
-                          separation,
-                          *ct_norm,
-                          *ct_depth,
-                          *ct_pt2,
-                          *ct_pt1,
-                          *ct_eff_rad)) {
-      *ct_norm = -(*ct_norm);
-      nC = 1;
-    }
-    return true;
+static bool RCollision_box_sphere(const ConvexShape& shapeA,
+                                  const ConvexShape& shapeB,
+                                  real separation,
+                                  real3* ct_norm,
+                                  real3* ct_pt1,
+                                  real3* ct_pt2,
+                                  real* ct_depth,
+                                  real* ct_eff_rad,
+                                  int& nC) {
+  nC = 0;
+  if (box_sphere(shapeA.A, shapeA.R, shapeA.B, shapeB.A, shapeB.B.x, separation, *ct_norm, *ct_depth, *ct_pt1,
+                 *ct_pt2, *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == BOX && shapeB.type == SPHERE) {
-    if (box_sphere(shapeA.A,
-                   shapeA.R,
-                   shapeA.B,
-                   shapeB.A,
-                   shapeB.B.x,
-                   separation,
-                   *ct_norm,
-                   *ct_depth,
-                   *ct_pt1,
-                   *ct_pt2,
-                   *ct_eff_rad)) {
-      nC = 1;
-    }
-    return true;
+static bool RCollision_roundedbox_sphere(const ConvexShape& shapeA,
+                                         const ConvexShape& shapeB,
+                                         real separation,
+                                         real3* ct_norm,
+                                         real3* ct_pt1,
+                                         real3* ct_pt2,
+                                         real* ct_depth,
+                                         real* ct_eff_rad,
+                                         int& nC) {
+  nC = 0;
+  if (roundedbox_sphere(shapeA.A, shapeA.R, shapeA.B, shapeA.C.x, shapeB.A, shapeB.B.x, separation, *ct_norm,
+                        *ct_depth, *ct_pt1, *ct_pt2, *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == SPHERE && shapeB.type == BOX) {
-    if (box_sphere(shapeB.A,
-                   shapeB.R,
-                   shapeB.B,
-                   shapeA.A,
-                   shapeA.B.x,
-                   separation,
-                   *ct_norm,
-                   *ct_depth,
-                   *ct_pt2,
-                   *ct_pt1,
-                   *ct_eff_rad)) {
-      *ct_norm = -(*ct_norm);
-      nC = 1;
-    }
-    return true;
+static bool RCollision_face_sphere(const ConvexShape& shapeA,
+                                   const ConvexShape& shapeB,
+                                   real separation,
+                                   real3* ct_norm,
+                                   real3* ct_pt1,
+                                   real3* ct_pt2,
+                                   real* ct_depth,
+                                   real* ct_eff_rad,
+                                   int& nC) {
+  nC = 0;
+  if (face_sphere(shapeA.A, shapeA.B, shapeA.C, shapeB.A, shapeB.B.x, separation, *ct_norm, *ct_depth, *ct_pt1,
+                  *ct_pt2, *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == ROUNDEDBOX && shapeB.type == SPHERE) {
-    if (roundedbox_sphere(shapeA.A,
-                          shapeA.R,
-                          shapeA.B,
-                          shapeA.C.x,
-                          shapeB.A,
-                          shapeB.B.x,
-                          separation,
-                          *ct_norm,
-                          *ct_depth,
-                          *ct_pt1,
-                          *ct_pt2,
-                          *ct_eff_rad)) {
-      nC = 1;
-    }
-    return true;
-  }
+static bool RCollision_capsule_capsule(const ConvexShape& shapeA,
+                                       const ConvexShape& shapeB,
+                                       real separation,
+                                       real3* ct_norm,
+                                       real3* ct_pt1,
+                                       real3* ct_pt2,
+                                       real* ct_depth,
+                                       real* ct_eff_rad,
+                                       int& nC) {
+  nC = capsule_capsule(shapeA.A, shapeA.R, shapeA.B.x, shapeA.B.y, shapeB.A, shapeB.R, shapeB.B.x, shapeB.B.y,
+                       separation, ct_norm, ct_depth, ct_pt1, ct_pt2, ct_eff_rad);
+  return true;
+}
 
-  if (shapeA.type == SPHERE && shapeB.type == ROUNDEDBOX) {
-    if (roundedbox_sphere(shapeB.A,
-                          shapeB.R,
-                          shapeB.B,
-                          shapeB.C.x,
-                          shapeA.A,
-                          shapeA.B.x,
-                          separation,
-                          *ct_norm,
-                          *ct_depth,
-                          *ct_pt2,
-                          *ct_pt1,
-                          *ct_eff_rad)) {
-      *ct_norm = -(*ct_norm);
-      nC = 1;
-    }
-    return true;
-  }
+static bool RCollision_box_capsule(const ConvexShape& shapeA,
+                                   const ConvexShape& shapeB,
+                                   real separation,
+                                   real3* ct_norm,
+                                   real3* ct_pt1,
+                                   real3* ct_pt2,
+                                   real* ct_depth,
+                                   real* ct_eff_rad,
+                                   int& nC) {
+  nC = box_capsule(shapeA.A, shapeA.R, shapeA.B, shapeB.A, shapeB.R, shapeB.B.x, shapeB.B.y, separation, ct_norm,
+                   ct_depth, ct_pt1, ct_pt2, ct_eff_rad);
+  return true;
+}
 
-  if (shapeA.type == TRIANGLEMESH && shapeB.type == SPHERE) {
-    if (face_sphere(shapeA.A,
-                    shapeA.B,
-                    shapeA.C,
-                    shapeB.A,
-                    shapeB.B.x,
-                    separation,
-                    *ct_norm,
-                    *ct_depth,
-                    *ct_pt1,
-                    *ct_pt2,
-                    *ct_eff_rad)) {
-      nC = 1;
-    }
-    return true;
-  }
+static bool RCollision_box_box(const ConvexShape& shapeA,
+                               const ConvexShape& shapeB,
+                               real separation,
+                               real3* ct_norm,
+                               real3* ct_pt1,
+                               real3* ct_pt2,
+                               real* ct_depth,
+                               real* ct_eff_rad,
+                               int& nC) {
+  nC = box_box(shapeA.A, shapeA.R, shapeA.B, shapeB.A, shapeB.R, shapeB.B, separation, ct_norm, ct_depth, ct_pt1,
+               ct_pt2, ct_eff_rad);
+  return true;
+}
 
-  if (shapeA.type == SPHERE && shapeB.type == TRIANGLEMESH) {
-    if (face_sphere(shapeB.A,
-                    shapeB.B,
-                    shapeB.C,
-                    shapeA.A,
-                    shapeA.B.x,
-                    separation,
-                    *ct_norm,
-                    *ct_depth,
-                    *ct_pt2,
-                    *ct_pt1,
-                    *ct_eff_rad)) {
-      *ct_norm = -(*ct_norm);
-      nC = 1;
-    }
-    return true;
+static bool RCollision_heightfield_sphere(const ConvexShape& shapeA,
+                                          const ConvexShape& shapeB,
+                                          real separation,
+                                          real3* ct_norm,
+                                          real3* ct_pt1,
+                                          real3* ct_pt2,
+                                          real* ct_depth,
+                                          real* ct_eff_rad,
+                                          int& nC) {
+  nC = 0;
+  if (heightfield_sphere(shapeA.A, shapeA.R, shapeA.B, shapeA.C, shapeA.heights, shapeB.A, shapeB.B.x, separation,
+                         *ct_norm, *ct_depth, *ct_pt1, *ct_pt2, *ct_eff_rad)) {
+    nC = 1;
   }
+  return true;
+}
 
-  if (shapeA.type == CAPSULE && shapeB.type == CAPSULE) {
-    nC = capsule_capsule(shapeA.A,
-                         shapeA.R,
-                         shapeA.B.x,
-                         shapeA.B.y,
-                         shapeB.A,
-                         shapeB.R,
-                         shapeB.B.x,
-                         shapeB.B.y,
-                         separation,
-                         ct_norm,
-                         ct_depth,
-                         ct_pt1,
-                         ct_pt2,
-                         ct_eff_rad);
-    return true;
-  }
+static bool RCollision_heightfield_capsule(const ConvexShape& shapeA,
+                                           const ConvexShape& shapeB,
+                                           real separation,
+                                           real3* ct_norm,
+                                           real3* ct_pt1,
+                                           real3* ct_pt2,
+                                           real* ct_depth,
+                                           real* ct_eff_rad,
+                                           int& nC) {
+  nC = heightfield_capsule(shapeA.A, shapeA.R, shapeA.B, shapeA.C, shapeA.heights, shapeB.A, shapeB.R, shapeB.B.x,
+                           shapeB.B.y, separation, ct_norm, ct_depth, ct_pt1, ct_pt2, ct_eff_rad);
+  return true;
+}
 
-  if (shapeA.type == BOX && shapeB.type == CAPSULE) {
-    nC = box_capsule(shapeA.A,
-                     shapeA.R,
-                     shapeA.B,
-                     shapeB.A,
-                     shapeB.R,
-                     shapeB.B.x,
-                     shapeB.B.y,
-                     separation,
-                     ct_norm,
-                     ct_depth,
-                     ct_pt1,
-                     ct_pt2,
-                     ct_eff_rad);
-    return true;
-  }
+static bool RCollision_heightfield_box(const ConvexShape& shapeA,
+                                       const ConvexShape& shapeB,
+                                       real separation,
+                                       real3* ct_norm,
+                                       real3* ct_pt1,
+                                       real3* ct_pt2,
+                                       real* ct_depth,
+                                       real* ct_eff_rad,
+                                       int& nC) {
+  nC = heightfield_box(shapeA.A, shapeA.R, shapeA.B, shapeA.C, shapeA.heights, shapeB.A, shapeB.R, shapeB.B,
+                       separation, ct_norm, ct_depth, ct_pt1, ct_pt2, ct_eff_rad);
+  return true;
+}
 
-  if (shapeA.type == CAPSULE && shapeB.type == BOX) {
-    nC = box_capsule(shapeB.A,
-                     shapeB.R,
-                     shapeB.B,
-                     shapeA.A,
-                     shapeA.R,
-                     shapeA.B.x,
-                     shapeA.B.y,
-                     separation,
-                     ct_norm,
-                     ct_depth,
-                     ct_pt2,
-                     ct_pt1,
-                     ct_eff_rad);
-    for (int i = 0; i < nC; i++) {
-      *(ct_norm + i) = -(*(ct_norm + i));
-    }
-    return true;
+template <RCollisionPair pair_function>
+static bool RCollision_swapped(const ConvexShape& shapeA,
+                               const ConvexShape& shapeB,
+                               real separation,
+                               real3* ct_norm,
+                               real3* ct_pt1,
+                               real3* ct_pt2,
+                               real* ct_depth,
+                               real* ct_eff_rad,
+                               int& nC) {
+  bool result = pair_function(shapeB, shapeA, separation, ct_norm, ct_pt2, ct_pt1, ct_depth, ct_eff_rad, nC);
+  for (int i = 0; i < nC; i++) {
+    ct_norm[i] = -ct_norm[i];
   }
+  return result;
+}
 
-  if (shapeA.type == BOX && shapeB.type == BOX) {
-    nC = box_box(
-        shapeA.A, shapeA.R, shapeA.B, shapeB.A, shapeB.R, shapeB.B, ct_norm, ct_depth, ct_pt1, ct_pt2, ct_eff_rad);
-    // TODO: Change to true when this is implemented
-    return false;
-  }
+// Select the function handling a pair of shape types.
+RCollisionPair RCollisionSelect(shape_type typeA, shape_type typeB) {
+  if (typeA == SPHERE && typeB == SPHERE)
+    return RCollision_sphere_sphere;
+
+  if (typeA == CAPSULE && typeB == SPHERE)
+    return RCollision_capsule_sphere;
+  if (typeA == SPHERE && typeB == CAPSULE)
+    return RCollision_swapped<RCollision_capsule_sphere>;
+
+  if (typeA == CYLINDER && typeB == SPHERE)
+    return RCollision_cylinder_sphere;
+  if (typeA == SPHERE && typeB == CYLINDER)
+    return RCollision_swapped<RCollision_cylinder_sphere>;
+
+  if (typeA == ROUNDEDCYL && typeB == SPHERE)
+    return RCollision_roundedcyl_sphere;
+  if (typeA == SPHERE && typeB == ROUNDEDCYL)
+    return RCollision_swapped<RCollision_roundedcyl_sphere>;
+
+  if (typeA == BOX && typeB == SPHERE)
+    return RCollision_box_sphere;
+  if (typeA == SPHERE && typeB == BOX)
+    return RCollision_swapped<RCollision_box_sphere>;
+
+  if (typeA == ROUNDEDBOX && typeB == SPHERE)
+    return RCollision_roundedbox_sphere;
+  if (typeA == SPHERE && typeB == ROUNDEDBOX)
+    return RCollision_swapped<RCollision_roundedbox_sphere>;
+
+  if (typeA == TRIANGLEMESH && typeB == SPHERE)
+    return RCollision_face_sphere;
+  if (typeA == SPHERE && typeB == TRIANGLEMESH)
+    return RCollision_swapped<RCollision_face_sphere>;
+
+  if (typeA == CAPSULE && typeB == CAPSULE)
+    return RCollision_capsule_capsule;
+
+  if (typeA == BOX && typeB == CAPSULE)
+    return RCollision_box_capsule;
+  if (typeA == CAPSULE && typeB == BOX)
+    return RCollision_swapped<RCollision_box_capsule>;
+
+  if (typeA == BOX && typeB == BOX)
+    return RCollision_box_box;
+
+  if (typeA == HEIGHTFIELD && typeB == SPHERE)
+    return RCollision_heightfield_sphere;
+  if (typeA == SPHERE && typeB == HEIGHTFIELD)
+    return RCollision_swapped<RCollision_heightfield_sphere>;
+
+  if (typeA == HEIGHTFIELD && typeB == CAPSULE)
+    return RCollision_heightfield_capsule;
+  if (typeA == CAPSULE && typeB == HEIGHTFIELD)
+    return RCollision_swapped<RCollision_heightfield_capsule>;
+
+  if (typeA == HEIGHTFIELD && typeB == BOX)
+    return RCollision_heightfield_box;
+  if (typeA == BOX && typeB == HEIGHTFIELD)
+    return RCollision_swapped<RCollision_heightfield_box>;
 
-  // Contact could not be checked using this CD algorithm
-  return false;
+  return 0;
 }
 
 // =============================================================================
@@ -1038,9 +1039,187 @@ int box_capsule(const real3& pos1,
 // =============================================================================
 //              BOX - BOX
 
+// Reduce a set of candidate contacts to at most 4, stored first in the arrays.
+// The deepest point is always kept, the other ones are picked so that the area
+// they span is as large as possible: the point farthest from the first, the
+// point farthest from the line through the first two and the point adding the
+// most area to the resulting triangle.
+static int reduce_manifold(int num, real3* pts, real* depths, real3* others) {
+  if (num <= 4)
+    return num;
+
+  int sel[4];
+
+  sel[0] = 0;
+  for (int i = 1; i < num; i++) {
+    if (depths[i] < depths[sel[0]])
+      sel[0] = i;
+  }
+
+  real best = -1;
+  for (int i = 0; i < num; i++) {
+    real d2 = (pts[i] - pts[sel[0]]).length2();
+    if (d2 > best) {
+      best = d2;
+      sel[1] = i;
+    }
+  }
+
+  best = -1;
+  for (int i = 0; i < num; i++) {
+    real a2 = cross(pts[sel[1]] - pts[sel[0]], pts[i] - pts[sel[0]]).length2();
+    if (a2 > best) {
+      best = a2;
+      sel[2] = i;
+    }
+  }
+
+  best = -1;
+  for (int i = 0; i < num; i++) {
+    real area = length(cross(pts[sel[0]] - pts[i], pts[sel[1]] - pts[i])) +
+                length(cross(pts[sel[1]] - pts[i], pts[sel[2]] - pts[i])) +
+                length(cross(pts[sel[2]] - pts[i], pts[sel[0]] - pts[i]));
+    if (area > best) {
+      best = area;
+      sel[3] = i;
+    }
+  }
+
+  // Degenerate sets (e.g. all points on a line) may select a point twice
+  int count = 0;
+  real3 tmp_pts[4], tmp_others[4];
+  real tmp_depths[4];
+  for (int k = 0; k < 4; k++) {
+    bool duplicate = false;
+    for (int l = 0; l < k; l++)
+      duplicate |= (sel[l] == sel[k]);
+    if (duplicate)
+      continue;
+    tmp_pts[count] = pts[sel[k]];
+    tmp_others[count] = others[sel[k]];
+    tmp_depths[count] = depths[sel[k]];
+    count++;
+  }
+  for (int k = 0; k < count; k++) {
+    pts[k] = tmp_pts[k];
+    others[k] = tmp_others[k];
+    depths[k] = tmp_depths[k];
+  }
+
+  return count;
+}
+
+// Clip the polygon 'in' (num vertices) against the plane coord[axis] <= lim if
+// sign is positive or coord[axis] >= -lim if sign is negative.
+static int clip_polygon(int num, const real3* in, int axis, real sign, real lim, real3* out) {
+  int count = 0;
+  for (int i = 0; i < num; i++) {
+    real3 a = in[i];
+    real3 b = in[(i + 1) % num];
+    real da = sign * a[axis] - lim;
+    real db = sign * b[axis] - lim;
+    if (da <= 0)
+      out[count++] = a;
+    if ((da < 0 && db > 0) || (da > 0 && db < 0))
+      out[count++] = a + (b - a) * (da / (da - db));
+  }
+  return count;
+}
+
+// Face contact between a reference box (posR, rotR, hdimsR) and an incident
+// box (posI, rotI, hdimsI). The reference face is the face of the reference
+// box whose outward normal is closest to 'n', a direction given in the frame
+// of the reference box and pointing towards the incident box. The incident
+// face is clipped against the side faces of the reference face and the
+// clipped vertices that are below the reference face (or above it by less
+// than the separation value) give the contacts. The normal goes from the
+// reference box to the incident box.
+static int box_box_face(const real3& posR,
+                        const real4& rotR,
+                        const real3& hdimsR,
+                        const real3& posI,
+                        const real4& rotI,
+                        const real3& hdimsI,
+                        const real3& n,
+                        const real& separation,
+                        real3* norm,
+                        real* depth,
+                        real3* ptR,
+                        real3* ptI) {
+  // Express the incident box in the frame of the reference box.
+  real3 pos = quatRotateMatT(posI - posR, rotR);
+  M33 R = AMat(mult(inv(rotR), rotI));
+  real3 hR = hdimsR;
+  real3 hI = hdimsI;
+
+  // Snap the direction to the closest axis of the reference box.
+  real3 an = absolute(n);
+  int k = (an.x > an.y) ? ((an.x > an.z) ? 0 : 2) : ((an.y > an.z) ? 1 : 2);
+  real3 dirn = n;
+  real s = (dirn[k] > 0) ? real(1) : real(-1);
+  real3 faceN(0);
+  faceN[k] = s;
+
+  // Find the face of the incident box most anti-parallel to the reference
+  // face normal.
+  real3 axesI[3] = {R.U, R.V, R.W};
+  real3 proj = R3(dot(R.U, faceN), dot(R.V, faceN), dot(R.W, faceN));
+  real3 aproj = absolute(proj);
+  int j = (aproj.x > aproj.y) ? ((aproj.x > aproj.z) ? 0 : 2) : ((aproj.y > aproj.z) ? 1 : 2);
+  real3 ja = axesI[j] * ((proj[j] > 0) ? -hI[j] : hI[j]);
+  real3 ea = axesI[(j + 1) % 3] * hI[(j + 1) % 3];
+  real3 eb = axesI[(j + 2) % 3] * hI[(j + 2) % 3];
+  real3 center = pos + ja;
+
+  real3 poly[8], tmp[8];
+  poly[0] = center + ea + eb;
+  poly[1] = center - ea + eb;
+  poly[2] = center - ea - eb;
+  poly[3] = center + ea - eb;
+  int num = 4;
+
+  // Clip against the four side planes of the reference face.
+  int u = (k + 1) % 3;
+  int v = (k + 2) % 3;
+  num = clip_polygon(num, poly, u, 1, hR[u], tmp);
+  num = clip_polygon(num, tmp, u, -1, hR[u], poly);
+  num = clip_polygon(num, poly, v, 1, hR[v], tmp);
+  num = clip_polygon(num, tmp, v, -1, hR[v], poly);
+
+  // Keep the points close enough to the reference face.
+  real3 cand_I[8], cand_R[8];
+  real cand_depth[8];
+  int count = 0;
+  for (int i = 0; i < num; i++) {
+    real dist = s * poly[i][k] - hR[k];
+    if (dist >= separation)
+      continue;
+    cand_I[count] = poly[i];
+    cand_R[count] = poly[i];
+    cand_R[count][k] = s * hR[k];
+    cand_depth[count] = dist;
+    count++;
+  }
+
+  count = reduce_manifold(count, cand_I, cand_depth, cand_R);
+
+  real3 normG = quatRotateMat(faceN, rotR);
+  for (int i = 0; i < count; i++) {
+    norm[i] = normG;
+    depth[i] = cand_depth[i];
+    ptR[i] = TransformLocalToParent(posR, rotR, cand_R[i]);
+    ptI[i] = TransformLocalToParent(posR, rotR, cand_I[i]);
+  }
+
+  return count;
+}
+
 // Box-box narrow phase collision detection.
 // In:  box at position pos1, with orientation rot1, and half-dimensions hdims1
 //      box at position pos2, with orientation rot2, and half-dimensions hdims2
+// Note: a box-box collision may return 0 to 4 contacts. Face contacts are
+// obtained by clipping the incident face against the reference face and are
+// reduced to 4 points, edge-edge contacts give a single point.
 
 int box_box(const real3& pos1,
             const real4& rot1,
@@ -1048,6 +1227,7 @@ int box_box(const real3& pos1,
             const real3& pos2,
             const real4& rot2,
             const real3& hdims2,
+            const real& separation,
             real3* norm,
             real* depth,
             real3* pt1,
@@ -1062,7 +1242,7 @@ int box_box(const real3& pos1,
   // overlap, we're done. Note that dir is calculated so that it points from
   // box2 to box1.
   real3 dir;
-  if (!box_intersects_box(hdims1, hdims2, pos, rot, dir))
+  if (!box_intersects_box(hdims1, hdims2, pos, rot, separation, dir))
     return 0;
 
   if (dot(pos, dir) > 0)
@@ -1077,9 +1257,422 @@ int box_box(const real3& pos1,
   uint numAxes1 = (code1 & 1) + ((code1 >> 1) & 1) + ((code1 >> 2) & 1);
   uint numAxes2 = (code2 & 1) + ((code2 >> 1) & 1) + ((code2 >> 2) & 1);
 
-  //// TODO
+  int nC = 0;
 
-  return 0;
+  if (numAxes1 == 1) {
+    // Face of box1 against box2.
+    nC = box_box_face(pos1, rot1, hdims1, pos2, rot2, hdims2, -dir, separation, norm, depth, pt1, pt2);
+  } else if (numAxes2 == 1) {
+    // Face of box2 against box1, the normal is flipped to go from box1 to box2.
+    nC = box_box_face(pos2, rot2, hdims2, pos1, rot1, hdims1, -dirI, separation, norm, depth, pt2, pt1);
+    for (int i = 0; i < nC; i++)
+      norm[i] = -norm[i];
+  } else {
+    // Edge-edge contact. The edge of each box is the one through its closest
+    // corner and along the box axis that is most orthogonal to the direction.
+    real3 adir1 = absolute(dir);
+    real3 adir2 = absolute(dirI);
+    int e1 = (adir1.x < adir1.y) ? ((adir1.x < adir1.z) ? 0 : 2) : ((adir1.y < adir1.z) ? 1 : 2);
+    int e2 = (adir2.x < adir2.y) ? ((adir2.x < adir2.z) ? 0 : 2) : ((adir2.y < adir2.z) ? 1 : 2);
+
+    real3 h1 = hdims1;
+    real3 h2 = hdims2;
+    real3 D1(0), D2(0);
+    D1[e1] = h1[e1];
+    D2[e2] = h2[e2];
+    corner1[e1] = 0;
+    corner2[e2] = 0;
+
+    // Express the edge of box2 in the frame of box1.
+    M33 R = AMat(rot);
+    real3 P2 = pos + R * corner2;
+    D2 = R * D2;
+
+    real3 c1, c2;
+    segment_closest_points(corner1, D1, P2, D2, c1, c2);
+
+    real3 n = -dir;
+    real dist = dot(c2 - c1, n);
+    if (dist >= separation)
+      return 0;
+
+    norm[0] = quatRotateMat(n, rot1);
+    depth[0] = dist;
+    pt1[0] = TransformLocalToParent(pos1, rot1, c1);
+    pt2[0] = TransformLocalToParent(pos1, rot1, c2);
+    eff_radius[0] = edge_radius / 2;
+    return 1;
+  }
+
+  for (int i = 0; i < nC; i++)
+    eff_radius[i] = edge_radius;
+
+  return nC;
+}
+
+// =============================================================================
+//              HEIGHTFIELD
+
+// The heightfield has grid.x by grid.y points, its heights start at index
+// grid.z of the heights list and x varies fastest. spacing.x and spacing.y are
+// the distances between the grid points, spacing.z is the half range of the
+// heights. The grid is centered at the origin of the heightfield frame and
+// every cell is split into two triangles along its diagonal.
+
+// Vertex (i, j) of the heightfield, in the heightfield frame.
+static real3 heightfield_vertex(const real3& grid, const real3& spacing, const real* heights, int i, int j) {
+  real x0 = -(grid.x - 1) * spacing.x / 2;
+  real y0 = -(grid.y - 1) * spacing.y / 2;
+  return R3(x0 + i * spacing.x, y0 + j * spacing.y, heights[int(grid.z) + j * int(grid.x) + i]);
+}
+
+// Triangle of the heightfield above or below the location P (heightfield
+// frame), found by indexing the grid directly. Returns false if P is outside
+// of the grid.
+static bool heightfield_triangle(const real3& grid,
+                                 const real3& spacing,
+                                 const real* heights,
+                                 const real3& P,
+                                 real3& A,
+                                 real3& B,
+                                 real3& C) {
+  real fx = P.x / spacing.x + (grid.x - 1) / 2;
+  real fy = P.y / spacing.y + (grid.y - 1) / 2;
+  if (fx < 0 || fy < 0 || fx > grid.x - 1 || fy > grid.y - 1)
+    return false;
+
+  int i = std::min(int(fx), int(grid.x) - 2);
+  int j = std::min(int(fy), int(grid.y) - 2);
+  A = heightfield_vertex(grid, spacing, heights, i, j);
+  C = heightfield_vertex(grid, spacing, heights, i + 1, j + 1);
+  if (fx - i >= fy - j) {
+    B = heightfield_vertex(grid, spacing, heights, i + 1, j);
+  } else {
+    B = C;
+    C = heightfield_vertex(grid, spacing, heights, i, j + 1);
+  }
+  return true;
+}
+
+// Closest point of the heightfield to the location P (heightfield frame)
+// among the triangles of the cells within 'radius' of P. The distance is
+// negative if P is below the heightfield, the normal points from the closest
+// point towards P. Returns false if no cell is close enough.
+static bool heightfield_closest(const real3& grid,
+                                const real3& spacing,
+                                const real* heights,
+                                const real3& P,
+                                const real& radius,
+                                real3& closest,
+                                real3& normal,
+                                real& dist) {
+  if (P.z - radius > spacing.z || P.z + radius < -spacing.z)
+    return false;
+
+  real fx = P.x / spacing.x + (grid.x - 1) / 2;
+  real fy = P.y / spacing.y + (grid.y - 1) / 2;
+  real rx = radius / spacing.x;
+  real ry = radius / spacing.y;
+  int imin = std::max(int(std::floor(fx - rx)), 0);
+  int imax = std::min(int(std::floor(fx + rx)), int(grid.x) - 2);
+  int jmin = std::max(int(std::floor(fy - ry)), 0);
+  int jmax = std::min(int(std::floor(fy + ry)), int(grid.y) - 2);
+  if (imin > imax || jmin > jmax)
+    return false;
+
+  real best = LARGE_REAL;
+  for (int j = jmin; j <= jmax; j++) {
+    for (int i = imin; i <= imax; i++) {
+      real3 v00 = heightfield_vertex(grid, spacing, heights, i, j);
+      real3 v10 = heightfield_vertex(grid, spacing, heights, i + 1, j);
+      real3 v01 = heightfield_vertex(grid, spacing, heights, i, j + 1);
+      real3 v11 = heightfield_vertex(grid, spacing, heights, i + 1, j + 1);
+      real3 tri[2][3] = {{v00, v10, v11}, {v00, v11, v01}};
+      for (int t = 0; t < 2; t++) {
+        real3 loc;
+        snap_to_face(tri[t][0], tri[t][1], tri[t][2], P, loc);
+        real3 delta = P - loc;
+        real d2 = dot(delta, delta);
+        if (d2 >= best)
+          continue;
+        best = d2;
+        closest = loc;
+
+        // The side of the face decides the sign, the face normal is used when
+        // P (almost) lies on the face
+        real3 nrm = face_normal(tri[t][0], tri[t][1], tri[t][2]);
+        real h = dot(P - tri[t][0], nrm);
+        real d = sqrt(d2);
+        if (d > 1e-6f) {
+          normal = (h < 0) ? -delta / d : delta / d;
+        } else {
+          normal = nrm;
+        }
+        dist = (h < 0) ? -d : d;
+      }
+    }
+  }
+  return true;
+}
+
+// Range of grid vertices whose location lies within [pmin, pmax] (heightfield
+// frame, only x and y are used). Returns false if the range is empty.
+static bool heightfield_vertex_range(const real3& grid,
+                                     const real3& spacing,
+                                     const real3& pmin,
+                                     const real3& pmax,
+                                     int& imin,
+                                     int& imax,
+                                     int& jmin,
+                                     int& jmax) {
+  imin = std::max(int(std::ceil(pmin.x / spacing.x + (grid.x - 1) / 2)), 0);
+  imax = std::min(int(std::floor(pmax.x / spacing.x + (grid.x - 1) / 2)), int(grid.x) - 1);
+  jmin = std::max(int(std::ceil(pmin.y / spacing.y + (grid.y - 1) / 2)), 0);
+  jmax = std::min(int(std::floor(pmax.y / spacing.y + (grid.y - 1) / 2)), int(grid.y) - 1);
+  return imin <= imax && jmin <= jmax;
+}
+
+// Add a contact (heightfield frame) to the list of the 4 deepest contacts of a
+// pair, a full list replaces its shallowest contact.
+static void heightfield_add_contact(const real3& nrm,
+                                    const real3& loc1,
+                                    const real3& loc2,
+                                    const real& dist,
+                                    const real& radius,
+                                    real3* norm,
+                                    real3* pt1,
+                                    real3* pt2,
+                                    real* depth,
+                                    real* eff_radius,
+                                    int& num) {
+  int k = num;
+  if (num == 4) {
+    k = 0;
+    for (int l = 1; l < 4; l++) {
+      if (depth[l] > depth[k])
+        k = l;
+    }
+    if (dist >= depth[k])
+      return;
+  } else {
+    num++;
+  }
+  norm[k] = nrm;
+  pt1[k] = loc1;
+  pt2[k] = loc2;
+  depth[k] = dist;
+  eff_radius[k] = radius;
+}
+
+// Heightfield-sphere narrow phase collision detection.
+// In:  heightfield at pos1, with orientation rot1, grid size and offset grid1,
+//                  spacing spacing1 and heights in heights1
+//      sphere centered at pos2 and with radius2
+
+bool heightfield_sphere(const real3& pos1,
+                        const real4& rot1,
+                        const real3& grid1,
+                        const real3& spacing1,
+                        const real* heights1,
+                        const real3& pos2,
+                        const real& radius2,
+                        const real& separation,
+                        real3& norm,
+                        real& depth,
+                        real3& pt1,
+                        real3& pt2,
+                        real& eff_radius) {
+  real radius2_s = radius2 + separation;
+
+  // Express the sphere center in the heightfield frame and find the closest
+  // point of the cells under the sphere.
+  real3 pos = TransformParentToLocal(pos1, rot1, pos2);
+  real3 closest, nrm;
+  real dist;
+  if (!heightfield_closest(grid1, spacing1, heights1, pos, radius2_s, closest, nrm, dist))
+    return false;
+
+  if (dist >= radius2_s)
+    return false;
+
+  norm = quatRotateMat(nrm, rot1);
+  depth = dist - radius2;
+  pt1 = TransformLocalToParent(pos1, rot1, closest);
+  pt2 = pos2 - norm * radius2;
+  eff_radius = radius2;
+
+  return true;
+}
+
+// Heightfield-capsule narrow phase collision detection.
+// In:  heightfield at pos1, with orientation rot1, grid size and offset grid1,
+//                  spacing spacing1 and heights in heights1
+//      capsule at pos2, with orientation rot2
+//              capsule has radius2 and half-length hlen2 (in Y direction)
+// Note: the two spherical ends of the capsule are tested, as well as the grid
+// vertices under the capsule against the closest point of its segment. The 4
+// deepest contacts are kept so that a heightfield-capsule collision may return
+// 0 to 4 contacts
+
+int heightfield_capsule(const real3& pos1,
+                        const real4& rot1,
+                        const real3& grid1,
+                        const real3& spacing1,
+                        const real* heights1,
+                        const real3& pos2,
+                        const real4& rot2,
+                        const real& radius2,
+                        const real& hlen2,
+                        const real& separation,
+                        real3* norm,
+                        real* depth,
+                        real3* pt1,
+                        real3* pt2,
+                        real* eff_radius) {
+  real3 V = quatRotate(R3(0, hlen2, 0), rot2);
+  real3 ends[2] = {pos2 + V, pos2 - V};
+
+  int nC = 0;
+  for (int k = 0; k < 2; k++) {
+    if (heightfield_sphere(pos1, rot1, grid1, spacing1, heights1, ends[k], radius2, separation, norm[nC],
+                           depth[nC], pt1[nC], pt2[nC], eff_radius[nC]))
+      nC++;
+  }
+
+  // Grid vertices under the segment, the ends are already covered by the
+  // spheres. Contacts are computed in the heightfield frame.
+  real radius2_s = radius2 + separation;
+  real3 E0 = TransformParentToLocal(pos1, rot1, ends[0]);
+  real3 E1 = TransformParentToLocal(pos1, rot1, ends[1]);
+  real3 pmin = R3(std::min(E0.x, E1.x), std::min(E0.y, E1.y), std::min(E0.z, E1.z)) - real3(radius2_s);
+  real3 pmax = R3(std::max(E0.x, E1.x), std::max(E0.y, E1.y), std::max(E0.z, E1.z)) + real3(radius2_s);
+  int imin, imax, jmin, jmax;
+  if (!heightfield_vertex_range(grid1, spacing1, pmin, pmax, imin, imax, jmin, jmax))
+    return nC;
+
+  for (int k = 0; k < nC; k++) {
+    norm[k] = quatRotateMatT(norm[k], rot1);
+    pt1[k] = TransformParentToLocal(pos1, rot1, pt1[k]);
+    pt2[k] = TransformParentToLocal(pos1, rot1, pt2[k]);
+  }
+  int num = nC;
+  real3 axis = E0 - E1;
+  real len2 = dot(axis, axis);
+  for (int j = jmin; j <= jmax; j++) {
+    for (int i = imin; i <= imax; i++) {
+      real3 P = heightfield_vertex(grid1, spacing1, heights1, i, j);
+      if (P.z < pmin.z || P.z > pmax.z)
+        continue;
+      real t = (len2 > 0) ? dot(P - E1, axis) / len2 : 0;
+      if (t <= 0 || t >= 1)
+        continue;
+      real3 Q = E1 + axis * t;
+      real3 delta = Q - P;
+      real d = length(delta);
+      if (d >= radius2_s)
+        continue;
+      real3 n = (d > 1e-6f) ? delta / d : R3(0, 0, 1);
+      heightfield_add_contact(n, P, Q - n * radius2, d - radius2, radius2, norm, pt1, pt2, depth, eff_radius, num);
+    }
+  }
+
+  for (int k = 0; k < num; k++) {
+    norm[k] = quatRotateMat(norm[k], rot1);
+    pt1[k] = TransformLocalToParent(pos1, rot1, pt1[k]);
+    pt2[k] = TransformLocalToParent(pos1, rot1, pt2[k]);
+  }
+
+  return num;
+}
+
+// Heightfield-box narrow phase collision detection.
+// In:  heightfield at pos1, with orientation rot1, grid size and offset grid1,
+//                  spacing spacing1 and heights in heights1
+//      box at pos2, with orientation rot2 and half-dimensions hdims2
+// Note: every corner of the box is tested against the triangle under it and
+// every grid vertex under the box is tested against the box face it is closest
+// to. The 4 deepest contacts are kept so that a heightfield-box collision may
+// return 0 to 4 contacts
+
+int heightfield_box(const real3& pos1,
+                    const real4& rot1,
+                    const real3& grid1,
+                    const real3& spacing1,
+                    const real* heights1,
+                    const real3& pos2,
+                    const real4& rot2,
+                    const real3& hdims2,
+                    const real& separation,
+                    real3* norm,
+                    real* depth,
+                    real3* pt1,
+                    real3* pt2,
+                    real* eff_radius) {
+  // Express the box in the frame of the heightfield.
+  real3 pos = TransformParentToLocal(pos1, rot1, pos2);
+  real4 rot = mult(inv(rot1), rot2);
+
+  int nC = 0;
+  real3 pmin = R3(LARGE_REAL);
+  real3 pmax = R3(-LARGE_REAL);
+  for (int k = 0; k < 8; k++) {
+    real3 corner = R3((k & 1) ? hdims2.x : -hdims2.x, (k & 2) ? hdims2.y : -hdims2.y, (k & 4) ? hdims2.z : -hdims2.z);
+    real3 P = pos + quatRotate(corner, rot);
+    pmin = R3(std::min(pmin.x, P.x), std::min(pmin.y, P.y), std::min(pmin.z, P.z));
+    pmax = R3(std::max(pmax.x, P.x), std::max(pmax.y, P.y), std::max(pmax.z, P.z));
+    real3 A, B, C;
+    if (!heightfield_triangle(grid1, spacing1, heights1, P, A, B, C))
+      continue;
+
+    real3 n = face_normal(A, B, C);
+    real h = dot(P - A, n);
+    if (h >= separation)
+      continue;
+
+    heightfield_add_contact(n, P - n * h, P, h, edge_radius, norm, pt1, pt2, depth, eff_radius, nC);
+  }
+
+  // Grid vertices in the footprint of the box. The depth of a vertex inside
+  // the box is measured along the normal of the closest box face.
+  pmin = pmin - real3(separation);
+  pmax = pmax + real3(separation);
+  int imin, imax, jmin, jmax;
+  if (heightfield_vertex_range(grid1, spacing1, pmin, pmax, imin, imax, jmin, jmax)) {
+    for (int j = jmin; j <= jmax; j++) {
+      for (int i = imin; i <= imax; i++) {
+        real3 P = heightfield_vertex(grid1, spacing1, heights1, i, j);
+        if (P.z < pmin.z || P.z > pmax.z)
+          continue;
+        real3 local = quatRotateT(P - pos, rot);
+        real3 gap = hdims2 - R3(std::fabs(local.x), std::fabs(local.y), std::fabs(local.z));
+        int axis = 0;
+        if (gap.y < gap.x && gap.y <= gap.z) {
+          axis = 1;
+        } else if (gap.z < gap.x && gap.z < gap.y) {
+          axis = 2;
+        }
+        // The vertex must lie over the face, within the separation from it
+        if (gap.array[axis] <= -separation || gap.array[(axis + 1) % 3] < 0 || gap.array[(axis + 2) % 3] < 0)
+          continue;
+
+        real3 face_dir = R3(0);
+        face_dir.array[axis] = (local.array[axis] < 0) ? -1 : 1;
+        real3 face_pt = local;
+        face_pt.array[axis] = face_dir.array[axis] * hdims2.array[axis];
+        real3 n = -quatRotate(face_dir, rot);
+        heightfield_add_contact(n, P, pos + quatRotate(face_pt, rot), -gap.array[axis], edge_radius, norm, pt1, pt2,
+                                depth, eff_radius, nC);
+      }
+    }
+  }
+
+  for (int k = 0; k < nC; k++) {
+    norm[k] = quatRotateMat(norm[k], rot1);
+    pt1[k] = TransformLocalToParent(pos1, rot1, pt1[k]);
+    pt2[k] = TransformLocalToParent(pos1, rot1, pt2[k]);
+  }
+
+  return nC;
 }
 
 }  // end namespace collision
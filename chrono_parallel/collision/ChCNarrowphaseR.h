@@ -17,17 +17,19 @@
 // each pair of collision shapes. Only a subset of collision shapes and of
 // pair-wise interactions are currently supported:
 //
-//          |  sphere   box   rbox   capsule   cylinder   rcyl   trimesh
-// ---------+----------------------------------------------------------
-// sphere   |    Y       Y      Y       Y         Y        Y        Y
-// box      |           WIP     N       Y         N        N        N
-// rbox     |                   N       N         N        N        N
-// capsule  |                           Y         N        N        N
-// cylinder |                                     N        N        N
-// rcyl     |                                              N        N
-// trimesh  |                                                       N
+//          |  sphere   box   rbox   capsule   cylinder   rcyl   trimesh   hfield
+// ---------+--------------------------------------------------------------------
+// sphere   |    Y       Y      Y       Y         Y        Y        Y         Y
+// box      |            Y      N       Y         N        N        N         Y
+// rbox     |                   N       N         N        N        N         N
+// capsule  |                           Y         N        N        N         Y
+// cylinder |                                     N        N        N         N
+// rcyl     |                                              N        N         N
+// trimesh  |                                                       N         N
+// hfield   |                                                                 N
 //
-// Note that some pairs may return more than one contact (e.g., box-box).
+// Note that some pairs may return more than one contact (e.g., box-box returns
+// up to 4 contacts).
 //
 // =============================================================================
 
@@ -165,12 +167,120 @@ int box_box(const real3& pos1,
             const real3& pos2,
             const real4& rot2,
             const real3& hdims2,
+            const real& separation,
             real3* norm,
             real* depth,
             real3* pt1,
             real3* pt2,
             real* eff_radius);
 
+// The heightfield functions find the cells close to the other shape by
+// indexing the grid directly, see ChCNarrowphaseR.cpp for the data layout.
+bool heightfield_sphere(const real3& pos1,
+                        const real4& rot1,
+                        const real3& grid1,
+                        const real3& spacing1,
+                        const real* heights1,
+                        const real3& pos2,
+                        const real& radius2,
+                        const real& separation,
+                        real3& norm,
+                        real& depth,
+                        real3& pt1,
+                        real3& pt2,
+                        real& eff_radius);
+
+int heightfield_capsule(const real3& pos1,
+                        const real4& rot1,
+                        const real3& grid1,
+                        const real3& spacing1,
+                        const real* heights1,
+                        const real3& pos2,
+                        const real4& rot2,
+                        const real& radius2,
+                        const real& hlen2,
+                        const real& separation,
+                        real3* norm,
+                        real* depth,
+                        real3* pt1,
+                        real3* pt2,
+                        real* eff_radius);
+
+int heightfield_box(const real3& pos1,
+                    const real4& rot1,
+                    const real3& grid1,
+                    const real3& spacing1,
+                    const real* heights1,
+                    const real3& pos2,
+                    const real4& rot2,
+                    const real3& hdims2,
+                    const real& separation,
+                    real3* norm,
+                    real* depth,
+                    real3* pt1,
+                    real3* pt2,
+                    real* eff_radius);
+
+// Batched versions of sphere_sphere and box_sphere working on shape indices.
+// Pair i involves shapes shapeA[i] and shapeB[i] whose global positions are
+// in pos and whose dimensions are in dims (radius in x for spheres). Groups of
+// pairs are gathered and processed with SSE (4 lanes) or AVX (4 or 8 lanes)
+// when the build allows it, the remaining pairs use the scalar functions above
+// which stay the reference. The results of pair i are written at index icoll[i]
+// of the output arrays only if the pair is in contact, contact[i] is set to
+// tell if it is.
+CH_PARALLEL_API
+void sphere_sphere_batch(int num_pairs,
+                         const uint* shapeA,
+                         const uint* shapeB,
+                         const uint* icoll,
+                         const real3* pos,
+                         const real3* dims,
+                         const real& separation,
+                         real3* norm,
+                         real* depth,
+                         real3* pt1,
+                         real3* pt2,
+                         real* eff_radius,
+                         bool* contact);
+
+// The box of pair i is box[i] and its sphere is sphere[i]. If swap is set the
+// sphere is the first shape of the pair, the normal is flipped and the points
+// are exchanged as done by RCollision for sphere-box pairs.
+CH_PARALLEL_API
+void box_sphere_batch(int num_pairs,
+                      const uint* box,
+                      const uint* sphere,
+                      bool swap,
+                      const uint* icoll,
+                      const real3* pos,
+                      const real4* rot,
+                      const real3* dims,
+                      const real& separation,
+                      real3* norm,
+                      real* depth,
+                      real3* pt1,
+                      real3* pt2,
+                      real* eff_radius,
+                      bool* contact);
+
+// Signature of the functions that handle one pair of shape types, the
+// arguments are the same as for RCollision
+typedef bool (*RCollisionPair)(const ConvexShape& shapeA,
+                               const ConvexShape& shapeB,
+                               real separation,
+                               real3* ct_norm,
+                               real3* ct_pt1,
+                               real3* ct_pt2,
+                               real* ct_depth,
+                               real* ct_eff_rad,
+                               int& nC);
+
+// Return the function handling the given pair of shape types, or 0 if the pair
+// is not supported. Used to dispatch batches of pairs that share their types.
+CH_PARALLEL_API
+RCollisionPair RCollisionSelect(shape_type typeA, shape_type typeB);
+
 CH_PARALLEL_API
 bool RCollision(const ConvexShape& shapeA,  ///< first candidate shape
                 const ConvexShape& shapeB,  ///< second candidate shape
@@ -0,0 +1,370 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Authors: Hammad Mazhar
+// =============================================================================
+//
+// Batched sphere-sphere and box-sphere narrow phase collision detection.
+// The data of a group of pairs is gathered into SoA arrays and every operation
+// of the scalar functions in ChCNarrowphaseR.cpp is done for the whole group
+// with one SSE or AVX instruction. The lanes that are in contact are scattered
+// back to the contact arrays.
+//
+// =============================================================================
+
+#include "chrono_parallel/collision/ChCNarrowphaseR.h"
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace chrono {
+namespace collision {
+
+// =============================================================================
+// Thin wrappers around the vector instructions, AVX is used when the compiler
+// targets it (8 floats or 4 doubles), otherwise SSE is used for floats.
+
+#if defined(__AVX__) && defined(CHRONO_PARALLEL_USE_DOUBLE)
+#define CHC_SIMD_WIDTH 4
+typedef __m256d simd_real;
+static inline simd_real simd_set(real a) { return _mm256_set1_pd(a); }
+static inline simd_real simd_load(const real* p) { return _mm256_loadu_pd(p); }
+static inline void simd_store(real* p, simd_real a) { _mm256_storeu_pd(p, a); }
+static inline simd_real simd_add(simd_real a, simd_real b) { return _mm256_add_pd(a, b); }
+static inline simd_real simd_sub(simd_real a, simd_real b) { return _mm256_sub_pd(a, b); }
+static inline simd_real simd_mul(simd_real a, simd_real b) { return _mm256_mul_pd(a, b); }
+static inline simd_real simd_div(simd_real a, simd_real b) { return _mm256_div_pd(a, b); }
+static inline simd_real simd_and(simd_real a, simd_real b) { return _mm256_and_pd(a, b); }
+static inline simd_real simd_sqrt(simd_real a) { return _mm256_sqrt_pd(a); }
+static inline simd_real simd_min(simd_real a, simd_real b) { return _mm256_min_pd(a, b); }
+static inline simd_real simd_max(simd_real a, simd_real b) { return _mm256_max_pd(a, b); }
+static inline simd_real simd_abs(simd_real a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+static inline simd_real simd_lt(simd_real a, simd_real b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+static inline simd_real simd_ge(simd_real a, simd_real b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+static inline simd_real simd_gt(simd_real a, simd_real b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+static inline int simd_mask(simd_real a) { return _mm256_movemask_pd(a); }
+#elif defined(__AVX__) && !defined(CHRONO_PARALLEL_USE_DOUBLE)
+#define CHC_SIMD_WIDTH 8
+typedef __m256 simd_real;
+static inline simd_real simd_set(real a) { return _mm256_set1_ps(a); }
+static inline simd_real simd_load(const real* p) { return _mm256_loadu_ps(p); }
+static inline void simd_store(real* p, simd_real a) { _mm256_storeu_ps(p, a); }
+static inline simd_real simd_add(simd_real a, simd_real b) { return _mm256_add_ps(a, b); }
+static inline simd_real simd_sub(simd_real a, simd_real b) { return _mm256_sub_ps(a, b); }
+static inline simd_real simd_mul(simd_real a, simd_real b) { return _mm256_mul_ps(a, b); }
+static inline simd_real simd_div(simd_real a, simd_real b) { return _mm256_div_ps(a, b); }
+static inline simd_real simd_and(simd_real a, simd_real b) { return _mm256_and_ps(a, b); }
+static inline simd_real simd_sqrt(simd_real a) { return _mm256_sqrt_ps(a); }
+static inline simd_real simd_min(simd_real a, simd_real b) { return _mm256_min_ps(a, b); }
+static inline simd_real simd_max(simd_real a, simd_real b) { return _mm256_max_ps(a, b); }
+static inline simd_real simd_abs(simd_real a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline simd_real simd_lt(simd_real a, simd_real b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline simd_real simd_ge(simd_real a, simd_real b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline simd_real simd_gt(simd_real a, simd_real b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline int simd_mask(simd_real a) { return _mm256_movemask_ps(a); }
+#elif defined(ENABLE_SSE)
+#define CHC_SIMD_WIDTH 4
+typedef __m128 simd_real;
+static inline simd_real simd_set(real a) { return _mm_set1_ps(a); }
+static inline simd_real simd_load(const real* p) { return _mm_loadu_ps(p); }
+static inline void simd_store(real* p, simd_real a) { _mm_storeu_ps(p, a); }
+static inline simd_real simd_add(simd_real a, simd_real b) { return _mm_add_ps(a, b); }
+static inline simd_real simd_sub(simd_real a, simd_real b) { return _mm_sub_ps(a, b); }
+static inline simd_real simd_mul(simd_real a, simd_real b) { return _mm_mul_ps(a, b); }
+static inline simd_real simd_div(simd_real a, simd_real b) { return _mm_div_ps(a, b); }
+static inline simd_real simd_and(simd_real a, simd_real b) { return _mm_and_ps(a, b); }
+static inline simd_real simd_sqrt(simd_real a) { return _mm_sqrt_ps(a); }
+static inline simd_real simd_min(simd_real a, simd_real b) { return _mm_min_ps(a, b); }
+static inline simd_real simd_max(simd_real a, simd_real b) { return _mm_max_ps(a, b); }
+static inline simd_real simd_abs(simd_real a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline simd_real simd_lt(simd_real a, simd_real b) { return _mm_cmplt_ps(a, b); }
+static inline simd_real simd_ge(simd_real a, simd_real b) { return _mm_cmpge_ps(a, b); }
+static inline simd_real simd_gt(simd_real a, simd_real b) { return _mm_cmpgt_ps(a, b); }
+static inline int simd_mask(simd_real a) { return _mm_movemask_ps(a); }
+#else
+#define CHC_SIMD_WIDTH 1
+#endif
+
+#if CHC_SIMD_WIDTH > 1
+
+// Vector of 3 components, one lane per pair
+struct simd_real3 {
+  simd_real x, y, z;
+};
+
+static inline simd_real3 simd_load3(const real* x, const real* y, const real* z) {
+  simd_real3 r = {simd_load(x), simd_load(y), simd_load(z)};
+  return r;
+}
+static inline void simd_store3(real* x, real* y, real* z, const simd_real3& a) {
+  simd_store(x, a.x);
+  simd_store(y, a.y);
+  simd_store(z, a.z);
+}
+static inline simd_real3 operator+(const simd_real3& a, const simd_real3& b) {
+  simd_real3 r = {simd_add(a.x, b.x), simd_add(a.y, b.y), simd_add(a.z, b.z)};
+  return r;
+}
+static inline simd_real3 operator-(const simd_real3& a, const simd_real3& b) {
+  simd_real3 r = {simd_sub(a.x, b.x), simd_sub(a.y, b.y), simd_sub(a.z, b.z)};
+  return r;
+}
+static inline simd_real3 operator-(const simd_real3& a) {
+  simd_real zero = simd_set(0);
+  simd_real3 r = {simd_sub(zero, a.x), simd_sub(zero, a.y), simd_sub(zero, a.z)};
+  return r;
+}
+static inline simd_real3 operator*(const simd_real3& a, simd_real b) {
+  simd_real3 r = {simd_mul(a.x, b), simd_mul(a.y, b), simd_mul(a.z, b)};
+  return r;
+}
+static inline simd_real3 operator/(const simd_real3& a, simd_real b) {
+  simd_real3 r = {simd_div(a.x, b), simd_div(a.y, b), simd_div(a.z, b)};
+  return r;
+}
+static inline simd_real dot(const simd_real3& a, const simd_real3& b) {
+  return simd_add(simd_add(simd_mul(a.x, b.x), simd_mul(a.y, b.y)), simd_mul(a.z, b.z));
+}
+static inline simd_real3 cross(const simd_real3& a, const simd_real3& b) {
+  simd_real3 r = {simd_sub(simd_mul(a.y, b.z), simd_mul(a.z, b.y)), simd_sub(simd_mul(a.z, b.x), simd_mul(a.x, b.z)),
+                  simd_sub(simd_mul(a.x, b.y), simd_mul(a.y, b.x))};
+  return r;
+}
+// Clamp every component of a to [-h, h]
+static inline simd_real3 simd_clamp(const simd_real3& a, const simd_real3& h) {
+  simd_real3 nh = -h;
+  simd_real3 r = {simd_min(simd_max(a.x, nh.x), h.x), simd_min(simd_max(a.y, nh.y), h.y),
+                  simd_min(simd_max(a.z, nh.z), h.z)};
+  return r;
+}
+
+// Same as quatRotate with the vector part of the quaternion given in u, the
+// transposed rotation is obtained by negating u
+static inline simd_real3 simd_quatRotate(const simd_real3& v, simd_real w, const simd_real3& u) {
+  simd_real3 t = cross(u, v) * simd_set(2);
+  return v + t * w + cross(u, t);
+}
+
+// Same as quatRotateMat, the rows of the rotation matrix are built first
+static inline simd_real3 simd_quatRotateMat(const simd_real3& v, simd_real w, const simd_real3& u) {
+  simd_real ww = simd_mul(w, w), xx = simd_mul(u.x, u.x), yy = simd_mul(u.y, u.y), zz = simd_mul(u.z, u.z);
+  simd_real3 tw = u * simd_mul(simd_set(2), w);  // 2 * w * (x, y, z)
+  simd_real3 tu = u * simd_set(2);               // 2 * (x, y, z)
+  simd_real xy = simd_mul(tu.x, u.y), xz = simd_mul(tu.x, u.z), yz = simd_mul(tu.y, u.z);
+
+  simd_real3 row0 = {simd_sub(simd_sub(simd_add(ww, xx), yy), zz), simd_sub(xy, tw.z), simd_add(xz, tw.y)};
+  simd_real3 row1 = {simd_add(xy, tw.z), simd_sub(simd_add(simd_sub(ww, xx), yy), zz), simd_sub(yz, tw.x)};
+  simd_real3 row2 = {simd_sub(xz, tw.y), simd_add(yz, tw.x), simd_add(simd_sub(simd_sub(ww, xx), yy), zz)};
+  simd_real3 r = {dot(row0, v), dot(row1, v), dot(row2, v)};
+  return r;
+}
+
+#endif
+
+// =============================================================================
+//              SPHERE - SPHERE
+
+void sphere_sphere_batch(int num_pairs,
+                         const uint* shapeA,
+                         const uint* shapeB,
+                         const uint* icoll,
+                         const real3* pos,
+                         const real3* dims,
+                         const real& separation,
+                         real3* norm,
+                         real* depth,
+                         real3* pt1,
+                         real3* pt2,
+                         real* eff_radius,
+                         bool* contact) {
+  int i = 0;
+
+#if CHC_SIMD_WIDTH > 1
+  const int W = CHC_SIMD_WIDTH;
+  real p1x[W], p1y[W], p1z[W], r1[W];
+  real p2x[W], p2y[W], p2z[W], r2[W];
+  real nx[W], ny[W], nz[W], c1x[W], c1y[W], c1z[W], c2x[W], c2y[W], c2z[W], d[W], e[W];
+
+  for (; i + W <= num_pairs; i += W) {
+    // Gather the sphere data of the group
+    for (int l = 0; l < W; l++) {
+      real3 a = pos[shapeA[i + l]];
+      real3 b = pos[shapeB[i + l]];
+      p1x[l] = a.x, p1y[l] = a.y, p1z[l] = a.z, r1[l] = dims[shapeA[i + l]].x;
+      p2x[l] = b.x, p2y[l] = b.y, p2z[l] = b.z, r2[l] = dims[shapeB[i + l]].x;
+    }
+    simd_real3 pos1 = simd_load3(p1x, p1y, p1z);
+    simd_real3 pos2 = simd_load3(p2x, p2y, p2z);
+    simd_real radius1 = simd_load(r1);
+    simd_real radius2 = simd_load(r2);
+
+    simd_real3 delta = pos2 - pos1;
+    simd_real dist2 = dot(delta, delta);
+    simd_real radSum = simd_add(radius1, radius2);
+    simd_real radSum_s = simd_add(radSum, simd_set(separation));
+
+    int mask = simd_mask(simd_and(simd_lt(dist2, simd_mul(radSum_s, radSum_s)), simd_ge(dist2, simd_set(1e-12))));
+    if (mask == 0) {
+      for (int l = 0; l < W; l++) {
+        contact[i + l] = false;
+      }
+      continue;
+    }
+
+    // The lanes that are not in contact may hold invalid values, they are not
+    // written out
+    simd_real dist = simd_sqrt(dist2);
+    simd_real3 n = delta / dist;
+    simd_store3(nx, ny, nz, n);
+    simd_store3(c1x, c1y, c1z, pos1 + n * radius1);
+    simd_store3(c2x, c2y, c2z, pos2 - n * radius2);
+    simd_store(d, simd_sub(dist, radSum));
+    simd_store(e, simd_div(simd_mul(radius1, radius2), radSum));
+
+    for (int l = 0; l < W; l++) {
+      contact[i + l] = (mask >> l) & 1;
+      if (contact[i + l]) {
+        uint k = icoll[i + l];
+        norm[k] = R3(nx[l], ny[l], nz[l]);
+        pt1[k] = R3(c1x[l], c1y[l], c1z[l]);
+        pt2[k] = R3(c2x[l], c2y[l], c2z[l]);
+        depth[k] = d[l];
+        eff_radius[k] = e[l];
+      }
+    }
+  }
+#endif
+
+  // Remaining pairs
+  for (; i < num_pairs; i++) {
+    uint k = icoll[i];
+    contact[i] = sphere_sphere(pos[shapeA[i]], dims[shapeA[i]].x, pos[shapeB[i]], dims[shapeB[i]].x, separation,
+                               norm[k], depth[k], pt1[k], pt2[k], eff_radius[k]);
+  }
+}
+
+// =============================================================================
+//              BOX - SPHERE
+
+// Swap the outputs of a box-sphere contact when the sphere is the first shape
+static inline void box_sphere_swap(real3& norm, real3& pt1, real3& pt2) {
+  real3 pt = pt1;
+  pt1 = pt2;
+  pt2 = pt;
+  norm = -norm;
+}
+
+void box_sphere_batch(int num_pairs,
+                      const uint* box,
+                      const uint* sphere,
+                      bool swap,
+                      const uint* icoll,
+                      const real3* pos,
+                      const real4* rot,
+                      const real3* dims,
+                      const real& separation,
+                      real3* norm,
+                      real* depth,
+                      real3* pt1,
+                      real3* pt2,
+                      real* eff_radius,
+                      bool* contact) {
+  int i = 0;
+
+#if CHC_SIMD_WIDTH > 1
+  const int W = CHC_SIMD_WIDTH;
+  real bx[W], by[W], bz[W], qw[W], qx[W], qy[W], qz[W], hx[W], hy[W], hz[W];
+  real sx[W], sy[W], sz[W], sr[W];
+  real nx[W], ny[W], nz[W], c1x[W], c1y[W], c1z[W], c2x[W], c2y[W], c2z[W], d[W];
+
+  for (; i + W <= num_pairs; i += W) {
+    // Gather the box and sphere data of the group
+    for (int l = 0; l < W; l++) {
+      real3 p = pos[box[i + l]];
+      real4 q = rot[box[i + l]];
+      real3 h = dims[box[i + l]];
+      real3 s = pos[sphere[i + l]];
+      bx[l] = p.x, by[l] = p.y, bz[l] = p.z;
+      qw[l] = q.w, qx[l] = q.x, qy[l] = q.y, qz[l] = q.z;
+      hx[l] = h.x, hy[l] = h.y, hz[l] = h.z;
+      sx[l] = s.x, sy[l] = s.y, sz[l] = s.z, sr[l] = dims[sphere[i + l]].x;
+    }
+    simd_real3 pos1 = simd_load3(bx, by, bz);
+    simd_real w = simd_load(qw);
+    simd_real3 u = simd_load3(qx, qy, qz);
+    simd_real3 hdims = simd_load3(hx, hy, hz);
+    simd_real3 pos2 = simd_load3(sx, sy, sz);
+    simd_real radius2 = simd_load(sr);
+
+    // Express the sphere position in the frame of the box.
+    simd_real3 spherePos = simd_quatRotate(pos2 - pos1, w, -u);
+
+    // Snap the sphere position to the surface of the box, the code of every
+    // lane is rebuilt below from the masks of the clamped axes.
+    simd_real3 boxPos = simd_clamp(spherePos, hdims);
+
+    simd_real3 delta = spherePos - boxPos;
+    simd_real dist2 = dot(delta, delta);
+    simd_real radius2_s = simd_add(radius2, simd_set(separation));
+
+    int mask = simd_mask(simd_and(simd_lt(dist2, simd_mul(radius2_s, radius2_s)), simd_gt(dist2, simd_set(1e-12f))));
+    if (mask == 0) {
+      for (int l = 0; l < W; l++) {
+        contact[i + l] = false;
+      }
+      continue;
+    }
+
+    int code_x = simd_mask(simd_gt(simd_abs(spherePos.x), hdims.x));
+    int code_y = simd_mask(simd_gt(simd_abs(spherePos.y), hdims.y));
+    int code_z = simd_mask(simd_gt(simd_abs(spherePos.z), hdims.z));
+
+    // Generate contact information
+    simd_real dist = simd_sqrt(dist2);
+    simd_real3 n = simd_quatRotateMat(delta / dist, w, u);
+    simd_store3(nx, ny, nz, n);
+    simd_store3(c1x, c1y, c1z, pos1 + simd_quatRotate(boxPos, w, u));
+    simd_store3(c2x, c2y, c2z, pos2 - n * radius2);
+    simd_store(d, simd_sub(dist, radius2));
+
+    for (int l = 0; l < W; l++) {
+      contact[i + l] = (mask >> l) & 1;
+      if (contact[i + l]) {
+        uint k = icoll[i + l];
+        uint code = ((code_x >> l) & 1) | (((code_y >> l) & 1) << 1) | (((code_z >> l) & 1) << 2);
+        norm[k] = R3(nx[l], ny[l], nz[l]);
+        pt1[k] = R3(c1x[l], c1y[l], c1z[l]);
+        pt2[k] = R3(c2x[l], c2y[l], c2z[l]);
+        depth[k] = d[l];
+        if ((code != 1) & (code != 2) & (code != 4))
+          eff_radius[k] = sr[l] * edge_radius / (sr[l] + edge_radius);
+        else
+          eff_radius[k] = sr[l];
+        if (swap)
+          box_sphere_swap(norm[k], pt1[k], pt2[k]);
+      }
+    }
+  }
+#endif
+
+  // Remaining pairs
+  for (; i < num_pairs; i++) {
+    uint k = icoll[i];
+    contact[i] = box_sphere(pos[box[i]], rot[box[i]], dims[box[i]], pos[sphere[i]], dims[sphere[i]].x, separation,
+                            norm[k], depth[k], pt1[k], pt2[k], eff_radius[k]);
+    if (contact[i] && swap)
+      box_sphere_swap(norm[k], pt1[k], pt2[k]);
+  }
+}
+
+}  // end namespace collision
+}  // end namespace chrono
@@ -221,12 +221,20 @@ uint box_closest_feature(const real3& dir) {
 // This function returns a boolean indicating whether or not a box1 with
 // dimensions hdims1 intersects a second box with the dimensions hdims2.
 // The check is performed in the local frame of box1. The transform from the
-// other box is given through 'pos' and 'rot'. If an intersection exists, the
-// direction of smallest intersection is returned in 'dir'.
+// other box is given through 'pos' and 'rot'. Boxes that are separated by less
+// than 'separation' are considered intersecting. If an intersection exists, the
+// direction of smallest intersection is returned in 'dir' (unit length).
 //
 // This check is performed by testing 15 possible separating planes between the
-// two boxes (Gottschalk, Lin, Manocha - Siggraph96).
-bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& pos, const real4& rot, real3& dir) {
+// two boxes (Gottschalk, Lin, Manocha - Siggraph96). The face axes are favored
+// over the edge axes so that resting boxes keep a face contact from one step
+// to the next.
+bool box_intersects_box(const real3& hdims1,
+                        const real3& hdims2,
+                        const real3& pos,
+                        const real4& rot,
+                        const real& separation,
+                        real3& dir) {
   M33 R = AMat(rot);
   M33 Rabs = AbsMat(R);
   real minOverlap = FLT_MAX;
@@ -236,7 +244,7 @@ bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& p
   // 1. Test the axes of box1 (3 cases)
   // x-axis
   r2 = Rabs.U.x * hdims2.x + Rabs.V.x * hdims2.y + Rabs.W.x * hdims2.z;
-  overlap = hdims1.x + r2 - fabs(pos.x);
+  overlap = hdims1.x + r2 + separation - fabs(pos.x);
   if (overlap <= 0)
     return false;
   if (overlap < minOverlap) {
@@ -245,7 +253,7 @@ bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& p
   }
   // y-axis
   r2 = Rabs.U.y * hdims2.x + Rabs.V.y * hdims2.y + Rabs.W.y * hdims2.z;
-  overlap = hdims1.y + r2 - fabs(pos.y);
+  overlap = hdims1.y + r2 + separation - fabs(pos.y);
   if (overlap <= 0)
     return false;
   if (overlap < minOverlap) {
@@ -254,7 +262,7 @@ bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& p
   }
   // z-axis
   r2 = Rabs.U.z * hdims2.x + Rabs.V.z * hdims2.y + Rabs.W.z * hdims2.z;
-  overlap = hdims1.z + r2 - fabs(pos.z);
+  overlap = hdims1.z + r2 + separation - fabs(pos.z);
   if (overlap <= 0)
     return false;
   if (overlap < minOverlap) {
@@ -265,7 +273,7 @@ bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& p
   // 2. Test the axes of box2 (3 cases)
   // x-axis
   r1 = dot(Rabs.U, hdims1);
-  overlap = r1 + hdims2.x - fabs(dot(R.U, pos));
+  overlap = r1 + hdims2.x + separation - fabs(dot(R.U, pos));
   if (overlap <= 0)
     return false;
   if (overlap < minOverlap) {
@@ -274,7 +282,7 @@ bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& p
   }
   // y-axis
   r1 = dot(Rabs.V, hdims1);
-  overlap = r1 + hdims2.y - fabs(dot(R.V, pos));
+  overlap = r1 + hdims2.y + separation - fabs(dot(R.V, pos));
   if (overlap <= 0)
     return false;
   if (overlap < minOverlap) {
@@ -283,7 +291,7 @@ bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& p
   }
   // z-axis
   r1 = dot(Rabs.W, hdims1);
-  overlap = r1 + hdims2.z - fabs(dot(R.W, pos));
+  overlap = r1 + hdims2.z + separation - fabs(dot(R.W, pos));
   if (overlap <= 0)
     return false;
   if (overlap < minOverlap) {
@@ -292,11 +300,73 @@ bool box_intersects_box(const real3& hdims1, const real3& hdims2, const real3& p
   }
 
   // 3. Test the planes that are orthogonal (the cross-product) to pairs of axes
-  // of the two boxes (9 cases)
+  // of the two boxes (9 cases). Pairs of (almost) parallel axes are skipped,
+  // the corresponding planes are covered by the face axes above. An edge axis
+  // only replaces a face axis if its overlap is clearly smaller.
+  real3 axes1[3] = {R3(1, 0, 0), R3(0, 1, 0), R3(0, 0, 1)};
+  real3 axes2[3] = {R.U, R.V, R.W};
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      real3 axis = cross(axes1[i], axes2[j]);
+      real len = length(axis);
+      if (len < 1e-5)
+        continue;
+      axis = axis / len;
+
+      r1 = dot(absolute(axis), hdims1);
+      r2 = fabs(dot(axis, R.U)) * hdims2.x + fabs(dot(axis, R.V)) * hdims2.y + fabs(dot(axis, R.W)) * hdims2.z;
+      overlap = r1 + r2 + separation - fabs(dot(axis, pos));
+      if (overlap <= 0)
+        return false;
+      if (overlap < 0.95 * minOverlap) {
+        dir = axis;
+        minOverlap = overlap;
+      }
+    }
+  }
 
-  //// TODO
+  return true;
+}
 
-  return false;
+// ----------------------------------------------------------------------------
+// This utility function finds the closest points between the segments P1+s*D1
+// and P2+t*D2 with s and t in [-1, 1] (the segments are given by their center
+// and half-extent vector). The closest points are returned in 'res1' and
+// 'res2'. Parallel segments return the point of the first segment closest to
+// the center of the second one.
+// Code adapted from Ericson, "Real-time collision detection", 2005, pp. 149
+void segment_closest_points(const real3& P1,
+                            const real3& D1,
+                            const real3& P2,
+                            const real3& D2,
+                            real3& res1,
+                            real3& res2) {
+  real3 r = P1 - P2;
+  real a = dot(D1, D1);
+  real e = dot(D2, D2);
+  real b = dot(D1, D2);
+  real c = dot(D1, r);
+  real f = dot(D2, r);
+  real denom = a * e - b * b;
+
+  real s = 0;
+  if (denom > 1e-10 * a * e)
+    s = clamp((b * f - c * e) / denom, real(-1), real(1));
+  else
+    s = clamp(-c / a, real(-1), real(1));
+
+  real t = (b * s + f) / e;
+  if (t < -1) {
+    t = -1;
+    s = clamp((-b - c) / a, real(-1), real(1));
+  } else if (t > 1) {
+    t = 1;
+    s = clamp((b - c) / a, real(-1), real(1));
+  }
+
+  res1 = P1 + s * D1;
+  res2 = P2 + t * D2;
 }
 
 // ----------------------------------------------------------------------------
@@ -5,6 +5,34 @@
 #include "collision/ChCCollisionModel.h"
 namespace chrono {
 namespace collision {
+// Hill climbing on the hull adjacency of a convex shape: starting from the
+// point 'start', move to the neighbor with the largest projection on n until
+// no neighbor improves it. A convex hull has no local maximum other than the
+// global one, so the result is the point a linear scan would find. The point,
+// adjacency and neighbor indices are local to the shape.
+inline int GetSupportIndex_Convex(const real3* points,
+                                  const int2* adjacency,
+                                  const int* neighbors,
+                                  int start,
+                                  const real3& n) {
+  int best = start;
+  real best_dot = dot(points[best], n);
+  int current = -1;
+  while (current != best) {
+    current = best;
+    const int2 range = adjacency[current];
+    for (int k = range.x; k < range.x + range.y; k++) {
+      int j = neighbors[k];
+      real d = dot(points[j], n);
+      if (d > best_dot) {
+        best_dot = d;
+        best = j;
+      }
+    }
+  }
+  return best;
+}
+
 inline real3 GetSupportPoint_Sphere(const real3& B, const real3& n) {
   // real3 b = real3(B.x);
   // return b * b * n / length(b * n);
@@ -157,6 +185,14 @@ inline real3 GetSupportPoint_Convex(const real3& B, const real3* convex_data, co
   return point + n * B.z;
 }
 
+// Support point of a convex shape found by hill climbing from the point of the
+// previous query of this shape.
+inline real3 GetSupportPoint_Convex(const chrono::collision::ConvexShape& Shape, const real3& n) {
+  int start = int(Shape.B.y);
+  Shape.hint = GetSupportIndex_Convex(Shape.convex + start, Shape.adjacency + start, Shape.neighbors, Shape.hint, n);
+  return Shape.convex[start + Shape.hint] + n * Shape.B.z;
+}
+
 inline real3 GetCenter_Sphere() {
   return ZERO_VECTOR;
 }
@@ -217,7 +253,7 @@ inline real3 SupportVertNoMargin(const chrono::collision::ConvexShape& Shape, co
       localSupport = GetSupportPoint_RoundedCone(Shape.B, Shape.C, n);
       break;
     case chrono::collision::CONVEX:
-      localSupport = GetSupportPoint_Convex(Shape.B, Shape.convex, n);
+      localSupport = GetSupportPoint_Convex(Shape, n);
       break;
   }
   // The collision envelope is applied as a compound support.
@@ -259,7 +295,7 @@ inline real3 SupportVert(const chrono::collision::ConvexShape& Shape, const real
       localSupport = GetSupportPoint_RoundedCone(Shape.B - Shape.margin, Shape.C, n);
       break;
     case chrono::collision::CONVEX:
-      localSupport = GetSupportPoint_Convex(Shape.B, Shape.convex, n) - Shape.margin * n;
+      localSupport = GetSupportPoint_Convex(Shape, n) - Shape.margin * n;
       break;
   }
   // The collision envelope is applied as a compound support.
@@ -0,0 +1,346 @@
+#include <algorithm>
+
+#include "chrono_parallel/collision/ChCStaticBVH.h"
+#include "chrono_parallel/collision/ChCBroadphaseUtils.h"
+
+#include <thrust/merge.h>
+
+namespace chrono {
+namespace collision {
+
+// Maximum number of shapes stored in a leaf
+#define BVH_LEAF_SIZE 4
+// Maximum depth of the traversal stack, the hierarchy is balanced so this is
+// enough for far more shapes than can be stored
+#define BVH_STACK_SIZE 64
+
+// Function to count or store the static shapes overlapping a dynamic shape=================================
+// Pairs are stored if potential_contacts is not null
+inline uint function_Query_Static_BVH(const uint shapeA,
+                                      const real3& Amin,
+                                      const real3& Amax,
+                                      const host_vector<real3>& node_min,
+                                      const host_vector<real3>& node_max,
+                                      const host_vector<uint>& node_start,
+                                      const host_vector<uint>& node_count,
+                                      const host_vector<uint>& static_shapes,
+                                      const host_vector<real3>& static_min,
+                                      const host_vector<real3>& static_max,
+                                      const host_vector<short2>& fam_data,
+                                      const host_vector<bool>& body_active,
+                                      const host_vector<uint>& body_id,
+                                      long long* potential_contacts) {
+  uint count = 0;
+  uint bodyA = body_id[shapeA];
+  short2 famA = fam_data[shapeA];
+  // Static bodies are never active, a pair needs an active dynamic body
+  if (!body_active[bodyA]) {
+    return 0;
+  }
+
+  uint stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    uint node = stack[--top];
+    if (!overlap(Amin, Amax, node_min[node], node_max[node])) {
+      continue;
+    }
+    if (node_count[node] == 0) {
+      stack[top++] = node_start[node];
+      stack[top++] = node_start[node] + 1;
+      continue;
+    }
+    for (uint i = node_start[node]; i < node_start[node] + node_count[node]; i++) {
+      uint shapeB = static_shapes[i];
+      if (body_id[shapeB] == bodyA)
+        continue;
+      if (!collide(famA, fam_data[shapeB]))
+        continue;
+      if (!overlap(Amin, Amax, static_min[i], static_max[i]))
+        continue;
+      if (potential_contacts) {
+        potential_contacts[count] = (shapeA < shapeB) ? ((long long)shapeA << 32 | (long long)shapeB)
+                                                      : ((long long)shapeB << 32 | (long long)shapeA);
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+// =========================================================================================================
+ChCStaticBVH::ChCStaticBVH() {
+  data_manager = 0;
+  last_num_shapes = 0;
+}
+// =========================================================================================================
+bool ChCStaticBVH::Update() {
+  const host_vector<bool>& fixed_rigid = data_manager->host_data.fixed_rigid;
+  const host_vector<real3>& pos_rigid = data_manager->host_data.pos_rigid;
+  const host_vector<real4>& rot_rigid = data_manager->host_data.rot_rigid;
+  const host_vector<uint>& id_rigid = data_manager->host_data.id_rigid;
+  host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  const uint num_shapes = data_manager->num_rigid_shapes;
+  const uint num_bodies = data_manager->num_rigid_bodies;
+
+  bool rebuild = (num_shapes != last_num_shapes || last_fixed.size() != num_bodies);
+  if (!rebuild) {
+    int num_changed = 0;
+#pragma omp parallel for reduction(+ : num_changed)
+    for (int i = 0; i < num_bodies; i++) {
+      if (fixed_rigid[i] != last_fixed[i]) {
+        num_changed++;
+      } else if (fixed_rigid[i] && (!(pos_rigid[i] == last_pos[i]) || !(rot_rigid[i] == last_rot[i]))) {
+        num_changed++;
+      }
+    }
+    rebuild = (num_changed > 0);
+  }
+
+  if (!rebuild) {
+    return false;
+  }
+
+  static_rigid.resize(num_shapes);
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    static_rigid[i] = fixed_rigid[id_rigid[i]];
+  }
+
+  last_num_shapes = num_shapes;
+  last_fixed = fixed_rigid;
+  last_pos = pos_rigid;
+  last_rot = rot_rigid;
+
+  Build();
+  return true;
+}
+// =========================================================================================================
+// Top down build, every node is split at the median of the shape centers along
+// the longest axis of its bounds. This is only done when the static geometry
+// changes so the build is serial.
+void ChCStaticBVH::Build() {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  const uint num_shapes = data_manager->num_rigid_shapes;
+
+  static_shapes.clear();
+  for (uint i = 0; i < num_shapes; i++) {
+    if (static_rigid[i]) {
+      static_shapes.push_back(i);
+    }
+  }
+  uint num_static = static_shapes.size();
+
+  node_min.clear();
+  node_max.clear();
+  node_start.clear();
+  node_count.clear();
+
+  LOG(TRACE) << "Static BVH: number of static shapes: " << num_static;
+
+  if (num_static == 0) {
+    static_min.clear();
+    static_max.clear();
+    return;
+  }
+
+  std::vector<real3> center(num_shapes);
+  for (uint i = 0; i < num_static; i++) {
+    uint shape = static_shapes[i];
+    center[shape] = (aabb_min_rigid[shape] + aabb_max_rigid[shape]) * real(0.5);
+  }
+
+  node_min.push_back(R3(0));
+  node_max.push_back(R3(0));
+  node_start.push_back(0);
+  node_count.push_back(num_static);
+
+  // Nodes to process along with the range of shapes they contain
+  std::vector<int3> stack;
+  stack.push_back(I3(0, 0, num_static));
+  while (!stack.empty()) {
+    int3 item = stack.back();
+    stack.pop_back();
+    uint node = item.x;
+    uint start = item.y;
+    uint end = item.z;
+
+    real3 bmin = aabb_min_rigid[static_shapes[start]];
+    real3 bmax = aabb_max_rigid[static_shapes[start]];
+    real3 cmin = center[static_shapes[start]];
+    real3 cmax = cmin;
+    for (uint i = start + 1; i < end; i++) {
+      uint shape = static_shapes[i];
+      bmin = R3(std::min(bmin.x, aabb_min_rigid[shape].x), std::min(bmin.y, aabb_min_rigid[shape].y),
+                std::min(bmin.z, aabb_min_rigid[shape].z));
+      bmax = R3(std::max(bmax.x, aabb_max_rigid[shape].x), std::max(bmax.y, aabb_max_rigid[shape].y),
+                std::max(bmax.z, aabb_max_rigid[shape].z));
+      cmin = R3(std::min(cmin.x, center[shape].x), std::min(cmin.y, center[shape].y),
+                std::min(cmin.z, center[shape].z));
+      cmax = R3(std::max(cmax.x, center[shape].x), std::max(cmax.y, center[shape].y),
+                std::max(cmax.z, center[shape].z));
+    }
+    node_min[node] = bmin;
+    node_max[node] = bmax;
+
+    if (end - start <= BVH_LEAF_SIZE) {
+      node_start[node] = start;
+      node_count[node] = end - start;
+      continue;
+    }
+
+    real3 extent = cmax - cmin;
+    int axis = 0;
+    if (extent.y > extent.x && extent.y >= extent.z) {
+      axis = 1;
+    } else if (extent.z > extent.x && extent.z > extent.y) {
+      axis = 2;
+    }
+
+    uint mid = (start + end) / 2;
+    std::nth_element(static_shapes.begin() + start, static_shapes.begin() + mid, static_shapes.begin() + end,
+                     [&center, axis](uint a, uint b) { return center[a].array[axis] < center[b].array[axis]; });
+
+    uint left = node_min.size();
+    node_start[node] = left;
+    node_count[node] = 0;
+    for (int c = 0; c < 2; c++) {
+      node_min.push_back(R3(0));
+      node_max.push_back(R3(0));
+      node_start.push_back(0);
+      node_count.push_back(0);
+    }
+    stack.push_back(I3(left, start, mid));
+    stack.push_back(I3(left + 1, mid, end));
+  }
+
+  // Store the AABBs in leaf order so that the traversal reads them contiguously
+  static_min.resize(num_static);
+  static_max.resize(num_static);
+  for (uint i = 0; i < num_static; i++) {
+    static_min[i] = aabb_min_rigid[static_shapes[i]];
+    static_max[i] = aabb_max_rigid[static_shapes[i]];
+  }
+
+  LOG(TRACE) << "Static BVH: number of nodes: " << node_min.size();
+}
+// =========================================================================================================
+void ChCStaticBVH::DetectPossibleCollisions() {
+  const host_vector<real3>& aabb_min_rigid = data_manager->host_data.aabb_min_rigid;
+  const host_vector<real3>& aabb_max_rigid = data_manager->host_data.aabb_max_rigid;
+  const host_vector<bool>& static_rigid = data_manager->host_data.static_rigid;
+  const host_vector<short2>& fam_data = data_manager->host_data.fam_rigid;
+  const host_vector<bool>& obj_active = data_manager->host_data.active_rigid;
+  const host_vector<uint>& obj_data_ID = data_manager->host_data.id_rigid;
+  host_vector<long long>& contact_pairs = data_manager->host_data.pair_rigid_rigid;
+  // The broadphase shifts the AABBs, the hierarchy is stored in global coordinates
+  const real3 global_origin = data_manager->measures.collision.global_origin;
+  const uint num_shapes = data_manager->num_rigid_shapes;
+
+  if (static_shapes.size() == 0) {
+    return;
+  }
+
+  num_pairs.resize(num_shapes + 1);
+  num_pairs[num_shapes] = 0;
+
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    if (static_rigid[i]) {
+      num_pairs[i] = 0;
+      continue;
+    }
+    num_pairs[i] = function_Query_Static_BVH(i, aabb_min_rigid[i] + global_origin, aabb_max_rigid[i] + global_origin,
+                                             node_min, node_max, node_start, node_count, static_shapes, static_min,
+                                             static_max, fam_data, obj_active, obj_data_ID, 0);
+  }
+
+  Thrust_Exclusive_Scan(num_pairs);
+  uint num_static_pairs = num_pairs.back();
+  static_pairs.resize(num_static_pairs);
+
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    if (static_rigid[i]) {
+      continue;
+    }
+    function_Query_Static_BVH(i, aabb_min_rigid[i] + global_origin, aabb_max_rigid[i] + global_origin, node_min,
+                              node_max, node_start, node_count, static_shapes, static_min, static_max, fam_data,
+                              obj_active, obj_data_ID, static_pairs.data() + num_pairs[i]);
+  }
+
+  // A dynamic shape can have a lower or a higher index than the static shape
+  Thrust_Sort(static_pairs);
+
+  custom_vector<long long> merged_pairs(contact_pairs.size() + num_static_pairs);
+  thrust::merge(contact_pairs.begin(), contact_pairs.end(), static_pairs.begin(), static_pairs.end(),
+                merged_pairs.begin());
+  contact_pairs.swap(merged_pairs);
+
+  LOG(TRACE) << "Static BVH: number of possible collisions: " << num_static_pairs;
+}
+// =========================================================================================================
+template <typename Test, typename Visit>
+void ChCStaticBVH::Traverse(Test test, Visit visit) const {
+  if (static_shapes.size() == 0 || node_min.size() == 0) {
+    return;
+  }
+  uint stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    uint node = stack[--top];
+    if (!test(node_min[node], node_max[node])) {
+      continue;
+    }
+    if (node_count[node] == 0) {
+      stack[top++] = node_start[node];
+      stack[top++] = node_start[node] + 1;
+      continue;
+    }
+    for (uint i = node_start[node]; i < node_start[node] + node_count[node]; i++) {
+      if (test(static_min[i], static_max[i])) {
+        visit(static_shapes[i], i);
+      }
+    }
+  }
+}
+// =========================================================================================================
+uint ChCStaticBVH::QueryAABB(const real3& Amin, const real3& Amax, uint* shapes) const {
+  uint count = 0;
+  Traverse([&](const real3& Bmin, const real3& Bmax) { return overlap(Amin, Amax, Bmin, Bmax); },
+           [&](uint shape, uint entry) {
+             if (shapes) {
+               shapes[count] = shape;
+             }
+             count++;
+           });
+  return count;
+}
+// =========================================================================================================
+uint ChCStaticBVH::QuerySphere(const real3& center, const real radius, uint* shapes) const {
+  uint count = 0;
+  Traverse([&](const real3& Bmin, const real3& Bmax) { return overlap_sphere(center, radius, Bmin, Bmax); },
+           [&](uint shape, uint entry) {
+             if (shapes) {
+               shapes[count] = shape;
+             }
+             count++;
+           });
+  return count;
+}
+// =========================================================================================================
+void ChCStaticBVH::QueryRay(const real3& from, const real3& to, std::vector<std::pair<real, uint> >& hits) const {
+  const real3 dir = to - from;
+  real tmin, tmax;
+  Traverse([&](const real3& Bmin, const real3& Bmax) { return overlap_ray(from, dir, Bmin, Bmax, tmin, tmax); },
+           [&](uint shape, uint entry) {
+             overlap_ray(from, dir, static_min[entry], static_max[entry], tmin, tmax);
+             hits.push_back(std::make_pair(tmin, shape));
+           });
+}
+}
+}
@@ -0,0 +1,99 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All rights reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Authors: Hammad Mazhar
+// =============================================================================
+// Bounding volume hierarchy for the shapes of fixed bodies. The hierarchy is
+// built once and only rebuilt when a fixed body is added or moved. Dynamic
+// shapes are tested against it, static-static pairs are never generated.
+// =============================================================================
+
+#ifndef CHC_STATIC_BVH_H
+#define CHC_STATIC_BVH_H
+
+#include <vector>
+#include <utility>
+
+#include "chrono_parallel/ChParallelDefines.h"
+#include "chrono_parallel/math/ChParallelMath.h"
+#include "chrono_parallel/ChDataManager.h"
+
+namespace chrono {
+namespace collision {
+
+class CH_PARALLEL_API ChCStaticBVH {
+ public:
+  ChCStaticBVH();
+  // Flag the shapes that belong to fixed bodies in host_data.static_rigid and
+  // rebuild the hierarchy if a fixed body was added, removed or moved. Must be
+  // called after the AABBs were generated and before the broadphase. Returns
+  // true if the hierarchy was rebuilt.
+  bool Update();
+  // Add the pairs between dynamic shapes and static shapes to the sorted pair
+  // list produced by the broadphase, the list stays sorted.
+  void DetectPossibleCollisions();
+
+  // Force a rebuild during the next update, the hierarchy can no longer be
+  // queried until then
+  void Reset() {
+    last_num_shapes = 0;
+    static_shapes.clear();
+    node_min.clear();
+  }
+
+  // Spatial queries against the static shapes, positions are given in global
+  // coordinates. Shapes are stored if shapes is not null, the number of shapes
+  // found is returned.
+  uint QueryAABB(const real3& Amin, const real3& Amax, uint* shapes) const;
+  uint QuerySphere(const real3& center, const real radius, uint* shapes) const;
+  // Append the static shapes whose AABB is hit by the segment from-to along
+  // with the fraction of the segment where it enters the AABB
+  void QueryRay(const real3& from, const real3& to, std::vector<std::pair<real, uint> >& hits) const;
+
+  uint GetNumStaticShapes() { return static_shapes.size(); }
+  uint GetNumNodes() { return node_min.size(); }
+
+  ChParallelDataManager* data_manager;
+
+ private:
+  void Build();
+  // Visit the leaves whose bounds pass test(min, max), visit(shape, entry) is
+  // called for every shape in them whose AABB passes the test as well
+  template <typename Test, typename Visit>
+  void Traverse(Test test, Visit visit) const;
+
+  // Number of shapes and state of the fixed bodies when the hierarchy was built
+  uint last_num_shapes;
+  custom_vector<bool> last_fixed;
+  custom_vector<real3> last_pos;
+  custom_vector<real4> last_rot;
+
+  // Global AABBs of the static shapes at the time of the build
+  custom_vector<real3> static_min;
+  custom_vector<real3> static_max;
+  // Static shape indices, ordered so that every leaf refers to a contiguous range
+  custom_vector<uint> static_shapes;
+
+  // Node bounds, leaves store the first shape and the shape count. Interior
+  // nodes store the index of the first child (the second child follows it) and
+  // a count of zero.
+  custom_vector<real3> node_min;
+  custom_vector<real3> node_max;
+  custom_vector<uint> node_start;
+  custom_vector<uint> node_count;
+
+  custom_vector<uint> num_pairs;
+  custom_vector<long long> static_pairs;
+};
+}
+}
+
+#endif
@@ -4,7 +4,10 @@
 #include "chrono_parallel/ChConfigParallel.h"
 #include "chrono_parallel/constraints/ChConstraintRigidRigid.h"
 #include "chrono_parallel/math/quartic.h"
+#include <thrust/binary_search.h>
+#include <thrust/sort.h>
 #include <thrust/iterator/constant_iterator.h>
+#include <thrust/iterator/counting_iterator.h>
 
 using namespace chrono;
 
@@ -248,6 +251,21 @@ void chrono::Compute_Jacobian_Rolling(const real4& quat,
   T3 = quatRotate(W, quaternion_conjugate);
 }
 
+int chrono::Contact_Row_Indices(SOLVERMODE mode, uint num_contacts, int index, int* rows) {
+  int count = 0;
+  rows[count++] = index;
+  if (mode == SLIDING || mode == SPINNING) {
+    rows[count++] = num_contacts + index * 2 + 0;
+    rows[count++] = num_contacts + index * 2 + 1;
+  }
+  if (mode == SPINNING) {
+    rows[count++] = num_contacts * 3 + index * 3 + 0;
+    rows[count++] = num_contacts * 3 + index * 3 + 1;
+    rows[count++] = num_contacts * 3 + index * 3 + 2;
+  }
+  return count;
+}
+
 void ChConstraintRigidRigid::Build_b() {
   if (data_manager->num_rigid_contacts <= 0) {
     return;
@@ -299,6 +317,23 @@ void ChConstraintRigidRigid::Build_s() {
   ConstSubVectorType gamma_b = blaze::subvector(gamma, num_unilaterals, num_bilaterals);
   ConstSubVectorType gamma_n = blaze::subvector(gamma, 0, num_contacts);
 
+  if (data_manager->contact_matrix_free) {
+    v_new = M_invk + M_invD_b * gamma_b;
+    Contact_D_Product(data_manager, data_manager->settings.solver.solver_mode, gamma.data(), true, v_new.data());
+
+    // Only the sliding rows of D^T * v_new are needed
+    s_rows.resize(3 * num_contacts);
+    Contact_D_T_Product(data_manager, SLIDING, v_new.data(), s_rows.data());
+#pragma omp parallel for
+    for (int index = 0; index < num_contacts; index++) {
+      real fric = data_manager->host_data.fric_rigid_rigid[index].x;
+      real s_v = s_rows[num_contacts + index * 2 + 0];
+      real s_w = s_rows[num_contacts + index * 2 + 1];
+      data_manager->host_data.s[index * 1 + 0] = sqrt(s_v * s_v + s_w * s_w) * fric;
+    }
+    return;
+  }
+
   // Compute new velocity based on the lagrange multipliers
   switch (data_manager->settings.solver.solver_mode) {
     case NORMAL: {
@@ -425,7 +460,7 @@ void inline SetCol6(CompressedMatrix<real>& D, const int row, const int col, con
   D.set(row + 5, col, B.z);
 }
 
-void ChConstraintRigidRigid::Build_D() {
+void ChConstraintRigidRigid::Build_D(bool assemble, bool store_blocks) {
   LOG(INFO) << "ChConstraintRigidRigid::Build_D";
   real3* norm = data_manager->host_data.norm_rigid_rigid.data();
   real3* ptA = data_manager->host_data.cpta_rigid_rigid.data();
@@ -448,12 +483,29 @@ void ChConstraintRigidRigid::Build_D() {
 
   const CompressedMatrix<real>& M_inv = data_manager->host_data.M_inv;
 
+  host_vector<real3>& jac_frame = data_manager->host_data.jac_frame;
+  host_vector<real3>& jac_angA = data_manager->host_data.jac_angA;
+  host_vector<real3>& jac_angB = data_manager->host_data.jac_angB;
+  host_vector<real3>& jac_rollA = data_manager->host_data.jac_rollA;
+  host_vector<real3>& jac_rollB = data_manager->host_data.jac_rollB;
+
   SOLVERMODE solver_mode = data_manager->settings.solver.solver_mode;
+  uint num_contacts = data_manager->num_rigid_contacts;
 
   const std::vector<ChBody*>* body_list = data_manager->body_list;
 
+  if (store_blocks) {
+    jac_frame.resize(3 * num_contacts);
+    jac_angA.resize(3 * num_contacts);
+    jac_angB.resize(3 * num_contacts);
+    if (solver_mode == SPINNING) {
+      jac_rollA.resize(3 * num_contacts);
+      jac_rollB.resize(3 * num_contacts);
+    }
+  }
+
 #pragma omp parallel for
-  for (int index = 0; index < data_manager->num_rigid_contacts; index++) {
+  for (int index = 0; index < num_contacts; index++) {
     real3 U = norm[index], V, W;
     real3 T3, T4, T5, T6, T7, T8;
     real3 TA, TB, TC;
@@ -466,6 +518,35 @@ void ChConstraintRigidRigid::Build_D() {
     Compute_Jacobian(rot[body_id.x], U, V, W, ptA[index] - pos_data[body_id.x], T3, T4, T5);
     Compute_Jacobian(rot[body_id.y], U, V, W, ptB[index] - pos_data[body_id.y], T6, T7, T8);
 
+    if (solver_mode == SPINNING) {
+      Compute_Jacobian_Rolling(rot[body_id.x], U, V, W, TA, TB, TC);
+      Compute_Jacobian_Rolling(rot[body_id.y], U, V, W, TD, TE, TF);
+    }
+
+    if (store_blocks) {
+      jac_frame[index * 3 + 0] = U;
+      jac_frame[index * 3 + 1] = V;
+      jac_frame[index * 3 + 2] = W;
+      jac_angA[index * 3 + 0] = T3;
+      jac_angA[index * 3 + 1] = T4;
+      jac_angA[index * 3 + 2] = T5;
+      jac_angB[index * 3 + 0] = T6;
+      jac_angB[index * 3 + 1] = T7;
+      jac_angB[index * 3 + 2] = T8;
+      if (solver_mode == SPINNING) {
+        jac_rollA[index * 3 + 0] = TA;
+        jac_rollA[index * 3 + 1] = TB;
+        jac_rollA[index * 3 + 2] = TC;
+        jac_rollB[index * 3 + 0] = TD;
+        jac_rollB[index * 3 + 1] = TE;
+        jac_rollB[index * 3 + 2] = TF;
+      }
+    }
+
+    if (!assemble) {
+      continue;
+    }
+
     // Normal jacobian entries
     SetRow6(D_n_T, row * 1 + 0, body_id.x * 6, -U, T3);
     SetRow6(D_n_T, row * 1 + 0, body_id.y * 6, U, -T6);
@@ -479,9 +560,6 @@ void ChConstraintRigidRigid::Build_D() {
     }
 
     if (solver_mode == SPINNING) {
-      Compute_Jacobian_Rolling(rot[body_id.x], U, V, W, TA, TB, TC);
-      Compute_Jacobian_Rolling(rot[body_id.y], U, V, W, TD, TE, TF);
-
       SetRow3(D_s_T, row * 3 + 0, body_id.x * 6 + 3, -TA);
       SetRow3(D_s_T, row * 3 + 1, body_id.x * 6 + 3, -TB);
       SetRow3(D_s_T, row * 3 + 2, body_id.x * 6 + 3, -TC);
@@ -492,6 +570,10 @@ void ChConstraintRigidRigid::Build_D() {
     }
   }
 
+  if (!assemble) {
+    return;
+  }
+
   LOG(INFO) << "ChConstraintRigidRigid::Build_D - Compute Transpose";
   switch (data_manager->settings.solver.solver_mode) {
     case NORMAL:
@@ -528,6 +610,189 @@ void ChConstraintRigidRigid::Build_D() {
   }
 }
 
+uint chrono::Contact_Rows(SOLVERMODE mode, uint num_contacts) {
+  switch (mode) {
+    case NORMAL:
+      return num_contacts;
+    case SLIDING:
+      return 3 * num_contacts;
+    case SPINNING:
+      return 6 * num_contacts;
+    default:
+      return 0;
+  }
+}
+
+void chrono::Contact_D_Product(ChParallelDataManager* data_manager,
+                               SOLVERMODE mode,
+                               const real* x,
+                               bool inverse_mass,
+                               real* v) {
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_bodies = data_manager->num_rigid_bodies;
+  if (Contact_Rows(mode, num_contacts) == 0) {
+    return;
+  }
+
+  const real3* jac_frame = data_manager->host_data.jac_frame.data();
+  const real3* jac_angA = data_manager->host_data.jac_angA.data();
+  const real3* jac_angB = data_manager->host_data.jac_angB.data();
+  const real3* jac_rollA = data_manager->host_data.jac_rollA.data();
+  const real3* jac_rollB = data_manager->host_data.jac_rollB.data();
+  const uint* body_contact_start = data_manager->host_data.body_contact_start.data();
+  const uint* body_contact_list = data_manager->host_data.body_contact_list.data();
+  const real* inv_mass = data_manager->host_data.inv_mass_rigid.data();
+  const M33* inv_inertia = data_manager->host_data.inv_inertia_rigid.data();
+
+#pragma omp parallel for
+  for (int b = 0; b < num_bodies; b++) {
+    real3 lin = R3(0), ang = R3(0);
+    for (uint k = body_contact_start[b]; k < body_contact_start[b + 1]; k++) {
+      uint index = body_contact_list[k] >> 1;
+      bool side_b = body_contact_list[k] & 1;
+
+      real3 f_lin = jac_frame[index * 3 + 0] * x[index];
+      real3 f_ang = (side_b ? jac_angB : jac_angA)[index * 3 + 0] * x[index];
+      if (mode == SLIDING || mode == SPINNING) {
+        real x_u = x[num_contacts + index * 2 + 0];
+        real x_v = x[num_contacts + index * 2 + 1];
+        f_lin = f_lin + jac_frame[index * 3 + 1] * x_u + jac_frame[index * 3 + 2] * x_v;
+        f_ang = f_ang + (side_b ? jac_angB : jac_angA)[index * 3 + 1] * x_u +
+                (side_b ? jac_angB : jac_angA)[index * 3 + 2] * x_v;
+      }
+      // The first body sees -U and T3, the second one U and -T6
+      if (side_b) {
+        lin = lin + f_lin;
+        ang = ang - f_ang;
+      } else {
+        lin = lin - f_lin;
+        ang = ang + f_ang;
+      }
+      if (mode == SPINNING) {
+        const real* x_s = x + num_contacts * 3 + index * 3;
+        const real3* roll = (side_b ? jac_rollB : jac_rollA) + index * 3;
+        real3 f_roll = roll[0] * x_s[0] + roll[1] * x_s[1] + roll[2] * x_s[2];
+        ang = side_b ? ang + f_roll : ang - f_roll;
+      }
+    }
+    if (inverse_mass) {
+      lin = lin * inv_mass[b];
+      ang = MatMult(inv_inertia[b], ang);
+    }
+    v[b * 6 + 0] += lin.x;
+    v[b * 6 + 1] += lin.y;
+    v[b * 6 + 2] += lin.z;
+    v[b * 6 + 3] += ang.x;
+    v[b * 6 + 4] += ang.y;
+    v[b * 6 + 5] += ang.z;
+  }
+}
+
+void chrono::Contact_D_T_Product(ChParallelDataManager* data_manager, SOLVERMODE mode, const real* v, real* out) {
+  uint num_contacts = data_manager->num_rigid_contacts;
+
+  const real3* jac_frame = data_manager->host_data.jac_frame.data();
+  const real3* jac_angA = data_manager->host_data.jac_angA.data();
+  const real3* jac_angB = data_manager->host_data.jac_angB.data();
+  const real3* jac_rollA = data_manager->host_data.jac_rollA.data();
+  const real3* jac_rollB = data_manager->host_data.jac_rollB.data();
+  const int2* ids = data_manager->host_data.bids_rigid_rigid.data();
+
+  if (Contact_Rows(mode, num_contacts) == 0) {
+    return;
+  }
+
+#pragma omp parallel for
+  for (int index = 0; index < num_contacts; index++) {
+    int2 body_id = ids[index];
+    const real* vA = v + body_id.x * 6;
+    const real* vB = v + body_id.y * 6;
+    // Relative linear velocity and the angular velocities of the two bodies
+    real3 lin = R3(vB[0] - vA[0], vB[1] - vA[1], vB[2] - vA[2]);
+    real3 angA = R3(vA[3], vA[4], vA[5]);
+    real3 angB = R3(vB[3], vB[4], vB[5]);
+
+    const real3* frame = jac_frame + index * 3;
+    const real3* TA = jac_angA + index * 3;
+    const real3* TB = jac_angB + index * 3;
+
+    out[index] = dot(frame[0], lin) + dot(TA[0], angA) - dot(TB[0], angB);
+    if (mode == SLIDING || mode == SPINNING) {
+      out[num_contacts + index * 2 + 0] = dot(frame[1], lin) + dot(TA[1], angA) - dot(TB[1], angB);
+      out[num_contacts + index * 2 + 1] = dot(frame[2], lin) + dot(TA[2], angA) - dot(TB[2], angB);
+    }
+    if (mode == SPINNING) {
+      const real3* RA = jac_rollA + index * 3;
+      const real3* RB = jac_rollB + index * 3;
+      out[num_contacts * 3 + index * 3 + 0] = dot(RB[0], angB) - dot(RA[0], angA);
+      out[num_contacts * 3 + index * 3 + 1] = dot(RB[1], angB) - dot(RA[1], angA);
+      out[num_contacts * 3 + index * 3 + 2] = dot(RB[2], angB) - dot(RA[2], angA);
+    }
+  }
+}
+
+int chrono::Contact_Jacobian_Rows(ChParallelDataManager* data_manager,
+                                  SOLVERMODE mode,
+                                  int index,
+                                  int* rows,
+                                  real3* lin,
+                                  real3* angA,
+                                  real3* angB) {
+  uint num_contacts = data_manager->num_rigid_contacts;
+  if (Contact_Rows(mode, num_contacts) == 0) {
+    return 0;
+  }
+  const real3* frame = data_manager->host_data.jac_frame.data() + index * 3;
+  const real3* TA = data_manager->host_data.jac_angA.data() + index * 3;
+  const real3* TB = data_manager->host_data.jac_angB.data() + index * 3;
+
+  int count = Contact_Row_Indices(mode, num_contacts, index, rows);
+  for (int k = 0; k < 3 && k < count; k++) {
+    lin[k] = frame[k];
+    angA[k] = TA[k];
+    angB[k] = -TB[k];
+  }
+  if (mode == SPINNING) {
+    const real3* RA = data_manager->host_data.jac_rollA.data() + index * 3;
+    const real3* RB = data_manager->host_data.jac_rollB.data() + index * 3;
+    for (int k = 0; k < 3; k++) {
+      lin[3 + k] = R3(0);
+      angA[3 + k] = -RA[k];
+      angB[3 + k] = RB[k];
+    }
+  }
+  return count;
+}
+
+void ChConstraintRigidRigid::Build_Body_Contacts() {
+  LOG(INFO) << "ChConstraintRigidRigid::Build_Body_Contacts";
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_bodies = data_manager->num_rigid_bodies;
+  const int2* ids = data_manager->host_data.bids_rigid_rigid.data();
+  host_vector<uint>& body_contact_start = data_manager->host_data.body_contact_start;
+  host_vector<uint>& body_contact_list = data_manager->host_data.body_contact_list;
+
+  body_contact_key.resize(2 * num_contacts);
+  body_contact_list.resize(2 * num_contacts);
+  body_contact_start.resize(num_bodies + 1);
+
+#pragma omp parallel for
+  for (int index = 0; index < num_contacts; index++) {
+    body_contact_key[index * 2 + 0] = ids[index].x;
+    body_contact_key[index * 2 + 1] = ids[index].y;
+    body_contact_list[index * 2 + 0] = index << 1;
+    body_contact_list[index * 2 + 1] = index << 1 | 1;
+  }
+
+  // The sort is stable so the contacts of a body stay in contact order and
+  // the sums in Contact_D_Product do not depend on the number of threads
+  thrust::stable_sort_by_key(thrust_parallel, body_contact_key.begin(), body_contact_key.end(),
+                             body_contact_list.begin());
+  thrust::lower_bound(thrust_parallel, body_contact_key.begin(), body_contact_key.end(),
+                      thrust::counting_iterator<uint>(0), thrust::counting_iterator<uint>(num_bodies + 1),
+                      body_contact_start.begin());
+}
+
 void ChConstraintRigidRigid::GenerateSparsity() {
   LOG(INFO) << "ChConstraintRigidRigid::GenerateSparsity";
   SOLVERMODE solver_mode = data_manager->settings.solver.solver_mode;
@@ -28,6 +28,42 @@ void Compute_Jacobian_Rolling(const real4& quat,
                               real3& T2,
                               real3& T3);
 
+// Rows of a contact in gamma for the given solver mode (normal, then sliding,
+// then spinning), returns the number of rows
+CH_PARALLEL_API
+int Contact_Row_Indices(SOLVERMODE mode, uint num_contacts, int index, int* rows);
+
+// Number of rows of the contact Jacobian used by a solver mode, the rows of a
+// contact are stored as in gamma (normal, then sliding, then spinning)
+CH_PARALLEL_API
+uint Contact_Rows(SOLVERMODE mode, uint num_contacts);
+
+// Matrix-free products with the contact Jacobian D using the blocks stored by
+// Build_D. Only the rows of the given mode take part in the products.
+// Adds D * x to the rigid body entries of v, or M_inv * D * x if inverse_mass
+// is set, the contacts of every body are gathered so bodies are processed in
+// parallel.
+CH_PARALLEL_API
+void Contact_D_Product(ChParallelDataManager* data_manager,
+                       SOLVERMODE mode,
+                       const real* x,
+                       bool inverse_mass,
+                       real* v);
+// Sets the rows of out to D^T * v
+CH_PARALLEL_API
+void Contact_D_T_Product(ChParallelDataManager* data_manager, SOLVERMODE mode, const real* v, real* out);
+// Rows of a contact for the given mode and their Jacobian, returns the number
+// of rows. A row acts on the linear velocities of the bodies as
+// lin * (vB - vA) and on the angular velocities as angA * wA + angB * wB.
+CH_PARALLEL_API
+int Contact_Jacobian_Rows(ChParallelDataManager* data_manager,
+                          SOLVERMODE mode,
+                          int index,
+                          int* rows,
+                          real3* lin,
+                          real3* angA,
+                          real3* angB);
+
 class CH_PARALLEL_API ChConstraintRigidRigid {
  public:
   ChConstraintRigidRigid() {
@@ -89,8 +125,12 @@ class CH_PARALLEL_API ChConstraintRigidRigid {
   // Compute the diagonal compliance matrix
   void Build_E();
   // Compute the jacobian matrix, no allocation is performed here,
-  // GenerateSparsity should take care of that
-  void Build_D();
+  // GenerateSparsity should take care of that. The sparse matrices are only
+  // filled if assemble is set, the Jacobian blocks used by the matrix-free
+  // products and the block solvers only if store_blocks is set.
+  void Build_D(bool assemble = true, bool store_blocks = false);
+  // Gather the contacts of every body for Contact_D_Product
+  void Build_Body_Contacts();
   void Build_s();
   // Fill-in the non zero entries in the bilateral jacobian with ones.
   // This operation is sequential.
@@ -99,6 +139,10 @@ class CH_PARALLEL_API ChConstraintRigidRigid {
 
  protected:
   custom_vector<bool2> contact_active_pairs;
+  // Body of every entry of body_contact_list, used as the sort key
+  host_vector<uint> body_contact_key;
+  // Holds D^T*v in the matrix-free Build_s, kept so that it does not allocate
+  DynamicVector<real> s_rows;
 
   real inv_h;
   real inv_hpa;
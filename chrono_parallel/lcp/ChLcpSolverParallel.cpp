@@ -43,11 +43,31 @@ void ChLcpSolverParallel::ComputeMassMatrix() {
   // Shafts have one DOF
   M_inv.resize(num_dof, num_dof);
 
+  // Per body copies used by the matrix-free contact products
+  host_vector<real>& inv_mass_rigid = data_manager->host_data.inv_mass_rigid;
+  host_vector<M33>& inv_inertia_rigid = data_manager->host_data.inv_inertia_rigid;
+  inv_mass_rigid.assign(num_bodies, 0);
+  inv_inertia_rigid.assign(num_bodies, M33());
+
   for (int i = 0; i < num_bodies; i++) {
     if (data_manager->host_data.active_rigid[i]) {
       real inv_mass = 1.0 / body_list->at(i)->GetMass();
       ChMatrix33<>& body_inv_inr = body_list->at(i)->VariablesBody().GetBodyInvInertia();
 
+      inv_mass_rigid[i] = inv_mass;
+      M33& inv_inr = inv_inertia_rigid[i];
+      inv_inr.U = R3(body_inv_inr.GetElement(0, 0), 0, 0);
+      inv_inr.V = R3(0, body_inv_inr.GetElement(1, 1), 0);
+      inv_inr.W = R3(0, 0, body_inv_inr.GetElement(2, 2));
+      if (use_full_inertia_tensor) {
+        inv_inr.U.y = body_inv_inr.GetElement(1, 0);
+        inv_inr.U.z = body_inv_inr.GetElement(2, 0);
+        inv_inr.V.x = body_inv_inr.GetElement(0, 1);
+        inv_inr.V.z = body_inv_inr.GetElement(2, 1);
+        inv_inr.W.x = body_inv_inr.GetElement(0, 2);
+        inv_inr.W.y = body_inv_inr.GetElement(1, 2);
+      }
+
       M_inv.append(i * 6 + 0, i * 6 + 0, inv_mass);
       M_inv.finalize(i * 6 + 0);
       M_inv.append(i * 6 + 1, i * 6 + 1, inv_mass);
@@ -77,6 +77,10 @@ class CH_PARALLEL_API ChLcpSolverParallelDVI : public ChLcpSolverParallel {
   void SetR();
   // This function computes an initial guess for each contact
   void PreSolve();
+  // Start the contact impulses from the ones of the matching contacts of the
+  // previous step, and keep the impulses of this step for the next one
+  void WarmStart();
+  void StoreWarmStart();
   // This function is used to change the solver algorithm.
   void ChangeSolverType(SOLVERTYPE type);
 
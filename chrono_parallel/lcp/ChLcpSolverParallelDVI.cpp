@@ -1,3 +1,8 @@
+#include <algorithm>
+
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
+
 #include "chrono_parallel/lcp/ChLcpSolverParallel.h"
 #include "chrono_parallel/math/ChThrustLinearAlgebra.h"
 
@@ -41,6 +46,9 @@ void ChLcpSolverParallelDVI::RunTimeStep() {
 
   data_manager->host_data.gamma.resize(data_manager->num_constraints);
   data_manager->host_data.gamma.reset();
+  if (data_manager->settings.solver.use_warm_start) {
+    WarmStart();
+  }
 
   // Perform any setup tasks for all constraint types
   rigid_rigid.Setup(data_manager);
@@ -108,6 +116,10 @@ void ChLcpSolverParallelDVI::RunTimeStep() {
 
   ComputeImpulses();
 
+  if (data_manager->settings.solver.use_warm_start) {
+    StoreWarmStart();
+  }
+
   for (int i = 0; i < data_manager->measures.solver.maxd_hist.size(); i++) {
     AtIterationEnd(data_manager->measures.solver.maxd_hist[i], data_manager->measures.solver.maxdeltalambda_hist[i],
                    i);
@@ -117,6 +129,90 @@ void ChLcpSolverParallelDVI::RunTimeStep() {
   LOG(TRACE) << "Solve Done: " << residual;
 }
 
+void ChLcpSolverParallelDVI::WarmStart() {
+  const custom_vector<long long>& contact_pair = data_manager->host_data.pair_rigid_rigid;
+  const custom_vector<real3>& cptb = data_manager->host_data.cptb_rigid_rigid;
+  const host_vector<long long>& warm_pair = data_manager->host_data.warm_pair;
+  const host_vector<real3>& warm_point = data_manager->host_data.warm_point;
+  const host_vector<real>& warm_gamma = data_manager->host_data.warm_gamma;
+  DynamicVector<real>& gamma = data_manager->host_data.gamma;
+  const SOLVERMODE solver_mode = data_manager->settings.solver.solver_mode;
+  const real factor = data_manager->settings.solver.warm_start_factor;
+  const int num_contacts = data_manager->num_rigid_contacts;
+
+  // The pair list is only kept by the parallel collision system
+  if (num_contacts == 0 || warm_pair.size() == 0 || contact_pair.size() != num_contacts) {
+    return;
+  }
+
+  // The previous contacts are sorted by pair, a pair can have several contacts
+  // (e.g. box-box) and the closest one is used
+#pragma omp parallel for
+  for (int index = 0; index < num_contacts; index++) {
+    long long p = contact_pair[index];
+    int match = -1;
+    real best = 0;
+    for (int j = std::lower_bound(warm_pair.begin(), warm_pair.end(), p) - warm_pair.begin();
+         j < warm_pair.size() && warm_pair[j] == p; j++) {
+      real d = (warm_point[j] - cptb[index]).length2();
+      if (match < 0 || d < best) {
+        best = d;
+        match = j;
+      }
+    }
+    if (match < 0) {
+      continue;
+    }
+
+    const real* g = &warm_gamma[6 * match];
+    int rows[6];
+    int count = Contact_Row_Indices(solver_mode, num_contacts, index, rows);
+    for (int k = 0; k < count; k++) {
+      gamma[rows[k]] = factor * g[k];
+    }
+  }
+}
+
+void ChLcpSolverParallelDVI::StoreWarmStart() {
+  const custom_vector<long long>& contact_pair = data_manager->host_data.pair_rigid_rigid;
+  const custom_vector<real3>& cptb = data_manager->host_data.cptb_rigid_rigid;
+  host_vector<long long>& warm_pair = data_manager->host_data.warm_pair;
+  host_vector<real3>& warm_point = data_manager->host_data.warm_point;
+  host_vector<real>& warm_gamma = data_manager->host_data.warm_gamma;
+  const DynamicVector<real>& gamma = data_manager->host_data.gamma;
+  const SOLVERMODE solver_mode = data_manager->settings.solver.solver_mode;
+  const int num_contacts = data_manager->num_rigid_contacts;
+
+  if (contact_pair.size() != num_contacts) {
+    warm_pair.clear();
+    return;
+  }
+
+  // The pair list is sorted by the narrowphase, the pairs of the static
+  // hierarchy are appended to it so it is sorted again if needed
+  host_vector<uint> order(num_contacts);
+  thrust::sequence(order.begin(), order.end());
+  warm_pair = contact_pair;
+  if (!thrust::is_sorted(warm_pair.begin(), warm_pair.end())) {
+    thrust::stable_sort_by_key(warm_pair.begin(), warm_pair.end(), order.begin());
+  }
+
+  warm_point.resize(num_contacts);
+  warm_gamma.resize(6 * num_contacts);
+#pragma omp parallel for
+  for (int i = 0; i < num_contacts; i++) {
+    uint index = order[i];
+    real* g = &warm_gamma[6 * i];
+    warm_point[i] = cptb[index];
+    g[1] = g[2] = g[3] = g[4] = g[5] = 0;
+    int rows[6];
+    int count = Contact_Row_Indices(solver_mode, num_contacts, index, rows);
+    for (int k = 0; k < count; k++) {
+      g[k] = gamma[rows[k]];
+    }
+  }
+}
+
 void ChLcpSolverParallelDVI::ComputeD() {
   LOG(INFO) << "ChLcpSolverParallelDVI::ComputeD()";
   data_manager->system_timer.start("ChLcpSolverParallel_D");
@@ -157,44 +253,59 @@ void ChLcpSolverParallelDVI::ComputeD() {
 
   const CompressedMatrix<real>& M_inv = data_manager->host_data.M_inv;
 
-  switch (data_manager->settings.solver.solver_mode) {
-    case NORMAL:
-      CLEAR_RESERVE_RESIZE(D_n_T, nnz_normal, num_normal, num_dof)
-      CLEAR_RESERVE_RESIZE(D_n, nnz_normal, num_dof, num_normal)
-      CLEAR_RESERVE_RESIZE(M_invD_n, nnz_normal, num_dof, num_normal)
-      break;
-    case SLIDING:
+  // The PDIP solver works on the assembled matrices
+  SOLVERTYPE solver_type = data_manager->settings.solver.solver_type;
+  bool assemble = !data_manager->settings.solver.use_matrix_free || solver_type == PDIP;
+  data_manager->contact_matrix_free = !assemble;
 
-      CLEAR_RESERVE_RESIZE(D_n_T, nnz_normal, num_normal, num_dof)
-      CLEAR_RESERVE_RESIZE(D_n, nnz_normal, num_dof, num_normal)
-      CLEAR_RESERVE_RESIZE(M_invD_n, nnz_normal, num_dof, num_normal)
+  if (assemble) {
+    switch (data_manager->settings.solver.solver_mode) {
+      case NORMAL:
+        CLEAR_RESERVE_RESIZE(D_n_T, nnz_normal, num_normal, num_dof)
+        CLEAR_RESERVE_RESIZE(D_n, nnz_normal, num_dof, num_normal)
+        CLEAR_RESERVE_RESIZE(M_invD_n, nnz_normal, num_dof, num_normal)
+        break;
+      case SLIDING:
 
-      CLEAR_RESERVE_RESIZE(D_t_T, nnz_tangential, num_tangential, num_dof)
-      CLEAR_RESERVE_RESIZE(D_t, nnz_tangential, num_dof, num_tangential)
-      CLEAR_RESERVE_RESIZE(M_invD_t, nnz_tangential, num_dof, num_tangential)
+        CLEAR_RESERVE_RESIZE(D_n_T, nnz_normal, num_normal, num_dof)
+        CLEAR_RESERVE_RESIZE(D_n, nnz_normal, num_dof, num_normal)
+        CLEAR_RESERVE_RESIZE(M_invD_n, nnz_normal, num_dof, num_normal)
 
-      break;
-    case SPINNING:
+        CLEAR_RESERVE_RESIZE(D_t_T, nnz_tangential, num_tangential, num_dof)
+        CLEAR_RESERVE_RESIZE(D_t, nnz_tangential, num_dof, num_tangential)
+        CLEAR_RESERVE_RESIZE(M_invD_t, nnz_tangential, num_dof, num_tangential)
 
-      CLEAR_RESERVE_RESIZE(D_n_T, nnz_normal, num_normal, num_dof)
-      CLEAR_RESERVE_RESIZE(D_n, nnz_normal, num_dof, num_normal)
-      CLEAR_RESERVE_RESIZE(M_invD_n, nnz_normal, num_dof, num_normal)
+        break;
+      case SPINNING:
 
-      CLEAR_RESERVE_RESIZE(D_t_T, nnz_tangential, num_tangential, num_dof)
-      CLEAR_RESERVE_RESIZE(D_t, nnz_tangential, num_dof, num_tangential)
-      CLEAR_RESERVE_RESIZE(M_invD_t, nnz_tangential, num_dof, num_tangential)
+        CLEAR_RESERVE_RESIZE(D_n_T, nnz_normal, num_normal, num_dof)
+        CLEAR_RESERVE_RESIZE(D_n, nnz_normal, num_dof, num_normal)
+        CLEAR_RESERVE_RESIZE(M_invD_n, nnz_normal, num_dof, num_normal)
 
-      CLEAR_RESERVE_RESIZE(D_s_T, nnz_spinning, num_spinning, num_dof)
-      CLEAR_RESERVE_RESIZE(D_s, nnz_spinning, num_dof, num_spinning)
-      CLEAR_RESERVE_RESIZE(M_invD_s, nnz_spinning, num_dof, num_spinning)
+        CLEAR_RESERVE_RESIZE(D_t_T, nnz_tangential, num_tangential, num_dof)
+        CLEAR_RESERVE_RESIZE(D_t, nnz_tangential, num_dof, num_tangential)
+        CLEAR_RESERVE_RESIZE(M_invD_t, nnz_tangential, num_dof, num_tangential)
 
-      break;
+        CLEAR_RESERVE_RESIZE(D_s_T, nnz_spinning, num_spinning, num_dof)
+        CLEAR_RESERVE_RESIZE(D_s, nnz_spinning, num_dof, num_spinning)
+        CLEAR_RESERVE_RESIZE(M_invD_s, nnz_spinning, num_dof, num_spinning)
+
+        break;
+    }
   }
   CLEAR_RESERVE_RESIZE(D_b_T, nnz_bilaterals, num_bilaterals, num_dof)
 
-  rigid_rigid.GenerateSparsity();
+  if (assemble) {
+    rigid_rigid.GenerateSparsity();
+  }
   bilateral.GenerateSparsity();
-  rigid_rigid.Build_D();
+  // The Jacobian blocks are read by the matrix-free products and the PGS and
+  // Jacobi solvers, the contacts of every body by Contact_D_Product only
+  bool store_blocks = !assemble || solver_type == GAUSS_SEIDEL || solver_type == JACOBI;
+  rigid_rigid.Build_D(assemble, store_blocks);
+  if (!assemble || solver_type == GAUSS_SEIDEL) {
+    rigid_rigid.Build_Body_Contacts();
+  }
   bilateral.Build_D();
 
   data_manager->system_timer.stop("ChLcpSolverParallel_D");
@@ -252,6 +363,18 @@ void ChLcpSolverParallelDVI::ComputeR() {
   SubVectorType R_b = blaze::subvector(R, num_unilaterals, num_bilaterals);
 
   R_b = -b_b - D_b_T * M_invk;
+  if (data_manager->contact_matrix_free) {
+    SOLVERMODE solver_mode = data_manager->settings.solver.solver_mode;
+    uint num_rows = Contact_Rows(solver_mode, num_contacts);
+    Contact_D_T_Product(data_manager, solver_mode, M_invk.data(), R.data());
+#pragma omp parallel for
+    for (int i = 0; i < num_rows; i++) {
+      R[i] = -R[i];
+    }
+    R_n = R_n - b_n;
+    data_manager->system_timer.stop("ChLcpSolverParallel_R");
+    return;
+  }
   switch (data_manager->settings.solver.solver_mode) {
     case NORMAL: {
       R_n = -b_n - D_n_T * M_invk;
@@ -352,6 +475,12 @@ void ChLcpSolverParallelDVI::ComputeImpulses() {
         blaze::subvector(gamma, num_unilaterals, num_bilaterals);
     ConstSubVectorType gamma_n = blaze::subvector(gamma, 0, num_contacts);
 
+    if (data_manager->contact_matrix_free) {
+      v = M_invk + M_invD_b * gamma_b;
+      Contact_D_Product(data_manager, data_manager->settings.solver.solver_mode, gamma.data(), true, v.data());
+      return;
+    }
+
     // Compute new velocity based on the lagrange multipliers
     switch (data_manager->settings.solver.solver_mode) {
       case NORMAL: {
@@ -5,8 +5,12 @@
 #include "physics/ChShaftsBody.h"
 
 #include "chrono_parallel/physics/ChSystemParallel.h"
+#include "chrono_parallel/collision/ChCBroadphaseUtils.h"
 #include <numeric>
 
+#include <thrust/sort.h>
+#include <thrust/transform_reduce.h>
+
 using namespace chrono;
 using namespace chrono::collision;
 #ifdef LOGGINGENABLED
@@ -25,10 +29,13 @@ ChSystemParallel::ChSystemParallel(unsigned int max_objects) : ChSystem(1000, 10
   cd_accumulator.resize(10, 0);
   frame_threads = 0;
   frame_bins = 0;
+  frame_reorder = 0;
   old_timer = 0;
   old_timer_cd = 0;
   detect_optimal_threads = false;
   detect_optimal_bins = false;
+  old_bin_scale = 1;
+  bin_tuning_direction = 1;
   current_threads = 2;
 
   data_manager->system_timer.AddTimer("step");
@@ -63,6 +70,14 @@ int ChSystemParallel::Integrate_Y() {
   data_manager->system_timer.Reset();
   data_manager->system_timer.start("step");
 
+  if (data_manager->settings.spatial_reorder_frequency > 0) {
+    frame_reorder++;
+    if (frame_reorder >= data_manager->settings.spatial_reorder_frequency) {
+      frame_reorder = 0;
+      ReorderBodies();
+    }
+  }
+
   Setup();
 
   data_manager->system_timer.start("update");
@@ -142,6 +157,9 @@ int ChSystemParallel::Integrate_Y() {
   if (data_manager->settings.perform_thread_tuning) {
     RecomputeThreads();
   }
+  if (data_manager->settings.perform_bin_tuning) {
+    RecomputeBins();
+  }
 
   return 1;
 }
@@ -172,6 +190,7 @@ void ChSystemParallel::AddBody(ChSharedPtr<ChBody> newbody) {
   data_manager->host_data.rot_rigid.push_back(R4());
   data_manager->host_data.active_rigid.push_back(true);
   data_manager->host_data.collide_rigid.push_back(true);
+  data_manager->host_data.fixed_rigid.push_back(false);
 
   // Let derived classes reserve space for specific material surface data
   AddMaterialSurfaceData(newbody);
@@ -285,6 +304,7 @@ void ChSystemParallel::UpdateRigidBodies() {
   custom_vector<real4>& rotation = data_manager->host_data.rot_rigid;
   custom_vector<bool>& active = data_manager->host_data.active_rigid;
   custom_vector<bool>& collide = data_manager->host_data.collide_rigid;
+  custom_vector<bool>& fixed = data_manager->host_data.fixed_rigid;
 
 #pragma omp parallel for
   for (int i = 0; i < bodylist.size(); i++) {
@@ -316,6 +336,7 @@ void ChSystemParallel::UpdateRigidBodies() {
 
     active[i] = bodylist[i]->IsActive();
     collide[i] = bodylist[i]->GetCollide();
+    fixed[i] = bodylist[i]->GetBodyFixed();
 
     // Let derived classes set the specific material surface data.
     UpdateMaterialSurfaceData(i, bodylist[i]);
@@ -557,6 +578,214 @@ void ChSystemParallel::RecomputeThreads() {
   frame_threads++;
 }
 
+void ChSystemParallel::RecomputeBins() {
+  const collision_settings& settings = data_manager->settings.collision;
+  collision_measures& measures = data_manager->measures.collision;
+  // Sweep and prune does not use the grid
+  if (settings.broadphase_type == BROADPHASE_SAP) {
+    return;
+  }
+
+  cd_accumulator.insert(cd_accumulator.begin(), data_manager->system_timer.GetTime("collision_broad") +
+                                                    data_manager->system_timer.GetTime("collision_narrow"));
+  cd_accumulator.pop_back();
+
+  double sum_of_elems = std::accumulate(cd_accumulator.begin(), cd_accumulator.end(), 0.0);
+
+  if (frame_bins >= data_manager->settings.bin_tuning_frequency && detect_optimal_bins == false) {
+    if (measures.num_bins_active == 0) {
+      return;
+    }
+    frame_bins = 0;
+    detect_optimal_bins = true;
+    old_timer_cd = sum_of_elems / 10.0;
+    old_bin_scale = measures.bin_scale;
+
+    // The pair tests in a bin grow with the square of its occupancy. If more
+    // than a tenth of the (shape, bin) entries lie in bins with 16 or more
+    // shapes, try a finer grid. If most bins hold a single shape the shapes
+    // span many bins, try a coarser grid. Otherwise keep the direction of the
+    // last successful trial.
+    uint crowded_entries = 0;
+    for (int i = 4; i < collision_measures::num_occupancy_buckets; i++) {
+      crowded_entries += measures.occupancy_histogram[i];
+    }
+    if (crowded_entries * 10 > measures.number_of_bin_intersections) {
+      bin_tuning_direction = 1;
+    } else if (measures.num_single_bins > measures.num_bins_active / 2) {
+      bin_tuning_direction = -1;
+    }
+
+    // Change every axis by 25 percent. The scale is applied by the broadphase
+    // to the fixed number of bins or to the one computed from grid_density.
+    real scale = old_bin_scale * (bin_tuning_direction > 0 ? real(1.25) : real(0.8));
+    measures.bin_scale = clamp(scale, real(1.0 / 64.0), real(64.0));
+    LOG(TRACE) << "Bin tuning: bin scale changed to " << measures.bin_scale << ", largest bin holds "
+               << measures.max_bin_occupancy << " shapes";
+  } else if (frame_bins == 10 && detect_optimal_bins) {
+    double current_timer = sum_of_elems / 10.0;
+    detect_optimal_bins = false;
+    frame_bins = 0;
+    if (old_timer_cd < current_timer) {
+      measures.bin_scale = old_bin_scale;
+      bin_tuning_direction = -bin_tuning_direction;
+      LOG(TRACE) << "Bin tuning: bin scale changed back to " << old_bin_scale;
+    }
+  }
+  frame_bins++;
+}
+
+// Reorder a vector holding stride entries per item, item i of the result is item
+// perm[i] of the input. The vector must hold an entry for every item.
+template <typename T>
+static void PermuteVector(custom_vector<T>& data, const custom_vector<uint>& perm, uint stride = 1) {
+  assert(data.size() == perm.size() * stride);
+  custom_vector<T> temp(data.size());
+#pragma omp parallel for
+  for (int i = 0; i < perm.size(); i++) {
+    for (uint j = 0; j < stride; j++) {
+      temp[i * stride + j] = data[perm[i] * stride + j];
+    }
+  }
+  data.swap(temp);
+}
+
+void ChSystemParallel::ReorderBodies() {
+  // The shapes are only stored in the data manager by the parallel collision system
+  ChCollisionSystemParallel* coll_sys = dynamic_cast<ChCollisionSystemParallel*>(collision_system);
+  const uint num_bodies = data_manager->num_rigid_bodies;
+  const uint num_shapes = data_manager->num_rigid_shapes;
+  if (coll_sys == 0 || num_bodies < 2) {
+    return;
+  }
+  LOG(INFO) << "ChSystemParallel::ReorderBodies()";
+
+  // Morton code of every body, positions are quantized on a grid with 1024
+  // cells along each axis spanning all of the bodies
+  custom_vector<real3> position(num_bodies);
+#pragma omp parallel for
+  for (int i = 0; i < num_bodies; i++) {
+    ChVector<>& pos = bodylist[i]->GetPos();
+    position[i] = R3(pos.x, pos.y, pos.z);
+  }
+  bbox res = bbox(position[0], position[0]);
+  res = thrust::transform_reduce(thrust_parallel, position.begin(), position.end(), bbox_transformation(), res,
+                                 bbox_reduction());
+  real3 diagonal = res.second - res.first;
+  real3 inv_cell_size = R3(diagonal.x > 0 ? 1023 / diagonal.x : 0, diagonal.y > 0 ? 1023 / diagonal.y : 0,
+                           diagonal.z > 0 ? 1023 / diagonal.z : 0);
+
+  custom_vector<uint> body_key(num_bodies);
+  custom_vector<uint> body_perm(num_bodies);
+#pragma omp parallel for
+  for (int i = 0; i < num_bodies; i++) {
+    real3 cell = (position[i] - res.first) * inv_cell_size;
+    body_key[i] = Hash_Morton(I3(int(cell.x), int(cell.y), int(cell.z)));
+    body_perm[i] = i;
+  }
+  // body_perm maps the new index of a body to its old index
+  thrust::stable_sort_by_key(thrust_parallel, body_key.begin(), body_key.end(), body_perm.begin());
+  custom_vector<uint> body_map(num_bodies);
+#pragma omp parallel for
+  for (int i = 0; i < num_bodies; i++) {
+    body_map[body_perm[i]] = i;
+  }
+
+  // The ChBody objects are not moved, only the list and their ids change
+  std::vector<ChBody*> old_bodylist = bodylist;
+  for (int i = 0; i < num_bodies; i++) {
+    bodylist[i] = old_bodylist[body_perm[i]];
+    bodylist[i]->SetId(i);
+  }
+
+  // These are filled again during the update but are kept consistent for
+  // anything that reads them before
+  PermuteVector(data_manager->host_data.pos_rigid, body_perm);
+  PermuteVector(data_manager->host_data.rot_rigid, body_perm);
+  PermuteVector(data_manager->host_data.active_rigid, body_perm);
+  PermuteVector(data_manager->host_data.collide_rigid, body_perm);
+  PermuteVector(data_manager->host_data.fixed_rigid, body_perm);
+
+  // Shapes follow the order of their bodies, the shapes of a body keep their
+  // relative order
+  custom_vector<uint> shape_key(num_shapes);
+  custom_vector<uint> shape_perm(num_shapes);
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    shape_key[i] = body_map[data_manager->host_data.id_rigid[i]];
+    shape_perm[i] = i;
+  }
+  thrust::stable_sort_by_key(thrust_parallel, shape_key.begin(), shape_key.end(), shape_perm.begin());
+  custom_vector<uint> shape_map(num_shapes);
+#pragma omp parallel for
+  for (int i = 0; i < num_shapes; i++) {
+    shape_map[shape_perm[i]] = i;
+  }
+
+  PermuteVector(data_manager->host_data.ObA_rigid, shape_perm);
+  PermuteVector(data_manager->host_data.ObB_rigid, shape_perm);
+  PermuteVector(data_manager->host_data.ObC_rigid, shape_perm);
+  PermuteVector(data_manager->host_data.ObR_rigid, shape_perm);
+  PermuteVector(data_manager->host_data.fam_rigid, shape_perm);
+  PermuteVector(data_manager->host_data.typ_rigid, shape_perm);
+  PermuteVector(data_manager->host_data.margin_rigid, shape_perm);
+  // The bounding boxes and the static flags are only sized for the current
+  // shapes once collision detection ran with them, otherwise they are
+  // computed again before they are used
+  if (data_manager->host_data.static_rigid.size() == num_shapes) {
+    PermuteVector(data_manager->host_data.static_rigid, shape_perm);
+  }
+  if (data_manager->host_data.aabb_min_rigid.size() == num_shapes) {
+    PermuteVector(data_manager->host_data.aabb_min_rigid, shape_perm);
+    PermuteVector(data_manager->host_data.aabb_max_rigid, shape_perm);
+  }
+  // The sorted keys are the new body ids of the shapes
+  data_manager->host_data.id_rigid = shape_key;
+
+  // Contact history (DEM), the history of a pair is stored on the body with the
+  // larger index along with the other body, the larger and the smaller shape.
+  // With the new ids an entry can belong to another body, entries that do not
+  // fit are dropped.
+  custom_vector<int3>& shear_neigh = data_manager->host_data.shear_neigh;
+  custom_vector<real3>& shear_disp = data_manager->host_data.shear_disp;
+  if (shear_neigh.size() == max_shear * num_bodies) {
+    custom_vector<int3> new_neigh(shear_neigh.size(), I3(-1, -1, -1));
+    custom_vector<real3> new_disp(shear_disp.size(), R3(0, 0, 0));
+    for (int i = 0; i < num_bodies; i++) {
+      for (int j = 0; j < max_shear; j++) {
+        int3 neigh = shear_neigh[max_shear * i + j];
+        if (neigh.x == -1) {
+          continue;
+        }
+        int body1 = body_map[i];
+        int body2 = body_map[neigh.x];
+        int shape1 = shape_map[neigh.y];
+        int shape2 = shape_map[neigh.z];
+        int owner = std::max(body1, body2);
+        for (int k = 0; k < max_shear; k++) {
+          if (new_neigh[max_shear * owner + k].x == -1) {
+            new_neigh[max_shear * owner + k] =
+                I3(std::min(body1, body2), std::max(shape1, shape2), std::min(shape1, shape2));
+            // The displacement is stored relative to the owner, flip it if the
+            // other body became the owner
+            new_disp[max_shear * owner + k] = (owner == body1) ? shear_disp[max_shear * i + j]
+                                                               : -shear_disp[max_shear * i + j];
+            break;
+          }
+        }
+      }
+    }
+    shear_neigh.swap(new_neigh);
+    shear_disp.swap(new_disp);
+  }
+
+  // Contact forces, the warm start impulses and all data kept by the collision
+  // system refer to the old indices
+  data_manager->Fc_current = false;
+  data_manager->host_data.warm_pair.clear();
+  coll_sys->ResetPersistentState();
+}
+
 void ChSystemParallel::ChangeCollisionSystem(COLLISIONSYSTEMTYPE type) {
   assert(GetNbodies() == 0);
 
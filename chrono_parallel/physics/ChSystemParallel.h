@@ -64,6 +64,9 @@ class CH_PARALLEL_API ChSystemParallel : public ChSystem {
   void UpdateShafts();
   void UpdateFluidBodies();
   void RecomputeThreads();
+  void RecomputeBins();
+  // Sort the bodies and the collision shapes along a Morton curve
+  void ReorderBodies();
 
   virtual void AddMaterialSurfaceData(ChSharedPtr<ChBody> newbody) = 0;
   virtual void UpdateMaterialSurfaceData(int index, ChBody* body) = 0;
@@ -117,8 +120,12 @@ class CH_PARALLEL_API ChSystemParallel : public ChSystem {
 
   int current_threads;
   int detect_optimal_bins;
+  // Bin scale before the current bin tuning trial and the direction of the
+  // next trial (1 for a finer grid, -1 for a coarser grid)
+  real old_bin_scale;
+  int bin_tuning_direction;
   std::vector<double> timer_accumulator, cd_accumulator;
-  uint frame_threads, frame_bins, counter;
+  uint frame_threads, frame_bins, frame_reorder, counter;
   std::vector<ChLink*>::iterator it;
 
  private:
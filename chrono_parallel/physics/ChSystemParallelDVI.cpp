@@ -67,6 +67,14 @@ void ChSystemParallelDVI::CalculateContactForces() {
 
   DynamicVector<real>& gamma = data_manager->host_data.gamma;
 
+  if (data_manager->contact_matrix_free) {
+    Fc.resize(data_manager->num_dof);
+    Fc = 0;
+    Contact_D_Product(data_manager, data_manager->settings.solver.solver_mode, gamma.data(), false, Fc.data());
+    Fc = Fc / data_manager->settings.step_size;
+    return;
+  }
+
   switch (data_manager->settings.solver.solver_mode) {
     case NORMAL: {
       const CompressedMatrix<real>& D_n = data_manager->host_data.D_n;
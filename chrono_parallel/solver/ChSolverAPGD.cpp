@@ -36,9 +36,60 @@ void ChSolverAPGD::UpdateR() {
   SubVectorType R_n = blaze::subvector(R, 0, num_contacts);
   SubVectorType s_n = blaze::subvector(s, 0, num_contacts);
 
+  if (data_manager->contact_matrix_free) {
+    // temp is not in use between iterations, its first rows hold D_n^T * M_invk
+    Contact_D_T_Product(data_manager, NORMAL, M_invk.data(), temp.data());
+    R_n = -b_n - blaze::subvector(temp, 0, num_contacts) - s_n;
+    return;
+  }
+
   R_n = -b_n - D_n_T * M_invk - s_n;
 }
 
+void ChSolverAPGD::StepAndProject(const DynamicVector<real>& r, bool subtract_rhs) {
+  SOLVERMODE solver_mode = data_manager->settings.solver.solver_mode;
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_unilaterals = data_manager->num_unilaterals;
+  uint num_bilaterals = data_manager->num_bilaterals;
+  real step = t;
+
+  // One block per contact followed by one block per bilateral row
+#pragma omp parallel for
+  for (int index = 0; index < num_contacts + num_bilaterals; index++) {
+    int rows[6];
+    int count = 1;
+    if (index < num_contacts) {
+      count = Contact_Row_Indices(solver_mode, num_contacts, index, rows);
+    } else {
+      rows[0] = num_unilaterals + index - num_contacts;
+    }
+    for (int k = 0; k < count; k++) {
+      int i = rows[k];
+      if (subtract_rhs) {
+        g[i] -= r[i];
+      }
+      gamma_new[i] = y[i] - step * g[i];
+    }
+    if (index < num_contacts) {
+      rigid_rigid->Project_Single(index, gamma_new.data());
+    }
+  }
+}
+
+void ChSolverAPGD::ObjectiveGammaNew(const DynamicVector<real>& r, const uint size) {
+  real obj = 0, dot_g = 0, norm = 0;
+#pragma omp parallel for reduction(+ : obj, dot_g, norm)
+  for (int i = 0; i < size; i++) {
+    obj += gamma_new[i] * (0.5 * N_gamma_new[i] - r[i]);
+    real diff = gamma_new[i] - y[i];
+    dot_g += g[i] * diff;
+    norm += diff * diff;
+  }
+  obj1 = obj;
+  dot_g_temp = dot_g;
+  norm_ms = norm;
+}
+
 uint ChSolverAPGD::SolveAPGD(const uint max_iter,
                              const uint size,
                              const DynamicVector<real>& r,
@@ -46,14 +97,20 @@ uint ChSolverAPGD::SolveAPGD(const uint max_iter,
   real& residual = data_manager->measures.solver.residual;
   real& objective_value = data_manager->measures.solver.objective_value;
 
-  DynamicVector<real> one(size, 1.0);
+  SOLVERMODE solver_mode = data_manager->settings.solver.solver_mode;
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_unilaterals = data_manager->num_unilaterals;
+  uint num_bilaterals = data_manager->num_bilaterals;
+
   data_manager->system_timer.start("ChSolverParallel_Solve");
-  gamma_hat.resize(size);
-  N_gamma_new.resize(size);
-  temp.resize(size);
-  g.resize(size);
-  gamma_new.resize(size);
-  y.resize(size);
+  // The work vectors only reallocate when the problem grows, their contents
+  // are overwritten before they are read
+  gamma_hat.resize(size, false);
+  N_gamma_new.resize(size, false);
+  temp.resize(size, false);
+  g.resize(size, false);
+  gamma_new.resize(size, false);
+  y.resize(size, false);
 
   residual = 10e30;
   g_diff = 1.0 / pow(size, 2.0);
@@ -71,18 +128,23 @@ uint ChSolverAPGD::SolveAPGD(const uint max_iter,
   // ShurProduct(gamma, mg);
   // mg = mg - r;
 
-  temp = gamma - one;
-  real norm_temp = sqrt((real)(temp, temp));
+  real norm_temp = 0;
+#pragma omp parallel for reduction(+ : norm_temp)
+  for (int i = 0; i < size; i++) {
+    temp[i] = gamma[i] - 1.0;
+    norm_temp += temp[i] * temp[i];
+  }
+  norm_temp = sqrt(norm_temp);
 
   // If gamma is one temp should be zero, in that case set L to one
   // We cannot divide by 0
   if (norm_temp == 0) {
     L = 1.0;
   } else {
-    // If the N matrix is zero for some reason, temp will be zero
-    ShurProduct(temp, temp);
-    // If temp is zero then L will be zero
-    L = sqrt((real)(temp, temp)) / norm_temp;
+    // If the N matrix is zero for some reason, N*temp will be zero
+    ShurProduct(temp, N_gamma_new);
+    // If N*temp is zero then L will be zero
+    L = sqrt((real)(N_gamma_new, N_gamma_new)) / norm_temp;
   }
   // When L is zero the step length can't be computed, in this case just return
   // If the N is indeed zero then solving doesn't make sense
@@ -104,59 +166,63 @@ uint ChSolverAPGD::SolveAPGD(const uint max_iter,
 
   for (current_iteration = 0; current_iteration < max_iter; current_iteration++) {
     ShurProduct(y, g);
-    g = g - r;
-    gamma_new = y - t * g;
-
-    Project(gamma_new.data());
+    // N*y is g + r once r is subtracted, so obj2 does not need its own product
+    real obj = 0;
+#pragma omp parallel for reduction(+ : obj)
+    for (int i = 0; i < size; i++) {
+      obj += y[i] * (0.5 * g[i] - r[i]);
+    }
+    obj2 = obj;
+    StepAndProject(r, true);
 
     ShurProduct(gamma_new, N_gamma_new);
-    obj1 = 0.5 * (gamma_new, N_gamma_new) - (gamma_new, r);
-
-    ShurProduct(y, temp);
-    obj2 = 0.5 * (y, temp) - (y, r);
+    ObjectiveGammaNew(r, size);
 
-    temp = gamma_new - y;
-    dot_g_temp = (g, temp);
-    norm_ms = (temp, temp);
     while (obj1 > obj2 + dot_g_temp + 0.5 * L * norm_ms) {
       L = 2.0 * L;
       t = 1.0 / L;
-      gamma_new = y - t * g;
-      Project(gamma_new.data());
+      StepAndProject(r, false);
       ShurProduct(gamma_new, N_gamma_new);
-      obj1 = 0.5 * (gamma_new, N_gamma_new) - (gamma_new, r);
-      temp = gamma_new - y;
-      dot_g_temp = (g, temp);
-      norm_ms = (temp, temp);
+      ObjectiveGammaNew(r, size);
     }
     theta_new = (-pow(theta, 2.0) + theta * sqrt(pow(theta, 2.0) + 4.0)) / 2.0;
     beta_new = theta * (1.0 - theta) / (pow(theta, 2.0) + theta_new);
 
-    temp = gamma_new - gamma;
-    y = beta_new * temp + gamma_new;
-    dot_g_temp = (g, temp);
-
-    // Compute the residual
-    temp = gamma_new - g_diff * (N_gamma_new - r);
-    real temp_dota = (real)(temp, temp);
-    // ಠ_ಠ THIS PROJECTION IS IMPORTANT! (╯°□°)╯︵ ┻━┻
-    // If turned off the residual will be very incorrect! Turning it off can cause the solver to effectively use the
-    // solution found in the first step because the residual never get's smaller. (You can convince yourself of this by
-    // looking at the objective function value and watch it decrease while the residual and the current solution remain
-    // the same.)
-    Project(temp.data());
-    temp = (1.0 / g_diff) * (gamma_new - temp);
-    real temp_dotb = (real)(temp, temp);
-    real res = sqrt(temp_dotb);
+    // Compute the residual, the projection here is required: without it the
+    // residual never gets smaller and the solver effectively keeps the
+    // solution of the first step
+    real res = 0;
+#pragma omp parallel for reduction(+ : res)
+    for (int index = 0; index < num_contacts + num_bilaterals; index++) {
+      int rows[6];
+      int count = 1;
+      if (index < num_contacts) {
+        count = Contact_Row_Indices(solver_mode, num_contacts, index, rows);
+      } else {
+        rows[0] = num_unilaterals + index - num_contacts;
+      }
+      for (int k = 0; k < count; k++) {
+        int i = rows[k];
+        temp[i] = gamma_new[i] - g_diff * (N_gamma_new[i] - r[i]);
+      }
+      if (index < num_contacts) {
+        rigid_rigid->Project_Single(index, temp.data());
+      }
+      for (int k = 0; k < count; k++) {
+        int i = rows[k];
+        real diff = (1.0 / g_diff) * (gamma_new[i] - temp[i]);
+        res += diff * diff;
+      }
+    }
+    res = sqrt(res);
 
     if (res < residual) {
       residual = res;
       gamma_hat = gamma_new;
     }
 
-    // Compute the objective value
-    temp = 0.5 * N_gamma_new - r;
-    objective_value = (gamma_new, temp);
+    // The objective value is the one of the accepted step
+    objective_value = obj1;
 
     AtIterationEnd(residual, objective_value);
 
@@ -170,6 +236,18 @@ uint ChSolverAPGD::SolveAPGD(const uint max_iter,
       }
     }
 
+    // Momentum step, gamma is not read again until the next iteration so the
+    // accepted step is copied into it in the same pass
+    real dot_g = 0;
+#pragma omp parallel for reduction(+ : dot_g)
+    for (int i = 0; i < size; i++) {
+      real diff = gamma_new[i] - gamma[i];
+      y[i] = beta_new * diff + gamma_new[i];
+      dot_g += g[i] * diff;
+      gamma[i] = gamma_new[i];
+    }
+    dot_g_temp = dot_g;
+
     if (dot_g_temp > 0) {
       y = gamma_new;
       theta_new = 1.0;
@@ -178,7 +256,6 @@ uint ChSolverAPGD::SolveAPGD(const uint max_iter,
     L = 0.9 * L;
     t = 1.0 / L;
     theta = theta_new;
-    gamma = gamma_new;
 
     if (data_manager->settings.solver.update_rhs) {
       UpdateR();
@@ -45,7 +45,15 @@ class CH_PARALLEL_API ChSolverAPGD : public ChSolverParallel {
 
   void UpdateR();
 
-  // APGD specific vectors
+  // gamma_new = y - t * g projected onto the friction cones, one contact per
+  // loop iteration. If subtract_rhs is set g holds N * y and r is subtracted
+  // from it first.
+  void StepAndProject(const DynamicVector<real>& r, bool subtract_rhs);
+  // Compute obj1, dot_g_temp and norm_ms for gamma_new in a single pass
+  void ObjectiveGammaNew(const DynamicVector<real>& r, const uint size);
+
+  // APGD specific vectors, kept between solves so they are only reallocated
+  // when the problem grows
   DynamicVector<real> obj2_temp, obj1_temp, temp, g, gamma_new, y, gamma_hat, N_gamma_new;
   real L, t;
   real g_diff;
@@ -1,8 +1,124 @@
+#include <algorithm>
+
 #include "chrono_parallel/solver/ChSolverJacobi.h"
 #include <blaze/math/SparseRow.h>
 #include <blaze/math/CompressedVector.h>
 using namespace chrono;
 
+// Invert a small dense matrix stored row major with Gauss-Jordan elimination
+// and partial pivoting, A is overwritten. Returns false if A is singular
+// relative to its largest diagonal entry.
+static bool InvertBlock(int n, real* A, real* inv) {
+  real scale_max = 0;
+  for (int i = 0; i < n; i++) {
+    scale_max = std::max(scale_max, fabs(A[i * n + i]));
+  }
+  real tolerance = scale_max * ZERO_EPSILON;
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      inv[i * n + j] = (i == j) ? 1 : 0;
+    }
+  }
+  for (int c = 0; c < n; c++) {
+    int pivot = c;
+    for (int r = c + 1; r < n; r++) {
+      if (fabs(A[r * n + c]) > fabs(A[pivot * n + c])) {
+        pivot = r;
+      }
+    }
+    if (fabs(A[pivot * n + c]) <= tolerance) {
+      return false;
+    }
+    if (pivot != c) {
+      for (int j = 0; j < n; j++) {
+        std::swap(A[c * n + j], A[pivot * n + j]);
+        std::swap(inv[c * n + j], inv[pivot * n + j]);
+      }
+    }
+    real scale = 1.0 / A[c * n + c];
+    for (int j = 0; j < n; j++) {
+      A[c * n + j] *= scale;
+      inv[c * n + j] *= scale;
+    }
+    for (int r = 0; r < n; r++) {
+      if (r == c || A[r * n + c] == 0) {
+        continue;
+      }
+      real factor = A[r * n + c];
+      for (int j = 0; j < n; j++) {
+        A[r * n + j] -= factor * A[c * n + j];
+        inv[r * n + j] -= factor * inv[c * n + j];
+      }
+    }
+  }
+  return true;
+}
+
+void ChSolverJacobi::ComputeBlockInverses() {
+  const host_container& data = data_manager->host_data;
+  SOLVERMODE mode = data_manager->settings.solver.local_solver_mode;
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_unilaterals = data_manager->num_unilaterals;
+  uint num_bilaterals = data_manager->num_bilaterals;
+  const int2* ids = data.bids_rigid_rigid.data();
+  const real* inv_mass = data.inv_mass_rigid.data();
+  const M33* inv_inertia = data.inv_inertia_rigid.data();
+  const DynamicVector<real>& E = data.E;
+
+  int block_size = num_contacts > 0 ? Contact_Rows(mode, num_contacts) / num_contacts : 0;
+  block_inv.resize(num_contacts * block_size * block_size);
+
+#pragma omp parallel for
+  for (int index = 0; index < num_contacts; index++) {
+    int rows[6];
+    real3 lin[6], angA[6], angB[6];
+    real block[36];
+    int n = Contact_Jacobian_Rows(data_manager, mode, index, rows, lin, angA, angB);
+    int2 body_id = ids[index];
+    real inv_m = inv_mass[body_id.x] + inv_mass[body_id.y];
+
+    // Block of D^T * M^-1 * D + E for the rows of this contact
+    real3 MA[6], MB[6];
+    for (int k = 0; k < n; k++) {
+      MA[k] = MatMult(inv_inertia[body_id.x], angA[k]);
+      MB[k] = MatMult(inv_inertia[body_id.y], angB[k]);
+    }
+    for (int k = 0; k < n; k++) {
+      for (int l = 0; l < n; l++) {
+        block[k * n + l] = inv_m * dot(lin[k], lin[l]) + dot(angA[k], MA[l]) + dot(angB[k], MB[l]);
+      }
+      block[k * n + k] += E[rows[k]];
+    }
+
+    real* inv = block_inv.data() + index * n * n;
+    real diag[6];
+    for (int k = 0; k < n; k++) {
+      diag[k] = block[k * n + k];
+    }
+    // A singular block, for example spinning rows between bodies that cannot
+    // rotate, falls back to the inverse of its diagonal
+    if (!InvertBlock(n, block, inv)) {
+      for (int k = 0; k < n; k++) {
+        for (int l = 0; l < n; l++) {
+          inv[k * n + l] = (k == l && diag[k] > 0) ? 1.0 / diag[k] : 0;
+        }
+      }
+    }
+  }
+
+  const CompressedMatrix<real>& D_b_T = data.D_b_T;
+  const CompressedMatrix<real>& M_invD_b = data.M_invD_b;
+  diagonal.resize(num_bilaterals, false);
+#pragma omp parallel for
+  for (int index = 0; index < num_bilaterals; index++) {
+    real d = E[num_unilaterals + index];
+    for (CompressedMatrix<real>::ConstIterator it = D_b_T.begin(index); it != D_b_T.end(index); ++it) {
+      d += it->value() * M_invD_b(it->index(), index);
+    }
+    diagonal[index] = d > 0 ? 1.0 / d : 0;
+  }
+}
+
 uint ChSolverJacobi::SolveJacobi(const uint max_iter,
                                  const uint size,
                                  DynamicVector<real>& mb,
@@ -10,51 +126,88 @@ uint ChSolverJacobi::SolveJacobi(const uint max_iter,
   real& residual = data_manager->measures.solver.residual;
   real& objective_value = data_manager->measures.solver.objective_value;
 
+  SOLVERMODE mode = data_manager->settings.solver.local_solver_mode;
   uint num_contacts = data_manager->num_rigid_contacts;
-  diagonal.resize(size, false);
-  ml_old = ml;
-  CompressedMatrix<real> Nshur_n = data_manager->host_data.D_n_T * data_manager->host_data.M_invD_n;
-  CompressedMatrix<real> Nshur_t = data_manager->host_data.D_t_T * data_manager->host_data.M_invD_t;
-
-  for (size_t i = 0; i < num_contacts; ++i) {
-    diagonal[i * 1 + 0] = Nshur_n(i, i);
-    diagonal[num_contacts + i * 2 + 0] = Nshur_t(i * 2 + 0, i * 2 + 0);
-    diagonal[num_contacts + i * 2 + 1] = Nshur_t(i * 2 + 1, i * 2 + 1);
-  }
+  uint num_unilaterals = data_manager->num_unilaterals;
+  uint num_bilaterals = data_manager->num_bilaterals;
+  real omega = data_manager->settings.solver.relaxation_factor;
+  real g_diff = 1.0 / pow(size, 2.0);
+
+  ComputeBlockInverses();
+  N_ml.resize(size, false);
+  projected.resize(size, false);
 
   Project(ml.data());
-  //
+
   for (current_iteration = 0; current_iteration < max_iter; current_iteration++) {
-    real omega = 1.0;
-#pragma omp parallel for
-    for (int i = 0; i < num_contacts; ++i) {
-      int a = i * 1 + 0;
-      int b = num_contacts + i * 2 + 0;
-      int c = num_contacts + i * 2 + 1;
-
-      real Dinv = 3.0 / (diagonal[a] + diagonal[b] + diagonal[c]);
-      real E1 = data_manager->host_data.E[a];
-      real E2 = data_manager->host_data.E[b];
-      real E3 = data_manager->host_data.E[c];
-      ml[a] = ml[a] -
-              omega * Dinv *
-                  ((row(Nshur_n, i * 1 + 0), blaze::subvector(ml_old, 0, 1 * num_contacts)) + E1 * ml_old[a] - mb[a]);
-      ml[b] = ml[b] -
-              omega * Dinv * ((row(Nshur_t, i * 2 + 0), blaze::subvector(ml_old, num_contacts, 2 * num_contacts)) +
-                              E2 * ml_old[b] - mb[b]);
-      ml[c] = ml[c] -
-              omega * Dinv * ((row(Nshur_t, i * 2 + 1), blaze::subvector(ml_old, num_contacts, 2 * num_contacts)) +
-                              E3 * ml_old[c] - mb[c]);
-
-      // Project_Single(i, ml.data());
-    }
-    Project(ml.data());
-    ml_old = ml;
-    residual = 0;  // Res4Blaze(ml, mb);
-    objective_value = 0;  // GetObjective(ml, mb);
+    ShurProduct(ml, N_ml);
+
+    // The residual and objective of the current iterate come from the same
+    // product that gives the update
+    real res = 0, obj = 0;
+#pragma omp parallel for reduction(+ : res, obj)
+    for (int index = 0; index < num_contacts; index++) {
+      int rows[6];
+      real3 lin[6], angA[6], angB[6];
+      int n = Contact_Jacobian_Rows(data_manager, mode, index, rows, lin, angA, angB);
+      for (int k = 0; k < n; k++) {
+        int i = rows[k];
+        obj += ml[i] * (0.5 * N_ml[i] - mb[i]);
+        projected[i] = ml[i] - g_diff * (N_ml[i] - mb[i]);
+      }
+      rigid_rigid->Project_Single(index, projected.data());
+      for (int k = 0; k < n; k++) {
+        real diff = (1.0 / g_diff) * (ml[rows[k]] - projected[rows[k]]);
+        res += diff * diff;
+      }
+    }
+#pragma omp parallel for reduction(+ : res, obj)
+    for (int index = 0; index < num_bilaterals; index++) {
+      int i = num_unilaterals + index;
+      obj += ml[i] * (0.5 * N_ml[i] - mb[i]);
+      res += (N_ml[i] - mb[i]) * (N_ml[i] - mb[i]);
+    }
+    residual = sqrt(res);
+    objective_value = obj;
+
     AtIterationEnd(residual, objective_value);
+
+    if (data_manager->settings.solver.test_objective) {
+      if (objective_value <= data_manager->settings.solver.tolerance_objective) {
+        break;
+      }
+    } else {
+      if (residual < data_manager->settings.solver.tol_speed) {
+        break;
+      }
+    }
+
+    // Every contact only reads N * x so the update is independent per contact
+#pragma omp parallel for
+    for (int index = 0; index < num_contacts; index++) {
+      int rows[6];
+      real3 lin[6], angA[6], angB[6];
+      real g[6];
+      int n = Contact_Jacobian_Rows(data_manager, mode, index, rows, lin, angA, angB);
+      const real* inv = block_inv.data() + index * n * n;
+      for (int k = 0; k < n; k++) {
+        g[k] = N_ml[rows[k]] - mb[rows[k]];
+      }
+      for (int k = 0; k < n; k++) {
+        real step = 0;
+        for (int l = 0; l < n; l++) {
+          step += inv[k * n + l] * g[l];
+        }
+        ml[rows[k]] -= omega * step;
+      }
+      rigid_rigid->Project_Single(index, ml.data());
+    }
+#pragma omp parallel for
+    for (int index = 0; index < num_bilaterals; index++) {
+      int i = num_unilaterals + index;
+      ml[i] -= omega * diagonal[index] * (N_ml[i] - mb[i]);
+    }
   }
 
   return current_iteration;
-  return 0;
 }
@@ -12,7 +12,10 @@
 // Authors: Hammad Mazhar
 // =============================================================================
 //
-// Implementation of the Jacobi iterative solver.
+// Implementation of a block Jacobi iterative solver. The diagonal block of the
+// Schur complement for every contact (1x1, 3x3 or 6x6 depending on the solver
+// mode) is computed from the per contact Jacobian blocks and inverted once per
+// solve, every iteration then needs a single Schur product.
 // =============================================================================
 
 #ifndef CHSOLVERJACOBI_H
@@ -37,15 +40,24 @@ class CH_PARALLEL_API ChSolverJacobi : public ChSolverParallel {
     data_manager->system_timer.stop("ChSolverParallel_Solve");
   }
 
-  // Solve using the Jacobi method
+  // Solve using the block Jacobi method
   uint SolveJacobi(const uint max_iter,            // Maximum number of iterations
                    const uint size,                // Number of unknowns
                    DynamicVector<real>& b,  // Rhs vector
                    DynamicVector<real>& x   // The vector of unknowns
                    );
 
-  custom_vector<real> r, p, Ap;
-  DynamicVector<real> diagonal, ml_old;
+  // Compute and invert the diagonal block of every contact and the diagonal
+  // of every bilateral row
+  void ComputeBlockInverses();
+
+  // Inverse of the diagonal block of every contact, stored row major with n * n
+  // entries per contact, n being the number of rows of a contact
+  host_vector<real> block_inv;
+  // Inverse of the diagonal for the bilateral rows
+  DynamicVector<real> diagonal;
+  // N * x for the current x and the projected candidate used for the residual
+  DynamicVector<real> N_ml, projected;
 };
 }
 
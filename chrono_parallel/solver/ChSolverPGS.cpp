@@ -1,46 +1,285 @@
+#include <algorithm>
+
 #include "chrono_parallel/solver/ChSolverPGS.h"
 #include <blaze/math/SparseRow.h>
 #include <blaze/math/CompressedVector.h>
 using namespace chrono;
 
+void ChSolverPGS::ColorContacts() {
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_bodies = data_manager->num_rigid_bodies;
+  const int2* ids = data_manager->host_data.bids_rigid_rigid.data();
+  const host_vector<bool>& active = data_manager->host_data.active_rigid;
+
+  contact_color.resize(num_contacts);
+
+  // Colors are assigned 64 at a time using a bit mask per body, contacts that
+  // do not fit are left for the next pass
+  host_vector<uint> pending(num_contacts), next;
+  for (uint i = 0; i < num_contacts; i++) {
+    pending[i] = i;
+  }
+  uint num_colors = 0;
+  while (pending.size() > 0) {
+    body_colors.assign(num_bodies, 0);
+    next.clear();
+    uint pass_colors = 0;
+    for (uint k = 0; k < pending.size(); k++) {
+      uint index = pending[k];
+      int2 body_id = ids[index];
+      unsigned long long used = 0;
+      if (active[body_id.x]) {
+        used |= body_colors[body_id.x];
+      }
+      if (active[body_id.y]) {
+        used |= body_colors[body_id.y];
+      }
+      if (used == ~0ULL) {
+        next.push_back(index);
+        continue;
+      }
+      uint color = 0;
+      while (used & (1ULL << color)) {
+        color++;
+      }
+      body_colors[body_id.x] |= 1ULL << color;
+      body_colors[body_id.y] |= 1ULL << color;
+      contact_color[index] = num_colors + color;
+      pass_colors = std::max(pass_colors, color + 1);
+    }
+    num_colors += pass_colors;
+    pending.swap(next);
+  }
+
+  // Counting sort of the contacts by color
+  color_start.assign(num_colors + 1, 0);
+  color_contacts.resize(num_contacts);
+  for (uint i = 0; i < num_contacts; i++) {
+    color_start[contact_color[i] + 1]++;
+  }
+  for (uint c = 0; c < num_colors; c++) {
+    color_start[c + 1] += color_start[c];
+  }
+  for (uint i = 0; i < num_contacts; i++) {
+    color_contacts[color_start[contact_color[i]]++] = i;
+  }
+  for (uint c = num_colors; c > 0; c--) {
+    color_start[c] = color_start[c - 1];
+  }
+  color_start[0] = 0;
+}
+
+void ChSolverPGS::ComputeDiagonal(const uint size) {
+  const host_container& data = data_manager->host_data;
+  SOLVERMODE mode = data_manager->settings.solver.local_solver_mode;
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_unilaterals = data_manager->num_unilaterals;
+  uint num_bilaterals = data_manager->num_bilaterals;
+  const int2* ids = data.bids_rigid_rigid.data();
+  const real* inv_mass = data.inv_mass_rigid.data();
+  const M33* inv_inertia = data.inv_inertia_rigid.data();
+  const DynamicVector<real>& E = data.E;
+
+  diagonal.resize(size, false);
+  diagonal = 0;
+
+#pragma omp parallel for
+  for (int index = 0; index < num_contacts; index++) {
+    int rows[6];
+    real3 lin[6], angA[6], angB[6];
+    int count = Contact_Jacobian_Rows(data_manager, mode, index, rows, lin, angA, angB);
+    int2 body_id = ids[index];
+    real inv_m = inv_mass[body_id.x] + inv_mass[body_id.y];
+    for (int k = 0; k < count; k++) {
+      diagonal[rows[k]] = inv_m * dot(lin[k], lin[k]) + dot(angA[k], MatMult(inv_inertia[body_id.x], angA[k])) +
+                          dot(angB[k], MatMult(inv_inertia[body_id.y], angB[k])) + E[rows[k]];
+    }
+  }
+
+  const CompressedMatrix<real>& D_b_T = data.D_b_T;
+  const CompressedMatrix<real>& M_invD_b = data.M_invD_b;
+#pragma omp parallel for
+  for (int index = 0; index < num_bilaterals; index++) {
+    int row = num_unilaterals + index;
+    real d = E[row];
+    for (CompressedMatrix<real>::ConstIterator it = D_b_T.begin(index); it != D_b_T.end(index); ++it) {
+      d += it->value() * M_invD_b(it->index(), index);
+    }
+    diagonal[row] = d;
+  }
+}
+
+void ChSolverPGS::UpdateContact(int index, const DynamicVector<real>& mb, DynamicVector<real>& ml) {
+  const host_container& data = data_manager->host_data;
+  SOLVERMODE mode = data_manager->settings.solver.local_solver_mode;
+  real omega = data_manager->settings.solver.relaxation_factor;
+  const DynamicVector<real>& E = data.E;
+
+  int rows[6];
+  real3 lin[6], angA[6], angB[6];
+  real old[6];
+  int count = Contact_Jacobian_Rows(data_manager, mode, index, rows, lin, angA, angB);
+
+  int2 body_id = data.bids_rigid_rigid[index];
+  real* vA = velocity.data() + body_id.x * 6;
+  real* vB = velocity.data() + body_id.y * 6;
+  real3 v_rel = R3(vB[0] - vA[0], vB[1] - vA[1], vB[2] - vA[2]);
+  real3 wA = R3(vA[3], vA[4], vA[5]);
+  real3 wB = R3(vB[3], vB[4], vB[5]);
+
+  for (int k = 0; k < count; k++) {
+    int i = rows[k];
+    old[k] = ml[i];
+    if (diagonal[i] > 0) {
+      real g = dot(lin[k], v_rel) + dot(angA[k], wA) + dot(angB[k], wB) + E[i] * ml[i] - mb[i];
+      ml[i] = ml[i] - omega * g / diagonal[i];
+    }
+  }
+
+  rigid_rigid->Project_Single(index, ml.data());
+
+  real3 d_lin = R3(0), d_angA = R3(0), d_angB = R3(0);
+  for (int k = 0; k < count; k++) {
+    real delta = ml[rows[k]] - old[k];
+    d_lin = d_lin + lin[k] * delta;
+    d_angA = d_angA + angA[k] * delta;
+    d_angB = d_angB + angB[k] * delta;
+  }
+
+  // Inactive bodies are shared between colors, they are never written to
+  if (data.active_rigid[body_id.x]) {
+    real3 dv = -d_lin * data.inv_mass_rigid[body_id.x];
+    real3 dw = MatMult(data.inv_inertia_rigid[body_id.x], d_angA);
+    vA[0] += dv.x, vA[1] += dv.y, vA[2] += dv.z;
+    vA[3] += dw.x, vA[4] += dw.y, vA[5] += dw.z;
+  }
+  if (data.active_rigid[body_id.y]) {
+    real3 dv = d_lin * data.inv_mass_rigid[body_id.y];
+    real3 dw = MatMult(data.inv_inertia_rigid[body_id.y], d_angB);
+    vB[0] += dv.x, vB[1] += dv.y, vB[2] += dv.z;
+    vB[3] += dw.x, vB[4] += dw.y, vB[5] += dw.z;
+  }
+}
+
+void ChSolverPGS::UpdateBilateral(int index, const DynamicVector<real>& mb, DynamicVector<real>& ml) {
+  const CompressedMatrix<real>& D_b_T = data_manager->host_data.D_b_T;
+  const CompressedMatrix<real>& M_inv = data_manager->host_data.M_inv;
+  real omega = data_manager->settings.solver.relaxation_factor;
+  int row = data_manager->num_unilaterals + index;
+
+  if (diagonal[row] <= 0) {
+    return;
+  }
+
+  real g = data_manager->host_data.E[row] * ml[row] - mb[row];
+  for (CompressedMatrix<real>::ConstIterator it = D_b_T.begin(index); it != D_b_T.end(index); ++it) {
+    g += it->value() * velocity[it->index()];
+  }
+  real delta = -omega * g / diagonal[row];
+  ml[row] += delta;
+
+  // M_inv is symmetric so its rows give the columns needed for M_inv * D_b
+  for (CompressedMatrix<real>::ConstIterator it = D_b_T.begin(index); it != D_b_T.end(index); ++it) {
+    real scale = it->value() * delta;
+    for (CompressedMatrix<real>::ConstIterator m = M_inv.begin(it->index()); m != M_inv.end(it->index()); ++m) {
+      velocity[m->index()] += m->value() * scale;
+    }
+  }
+}
+
 uint ChSolverPGS::SolvePGS(const uint max_iter,
                            const uint size,
                            DynamicVector<real>& mb,
                            DynamicVector<real>& ml) {
-  //  real& residual = data_manager->measures.solver.residual;
-  //  real& objective_value = data_manager->measures.solver.objective_value;
-  //  custom_vector<real>& iter_hist = data_manager->measures.solver.iter_hist;
-  //
-  //  real rmax = 0, flimit, aux;
-  //  diagonal.resize(size, false);
-  //
-  //  for (size_t i = 0; i < size; ++i) {
-  //    const real tmp(data_manager->host_data.Nshur(i, i));
-  //    diagonal[i] = real(1) / tmp;
-  //  }
-  //
-  //  Project(ml.data());
-  //
-  //  for (current_iteration = 0; current_iteration < max_iter; current_iteration++) {
-  //    const size_t N(size / 3);
-  //    size_t j;
-  //    real omega = 1.0;
-  //
-  //    for (size_t i = 0; i < data_manager->num_contacts; ++i) {
-  //      j = i * 3;
-  //      real Dinv = 1.0 / (diagonal[j + 0] + diagonal[j + 1] + diagonal[j + 2]);
-  //
-  //      ml[j + 0] = ml[j + 0] - omega * Dinv * ((row(data_manager->host_data.Nshur, j + 0), ml) - mb[j + 0]);
-  //      ml[j + 1] = ml[j + 1] - omega * Dinv * ((row(data_manager->host_data.Nshur, j + 1), ml) - mb[j + 1]);
-  //      ml[j + 2] = ml[j + 2] - omega * Dinv * ((row(data_manager->host_data.Nshur, j + 2), ml) - mb[j + 2]);
-  //
-  //      Project_Single(i, ml.data());
-  //    }
-  //    residual = Res4Blaze(ml, mb);
-  //    objective_value = GetObjective(ml, mb);
-  //    AtIterationEnd(residual, objective_value);
-  //  }
-  //
-  //  return current_iteration;
-  return 0;
+  real& residual = data_manager->measures.solver.residual;
+  real& objective_value = data_manager->measures.solver.objective_value;
+
+  const host_container& data = data_manager->host_data;
+  SOLVERMODE mode = data_manager->settings.solver.local_solver_mode;
+  uint num_contacts = data_manager->num_rigid_contacts;
+  uint num_unilaterals = data_manager->num_unilaterals;
+  uint num_bilaterals = data_manager->num_bilaterals;
+  const CompressedMatrix<real>& D_b_T = data.D_b_T;
+  const DynamicVector<real>& E = data.E;
+
+  ColorContacts();
+  ComputeDiagonal(size);
+  projected.resize(size, false);
+
+  Project(ml.data());
+
+  // Velocity change produced by the current impulses
+  ConstSubVectorType ml_b = blaze::subvector(ml, num_unilaterals, num_bilaterals);
+  velocity = data.M_invD_b * ml_b;
+  Contact_D_Product(data_manager, mode, ml.data(), true, velocity.data());
+
+  uint num_colors = color_start.size() - 1;
+  real g_diff = 1.0 / pow(size, 2.0);
+
+  for (current_iteration = 0; current_iteration < max_iter; current_iteration++) {
+    for (uint c = 0; c < num_colors; c++) {
+#pragma omp parallel for
+      for (int k = color_start[c]; k < color_start[c + 1]; k++) {
+        UpdateContact(color_contacts[k], mb, ml);
+      }
+    }
+    for (int index = 0; index < num_bilaterals; index++) {
+      UpdateBilateral(index, mb, ml);
+    }
+
+    // The gradient N*x - b is D^T * velocity + E*x - b, it gives the projected
+    // residual and the objective without a Schur product
+    real res = 0, obj = 0;
+#pragma omp parallel for reduction(+ : res, obj)
+    for (int index = 0; index < num_contacts; index++) {
+      int rows[6];
+      real3 lin[6], angA[6], angB[6];
+      int count = Contact_Jacobian_Rows(data_manager, mode, index, rows, lin, angA, angB);
+      int2 body_id = data.bids_rigid_rigid[index];
+      const real* vA = velocity.data() + body_id.x * 6;
+      const real* vB = velocity.data() + body_id.y * 6;
+      real3 v_rel = R3(vB[0] - vA[0], vB[1] - vA[1], vB[2] - vA[2]);
+      real3 wA = R3(vA[3], vA[4], vA[5]);
+      real3 wB = R3(vB[3], vB[4], vB[5]);
+
+      for (int k = 0; k < count; k++) {
+        int i = rows[k];
+        real g = dot(lin[k], v_rel) + dot(angA[k], wA) + dot(angB[k], wB) + E[i] * ml[i] - mb[i];
+        obj += ml[i] * (0.5 * (g + mb[i]) - mb[i]);
+        projected[i] = ml[i] - g_diff * g;
+      }
+      rigid_rigid->Project_Single(index, projected.data());
+      for (int k = 0; k < count; k++) {
+        real diff = (1.0 / g_diff) * (ml[rows[k]] - projected[rows[k]]);
+        res += diff * diff;
+      }
+    }
+    // Bilaterals are not projected, their residual is the gradient itself
+#pragma omp parallel for reduction(+ : res, obj)
+    for (int index = 0; index < num_bilaterals; index++) {
+      int row = num_unilaterals + index;
+      real g = E[row] * ml[row] - mb[row];
+      for (CompressedMatrix<real>::ConstIterator it = D_b_T.begin(index); it != D_b_T.end(index); ++it) {
+        g += it->value() * velocity[it->index()];
+      }
+      obj += ml[row] * (0.5 * (g + mb[row]) - mb[row]);
+      res += g * g;
+    }
+    residual = sqrt(res);
+    objective_value = obj;
+
+    AtIterationEnd(residual, objective_value);
+
+    if (data_manager->settings.solver.test_objective) {
+      if (objective_value <= data_manager->settings.solver.tolerance_objective) {
+        break;
+      }
+    } else {
+      if (residual < data_manager->settings.solver.tol_speed) {
+        break;
+      }
+    }
+  }
+
+  return current_iteration;
 }
@@ -12,7 +12,11 @@
 // Authors: Hammad Mazhar
 // =============================================================================
 //
-// Implementation of an iterative Conjugate Gradient solver.
+// Implementation of a parallel projected Gauss-Seidel (PGS/PSOR) solver. The
+// contacts are colored so that contacts in the same color do not share a
+// body, colors are swept one after the other and the contacts of a color are
+// updated in parallel. The body velocities are updated in place after every
+// contact update so the Schur complement is never formed.
 // =============================================================================
 
 #ifndef CHSOLVERPGS_H
@@ -37,14 +41,33 @@ class CH_PARALLEL_API ChSolverPGS : public ChSolverParallel {
     data_manager->system_timer.stop("ChSolverParallel_Solve");
   }
 
-  // Solve using an iterative projected gradient method
+  // Solve using the projected Gauss-Seidel method
   uint SolvePGS(const uint max_iter,            // Maximum number of iterations
                 const uint size,                // Number of unknowns
                 DynamicVector<real>& b,  // Rhs vector
                 DynamicVector<real>& x   // The vector of unknowns
                 );
 
+  // Greedy coloring of the contact graph, inactive bodies do not connect
+  // contacts because their velocity is never updated
+  void ColorContacts();
+  // Compute the diagonal of the Schur complement for every row
+  void ComputeDiagonal(const uint size);
+  // Update the impulses of a contact and the velocities of its bodies
+  void UpdateContact(int index, const DynamicVector<real>& b, DynamicVector<real>& x);
+  // Update a bilateral row and the velocities of the bodies it connects
+  void UpdateBilateral(int index, const DynamicVector<real>& b, DynamicVector<real>& x);
+
   DynamicVector<real> diagonal;
+  // M^-1*D*x for the current x
+  DynamicVector<real> velocity;
+  // Projected candidate used for the residual
+  DynamicVector<real> projected;
+  // The contacts sorted by color, the contacts of color c are
+  // color_contacts[color_start[c]] to color_contacts[color_start[c+1]]
+  host_vector<uint> contact_color, color_start, color_contacts;
+  // Colors used by the contacts of every body in the current coloring pass
+  host_vector<unsigned long long> body_colors;
 };
 }
 
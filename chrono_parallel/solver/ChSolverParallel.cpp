@@ -59,16 +59,32 @@ void ChSolverParallel::ShurProduct(const DynamicVector<real>& x, DynamicVector<r
   ConstSubVectorType x_n = blaze::subvector(x, 0, num_contacts);
   ConstSubVectorType E_n = blaze::subvector(E, 0, num_contacts);
 
+  SOLVERMODE local_mode = data_manager->settings.solver.local_solver_mode;
+  if (data_manager->contact_matrix_free && local_mode != BILATERAL) {
+    uint num_rows = Contact_Rows(local_mode, num_contacts);
+    shur_tmp = M_invD_b * x_b;
+    Contact_D_Product(data_manager, local_mode, x.data(), true, shur_tmp.data());
+    o_b = D_b_T * shur_tmp + E_b * x_b;
+    Contact_D_T_Product(data_manager, local_mode, shur_tmp.data(), output.data());
+#pragma omp parallel for
+    for (int i = 0; i < num_rows; i++) {
+      output[i] += E[i] * x[i];
+    }
+    data_manager->system_timer.stop("ShurProduct");
+    return;
+  }
+
   switch (data_manager->settings.solver.local_solver_mode) {
     case BILATERAL: {
-      o_b = D_b_T * (M_invD_b * x_b) + E_b * x_b;
+      shur_tmp = M_invD_b * x_b;
+      o_b = D_b_T * shur_tmp + E_b * x_b;
 
     } break;
 
     case NORMAL: {
-      DynamicVector<real> tmp = M_invD_b * x_b + M_invD_n * x_n;
-      o_b = D_b_T * tmp + E_b * x_b;
-      o_n = D_n_T * tmp + E_n * x_n;
+      shur_tmp = M_invD_b * x_b + M_invD_n * x_n;
+      o_b = D_b_T * shur_tmp + E_b * x_b;
+      o_n = D_n_T * shur_tmp + E_n * x_n;
 
     } break;
 
@@ -77,10 +93,10 @@ void ChSolverParallel::ShurProduct(const DynamicVector<real>& x, DynamicVector<r
       ConstSubVectorType x_t = blaze::subvector(x, num_contacts, num_contacts * 2);
       ConstSubVectorType E_t = blaze::subvector(E, num_contacts, num_contacts * 2);
 
-      DynamicVector<real> tmp = M_invD_b * x_b + M_invD_n * x_n + M_invD_t * x_t;
-      o_b = D_b_T * tmp + E_b * x_b;
-      o_n = D_n_T * tmp + E_n * x_n;
-      o_t = D_t_T * tmp + E_t * x_t;
+      shur_tmp = M_invD_b * x_b + M_invD_n * x_n + M_invD_t * x_t;
+      o_b = D_b_T * shur_tmp + E_b * x_b;
+      o_n = D_n_T * shur_tmp + E_n * x_n;
+      o_t = D_t_T * shur_tmp + E_t * x_t;
 
     } break;
 
@@ -93,11 +109,11 @@ void ChSolverParallel::ShurProduct(const DynamicVector<real>& x, DynamicVector<r
       ConstSubVectorType x_s = blaze::subvector(x, num_contacts * 3, num_contacts * 3);
       ConstSubVectorType E_s = blaze::subvector(E, num_contacts * 3, num_contacts * 3);
 
-      DynamicVector<real> tmp = M_invD_b * x_b + M_invD_n * x_n + M_invD_t * x_t + M_invD_s * x_s;
-      o_b = D_b_T * tmp + E_b * x_b;
-      o_n = D_n_T * tmp + E_n * x_n;
-      o_t = D_t_T * tmp + E_t * x_t;
-      o_s = D_s_T * tmp + E_s * x_s;
+      shur_tmp = M_invD_b * x_b + M_invD_n * x_n + M_invD_t * x_t + M_invD_s * x_s;
+      o_b = D_b_T * shur_tmp + E_b * x_b;
+      o_n = D_n_T * shur_tmp + E_n * x_n;
+      o_t = D_t_T * shur_tmp + E_t * x_t;
+      o_s = D_s_T * shur_tmp + E_s * x_s;
 
     } break;
   }
@@ -109,7 +125,8 @@ void ChSolverParallel::ShurBilaterals(const DynamicVector<real>& x, DynamicVecto
   const CompressedMatrix<real>& D_b_T = data_manager->host_data.D_b_T;
   const CompressedMatrix<real>& M_invD_b = data_manager->host_data.M_invD_b;
 
-  output = D_b_T * (M_invD_b * x);
+  shur_tmp = M_invD_b * x;
+  output = D_b_T * shur_tmp;
 }
 
 //=================================================================================================================================
@@ -115,6 +115,9 @@ class CH_PARALLEL_API ChSolverParallel {
   ChConstraintRigidRigid* rigid_rigid;
   ChConstraintBilateral* bilateral;
 
+  // Holds M^-1*D*x in ShurProduct, kept so that the product does not allocate
+  DynamicVector<real> shur_tmp;
+
   // Pointer to the system's data manager
   ChParallelDataManager* data_manager;
 };
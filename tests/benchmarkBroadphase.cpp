@@ -0,0 +1,215 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Authors: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel benchmark comparing the broadphase algorithms.
+//
+// Two scenes are simulated with every algorithm:
+// - balls: spheres falling in a tilted container (as in ballsDVI)
+// - chute: spheres sliding down a long inclined chute, the domain is much
+//   longer along one axis than along the other two
+//
+// The time spent in the broadphase and the number of contacts are reported.
+// The global reference frame has Z up.
+// =============================================================================
+
+#include <stdio.h>
+#include <vector>
+#include <cmath>
+
+#include "chrono_parallel/physics/ChSystemParallel.h"
+
+#include "chrono_utils/ChUtilsCreators.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+double gravity = 9.81;
+double time_step = 1e-3;
+int num_steps = 500;
+
+// -----------------------------------------------------------------------------
+// Balls scene: a tilted container with a block of falling balls.
+// -----------------------------------------------------------------------------
+void AddBallsScene(ChSystemParallelDVI* sys) {
+  ChSharedPtr<ChMaterialSurface> mat(new ChMaterialSurface);
+  mat->SetFriction(0.4f);
+
+  ChSharedBodyPtr bin(new ChBody(new ChCollisionModelParallel));
+  bin->SetMaterialSurface(mat);
+  bin->SetIdentifier(-200);
+  bin->SetMass(1);
+  bin->SetPos(ChVector<>(0, 0, 0));
+  bin->SetRot(Q_from_AngY(CH_C_PI / 20));
+  bin->SetCollide(true);
+  bin->SetBodyFixed(true);
+
+  ChVector<> hdim(2, 2, 0.5);
+  double hthick = 0.1;
+
+  bin->GetCollisionModel()->ClearModel();
+  utils::AddBoxGeometry(bin.get_ptr(), ChVector<>(hdim.x, hdim.y, hthick), ChVector<>(0, 0, -hthick));
+  utils::AddBoxGeometry(bin.get_ptr(), ChVector<>(hthick, hdim.y, hdim.z), ChVector<>(-hdim.x - hthick, 0, hdim.z));
+  utils::AddBoxGeometry(bin.get_ptr(), ChVector<>(hthick, hdim.y, hdim.z), ChVector<>(hdim.x + hthick, 0, hdim.z));
+  utils::AddBoxGeometry(bin.get_ptr(), ChVector<>(hdim.x, hthick, hdim.z), ChVector<>(0, -hdim.y - hthick, hdim.z));
+  utils::AddBoxGeometry(bin.get_ptr(), ChVector<>(hdim.x, hthick, hdim.z), ChVector<>(0, hdim.y + hthick, hdim.z));
+  bin->GetCollisionModel()->BuildModel();
+
+  sys->AddBody(bin);
+
+  double mass = 1;
+  double radius = 0.05;
+  ChVector<> inertia = (2.0 / 5.0) * mass * radius * radius * ChVector<>(1, 1, 1);
+  int ballId = 0;
+
+  for (int ix = -15; ix <= 15; ix++) {
+    for (int iy = -15; iy <= 15; iy++) {
+      for (int iz = 0; iz < 8; iz++) {
+        ChVector<> pos(0.11 * ix, 0.11 * iy, 0.5 + 0.11 * iz);
+
+        ChSharedBodyPtr ball(new ChBody(new ChCollisionModelParallel));
+        ball->SetMaterialSurface(mat);
+        ball->SetIdentifier(ballId++);
+        ball->SetMass(mass);
+        ball->SetInertiaXX(inertia);
+        ball->SetPos(pos);
+        ball->SetBodyFixed(false);
+        ball->SetCollide(true);
+
+        ball->GetCollisionModel()->ClearModel();
+        utils::AddSphereGeometry(ball.get_ptr(), radius);
+        ball->GetCollisionModel()->BuildModel();
+
+        sys->AddBody(ball);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Chute scene: a long narrow inclined chute with balls released at the top.
+// -----------------------------------------------------------------------------
+void AddChuteScene(ChSystemParallelDVI* sys) {
+  ChSharedPtr<ChMaterialSurface> mat(new ChMaterialSurface);
+  mat->SetFriction(0.2f);
+
+  ChSharedBodyPtr chute(new ChBody(new ChCollisionModelParallel));
+  chute->SetMaterialSurface(mat);
+  chute->SetIdentifier(-200);
+  chute->SetMass(1);
+  chute->SetPos(ChVector<>(0, 0, 0));
+  chute->SetRot(Q_from_AngY(CH_C_PI / 12));
+  chute->SetCollide(true);
+  chute->SetBodyFixed(true);
+
+  ChVector<> hdim(20, 0.5, 0.3);
+  double hthick = 0.1;
+
+  chute->GetCollisionModel()->ClearModel();
+  utils::AddBoxGeometry(chute.get_ptr(), ChVector<>(hdim.x, hdim.y, hthick), ChVector<>(0, 0, -hthick));
+  utils::AddBoxGeometry(chute.get_ptr(), ChVector<>(hdim.x, hthick, hdim.z), ChVector<>(0, -hdim.y - hthick, hdim.z));
+  utils::AddBoxGeometry(chute.get_ptr(), ChVector<>(hdim.x, hthick, hdim.z), ChVector<>(0, hdim.y + hthick, hdim.z));
+  utils::AddBoxGeometry(chute.get_ptr(), ChVector<>(hthick, hdim.y, hdim.z), ChVector<>(hdim.x + hthick, 0, hdim.z));
+  chute->GetCollisionModel()->BuildModel();
+
+  sys->AddBody(chute);
+
+  double mass = 1;
+  double radius = 0.05;
+  ChVector<> inertia = (2.0 / 5.0) * mass * radius * radius * ChVector<>(1, 1, 1);
+  int ballId = 0;
+
+  // Balls are placed in the chute frame so that they start on the incline
+  ChQuaternion<> rot = Q_from_AngY(CH_C_PI / 12);
+  for (int ix = 0; ix < 300; ix++) {
+    for (int iy = -3; iy <= 3; iy++) {
+      for (int iz = 0; iz < 3; iz++) {
+        ChVector<> pos(-hdim.x + 0.2 + 0.11 * ix, 0.11 * iy, radius + 0.01 + 0.11 * iz);
+
+        ChSharedBodyPtr ball(new ChBody(new ChCollisionModelParallel));
+        ball->SetMaterialSurface(mat);
+        ball->SetIdentifier(ballId++);
+        ball->SetMass(mass);
+        ball->SetInertiaXX(inertia);
+        ball->SetPos(rot.Rotate(pos));
+        ball->SetBodyFixed(false);
+        ball->SetCollide(true);
+
+        ball->GetCollisionModel()->ClearModel();
+        utils::AddSphereGeometry(ball.get_ptr(), radius);
+        ball->GetCollisionModel()->BuildModel();
+
+        sys->AddBody(ball);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Simulate a scene with the given broadphase and report the timings.
+// -----------------------------------------------------------------------------
+void RunBenchmark(const char* name, bool chute, BROADPHASETYPE broadphase, int threads) {
+  ChSystemParallelDVI msystem;
+  msystem.SetParallelThreadNumber(threads);
+  msystem.Set_G_acc(ChVector<>(0, 0, -gravity));
+
+  msystem.GetSettings()->solver.solver_mode = SLIDING;
+  msystem.GetSettings()->solver.max_iteration_normal = 0;
+  msystem.GetSettings()->solver.max_iteration_sliding = 30;
+  msystem.GetSettings()->solver.max_iteration_spinning = 0;
+  msystem.GetSettings()->solver.tolerance = 1e-3;
+  msystem.GetSettings()->solver.contact_recovery_speed = 10000;
+  msystem.ChangeSolverType(APGD);
+  msystem.GetSettings()->collision.narrowphase_algorithm = NARROWPHASE_HYBRID_MPR;
+  msystem.GetSettings()->collision.collision_envelope = 0.005;
+  msystem.GetSettings()->collision.bins_per_axis = I3(20, 20, 20);
+  msystem.GetSettings()->collision.broadphase_type = broadphase;
+  msystem.GetSettings()->perform_thread_tuning = false;
+
+  if (chute) {
+    AddChuteScene(&msystem);
+  } else {
+    AddBallsScene(&msystem);
+  }
+
+  double time_broad = 0;
+  double time_total = 0;
+  for (int i = 0; i < num_steps; i++) {
+    msystem.DoStepDynamics(time_step);
+    time_broad += msystem.GetTimerCollisionBroad();
+    time_total += msystem.GetTimerStep();
+  }
+
+  printf("%-8s %-14s bodies: %6d contacts: %8d broadphase: %10.4f s step: %10.4f s\n", chute ? "chute" : "balls",
+         name, msystem.data_manager->num_rigid_bodies, msystem.data_manager->num_rigid_contacts, time_broad,
+         time_total);
+}
+
+int main(int argc, char* argv[]) {
+  int threads = 8;
+  if (argc > 1) {
+    threads = atoi(argv[1]);
+  }
+  int max_threads = omp_get_num_procs();
+  if (threads > max_threads)
+    threads = max_threads;
+  omp_set_num_threads(threads);
+
+  for (int scene = 0; scene < 2; scene++) {
+    RunBenchmark("grid", scene == 1, BROADPHASE_GRID, threads);
+    RunBenchmark("hierarchical", scene == 1, BROADPHASE_HIERARCHICAL, threads);
+    RunBenchmark("sap", scene == 1, BROADPHASE_SAP, threads);
+  }
+
+  return 0;
+}
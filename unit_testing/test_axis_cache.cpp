@@ -0,0 +1,92 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for the cache of separating axes used by MPR. A pair
+// is only rejected using its cached axis if the shapes are separated along it,
+// so the contacts found by a system that uses the cache must be the same as the
+// ones of a system that runs MPR from scratch for every pair.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_end = 0.2;
+
+// Mix spheres and boxes, all pairs are processed by MPR
+void AddShapes(ChBody* body, int ix, int iy, int iz) {
+  if ((ix + iy + iz) % 3 == 0) {
+    utils::AddBoxGeometry(body, ChVector<>(pile_radius, pile_radius, pile_radius) * 0.8);
+  } else {
+    utils::AddSphereGeometry(body, pile_radius);
+  }
+}
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->collision.narrowphase_algorithm = NARROWPHASE_MPR;
+
+  CreateContainer(system);
+  CreateGranularMaterial(system, 4, 4, 0.21, 0.1, AddShapes, true);
+  return system;
+}
+
+void CompareContacts(ChSystemParallel* msystem_A, ChSystemParallel* msystem_B) {
+  host_container& data_A = msystem_A->data_manager->host_data;
+  host_container& data_B = msystem_B->data_manager->host_data;
+  int num_contacts = msystem_A->data_manager->num_rigid_contacts;
+
+  // The pairs that are not rejected by their axis run the same MPR code
+  StrictEqual(num_contacts, (int)msystem_B->data_manager->num_rigid_contacts);
+  for (int i = 0; i < num_contacts; i++) {
+    StrictEqual(data_A.bids_rigid_rigid[i].x, data_B.bids_rigid_rigid[i].x);
+    StrictEqual(data_A.bids_rigid_rigid[i].y, data_B.bids_rigid_rigid[i].y);
+    StrictEqual(data_A.norm_rigid_rigid[i], data_B.norm_rigid_rigid[i]);
+    StrictEqual(data_A.dpth_rigid_rigid[i], data_B.dpth_rigid_rigid[i]);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  ChSystemParallelDVI* msystem_ref = CreateSystem();
+  ChSystemParallelDVI* msystem = CreateSystem();
+  msystem->GetSettings()->collision.use_axis_cache = true;
+
+  double time = 0;
+  while (time < time_end) {
+    Sync(msystem_ref, msystem);
+    msystem_ref->DoStepDynamics(time_step);
+    msystem->DoStepDynamics(time_step);
+    CompareContacts(msystem_ref, msystem);
+    time += time_step;
+  }
+  cout << "Number of contacts: " << msystem_ref->data_manager->num_rigid_contacts << endl;
+
+  delete msystem_ref;
+  delete msystem;
+  return 0;
+}
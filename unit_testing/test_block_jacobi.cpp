@@ -0,0 +1,111 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for the block Jacobi solver. A pile of spheres
+// falls into a container, after every step the inverse of the diagonal block
+// of every contact kept by the solver is multiplied with the same block taken
+// from the assembled Schur complement, the result must be the identity.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "chrono_parallel/solver/ChSolverJacobi.h"
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_end = 0.1;
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->solver.tol_speed = 1e-3;
+  system->GetSettings()->solver.max_iteration_sliding = 50;
+  system->GetSettings()->solver.relaxation_factor = 0.3;
+  system->ChangeSolverType(JACOBI);
+
+  CreateContainer(system);
+  CreateGranularMaterial(system, 2, 4, 0.2, 0.1);
+  return system;
+}
+
+void CheckBlocks(ChSystemParallelDVI* msystem) {
+  ChSolverJacobi* solver = (ChSolverJacobi*)((ChLcpSolverParallelDVI*)msystem->GetLcpSolverSpeed())->solver;
+  host_container& data = msystem->data_manager->host_data;
+  int num_contacts = msystem->data_manager->num_rigid_contacts;
+  if (num_contacts == 0) {
+    return;
+  }
+  // Normal and sliding rows, a 3 x 3 block per contact
+  StrictEqual(int(solver->block_inv.size()), 9 * num_contacts);
+
+  CompressedMatrix<real> Nshur_n = data.D_n_T * data.M_invD_n;
+  CompressedMatrix<real> Nshur_t = data.D_t_T * data.M_invD_t;
+  CompressedMatrix<real> Nshur_nt = data.D_n_T * data.M_invD_t;
+
+  for (int i = 0; i < num_contacts; i++) {
+    // Block of the normal and the two sliding rows of the contact
+    int rows[3] = {i, num_contacts + i * 2 + 0, num_contacts + i * 2 + 1};
+    real block[9];
+    block[0] = Nshur_n(i, i);
+    for (int k = 0; k < 2; k++) {
+      block[k + 1] = Nshur_nt(i, i * 2 + k);
+      block[(k + 1) * 3] = Nshur_nt(i, i * 2 + k);
+      for (int l = 0; l < 2; l++) {
+        block[(k + 1) * 3 + l + 1] = Nshur_t(i * 2 + k, i * 2 + l);
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      block[k * 3 + k] += data.E[rows[k]];
+    }
+
+    const real* inv = solver->block_inv.data() + i * 9;
+    for (int k = 0; k < 3; k++) {
+      for (int l = 0; l < 3; l++) {
+        real value = 0;
+        for (int m = 0; m < 3; m++) {
+          value += block[k * 3 + m] * inv[m * 3 + l];
+        }
+        WeakEqual(value, real(k == l), real(1e-3));
+      }
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  ChSystemParallelDVI* msystem = CreateSystem();
+
+  double time = 0;
+  while (time < time_end) {
+    msystem->DoStepDynamics(time_step);
+    CheckBlocks(msystem);
+    time += time_step;
+  }
+  cout << "Number of contacts: " << msystem->data_manager->num_rigid_contacts << endl;
+
+  delete msystem;
+  return 0;
+}
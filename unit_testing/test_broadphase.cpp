@@ -0,0 +1,174 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test to compare the contacts found using different
+// broadphase algorithms and settings. The uniform grid is used as the reference.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_end = 0.5;
+
+// Mix small and large particles
+void AddShapes(ChBody* body, int ix, int iy, int iz) {
+  utils::AddSphereGeometry(body, (ix + iy) % 3 == 0 ? pile_radius : pile_radius / 2);
+}
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->collision.narrowphase_algorithm = NARROWPHASE_R;
+
+  CreateContainer(system, true);
+  CreateGranularMaterial(system, 4, 6, 0.21, 0.2, AddShapes, true);
+  return system;
+}
+
+// Both systems must report the same contacts in the same order
+void CompareContacts(ChSystemParallel* msystem_A, ChSystemParallel* msystem_B) {
+  int num_contacts_A = msystem_A->data_manager->num_rigid_contacts;
+  int num_contacts_B = msystem_B->data_manager->num_rigid_contacts;
+  StrictEqual(num_contacts_A, num_contacts_B);
+  for (int i = 0; i < num_contacts_A; i++) {
+    int2 id_A = msystem_A->data_manager->host_data.bids_rigid_rigid[i];
+    int2 id_B = msystem_B->data_manager->host_data.bids_rigid_rigid[i];
+    StrictEqual(id_A.x, id_B.x);
+    StrictEqual(id_A.y, id_B.y);
+  }
+}
+
+void RunComparison(ChSystemParallelDVI* msystem_ref, ChSystemParallelDVI* msystem) {
+  double time = 0;
+  while (time < time_end) {
+    Sync(msystem_ref, msystem);
+    msystem_ref->DoStepDynamics(time_step);
+    msystem->DoStepDynamics(time_step);
+    CompareContacts(msystem_ref, msystem);
+    time += time_step;
+  }
+  cout << "Number of contacts: " << msystem_ref->data_manager->num_rigid_contacts << endl;
+}
+
+// Returns true if the system reports a contact between the two bodies
+bool HasContact(ChSystemParallel* msystem, int body_A, int body_B) {
+  for (int i = 0; i < msystem->data_manager->num_rigid_contacts; i++) {
+    int2 id = msystem->data_manager->host_data.bids_rigid_rigid[i];
+    if ((id.x == body_A && id.y == body_B) || (id.x == body_B && id.y == body_A)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Move the last body onto another one, much farther than half of the collision
+// skin. The pairs kept by the collision skin do not contain the new contact,
+// it is only found if the broadphase runs again.
+void RunSkinRebuild(ChSystemParallelDVI* msystem_ref, ChSystemParallelDVI* msystem) {
+  std::vector<ChBody*>& bodies = *msystem_ref->Get_bodylist();
+  ChBody* moved = bodies.back();
+  ChBody* target = bodies[1];
+  moved->SetPos(target->GetPos() + ChVector<>(0, 0, 0.01));
+  moved->SetPos_dt(ChVector<>(0, 0, 0));
+  moved->SetWvel_par(ChVector<>(0, 0, 0));
+
+  Sync(msystem_ref, msystem);
+  msystem_ref->DoStepDynamics(time_step);
+  msystem->DoStepDynamics(time_step);
+  CompareContacts(msystem_ref, msystem);
+  if (!HasContact(msystem, moved->GetId(), target->GetId())) {
+    cout << "Contact of the moved body not found" << endl;
+    exit(1);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  cout << "Hierarchical Grid" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem->GetSettings()->collision.broadphase_type = BROADPHASE_HIERARCHICAL;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  cout << "Sweep and Prune" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem->GetSettings()->collision.broadphase_type = BROADPHASE_SAP;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  cout << "Radix Sort and Morton Bins" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem->GetSettings()->collision.use_radix_sort = true;
+    msystem->GetSettings()->collision.use_morton_bins = true;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  cout << "Incremental Grid" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem->GetSettings()->collision.use_incremental_broadphase = true;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  cout << "Collision Skin" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem->GetSettings()->collision.collision_skin = 0.05;
+    RunComparison(msystem_ref, msystem);
+    RunSkinRebuild(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  cout << "Static BVH" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem->GetSettings()->collision.use_static_bvh = true;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  return 0;
+}
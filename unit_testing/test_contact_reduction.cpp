@@ -0,0 +1,143 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for contact reduction. A compound body made of a
+// grid of spheres rests on a fixed box, every sphere touches the box with the
+// same normal. Without reduction every sphere has a contact, with reduction
+// the body keeps four contacts, including the deepest one.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "chrono_parallel/physics/ChSystemParallel.h"
+#include "chrono_parallel/lcp/ChLcpSystemDescriptorParallel.h"
+
+#include "unit_testing.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double radius = 0.1;
+double penetration = 0.01;
+double deepest = 0.02;
+int num_spheres = 5;
+
+void CreateFloor(ChSystemParallel* system) {
+  ChSharedPtr<ChMaterialSurface> mat_floor(new ChMaterialSurface);
+  mat_floor->SetFriction(0.3f);
+
+  ChSharedPtr<ChBody> floor(new ChBody(new ChCollisionModelParallel));
+  floor->SetMaterialSurface(mat_floor);
+  floor->SetIdentifier(-1);
+  floor->SetPos(ChVector<>(0, 0, -0.1));
+  floor->SetBodyFixed(true);
+  floor->SetCollide(true);
+  floor->SetMass(10000.0);
+
+  floor->GetCollisionModel()->ClearModel();
+  floor->GetCollisionModel()->AddBox(2, 2, 0.1);
+  floor->GetCollisionModel()->BuildModel();
+
+  system->AddBody(floor);
+}
+
+void CreateCompound(ChSystemParallel* system) {
+  ChSharedPtr<ChMaterialSurface> mat(new ChMaterialSurface);
+  mat->SetFriction(1.0);
+
+  ChSharedBodyPtr body(new ChBody(new ChCollisionModelParallel));
+  body->SetMaterialSurface(mat);
+  body->SetIdentifier(1);
+  body->SetMass(1);
+  body->SetInertiaXX(ChVector<>(0.1, 0.1, 0.1));
+  body->SetPos(ChVector<>(0, 0, radius - penetration));
+  body->SetBodyFixed(false);
+  body->SetCollide(true);
+
+  // The sphere in the middle of the grid is the deepest one
+  body->GetCollisionModel()->ClearModel();
+  for (int ix = 0; ix < num_spheres; ix++) {
+    for (int iy = 0; iy < num_spheres; iy++) {
+      double z = (2 * ix == num_spheres - 1 && 2 * iy == num_spheres - 1) ? penetration - deepest : 0;
+      body->GetCollisionModel()->AddSphere(radius, ChVector<>(ix * 2 * radius, iy * 2 * radius, z));
+    }
+  }
+  body->GetCollisionModel()->BuildModel();
+
+  system->AddBody(body);
+}
+
+ChSystemParallelDVI* CreateSystem(bool reduction) {
+  ChSystemParallelDVI* system = new ChSystemParallelDVI();
+  system->Set_G_acc(ChVector<>(0, 0, -9.81));
+  system->GetSettings()->solver.tolerance = 1e-2;
+  system->GetSettings()->solver.solver_mode = SLIDING;
+  system->GetSettings()->solver.max_iteration_normal = 0;
+  system->GetSettings()->solver.max_iteration_sliding = 25;
+  system->GetSettings()->solver.max_iteration_spinning = 0;
+  system->ChangeSolverType(APGD);
+  system->GetSettings()->collision.collision_envelope = 0.01;
+  system->GetSettings()->collision.bins_per_axis = I3(10, 10, 10);
+  system->GetSettings()->collision.narrowphase_algorithm = NARROWPHASE_HYBRID_MPR;
+  system->GetSettings()->collision.use_contact_reduction = reduction;
+  system->GetSettings()->max_threads = 1;
+  system->GetSettings()->perform_thread_tuning = false;
+
+  CreateFloor(system);
+  CreateCompound(system);
+  return system;
+}
+
+void CheckContacts(ChSystemParallel* msystem, int expected) {
+  host_container& data = msystem->data_manager->host_data;
+  int num_contacts = msystem->data_manager->num_rigid_contacts;
+  StrictEqual(num_contacts, expected);
+
+  // The deepest contact is always kept
+  real min_depth = 0;
+  for (int i = 0; i < num_contacts; i++) {
+    WeakEqual(std::abs(data.norm_rigid_rigid[i].z), real(1), real(1e-4));
+    min_depth = std::min(min_depth, data.dpth_rigid_rigid[i]);
+  }
+  WeakEqual(min_depth, real(-deepest), real(1e-4));
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  {
+    ChSystemParallelDVI* msystem = CreateSystem(false);
+    msystem->DoStepDynamics(time_step);
+    CheckContacts(msystem, num_spheres * num_spheres);
+    cout << "Number of contacts: " << msystem->data_manager->num_rigid_contacts << endl;
+    delete msystem;
+  }
+  {
+    ChSystemParallelDVI* msystem = CreateSystem(true);
+    msystem->DoStepDynamics(time_step);
+    CheckContacts(msystem, 4);
+    cout << "Number of reduced contacts: " << msystem->data_manager->num_rigid_contacts << endl;
+    delete msystem;
+  }
+
+  return 0;
+}
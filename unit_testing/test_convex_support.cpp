@@ -0,0 +1,146 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for the support function of convex hulls. The hull
+// adjacency is built by AddConvexHull and the support point is found by hill
+// climbing from the previous query, it must give the same projection as a
+// linear scan over all the points, including points inside the hull and flat
+// point sets.
+//
+// =============================================================================
+
+#include <cstdlib>
+
+#include "chrono_parallel/physics/ChSystemParallel.h"
+#include "chrono_parallel/collision/ChCNarrowphaseUtils.h"
+
+#include "unit_testing.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+double rnd() {
+  return rand() % 10000 / 5000.0 - 1.0;
+}
+
+void test_hull(std::vector<ChVector<> >& points) {
+  ChSharedPtr<ChBody> body(new ChBody(new ChCollisionModelParallel));
+  ChCollisionModelParallel* model = (ChCollisionModelParallel*)body->GetCollisionModel();
+  model->ClearModel();
+  model->AddConvexHull(points);
+  model->BuildModel();
+
+  ConvexShape shape = model->mData[0];
+  shape.convex = model->local_convex_data.data();
+  shape.adjacency = model->local_convex_adjacency.data();
+  shape.neighbors = model->local_convex_neighbors.data();
+  shape.hint = 0;
+
+  StrictEqual((int)model->local_convex_data.size(), (int)points.size());
+
+  for (int q = 0; q < 1000; q++) {
+    real3 n = R3(rnd(), rnd(), rnd());
+    real3 climb = GetSupportPoint_Convex(shape, n);
+    real3 scan = GetSupportPoint_Convex(shape.B, shape.convex, n);
+    WeakEqual(dot(climb, n), dot(scan, n), real(1e-5));
+  }
+}
+
+// Rebuild a model with a smaller hull, the hull data of the first build must
+// be dropped by ClearModel
+void test_rebuild() {
+  ChSharedPtr<ChBody> body(new ChBody(new ChCollisionModelParallel));
+  ChCollisionModelParallel* model = (ChCollisionModelParallel*)body->GetCollisionModel();
+
+  std::vector<ChVector<> > sphere;
+  for (int i = 0; i < 100; i++) {
+    ChVector<> p(rnd(), rnd(), rnd());
+    p.Normalize();
+    sphere.push_back(p);
+  }
+  model->ClearModel();
+  model->AddConvexHull(sphere);
+  model->BuildModel();
+
+  std::vector<ChVector<> > box;
+  for (int i = 0; i < 8; i++) {
+    box.push_back(ChVector<>((i & 1) ? 1 : -1, (i & 2) ? 2 : -2, (i & 4) ? 3 : -3));
+  }
+  model->ClearModel();
+  model->AddConvexHull(box);
+  model->BuildModel();
+
+  StrictEqual((int)model->local_convex_data.size(), (int)box.size());
+
+  ConvexShape shape = model->mData[0];
+  shape.convex = model->local_convex_data.data();
+  shape.adjacency = model->local_convex_adjacency.data();
+  shape.neighbors = model->local_convex_neighbors.data();
+  shape.hint = 0;
+
+  for (int q = 0; q < 100; q++) {
+    real3 n = R3(rnd(), rnd(), rnd());
+    real3 corner = R3(n.x > 0 ? 1 : -1, n.y > 0 ? 2 : -2, n.z > 0 ? 3 : -3);
+    real3 climb = GetSupportPoint_Convex(shape, n);
+    WeakEqual(dot(climb, n), dot(corner, n), real(1e-5));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  srand(1);
+
+  // Points on a sphere and inside of it
+  {
+    cout << "sphere" << endl;
+    std::vector<ChVector<> > points;
+    for (int i = 0; i < 300; i++) {
+      ChVector<> p(rnd(), rnd(), rnd());
+      if (i % 3) {
+        p.Normalize();
+      } else {
+        p = p * 0.5;
+      }
+      points.push_back(p);
+    }
+    test_hull(points);
+  }
+
+  // Corners of a box, the faces have coplanar vertices
+  {
+    cout << "box" << endl;
+    std::vector<ChVector<> > points;
+    for (int i = 0; i < 8; i++) {
+      points.push_back(ChVector<>((i & 1) ? 1 : -1, (i & 2) ? 2 : -2, (i & 4) ? 3 : -3));
+    }
+    test_hull(points);
+  }
+
+  // Flat set of points, every point is a neighbor of every other one
+  {
+    cout << "flat" << endl;
+    std::vector<ChVector<> > points;
+    for (int i = 0; i < 50; i++) {
+      points.push_back(ChVector<>(rnd(), rnd(), 0));
+    }
+    test_hull(points);
+  }
+
+  cout << "rebuild" << endl;
+  test_rebuild();
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for the matrix-free contact products. A pile of
+// spheres settles in a container, then a system that assembles the contact
+// Jacobian and a system that uses the per contact Jacobian blocks are stepped
+// from the same state. Both must give the same impulses, velocities and
+// contact forces.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_settle = 0.3;
+double time_end = 0.32;
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->solver.tol_speed = 1e-3;
+  system->GetSettings()->solver.max_iteration_sliding = 100;
+
+  CreateContainer(system);
+  CreateGranularMaterial(system, 2, 4, 0.2, 0.1);
+  return system;
+}
+
+void Compare(ChSystemParallelDVI* msystem_A, ChSystemParallelDVI* msystem_B) {
+  ChParallelDataManager* data_A = msystem_A->data_manager;
+  ChParallelDataManager* data_B = msystem_B->data_manager;
+
+  StrictEqual((int)data_A->contact_matrix_free, 0);
+  StrictEqual((int)data_B->contact_matrix_free, 1);
+  StrictEqual((int)data_A->num_rigid_contacts, (int)data_B->num_rigid_contacts);
+  StrictEqual((int)data_A->host_data.gamma.size(), (int)data_B->host_data.gamma.size());
+
+  for (int i = 0; i < data_A->host_data.gamma.size(); i++) {
+    WeakEqual(data_A->host_data.gamma[i], data_B->host_data.gamma[i], real(1e-4));
+  }
+  for (int i = 0; i < data_A->host_data.v.size(); i++) {
+    WeakEqual(data_A->host_data.v[i], data_B->host_data.v[i], real(1e-4));
+  }
+
+  msystem_A->CalculateContactForces();
+  msystem_B->CalculateContactForces();
+  for (int i = 0; i < data_A->num_rigid_bodies; i++) {
+    WeakEqual(msystem_A->GetBodyContactForce(i), msystem_B->GetBodyContactForce(i), real(1e-2));
+    WeakEqual(msystem_A->GetBodyContactTorque(i), msystem_B->GetBodyContactTorque(i), real(1e-2));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  ChSystemParallelDVI* msystem_ref = CreateSystem();
+  ChSystemParallelDVI* msystem = CreateSystem();
+  msystem->GetSettings()->solver.use_matrix_free = true;
+
+  double time = 0;
+  while (time < time_settle) {
+    msystem_ref->DoStepDynamics(time_step);
+    time += time_step;
+  }
+
+  while (time < time_end) {
+    Sync(msystem_ref, msystem);
+    msystem_ref->DoStepDynamics(time_step);
+    msystem->DoStepDynamics(time_step);
+    Compare(msystem_ref, msystem);
+    time += time_step;
+  }
+  cout << "Number of contacts: " << msystem->data_manager->num_rigid_contacts << endl;
+
+  delete msystem_ref;
+  delete msystem;
+  return 0;
+}
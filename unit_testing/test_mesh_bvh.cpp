@@ -0,0 +1,172 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for triangle meshes stored as a single shape with a
+// bounding volume hierarchy. Spheres rest on a fixed mesh floor with a known
+// penetration, every sphere must find the floor through the hierarchy with at
+// most four contacts, the deepest one having the expected depth and normal.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "chrono_parallel/physics/ChSystemParallel.h"
+#include "chrono_parallel/lcp/ChLcpSystemDescriptorParallel.h"
+
+#include "geometry/ChCTriangleMeshSoup.h"
+
+#include "unit_testing.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double radius = 0.1;
+double penetration = 0.01;
+int num_cells = 8;
+int num_balls = 5;
+
+void CreateFloor(ChSystemParallel* system) {
+  ChSharedPtr<ChMaterialSurface> mat_floor(new ChMaterialSurface);
+  mat_floor->SetFriction(0.3f);
+
+  // Square grid of num_cells x num_cells quads, two triangles per quad
+  geometry::ChTriangleMeshSoup trimesh;
+  double size = 2.0 / num_cells;
+  for (int ix = 0; ix < num_cells; ix++) {
+    for (int iy = 0; iy < num_cells; iy++) {
+      ChVector<> p00(-1 + ix * size, -1 + iy * size, 0);
+      ChVector<> p10(-1 + (ix + 1) * size, -1 + iy * size, 0);
+      ChVector<> p01(-1 + ix * size, -1 + (iy + 1) * size, 0);
+      ChVector<> p11(-1 + (ix + 1) * size, -1 + (iy + 1) * size, 0);
+      trimesh.addTriangle(p00, p10, p11);
+      trimesh.addTriangle(p00, p11, p01);
+    }
+  }
+
+  ChSharedPtr<ChBody> floor(new ChBody(new ChCollisionModelParallel));
+  floor->SetMaterialSurface(mat_floor);
+  floor->SetIdentifier(-1);
+  floor->SetBodyFixed(true);
+  floor->SetCollide(true);
+  floor->SetMass(10000.0);
+
+  floor->GetCollisionModel()->ClearModel();
+  floor->GetCollisionModel()->AddTriangleMesh(trimesh, true, false);
+  floor->GetCollisionModel()->BuildModel();
+
+  system->AddBody(floor);
+}
+
+void CreateBalls(ChSystemParallel* system) {
+  ChSharedPtr<ChMaterialSurface> ballMat(new ChMaterialSurface);
+  ballMat->SetFriction(1.0);
+
+  int ballId = 0;
+  double mass = 1;
+  ChVector<> inertia = (2.0 / 5.0) * mass * radius * radius * ChVector<>(1, 1, 1);
+
+  // The balls are placed over the inside of triangles, over their edges and
+  // over the vertices shared by several triangles
+  for (int ix = 0; ix < num_balls; ix++) {
+    for (int iy = 0; iy < num_balls; iy++) {
+      ChVector<> pos(-0.75 + 0.3125 * ix, -0.75 + 0.375 * iy, radius - penetration);
+
+      ChSharedBodyPtr ball(new ChBody(new ChCollisionModelParallel));
+      ball->SetMaterialSurface(ballMat);
+      ball->SetIdentifier(ballId++);
+      ball->SetMass(mass);
+      ball->SetInertiaXX(inertia);
+      ball->SetPos(pos);
+      ball->SetBodyFixed(false);
+      ball->SetCollide(true);
+
+      ball->GetCollisionModel()->ClearModel();
+      ball->GetCollisionModel()->AddSphere(radius);
+      ball->GetCollisionModel()->BuildModel();
+
+      system->AddBody(ball);
+    }
+  }
+}
+
+ChSystemParallelDVI* CreateSystem(NARROWPHASETYPE algorithm) {
+  ChSystemParallelDVI* system = new ChSystemParallelDVI();
+  system->Set_G_acc(ChVector<>(0, 0, -9.81));
+  system->GetSettings()->solver.tolerance = 1e-2;
+  system->GetSettings()->solver.solver_mode = SLIDING;
+  system->GetSettings()->solver.max_iteration_normal = 0;
+  system->GetSettings()->solver.max_iteration_sliding = 25;
+  system->GetSettings()->solver.max_iteration_spinning = 0;
+  system->ChangeSolverType(APGD);
+  system->GetSettings()->collision.collision_envelope = 0.01;
+  system->GetSettings()->collision.bins_per_axis = I3(10, 10, 10);
+  system->GetSettings()->collision.narrowphase_algorithm = algorithm;
+  system->GetSettings()->max_threads = 1;
+  system->GetSettings()->perform_thread_tuning = false;
+
+  CreateFloor(system);
+  CreateBalls(system);
+  return system;
+}
+
+void CheckContacts(ChSystemParallel* msystem) {
+  host_container& data = msystem->data_manager->host_data;
+  int num_contacts = msystem->data_manager->num_rigid_contacts;
+  int num_bodies = msystem->Get_bodylist()->size();
+
+  // Number of contacts and deepest contact of every ball
+  std::vector<int> count(num_bodies, 0);
+  std::vector<int> deepest(num_bodies, -1);
+  for (int i = 0; i < num_contacts; i++) {
+    int2 bids = data.bids_rigid_rigid[i];
+    int ball = (bids.x == 0) ? bids.y : bids.x;
+    StrictEqual((int)(bids.x == 0 || bids.y == 0), 1);
+    count[ball]++;
+    if (deepest[ball] < 0 || data.dpth_rigid_rigid[i] < data.dpth_rigid_rigid[deepest[ball]]) {
+      deepest[ball] = i;
+    }
+  }
+
+  // The floor is flat so the triangles under a ball give the same contact
+  for (int b = 1; b < num_bodies; b++) {
+    StrictEqual((int)(count[b] >= 1), 1);
+    StrictEqual((int)(count[b] <= 4), 1);
+    WeakEqual(data.dpth_rigid_rigid[deepest[b]], real(-penetration), real(1e-4));
+    WeakEqual(std::abs(data.norm_rigid_rigid[deepest[b]].z), real(1), real(1e-4));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  // The triangles are processed by MPR and by the sphere-triangle function of
+  // NarrowphaseR
+  NARROWPHASETYPE algorithms[2] = {NARROWPHASE_MPR, NARROWPHASE_HYBRID_MPR};
+  for (int a = 0; a < 2; a++) {
+    ChSystemParallelDVI* msystem = CreateSystem(algorithms[a]);
+    msystem->DoStepDynamics(time_step);
+    CheckContacts(msystem);
+    cout << "Number of contacts: " << msystem->data_manager->num_rigid_contacts << endl;
+    delete msystem;
+  }
+
+  return 0;
+}
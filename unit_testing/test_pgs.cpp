@@ -0,0 +1,95 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for the projected Gauss-Seidel solver. A pile of
+// spheres settles in a container using PGS. Contacts with the same color must
+// not share a body that can move, and the pile must come to rest without
+// sinking into the container.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "chrono_parallel/solver/ChSolverPGS.h"
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_end = 0.5;
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->solver.tol_speed = 1e-3;
+  system->GetSettings()->solver.max_iteration_sliding = 50;
+  system->ChangeSolverType(GAUSS_SEIDEL);
+
+  CreateContainer(system);
+  CreateGranularMaterial(system, 2, 4, 0.2, 0.1);
+  return system;
+}
+
+void CheckColoring(ChSystemParallelDVI* msystem) {
+  ChSolverPGS* solver = (ChSolverPGS*)((ChLcpSolverParallelDVI*)msystem->GetLcpSolverSpeed())->solver;
+  host_container& data = msystem->data_manager->host_data;
+  int num_contacts = msystem->data_manager->num_rigid_contacts;
+  int num_colors = solver->color_start.size() - 1;
+
+  StrictEqual((int)solver->color_start[num_colors], num_contacts);
+  for (int c = 0; c < num_colors; c++) {
+    std::vector<int> used(msystem->data_manager->num_rigid_bodies, 0);
+    for (int k = solver->color_start[c]; k < solver->color_start[c + 1]; k++) {
+      int2 body_id = data.bids_rigid_rigid[solver->color_contacts[k]];
+      if (data.active_rigid[body_id.x]) {
+        StrictEqual(used[body_id.x]++, 0);
+      }
+      if (data.active_rigid[body_id.y]) {
+        StrictEqual(used[body_id.y]++, 0);
+      }
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  ChSystemParallelDVI* msystem = CreateSystem();
+
+  double time = 0;
+  while (time < time_end) {
+    msystem->DoStepDynamics(time_step);
+    CheckColoring(msystem);
+    time += time_step;
+  }
+  cout << "Number of contacts: " << msystem->data_manager->num_rigid_contacts << endl;
+
+  // The spheres rest in four layers on the container
+  for (int i = 1; i < msystem->Get_bodylist()->size(); i++) {
+    ChBody* body = msystem->Get_bodylist()->at(i);
+    WeakEqual(real(body->GetPos_dt().Length()), real(0), real(5e-2));
+    StrictEqual((int)(body->GetPos().z > 0.09), 1);
+  }
+
+  delete msystem;
+  return 0;
+}
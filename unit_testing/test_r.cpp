@@ -16,6 +16,7 @@
 // =============================================================================
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <vector>
 #include <cmath>
 
@@ -793,6 +794,441 @@ void test_roundedcyl_sphere() {
   }
 }
 
+// -----------------------------------------------------------------------------
+
+void test_box_box(bool sep) {
+  cout << "box_box" << endl;
+
+  // First box fixed for all tests, centered at the origin and axis-aligned.
+  ConvexShape shapeA;
+  shapeA.type = ShapeType::BOX;
+  shapeA.A = real3(0);
+  shapeA.B = real3(1.0, 1.0, 1.0);
+  shapeA.C = real3(0);
+  shapeA.R = real4(1, 0, 0, 0);
+
+  // Second box changes for each test.
+  ConvexShape shapeB;
+  shapeB.type = ShapeType::BOX;
+  shapeB.C = real3(0);
+
+  real separation = sep ? 0.1 : 0.0;
+
+  // Output quantities (at most 4 contacts).
+  real3 norm[4];
+  real3 pt1[4];
+  real3 pt2[4];
+  real depth[4];
+  real eff_rad[4];
+  int nC;
+
+  {
+    cout << "  separated far" << endl;
+    shapeB.A = real3(0, 0, 2.5);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    shapeB.R = real4(1, 0, 0, 0);
+    bool res = RCollision(shapeA, shapeB, separation, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res || nC != 0) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+  }
+
+  {
+    cout << "  face interaction (separated near)" << endl;
+    shapeB.A = real3(0, 0, 1.55);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    shapeB.R = real4(1, 0, 0, 0);
+    bool res = RCollision(shapeA, shapeB, separation, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    StrictEqual(nC, sep ? 4 : 0);
+    for (int i = 0; i < nC; i++) {
+      WeakEqual(norm[i], real3(0, 0, 1), precision);
+      WeakEqual(depth[i], 0.05, precision);
+      WeakEqual(pt1[i].z, 1.0, precision);
+      WeakEqual(pt2[i].z, 1.05, precision);
+    }
+  }
+
+  {
+    cout << "  face interaction (penetrated)" << endl;
+    shapeB.A = real3(0.2, 0, 1.4);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    shapeB.R = real4(1, 0, 0, 0);
+    bool res = RCollision(shapeA, shapeB, separation, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    // The four corners of the bottom face of the second box
+    StrictEqual(nC, 4);
+    for (int i = 0; i < nC; i++) {
+      WeakEqual(norm[i], real3(0, 0, 1), precision);
+      WeakEqual(depth[i], -0.1, precision);
+      WeakEqual(fabs(pt2[i].x - 0.2), 0.5, precision);
+      WeakEqual(fabs(pt2[i].y), 0.5, precision);
+      WeakEqual(pt2[i].z, 0.9, precision);
+      WeakEqual(pt1[i], real3(pt2[i].x, pt2[i].y, 1.0), precision);
+    }
+  }
+
+  {
+    cout << "  face interaction (reversed order)" << endl;
+    shapeB.A = real3(0, 0, -1.4);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    shapeB.R = real4(1, 0, 0, 0);
+    bool res = RCollision(shapeB, shapeA, separation, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    StrictEqual(nC, 4);
+    for (int i = 0; i < nC; i++) {
+      WeakEqual(norm[i], real3(0, 0, 1), precision);
+      WeakEqual(depth[i], -0.1, precision);
+      WeakEqual(pt1[i].z, -0.9, precision);
+      WeakEqual(pt2[i].z, -1.0, precision);
+    }
+  }
+
+  {
+    cout << "  face interaction (manifold reduction)" << endl;
+    // Rotated by 45 degrees around Z axis, the clipped face has 8 vertices.
+    shapeB.A = real3(0, 0, 1.9);
+    shapeB.B = real3(1.0, 1.0, 1.0);
+    shapeB.R = ToReal4(Q_from_AngAxis(CH_C_PI_4, ChVector<>(0, 0, 1)));
+    bool res = RCollision(shapeA, shapeB, separation, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    StrictEqual(nC, 4);
+    for (int i = 0; i < nC; i++) {
+      WeakEqual(norm[i], real3(0, 0, 1), precision);
+      WeakEqual(depth[i], -0.1, precision);
+      // All points are vertices of the octagon, on the boundary of the face
+      WeakEqual(std::max(fabs(pt1[i].x), fabs(pt1[i].y)), 1.0, precision);
+    }
+  }
+
+  {
+    cout << "  edge-edge interaction" << endl;
+    // Rotated by 45 degrees around X and then around Z, an edge of the second
+    // box crosses the top edge of the first box along Y.
+    shapeB.A = real3(1.3, 0, 1.3);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    shapeB.R = ToReal4(Q_from_AngAxis(CH_C_PI_4, ChVector<>(0, 0, 1)) * Q_from_AngAxis(CH_C_PI_4, ChVector<>(1, 0, 0)));
+    bool res = RCollision(shapeA, shapeB, separation, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    StrictEqual(nC, 1);
+    WeakEqual(depth[0], dot(pt2[0] - pt1[0], norm[0]), precision);
+    WeakEqual(eff_rad[0], edge_radius / 2, precision);
+    WeakEqual(pt1[0].x, 1.0, precision);
+    WeakEqual(pt1[0].z, 1.0, precision);
+    if (depth[0] >= 0) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+
+void test_heightfield() {
+  cout << "heightfield" << endl;
+
+  // 5 x 5 grid with unit spacing centered at the origin, flat heights first.
+  real heights[25];
+  for (int i = 0; i < 25; i++)
+    heights[i] = 0;
+
+  ConvexShape shapeA;
+  shapeA.type = HEIGHTFIELD;
+  shapeA.A = real3(0);
+  shapeA.B = real3(5, 5, 0);
+  shapeA.C = real3(1, 1, 0);
+  shapeA.R = real4(1, 0, 0, 0);
+  shapeA.heights = heights;
+
+  ConvexShape shapeB;
+  shapeB.C = real3(0);
+  shapeB.R = real4(1, 0, 0, 0);
+
+  // Output quantities (at most 4 contacts).
+  real3 norm[4];
+  real3 pt1[4];
+  real3 pt2[4];
+  real depth[4];
+  real eff_rad[4];
+  int nC;
+
+  {
+    cout << "  sphere outside of the grid" << endl;
+    shapeB.type = SPHERE;
+    shapeB.A = real3(4, 0.2, 0.45);
+    shapeB.B = real3(0.5, 0, 0);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res || nC != 0) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+  }
+
+  {
+    cout << "  sphere on flat heightfield" << endl;
+    shapeB.type = SPHERE;
+    shapeB.A = real3(0.3, 0.2, 0.45);
+    shapeB.B = real3(0.5, 0, 0);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res || nC != 1) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    WeakEqual(norm[0], real3(0, 0, 1), precision);
+    WeakEqual(depth[0], -0.05, precision);
+    WeakEqual(pt1[0], real3(0.3, 0.2, 0), precision);
+    WeakEqual(pt2[0], real3(0.3, 0.2, -0.05), precision);
+    WeakEqual(eff_rad[0], 0.5, precision);
+  }
+
+  {
+    cout << "  flat heightfield on sphere (reversed order)" << endl;
+    shapeB.type = SPHERE;
+    shapeB.A = real3(0.3, 0.2, 0.45);
+    shapeB.B = real3(0.5, 0, 0);
+    bool res = RCollision(shapeB, shapeA, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res || nC != 1) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    WeakEqual(norm[0], real3(0, 0, -1), precision);
+    WeakEqual(depth[0], -0.05, precision);
+    WeakEqual(pt1[0], real3(0.3, 0.2, -0.05), precision);
+    WeakEqual(pt2[0], real3(0.3, 0.2, 0), precision);
+  }
+
+  {
+    cout << "  box on flat heightfield" << endl;
+    shapeB.type = BOX;
+    shapeB.A = real3(0.2, 0.1, 0.45);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    StrictEqual(nC, 4);
+    for (int i = 0; i < nC; i++) {
+      WeakEqual(norm[i], real3(0, 0, 1), precision);
+      WeakEqual(depth[i], -0.05, precision);
+      WeakEqual(pt1[i].z, 0.0, precision);
+      WeakEqual(pt2[i].z, -0.05, precision);
+    }
+  }
+
+  {
+    cout << "  capsule on flat heightfield" << endl;
+    // Capsule lying along Y, both of its ends touch the heightfield.
+    shapeB.type = CAPSULE;
+    shapeB.A = real3(-0.4, 0.7, 0.45);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    StrictEqual(nC, 2);
+    WeakEqual(pt1[0], real3(-0.4, 1.2, 0), precision);
+    WeakEqual(pt1[1], real3(-0.4, 0.2, 0), precision);
+    for (int i = 0; i < nC; i++) {
+      WeakEqual(norm[i], real3(0, 0, 1), precision);
+      WeakEqual(depth[i], -0.05, precision);
+    }
+  }
+
+  // Heights rising along x with slope 1/2 (half range of 1).
+  for (int j = 0; j < 5; j++)
+    for (int i = 0; i < 5; i++)
+      heights[j * 5 + i] = 0.5 * (i - 2);
+  shapeA.C = real3(1, 1, 1);
+  real3 slope_normal = normalize(real3(-0.5, 0, 1));
+
+  {
+    cout << "  sphere on sloped heightfield" << endl;
+    shapeB.type = SPHERE;
+    shapeB.A = real3(0.1, 0.3, 0.05) + slope_normal * 0.45;
+    shapeB.B = real3(0.5, 0, 0);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res || nC != 1) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    WeakEqual(norm[0], slope_normal, precision);
+    WeakEqual(depth[0], -0.05, precision);
+    WeakEqual(pt1[0], real3(0.1, 0.3, 0.05), precision);
+  }
+
+  {
+    cout << "  box on sloped heightfield" << endl;
+    shapeB.type = BOX;
+    shapeB.A = real3(0, 0, 0.55);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    // Only the two lower corners on the rising side are below the surface.
+    StrictEqual(nC, 2);
+    for (int i = 0; i < nC; i++) {
+      WeakEqual(norm[i], slope_normal, precision);
+      WeakEqual(depth[i], dot(pt2[i] - pt1[i], norm[i]), precision);
+      WeakEqual(pt2[i].x, 0.5, precision);
+    }
+  }
+
+  // Flat heights with a spike at the center vertex (0, 0).
+  for (int i = 0; i < 25; i++)
+    heights[i] = 0;
+  heights[12] = 0.3;
+
+  {
+    cout << "  box on heightfield spike" << endl;
+    // The corners are above the surface, only the spike touches the box.
+    shapeB.type = BOX;
+    shapeB.A = real3(0, 0, 0.75);
+    shapeB.B = real3(0.5, 0.5, 0.5);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res || nC != 1) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    WeakEqual(norm[0], real3(0, 0, 1), precision);
+    WeakEqual(depth[0], -0.05, precision);
+    WeakEqual(pt1[0], real3(0, 0, 0.3), precision);
+    WeakEqual(pt2[0], real3(0, 0, 0.25), precision);
+  }
+
+  {
+    cout << "  capsule on heightfield spike" << endl;
+    // The ends are above the surface, only the spike touches the capsule.
+    shapeB.type = CAPSULE;
+    shapeB.A = real3(0, 0, 0.75);
+    shapeB.B = real3(0.5, 1, 0.5);
+    bool res = RCollision(shapeA, shapeB, 0, norm, pt1, pt2, depth, eff_rad, nC);
+    if (!res || nC != 1) {
+      cout << "    test failed" << endl;
+      exit(1);
+    }
+    WeakEqual(norm[0], real3(0, 0, 1), precision);
+    WeakEqual(depth[0], -0.05, precision);
+    WeakEqual(pt1[0], real3(0, 0, 0.3), precision);
+    WeakEqual(pt2[0], real3(0, 0, 0.25), precision);
+    WeakEqual(eff_rad[0], 0.5, precision);
+  }
+}
+
+// =============================================================================
+// Tests for the batched collision functions, compared with the scalar ones
+// =============================================================================
+
+// Random shapes, pair i is made of shapes i and i + 1. The number of pairs is
+// not a multiple of the vector width so that the scalar tail is also used.
+void create_batch_shapes(int num_shapes,
+                         std::vector<real3>& pos,
+                         std::vector<real4>& rot,
+                         std::vector<real3>& dims,
+                         std::vector<uint>& shapeA,
+                         std::vector<uint>& shapeB,
+                         std::vector<uint>& icoll) {
+  srand(1);
+  for (int i = 0; i < num_shapes; i++) {
+    pos.push_back(real3(rand() % 3000 / 1000.0, rand() % 3000 / 1000.0, rand() % 3000 / 1000.0));
+    dims.push_back(real3(0.2 + rand() % 500 / 1000.0, 0.2 + rand() % 500 / 1000.0, 0.2 + rand() % 500 / 1000.0));
+    ChQuaternion<> q(rand() % 1000 / 1000.0 - 0.5, rand() % 1000 / 1000.0 - 0.5, rand() % 1000 / 1000.0 - 0.5,
+                     rand() % 1000 / 1000.0 - 0.5);
+    q.Normalize();
+    rot.push_back(ToReal4(q));
+  }
+  // Contact slots are reversed to check that the results are scattered
+  for (int i = 0; i < num_shapes - 1; i++) {
+    shapeA.push_back(i);
+    shapeB.push_back(i + 1);
+    icoll.push_back(num_shapes - 2 - i);
+  }
+}
+
+void test_batch(bool sep) {
+  int num_shapes = 1003;
+  real separation = sep ? 0.05 : 0;
+  std::vector<real3> pos, dims;
+  std::vector<real4> rot;
+  std::vector<uint> shapeA, shapeB, icoll;
+  create_batch_shapes(num_shapes, pos, rot, dims, shapeA, shapeB, icoll);
+  int num_pairs = num_shapes - 1;
+
+  std::vector<real3> norm(num_pairs), pt1(num_pairs), pt2(num_pairs);
+  std::vector<real> depth(num_pairs), eff_rad(num_pairs);
+  bool* contact = new bool[num_pairs];
+
+  // 0: sphere-sphere, 1: box-sphere, 2: sphere-box
+  for (int test = 0; test < 3; test++) {
+    const char* names[] = {"sphere_sphere_batch", "box_sphere_batch", "box_sphere_batch (swapped)"};
+    cout << names[test] << endl;
+
+    if (test == 0) {
+      sphere_sphere_batch(num_pairs, shapeA.data(), shapeB.data(), icoll.data(), pos.data(), dims.data(), separation,
+                          norm.data(), depth.data(), pt1.data(), pt2.data(), eff_rad.data(), contact);
+    } else {
+      box_sphere_batch(num_pairs, shapeA.data(), shapeB.data(), test == 2, icoll.data(), pos.data(), rot.data(),
+                       dims.data(), separation, norm.data(), depth.data(), pt1.data(), pt2.data(), eff_rad.data(),
+                       contact);
+    }
+
+    int num_contacts = 0;
+    for (int i = 0; i < num_pairs; i++) {
+      uint a = shapeA[i];
+      uint b = shapeB[i];
+      real3 r_norm, r_pt1, r_pt2;
+      real r_depth, r_eff_rad;
+      bool r_contact;
+      if (test == 0) {
+        r_contact = sphere_sphere(pos[a], dims[a].x, pos[b], dims[b].x, separation, r_norm, r_depth, r_pt1, r_pt2,
+                                  r_eff_rad);
+      } else {
+        r_contact = box_sphere(pos[a], rot[a], dims[a], pos[b], dims[b].x, separation, r_norm, r_depth, r_pt1, r_pt2,
+                               r_eff_rad);
+        if (test == 2) {
+          real3 pt = r_pt1;
+          r_pt1 = r_pt2;
+          r_pt2 = pt;
+          r_norm = -r_norm;
+        }
+      }
+
+      StrictEqual((int)contact[i], (int)r_contact);
+      if (r_contact) {
+        uint k = icoll[i];
+        WeakEqual(norm[k], r_norm, precision);
+        WeakEqual(depth[k], r_depth, precision);
+        WeakEqual(pt1[k], r_pt1, precision);
+        WeakEqual(pt2[k], r_pt2, precision);
+        WeakEqual(eff_rad[k], r_eff_rad, precision);
+        num_contacts++;
+      }
+    }
+    cout << "  contacts: " << num_contacts << endl;
+  }
+
+  delete[] contact;
+}
+
 // =============================================================================
 
 int main() {
@@ -807,10 +1243,17 @@ int main() {
   test_capsule_sphere();
   test_cylinder_sphere();
   test_roundedcyl_sphere();
+  test_box_box(false);
+  test_heightfield();
 
   cout << endl << "With separation distance" << endl;
   test_sphere_sphere(true);
   test_box_sphere(true);
+  test_box_box(true);
+
+  cout << endl << "Batched functions" << endl;
+  test_batch(false);
+  test_batch(true);
 
   return 0;
 }
@@ -0,0 +1,113 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for the spatial reordering of bodies and shapes.
+// The contacts found by a system that periodically reorders its bodies are
+// compared with the ones of a reference system, bodies are matched using their
+// identifiers.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include <algorithm>
+#include <vector>
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_end = 0.2;
+
+// Bodies are added in an order that is unrelated to their position. Bodies
+// with two shapes check that the shapes follow their body.
+void AddShapes(ChBody* body, int ix, int iy, int iz) {
+  body->SetPos(body->GetPos() + ChVector<>(0.21 * ((ix * 5 + 20) % 9 - 4 - ix), 0, 0));
+  utils::AddSphereGeometry(body, pile_radius / 2, ChVector<>(0, 0, -pile_radius / 2));
+  utils::AddSphereGeometry(body, pile_radius / 2, ChVector<>(0, 0, pile_radius / 2));
+}
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->collision.narrowphase_algorithm = NARROWPHASE_R;
+
+  CreateContainer(system);
+  CreateGranularMaterial(system, 4, 4, 0.21, 0.1, AddShapes, true);
+  return system;
+}
+
+// Sorted list of the contacts, each contact is stored as the pair of body
+// identifiers
+std::vector<std::pair<int, int> > GetContacts(ChSystemParallel* msystem) {
+  std::vector<std::pair<int, int> > contacts;
+  for (int i = 0; i < msystem->data_manager->num_rigid_contacts; i++) {
+    int2 ids = msystem->data_manager->host_data.bids_rigid_rigid[i];
+    int id_A = msystem->Get_bodylist()->at(ids.x)->GetIdentifier();
+    int id_B = msystem->Get_bodylist()->at(ids.y)->GetIdentifier();
+    contacts.push_back(std::make_pair(std::min(id_A, id_B), std::max(id_A, id_B)));
+  }
+  std::sort(contacts.begin(), contacts.end());
+  return contacts;
+}
+
+// Check that the ids of the bodies match their index and that the shapes are
+// ordered by body
+void CheckOrdering(ChSystemParallel* msystem) {
+  for (int i = 0; i < msystem->Get_bodylist()->size(); i++) {
+    StrictEqual(msystem->Get_bodylist()->at(i)->GetId(), i);
+  }
+  for (int i = 1; i < msystem->data_manager->num_rigid_shapes; i++) {
+    StrictEqual(msystem->data_manager->host_data.id_rigid[i - 1] <= msystem->data_manager->host_data.id_rigid[i],
+                true);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  ChSystemParallelDVI* msystem_ref = CreateSystem();
+  ChSystemParallelDVI* msystem = CreateSystem();
+  msystem->GetSettings()->spatial_reorder_frequency = 10;
+
+  double time = 0;
+  while (time < time_end) {
+    Sync(msystem_ref, msystem);
+    msystem_ref->DoStepDynamics(time_step);
+    msystem->DoStepDynamics(time_step);
+    CheckOrdering(msystem);
+
+    std::vector<std::pair<int, int> > contacts_ref = GetContacts(msystem_ref);
+    std::vector<std::pair<int, int> > contacts = GetContacts(msystem);
+    StrictEqual((int)contacts_ref.size(), (int)contacts.size());
+    for (int i = 0; i < contacts_ref.size(); i++) {
+      StrictEqual(contacts_ref[i].first, contacts[i].first);
+      StrictEqual(contacts_ref[i].second, contacts[i].second);
+    }
+    time += time_step;
+  }
+  cout << "Number of contacts: " << msystem_ref->data_manager->num_rigid_contacts << endl;
+
+  delete msystem_ref;
+  delete msystem;
+  return 0;
+}
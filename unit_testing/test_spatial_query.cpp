@@ -0,0 +1,164 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for the spatial queries of the collision system. The
+// queries answered using the bins of the uniform grid are compared with the
+// ones of a system using sweep and prune, where every shape is tested.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "chrono_parallel/collision/ChCCollisionSystemParallel.h"
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_end = 0.2;
+
+// Mix small and large particles
+void AddShapes(ChBody* body, int ix, int iy, int iz) {
+  utils::AddSphereGeometry(body, (ix + iy) % 3 == 0 ? pile_radius : pile_radius / 2);
+}
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->collision.narrowphase_algorithm = NARROWPHASE_R;
+
+  CreateContainer(system, true);
+  CreateGranularMaterial(system, 4, 6, 0.21, 0.2, AddShapes, true);
+  return system;
+}
+
+real Random(real min, real max) {
+  return min + (max - min) * (rand() % 10000) / 10000.0;
+}
+
+real3 RandomPoint() {
+  return R3(Random(-1.2, 1.2), Random(-1.2, 1.2), Random(-0.2, 2.2));
+}
+
+void CompareResults(const custom_vector<uint>& offsets_A,
+                    const custom_vector<uint>& shapes_A,
+                    const custom_vector<uint>& offsets_B,
+                    const custom_vector<uint>& shapes_B) {
+  StrictEqual((int)offsets_A.size(), (int)offsets_B.size());
+  for (int i = 0; i < offsets_A.size(); i++) {
+    StrictEqual((int)offsets_A[i], (int)offsets_B[i]);
+  }
+  for (int i = 0; i < shapes_A.size(); i++) {
+    StrictEqual((int)shapes_A[i], (int)shapes_B[i]);
+  }
+}
+
+// Random boxes, spheres and segments spanning the container are sent to both
+// systems, the results must be identical
+void CompareQueries(ChSystemParallel* msystem_A, ChSystemParallel* msystem_B) {
+  ChCollisionSystemParallel* coll_A = (ChCollisionSystemParallel*)msystem_A->GetCollisionSystem();
+  ChCollisionSystemParallel* coll_B = (ChCollisionSystemParallel*)msystem_B->GetCollisionSystem();
+  int num_queries = 100;
+
+  custom_vector<real3> query_min(num_queries), query_max(num_queries);
+  custom_vector<real3> centers(num_queries), from(num_queries), to(num_queries);
+  custom_vector<real> radii(num_queries);
+  for (int i = 0; i < num_queries; i++) {
+    real3 a = RandomPoint();
+    real3 b = RandomPoint();
+    query_min[i] = R3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+    // Some of the boxes are points
+    query_max[i] = (i % 10 == 0) ? query_min[i] : R3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+    centers[i] = RandomPoint();
+    radii[i] = Random(0, 0.5);
+    from[i] = RandomPoint();
+    to[i] = RandomPoint();
+  }
+
+  custom_vector<uint> offsets_A, offsets_B, shapes_A, shapes_B;
+  custom_vector<real> distances_A, distances_B;
+
+  coll_A->QueryAABB(query_min, query_max, offsets_A, shapes_A);
+  coll_B->QueryAABB(query_min, query_max, offsets_B, shapes_B);
+  CompareResults(offsets_A, shapes_A, offsets_B, shapes_B);
+
+  coll_A->QuerySphere(centers, radii, offsets_A, shapes_A);
+  coll_B->QuerySphere(centers, radii, offsets_B, shapes_B);
+  CompareResults(offsets_A, shapes_A, offsets_B, shapes_B);
+
+  coll_A->RayCast(from, to, offsets_A, shapes_A, distances_A);
+  coll_B->RayCast(from, to, offsets_B, shapes_B, distances_B);
+  CompareResults(offsets_A, shapes_A, offsets_B, shapes_B);
+  for (int i = 0; i < distances_A.size(); i++) {
+    WeakEqual(distances_A[i], distances_B[i], 1e-4);
+  }
+}
+
+void RunComparison(ChSystemParallelDVI* msystem_ref, ChSystemParallelDVI* msystem) {
+  double time = 0;
+  while (time < time_end) {
+    Sync(msystem_ref, msystem);
+    msystem_ref->DoStepDynamics(time_step);
+    msystem->DoStepDynamics(time_step);
+    CompareQueries(msystem_ref, msystem);
+    time += time_step;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+  srand(2);
+
+  cout << "Uniform Grid" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem_ref->GetSettings()->collision.broadphase_type = BROADPHASE_SAP;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  cout << "Morton Bins" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem_ref->GetSettings()->collision.broadphase_type = BROADPHASE_SAP;
+    msystem->GetSettings()->collision.use_morton_bins = true;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  cout << "Static BVH" << endl;
+  {
+    ChSystemParallelDVI* msystem_ref = CreateSystem();
+    ChSystemParallelDVI* msystem = CreateSystem();
+    msystem_ref->GetSettings()->collision.broadphase_type = BROADPHASE_SAP;
+    msystem->GetSettings()->collision.use_static_bvh = true;
+    RunComparison(msystem_ref, msystem);
+    delete msystem_ref;
+    delete msystem;
+  }
+
+  return 0;
+}
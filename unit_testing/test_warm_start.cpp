@@ -0,0 +1,97 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Author: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit test for warm starting the DVI solver. A pile of spheres
+// settles in a container, then a system that starts every solve from the
+// impulses of the previous step and a system that starts from zero are run
+// from the same state. The impulses kept for warm starting must be sorted by
+// pair and the warm started solver must not need more iterations.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+//
+// =============================================================================
+
+#include "unit_testing.h"
+#include "unit_testing_pile.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+using std::cout;
+using std::endl;
+
+// -----------------------------------------------------------------------------
+// Global problem definitions
+// -----------------------------------------------------------------------------
+double time_step = 1e-3;
+double time_settle = 0.3;
+double time_end = 0.35;
+
+ChSystemParallelDVI* CreateSystem() {
+  ChSystemParallelDVI* system = CreatePileSystem();
+  system->GetSettings()->solver.tol_speed = 1e-3;
+  system->GetSettings()->solver.max_iteration_sliding = 100;
+
+  CreateContainer(system);
+  CreateGranularMaterial(system, 2, 4, 0.2, 0.1);
+  return system;
+}
+
+void CheckWarmStart(ChSystemParallel* msystem) {
+  host_container& data = msystem->data_manager->host_data;
+  int num_contacts = msystem->data_manager->num_rigid_contacts;
+
+  StrictEqual((int)data.warm_pair.size(), num_contacts);
+  StrictEqual((int)data.warm_gamma.size(), 6 * num_contacts);
+  for (int i = 1; i < num_contacts; i++) {
+    StrictEqual((int)(data.warm_pair[i - 1] <= data.warm_pair[i]), 1);
+  }
+  // Spinning impulses are not solved for in SLIDING mode
+  for (int i = 0; i < num_contacts; i++) {
+    StrictEqual(data.warm_gamma[6 * i + 3], real(0));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  omp_set_num_threads(1);
+
+  ChSystemParallelDVI* msystem_ref = CreateSystem();
+  ChSystemParallelDVI* msystem = CreateSystem();
+  msystem->GetSettings()->solver.use_warm_start = true;
+
+  double time = 0;
+  while (time < time_settle) {
+    msystem_ref->DoStepDynamics(time_step);
+    time += time_step;
+  }
+
+  int iterations_ref = 0;
+  int iterations = 0;
+  while (time < time_end) {
+    Sync(msystem_ref, msystem);
+    msystem_ref->DoStepDynamics(time_step);
+    msystem->DoStepDynamics(time_step);
+    CheckWarmStart(msystem);
+    iterations_ref += msystem_ref->data_manager->measures.solver.total_iteration;
+    iterations += msystem->data_manager->measures.solver.total_iteration;
+    time += time_step;
+  }
+  cout << "Iterations: " << iterations_ref << " cold, " << iterations << " warm" << endl;
+
+  StrictEqual((int)(iterations <= iterations_ref), 1);
+
+  delete msystem_ref;
+  delete msystem;
+  return 0;
+}
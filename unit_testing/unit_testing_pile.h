@@ -0,0 +1,154 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+// Authors: Hammad Mazhar
+// =============================================================================
+//
+// ChronoParallel unit testing fixture: a pile of particles in a container.
+// A test creates its systems with CreatePileSystem, changes the settings of the
+// feature it checks and adds the container and the particles.
+// The global reference frame has Z up.
+// All units SI (CGS, i.e., centimeter - gram - second)
+// =============================================================================
+
+#include <map>
+
+#include "chrono_parallel/physics/ChSystemParallel.h"
+#include "chrono_parallel/lcp/ChLcpSystemDescriptorParallel.h"
+
+#include "chrono_utils/ChUtilsCreators.h"
+
+using namespace chrono;
+using namespace chrono::collision;
+
+double pile_radius = 0.1;  // [m] radius of the particles
+
+// Adds the collision shapes of the particle (ix, iy, iz) of the pile, the body
+// is already placed and may be moved
+typedef void (*PileShapeFunction)(ChBody* body, int ix, int iy, int iz);
+
+void AddPileSphere(ChBody* body, int ix, int iy, int iz) {
+  utils::AddSphereGeometry(body, pile_radius);
+}
+
+// A fixed plate of 2 x 2 m with its top at z = 0, with walls of 1 m if set
+void CreateContainer(ChSystemParallel* system, bool walls = false) {
+  double hdimX = 2.0 / 2;   // [m] bin half-length in x direction
+  double hdimY = 2.0 / 2;   // [m] bin half-depth in y direction
+  double hdimZ = 2.0 / 2;   // [m] bin half-height in z direction
+  double hthick = 0.1 / 2;  // [m] bin half-thickness of the walls
+
+  ChSharedPtr<ChMaterialSurface> mat_walls(new ChMaterialSurface);
+  mat_walls->SetFriction(0.3f);
+
+  ChSharedPtr<ChBody> container(new ChBody(new ChCollisionModelParallel));
+  container->SetMaterialSurface(mat_walls);
+  container->SetIdentifier(-1);
+  container->SetBodyFixed(true);
+  container->SetCollide(true);
+  container->SetMass(10000.0);
+
+  container->GetCollisionModel()->ClearModel();
+  utils::AddBoxGeometry(container.get_ptr(), ChVector<>(hdimX, hdimY, hthick), ChVector<>(0, 0, -hthick));
+  if (walls) {
+    utils::AddBoxGeometry(container.get_ptr(), ChVector<>(hthick, hdimY, hdimZ), ChVector<>(-hdimX - hthick, 0, hdimZ));
+    utils::AddBoxGeometry(container.get_ptr(), ChVector<>(hthick, hdimY, hdimZ), ChVector<>(hdimX + hthick, 0, hdimZ));
+    utils::AddBoxGeometry(container.get_ptr(), ChVector<>(hdimX, hthick, hdimZ), ChVector<>(0, -hdimY - hthick, hdimZ));
+    utils::AddBoxGeometry(container.get_ptr(), ChVector<>(hdimX, hthick, hdimZ), ChVector<>(0, hdimY + hthick, hdimZ));
+  }
+  container->GetCollisionModel()->BuildModel();
+
+  system->AddBody(container);
+}
+
+// Layers of (2 * half_width + 1)^2 particles of unit mass on a grid with the
+// given spacing, the lowest layer at height. With jitter the particles are
+// moved by up to 1 cm so that they do not touch on a plane.
+void CreateGranularMaterial(ChSystemParallel* system,
+                            int half_width,
+                            int layers,
+                            double spacing,
+                            double height,
+                            PileShapeFunction add_shapes = AddPileSphere,
+                            bool jitter = false) {
+  ChSharedPtr<ChMaterialSurface> ballMat(new ChMaterialSurface);
+  ballMat->SetFriction(1.0);
+
+  int ballId = 0;
+  double mass = 1;
+  ChVector<> inertia = (2.0 / 5.0) * mass * pile_radius * pile_radius * ChVector<>(1, 1, 1);
+  srand(1);
+
+  for (int iz = 0; iz < layers; iz++) {
+    for (int ix = -half_width; ix <= half_width; ix++) {
+      for (int iy = -half_width; iy <= half_width; iy++) {
+        ChVector<> pos(spacing * ix, spacing * iy, spacing * iz + height);
+        if (jitter) {
+          pos += ChVector<>(rand() % 1000 / 100000.0, rand() % 1000 / 100000.0, rand() % 1000 / 100000.0);
+        }
+
+        ChSharedBodyPtr ball(new ChBody(new ChCollisionModelParallel));
+        ball->SetMaterialSurface(ballMat);
+        ball->SetIdentifier(ballId++);
+        ball->SetMass(mass);
+        ball->SetInertiaXX(inertia);
+        ball->SetPos(pos);
+        ball->SetBodyFixed(false);
+        ball->SetCollide(true);
+
+        ball->GetCollisionModel()->ClearModel();
+        add_shapes(ball.get_ptr(), ix, iy, iz);
+        ball->GetCollisionModel()->BuildModel();
+
+        system->AddBody(ball);
+      }
+    }
+  }
+}
+
+// An empty DVI system solving for the normal and sliding impulses with APGD on
+// one thread
+ChSystemParallelDVI* CreatePileSystem() {
+  double gravity = 9.81;
+
+  ChSystemParallelDVI* system = new ChSystemParallelDVI();
+  system->Set_G_acc(ChVector<>(0, 0, -gravity));
+  system->GetSettings()->solver.tolerance = 1e-2;
+  system->GetSettings()->solver.solver_mode = SLIDING;
+  system->GetSettings()->solver.max_iteration_normal = 0;
+  system->GetSettings()->solver.max_iteration_sliding = 25;
+  system->GetSettings()->solver.max_iteration_spinning = 0;
+  system->ChangeSolverType(APGD);
+  system->GetSettings()->collision.collision_envelope = 0.01;
+  system->GetSettings()->collision.bins_per_axis = I3(10, 10, 10);
+  system->GetSettings()->max_threads = 1;
+  system->GetSettings()->perform_thread_tuning = false;
+  return system;
+}
+
+// Copy the state of the reference system into the tested system, bodies are
+// matched using their identifiers so the tested system may store them in a
+// different order
+void Sync(ChSystemParallel* msystem_A, ChSystemParallel* msystem_B) {
+  std::map<int, ChBody*> bodies_B;
+  for (int i = 0; i < msystem_B->Get_bodylist()->size(); i++) {
+    ChBody* body = msystem_B->Get_bodylist()->at(i);
+    bodies_B[body->GetIdentifier()] = body;
+  }
+  for (int i = 0; i < msystem_A->Get_bodylist()->size(); i++) {
+    ChBody* body_A = msystem_A->Get_bodylist()->at(i);
+    ChBody* body_B = bodies_B[body_A->GetIdentifier()];
+    body_B->SetPos(body_A->GetPos());
+    body_B->SetRot(body_A->GetRot());
+    body_B->SetPos_dt(body_A->GetPos_dt());
+    body_B->SetWvel_par(body_A->GetWvel_par());
+  }
+}